@@ -0,0 +1,593 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_adv.h"
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "app_error.h"
+#include "app_util.h"
+#include "app_timer.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+#include "peer_manager.h"
+
+#include "ble.h"
+#include "ble_gap.h"
+#include "ble_advdata.h"
+
+#include "estc_metrics.h"
+
+static const estc_adv_profile_t m_profiles[ESTC_ADV_PROFILE_COUNT] =
+{
+    [ESTC_ADV_PROFILE_LEGACY] =
+    {
+        // Interval and timeout come from the stage scheduler
+        .mode          = ESTC_ADV_MODE_LEGACY,
+    },
+    [ESTC_ADV_PROFILE_LONG_RANGE] =
+    {
+        .mode          = ESTC_ADV_MODE_EXT_CONNECTABLE,
+        .primary_phy   = BLE_GAP_PHY_CODED,
+        .secondary_phy = BLE_GAP_PHY_CODED,
+        .interval      = MSEC_TO_UNITS(300, UNIT_0_625_MS),
+    },
+    [ESTC_ADV_PROFILE_BROADCAST_HIGH_RATE] =
+    {
+        .mode          = ESTC_ADV_MODE_EXT_BROADCAST,
+        .primary_phy   = BLE_GAP_PHY_1MBPS,
+        .secondary_phy = BLE_GAP_PHY_2MBPS,
+        .interval      = MSEC_TO_UNITS(ESTC_ADV_BROADCAST_INTERVAL_MS, UNIT_0_625_MS),
+    },
+    [ESTC_ADV_PROFILE_BROADCAST_LONG_RANGE] =
+    {
+        .mode          = ESTC_ADV_MODE_EXT_BROADCAST,
+        .primary_phy   = BLE_GAP_PHY_CODED,
+        .secondary_phy = BLE_GAP_PHY_CODED,
+        .interval      = MSEC_TO_UNITS(500, UNIT_0_625_MS),
+    },
+};
+
+typedef struct
+{
+    uint32_t connections;       /**< Connections established while the stage was active. */
+    uint32_t ttc_sum_ms;        /**< Time to connect, counted from the start of the first stage. */
+} estc_adv_stage_stats_t;
+
+STATIC_ASSERT(ESTC_METRICS_GAUGE_TTC_VERY_SLOW - ESTC_METRICS_GAUGE_TTC_VERY_FAST + 1 == ESTC_ADV_STAGE_COUNT);
+
+static ble_advertising_t     * m_p_advertising;
+static ble_adv_evt_handler_t   m_evt_handler;
+static ble_uuid_t            * m_p_uuids;
+static uint16_t                m_uuid_cnt;
+static uint8_t                 m_conn_cfg_tag;
+
+static estc_adv_profile_id_t   m_profile_id = ESTC_ADV_DEFAULT_PROFILE;
+static bool                    m_active;       /**< Advertising set is started and has not been stopped by a connection. */
+static bool                    m_connected;
+
+// The SoftDevice keeps referencing the buffer of a running set, so updates go to the spare one
+static uint8_t                 m_ext_buf[2][BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED];
+static uint8_t                 m_ext_buf_idx;
+static ble_gap_adv_data_t      m_ext_data;
+
+static uint8_t                 m_broadcast_payload[ESTC_ADV_BROADCAST_PAYLOAD_MAX];
+static uint16_t                m_broadcast_len;
+
+static estc_adv_stage_cfg_t    m_stages[ESTC_ADV_STAGE_COUNT];
+static estc_adv_stage_stats_t  m_stage_stats[ESTC_ADV_STAGE_COUNT];
+static estc_adv_stage_t        m_stage;
+static uint32_t                m_stage_start_ticks;
+static uint32_t                m_episode_ms;    /**< Time spent in the completed stages of the current episode. */
+
+static ble_gap_addr_t          m_gateway_addr;  /**< Peer of the last connection, target of directed advertising. */
+static bool                    m_gateway_known;
+static pm_peer_id_t            m_peer_id = PM_PEER_ID_INVALID;  /**< Bonded peer of the last connection. */
+
+static uint32_t ticks_to_ms(uint32_t ticks)
+{
+    return (uint32_t)(((uint64_t)ticks * 1000 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1)) / APP_TIMER_CLOCK_FREQ);
+}
+
+static uint32_t stage_elapsed_ms(void)
+{
+    return ticks_to_ms(app_timer_cnt_diff_compute(app_timer_cnt_get(), m_stage_start_ticks));
+}
+
+/**@brief Load the bonded peers with an identity address into the Peer Manager whitelist.
+ */
+static void whitelist_set(void)
+{
+    pm_peer_id_t peer_ids[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+    uint32_t     peer_id_count = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+
+    ret_code_t err_code = pm_peer_id_list(peer_ids, &peer_id_count, PM_PEER_ID_INVALID,
+                                          PM_PEER_ID_LIST_SKIP_NO_ID_ADDR);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_whitelist_set(peer_ids, peer_id_count);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void identities_set(pm_peer_id_list_skip_t skip)
+{
+    pm_peer_id_t peer_ids[BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT];
+    uint32_t     peer_id_count = BLE_GAP_DEVICE_IDENTITIES_MAX_COUNT;
+
+    ret_code_t err_code = pm_peer_id_list(peer_ids, &peer_id_count, PM_PEER_ID_INVALID, skip);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_device_identities_list_set(peer_ids, peer_id_count);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void whitelist_reply(void)
+{
+    ret_code_t     err_code;
+    ble_gap_addr_t whitelist_addrs[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+    ble_gap_irk_t  whitelist_irks[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+    uint32_t       addr_cnt = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+    uint32_t       irk_cnt  = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+
+    err_code = pm_whitelist_get(whitelist_addrs, &addr_cnt, whitelist_irks, &irk_cnt);
+    APP_ERROR_CHECK(err_code);
+
+    // Gateways using private addresses are resolved through their IRK
+    identities_set(PM_PEER_ID_LIST_SKIP_NO_IRK);
+
+    // With an empty whitelist ble_advertising falls back to undirected advertising
+    err_code = ble_advertising_whitelist_reply(m_p_advertising, whitelist_addrs, addr_cnt,
+                                               whitelist_irks, irk_cnt);
+    APP_ERROR_CHECK(err_code);
+}
+
+static void peer_addr_reply(void)
+{
+    ret_code_t             err_code;
+    pm_peer_data_bonding_t bonding_data;
+    ble_gap_addr_t       * p_addr = m_gateway_known ? &m_gateway_addr : NULL;
+
+    if (m_peer_id != PM_PEER_ID_INVALID)
+    {
+        err_code = pm_peer_data_bonding_load(m_peer_id, &bonding_data);
+        if (err_code == NRF_SUCCESS)
+        {
+            // Target the identity address, so the gateway does not have to support address resolution
+            identities_set(PM_PEER_ID_LIST_SKIP_ALL);
+            p_addr = &bonding_data.peer_ble_id.id_addr_info;
+        }
+        else if (err_code != NRF_ERROR_NOT_FOUND)
+        {
+            APP_ERROR_CHECK(err_code);
+        }
+    }
+
+    if (p_addr != NULL)
+    {
+        err_code = ble_advertising_peer_addr_reply(m_p_advertising, p_addr);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/**@brief Start legacy advertising with the parameters of the given stage.
+ *
+ * @details Every stage runs as ble_advertising fast mode with slow mode disabled, so the end of a
+ *          stage is reported as BLE_ADV_EVT_IDLE and estc_adv_on_adv_evt() moves on to the next one.
+ *
+ * @param[in] stage         Stage to enter.
+ * @param[in] new_episode   First stage after boot or disconnect.
+ */
+static ret_code_t stage_start(estc_adv_stage_t stage, bool new_episode)
+{
+    ble_adv_modes_config_t config;
+    ble_adv_mode_t         mode = BLE_ADV_MODE_FAST;
+
+    memset(&config, 0, sizeof(config));
+
+    config.ble_adv_on_disconnect_disabled = true;
+    config.ble_adv_fast_enabled           = true;
+    config.ble_adv_fast_interval          = m_stages[stage].interval;
+    config.ble_adv_fast_timeout           = m_stages[stage].duration;
+
+    if (stage == ESTC_ADV_STAGE_VERY_FAST)
+    {
+        // Reconnect path: only bonded gateways may connect until the stage is over
+        config.ble_adv_whitelist_enabled = true;
+
+        if ((m_peer_id != PM_PEER_ID_INVALID) || m_gateway_known)
+        {
+            // Falls through to fast mode once the 1.28 s high duty cycle window is over
+            config.ble_adv_directed_high_duty_enabled = true;
+            mode = BLE_ADV_MODE_DIRECTED_HIGH_DUTY;
+        }
+    }
+
+    ble_advertising_modes_config_set(m_p_advertising, &config);
+
+    // Time to connect is counted from the first stage of an episode
+    m_episode_ms = new_episode ? 0 : (m_episode_ms + stage_elapsed_ms());
+
+    m_stage             = stage;
+    m_stage_start_ticks = app_timer_cnt_get();
+
+    NRF_LOG_INFO("ADV stage %d: interval %d, duration %d", stage, m_stages[stage].interval, m_stages[stage].duration);
+
+    return ble_advertising_start(m_p_advertising, mode);
+}
+
+static void stage_connected(void)
+{
+    estc_adv_stage_stats_t * p_stats = &m_stage_stats[m_stage];
+    uint32_t                 ttc_ms  = m_episode_ms + stage_elapsed_ms();
+
+    p_stats->ttc_sum_ms += ttc_ms;
+    p_stats->connections++;
+
+    estc_metrics_gauge_set((estc_metrics_gauge_t)(ESTC_METRICS_GAUGE_TTC_VERY_FAST + m_stage),
+                           (uint16_t)MIN(p_stats->ttc_sum_ms / p_stats->connections / 100, UINT16_MAX));
+
+    NRF_LOG_INFO("Connected in ADV stage %d after %d ms", m_stage, ttc_ms);
+}
+
+static ret_code_t ext_adv_data_encode(estc_adv_profile_t const * p_profile,
+                                      uint8_t                  * p_buf,
+                                      uint16_t                 * p_len)
+{
+    ble_advdata_t            advdata;
+    ble_advdata_manuf_data_t manuf_data;
+
+    memset(&advdata, 0, sizeof(advdata));
+
+    if (p_profile->mode == ESTC_ADV_MODE_EXT_CONNECTABLE)
+    {
+        // No scan response in extended connectable mode, so everything goes into the AUX payload
+        advdata.name_type               = BLE_ADVDATA_FULL_NAME;
+        advdata.flags                   = BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE;
+        advdata.uuids_complete.uuid_cnt = m_uuid_cnt;
+        advdata.uuids_complete.p_uuids  = m_p_uuids;
+
+        *p_len = BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_CONNECTABLE_MAX_SUPPORTED;
+    }
+    else
+    {
+        manuf_data.company_identifier = ESTC_ADV_COMPANY_ID;
+        manuf_data.data.p_data        = m_broadcast_payload;
+        manuf_data.data.size          = m_broadcast_len;
+
+        advdata.name_type             = BLE_ADVDATA_NO_NAME;
+        advdata.p_manuf_specific_data = &manuf_data;
+
+        *p_len = BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED;
+    }
+
+    return ble_advdata_encode(&advdata, p_buf, p_len);
+}
+
+/**@brief Encode the payload into the spare buffer and hand it to the SoftDevice.
+ *
+ * @param[in] p_profile     Active extended profile.
+ * @param[in] with_params   Reconfigure the advertising parameters too. Only allowed while the set is stopped.
+ */
+static ret_code_t ext_adv_configure(estc_adv_profile_t const * p_profile, bool with_params)
+{
+    ret_code_t           err_code;
+    ble_gap_adv_params_t adv_params;
+    uint8_t              next_idx = m_ext_buf_idx ^ 1;
+    uint16_t             len;
+
+    err_code = ext_adv_data_encode(p_profile, m_ext_buf[next_idx], &len);
+    VERIFY_SUCCESS(err_code);
+
+    m_ext_data.adv_data.p_data      = m_ext_buf[next_idx];
+    m_ext_data.adv_data.len         = len;
+    m_ext_data.scan_rsp_data.p_data = NULL;
+    m_ext_data.scan_rsp_data.len    = 0;
+
+    if (!with_params)
+    {
+        err_code = sd_ble_gap_adv_set_configure(&m_p_advertising->adv_handle, &m_ext_data, NULL);
+    }
+    else
+    {
+        memset(&adv_params, 0, sizeof(adv_params));
+
+        adv_params.properties.type = (p_profile->mode == ESTC_ADV_MODE_EXT_CONNECTABLE)
+                                   ? BLE_GAP_ADV_TYPE_EXTENDED_CONNECTABLE_NONSCANNABLE_UNDIRECTED
+                                   : BLE_GAP_ADV_TYPE_EXTENDED_NONCONNECTABLE_NONSCANNABLE_UNDIRECTED;
+        adv_params.p_peer_addr     = NULL;
+        adv_params.filter_policy   = BLE_GAP_ADV_FP_ANY;
+        adv_params.interval        = p_profile->interval;
+        // No timeout: a terminated set would make ble_advertising move on to its next legacy mode
+        adv_params.duration        = BLE_GAP_ADV_TIMEOUT_GENERAL_UNLIMITED;
+        adv_params.primary_phy     = p_profile->primary_phy;
+        adv_params.secondary_phy   = p_profile->secondary_phy;
+
+        err_code = sd_ble_gap_adv_set_configure(&m_p_advertising->adv_handle, &m_ext_data, &adv_params);
+    }
+    VERIFY_SUCCESS(err_code);
+
+    m_ext_buf_idx = next_idx;
+
+    return NRF_SUCCESS;
+}
+
+static ret_code_t adv_start(estc_adv_stage_t first_stage)
+{
+    ret_code_t                 err_code;
+    estc_adv_profile_t const * p_profile = &m_profiles[m_profile_id];
+
+    if (p_profile->mode == ESTC_ADV_MODE_LEGACY)
+    {
+        err_code = stage_start(first_stage, true);
+        VERIFY_SUCCESS(err_code);
+
+        m_active = true;
+        return NRF_SUCCESS;
+    }
+
+    err_code = ext_adv_configure(p_profile, true);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = sd_ble_gap_adv_start(m_p_advertising->adv_handle, m_conn_cfg_tag);
+    VERIFY_SUCCESS(err_code);
+
+    m_active = true;
+    NRF_LOG_INFO("Extended advertising started (profile %d, PHY %d/%d)",
+                 m_profile_id, p_profile->primary_phy, p_profile->secondary_phy);
+
+    if ((p_profile->mode == ESTC_ADV_MODE_EXT_CONNECTABLE) && (m_evt_handler != NULL))
+    {
+        m_evt_handler(BLE_ADV_EVT_FAST);
+    }
+
+    return NRF_SUCCESS;
+}
+
+static void on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    ret_code_t err_code;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+        {
+            ble_gap_addr_t const * p_peer = &p_ble_evt->evt.gap_evt.params.connected.peer_addr;
+
+            if (m_active && (m_profiles[m_profile_id].mode == ESTC_ADV_MODE_LEGACY))
+            {
+                stage_connected();
+            }
+
+            // Peer Manager observes the event first, a bonded peer is already known here
+            err_code = pm_peer_id_get(p_ble_evt->evt.gap_evt.conn_handle, &m_peer_id);
+            APP_ERROR_CHECK(err_code);
+
+            // Private resolvable addresses change over time, only identity addresses can be targeted
+            if ((p_peer->addr_type == BLE_GAP_ADDR_TYPE_PUBLIC) ||
+                (p_peer->addr_type == BLE_GAP_ADDR_TYPE_RANDOM_STATIC))
+            {
+                m_gateway_addr  = *p_peer;
+                m_gateway_known = true;
+            }
+
+            // The SoftDevice stops connectable sets itself. A broadcast would take radio events between the
+            // connection events, and estc_radio_sync cannot tell them apart, so it waits for the link to go.
+            if (m_active && (m_profiles[m_profile_id].mode == ESTC_ADV_MODE_EXT_BROADCAST))
+            {
+                estc_adv_stop();
+            }
+            m_active    = false;
+            m_connected = true;
+        } break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            m_connected = false;
+            if (!m_active)
+            {
+                err_code = adv_start(ESTC_ADV_STAGE_VERY_FAST);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_estc_adv_observer, ESTC_ADV_BLE_OBSERVER_PRIO, on_ble_evt, NULL);
+
+static void on_pm_evt(pm_evt_t const * p_evt)
+{
+    switch (p_evt->evt_id)
+    {
+        case PM_EVT_CONN_SEC_SUCCEEDED:
+            m_peer_id = p_evt->peer_id;
+            break;
+
+        case PM_EVT_PEER_DATA_UPDATE_SUCCEEDED:
+            if (p_evt->params.peer_data_update_succeeded.flash_changed &&
+                (p_evt->params.peer_data_update_succeeded.data_id == PM_PEER_DATA_ID_BONDING))
+            {
+                // New bond, include it in the next reconnect
+                whitelist_set();
+            }
+            break;
+
+        case PM_EVT_PEERS_DELETE_SUCCEEDED:
+            m_peer_id       = PM_PEER_ID_INVALID;
+            m_gateway_known = false;
+            whitelist_set();
+            break;
+
+        default:
+            break;
+    }
+}
+
+ret_code_t estc_adv_init(estc_adv_init_t const * p_init)
+{
+    VERIFY_PARAM_NOT_NULL(p_init);
+    VERIFY_PARAM_NOT_NULL(p_init->p_advertising);
+
+    m_p_advertising = p_init->p_advertising;
+    m_evt_handler   = p_init->evt_handler;
+    m_p_uuids       = p_init->p_uuids;
+    m_uuid_cnt      = p_init->uuid_cnt;
+    m_conn_cfg_tag  = p_init->conn_cfg_tag;
+    m_active        = false;
+    m_connected     = false;
+
+    memcpy(m_stages, p_init->stages, sizeof(m_stages));
+    memset(m_stage_stats, 0, sizeof(m_stage_stats));
+
+    // Peer Manager must be initialized by now
+    ret_code_t err_code = pm_register(on_pm_evt);
+    VERIFY_SUCCESS(err_code);
+
+    whitelist_set();
+
+    return NRF_SUCCESS;
+}
+
+void estc_adv_on_adv_evt(ble_adv_evt_t ble_adv_evt)
+{
+    ret_code_t err_code;
+
+    switch (ble_adv_evt)
+    {
+        case BLE_ADV_EVT_PEER_ADDR_REQUEST:
+            peer_addr_reply();
+            return;
+
+        case BLE_ADV_EVT_WHITELIST_REQUEST:
+            whitelist_reply();
+            return;
+
+        case BLE_ADV_EVT_IDLE:
+            if (m_active && (m_stage + 1 < ESTC_ADV_STAGE_COUNT))
+            {
+                err_code = stage_start((estc_adv_stage_t)(m_stage + 1), false);
+                APP_ERROR_CHECK(err_code);
+                return;
+            }
+            // Last stage has a timeout: let the application decide what to do
+            m_active = false;
+            break;
+
+        case BLE_ADV_EVT_FAST:
+            if (m_stage >= ESTC_ADV_STAGE_SLOW)
+            {
+                // Every stage runs as fast mode, report the slow ones as such
+                ble_adv_evt = BLE_ADV_EVT_SLOW;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (m_evt_handler != NULL)
+    {
+        m_evt_handler(ble_adv_evt);
+    }
+}
+
+ret_code_t estc_adv_start(void)
+{
+    return adv_start(ESTC_ADV_STAGE_FAST);
+}
+
+void estc_adv_stop(void)
+{
+    // All profiles share one advertising set, so this stops legacy advertising as well
+    ret_code_t err_code = sd_ble_gap_adv_stop(m_p_advertising->adv_handle);
+    if (err_code != NRF_ERROR_INVALID_STATE)
+    {
+        APP_ERROR_CHECK(err_code);
+    }
+
+    m_active = false;
+}
+
+ret_code_t estc_adv_profile_set(estc_adv_profile_id_t profile_id)
+{
+    if (profile_id >= ESTC_ADV_PROFILE_COUNT)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    bool restart = m_active;
+
+    estc_adv_stop();
+    m_profile_id = profile_id;
+
+    NRF_LOG_INFO("Advertising profile set to %d", profile_id);
+
+    // A broadcast does not need a free link, but while one is up it starts only on the disconnect
+    if (restart || ((m_profiles[profile_id].mode == ESTC_ADV_MODE_EXT_BROADCAST) && !m_connected))
+    {
+        return adv_start(ESTC_ADV_STAGE_FAST);
+    }
+
+    return NRF_SUCCESS;
+}
+
+estc_adv_profile_id_t estc_adv_profile_get(void)
+{
+    return m_profile_id;
+}
+
+bool estc_adv_connectable(void)
+{
+    return m_profiles[m_profile_id].mode != ESTC_ADV_MODE_EXT_BROADCAST;
+}
+
+ret_code_t estc_adv_broadcast_data_set(uint8_t const * p_data, uint16_t len)
+{
+    if (len > ESTC_ADV_BROADCAST_PAYLOAD_MAX)
+    {
+        return NRF_ERROR_DATA_SIZE;
+    }
+    if (len > 0)
+    {
+        VERIFY_PARAM_NOT_NULL(p_data);
+        memcpy(m_broadcast_payload, p_data, len);
+    }
+    m_broadcast_len = len;
+
+    if (!m_active || (m_profiles[m_profile_id].mode != ESTC_ADV_MODE_EXT_BROADCAST))
+    {
+        // Picked up by the next estc_adv_start()
+        return NRF_SUCCESS;
+    }
+
+    return ext_adv_configure(&m_profiles[m_profile_id], false);
+}
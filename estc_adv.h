@@ -0,0 +1,120 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_ADV_H__
+#define ESTC_ADV_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ble.h"
+#include "ble_advertising.h"
+#include "sdk_errors.h"
+
+// Manufacturer specific AD structure header: length, type and company identifier
+#define ESTC_ADV_MANUF_HDR_LEN          4
+
+// Largest application payload that fits into a non-connectable extended advertising set
+#define ESTC_ADV_BROADCAST_PAYLOAD_MAX  (BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED - ESTC_ADV_MANUF_HDR_LEN)
+
+typedef enum
+{
+    ESTC_ADV_MODE_LEGACY,           /**< Connectable legacy advertising driven by the ble_advertising module. */
+    ESTC_ADV_MODE_EXT_CONNECTABLE,  /**< Connectable, non-scannable extended advertising. */
+    ESTC_ADV_MODE_EXT_BROADCAST,    /**< Non-connectable extended advertising carrying the broadcast payload. */
+} estc_adv_mode_t;
+
+typedef struct
+{
+    estc_adv_mode_t mode;
+    uint8_t         primary_phy;    /**< BLE_GAP_PHY_1MBPS or BLE_GAP_PHY_CODED. Ignored in legacy mode. */
+    uint8_t         secondary_phy;  /**< BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_2MBPS or BLE_GAP_PHY_CODED. Ignored in legacy mode. */
+    uint32_t        interval;       /**< Advertising interval in 0.625 ms units. Ignored in legacy mode. */
+} estc_adv_profile_t;
+
+typedef enum
+{
+    ESTC_ADV_PROFILE_LEGACY,                /**< Legacy 1M fast advertising, 31-byte payload. */
+    ESTC_ADV_PROFILE_LONG_RANGE,            /**< Connectable, Coded PHY on both primary and secondary channels. */
+    ESTC_ADV_PROFILE_BROADCAST_HIGH_RATE,   /**< Broadcast, 1M primary and 2M AUX payload. */
+    ESTC_ADV_PROFILE_BROADCAST_LONG_RANGE,  /**< Broadcast, Coded PHY on both primary and secondary channels. */
+
+    ESTC_ADV_PROFILE_COUNT
+} estc_adv_profile_id_t;
+
+/**@brief Stages of the legacy advertising scheduler, entered in order until a connection is made. */
+typedef enum
+{
+    ESTC_ADV_STAGE_VERY_FAST,   /**< Right after a disconnect. Directed advertising to the last gateway, then whitelisted. */
+    ESTC_ADV_STAGE_FAST,        /**< Entry stage after boot. */
+    ESTC_ADV_STAGE_SLOW,
+    ESTC_ADV_STAGE_VERY_SLOW,   /**< Last stage. With a zero duration the device never stops advertising. */
+
+    ESTC_ADV_STAGE_COUNT
+} estc_adv_stage_t;
+
+typedef struct
+{
+    uint32_t interval;          /**< Advertising interval in 0.625 ms units. */
+    uint32_t duration;          /**< Stage duration in 10 ms units, 0 for no timeout. */
+} estc_adv_stage_cfg_t;
+
+typedef struct
+{
+    ble_advertising_t     * p_advertising;  /**< Legacy advertising instance. Its advertising set is shared by all profiles. */
+    ble_adv_evt_handler_t   evt_handler;    /**< Application handler, receives the advertising events forwarded by estc_adv. */
+    ble_uuid_t            * p_uuids;        /**< Service UUIDs to put into the extended connectable payload. */
+    uint16_t                uuid_cnt;
+    uint8_t                 conn_cfg_tag;
+    estc_adv_stage_cfg_t    stages[ESTC_ADV_STAGE_COUNT];
+} estc_adv_init_t;
+
+/**@brief Initialize the advertising scheduler. The Peer Manager has to be initialized first. */
+ret_code_t estc_adv_init(estc_adv_init_t const * p_init);
+
+/**@brief Advertising event handler to pass to ble_advertising_init(). Drives the stage scheduler. */
+void estc_adv_on_adv_evt(ble_adv_evt_t ble_adv_evt);
+
+ret_code_t estc_adv_start(void);
+
+void estc_adv_stop(void);
+
+ret_code_t estc_adv_profile_set(estc_adv_profile_id_t profile_id);
+
+estc_adv_profile_id_t estc_adv_profile_get(void);
+
+/**@brief Whether a gateway can connect in the selected profile. Broadcast profiles are left only by selecting
+ *        another profile on the device.
+ */
+bool estc_adv_connectable(void);
+
+ret_code_t estc_adv_broadcast_data_set(uint8_t const * p_data, uint16_t len);
+
+#endif /* ESTC_ADV_H__ */
@@ -0,0 +1,210 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_change.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "estc_le.h"
+
+typedef struct
+{
+    estc_change_cfg_t cfg;
+    bool              sent;         /**< A value went out since init. */
+    int32_t           sent_value;
+    uint32_t          sent_ms;
+    bool              evaluated;    /**< prev_value holds the value of the last evaluation. */
+    int32_t           prev_value;
+    uint32_t          prev_ms;
+} estc_change_ch_state_t;
+
+static estc_change_ch_state_t m_channels[ESTC_CHANGE_CH_COUNT];
+
+static uint32_t distance(int32_t a, int32_t b)
+{
+    return (a > b) ? (uint32_t)((int64_t)a - b) : (uint32_t)((int64_t)b - a);
+}
+
+/**@brief 0 below threshold_lo, 1 inside the band, 2 above threshold_hi. */
+static uint8_t zone(estc_change_cfg_t const * p_cfg, int32_t value)
+{
+    if (value < p_cfg->threshold_lo)
+    {
+        return 0;
+    }
+    return (value > p_cfg->threshold_hi) ? 2 : 1;
+}
+
+void estc_change_init(estc_change_cfg_t const p_cfg[ESTC_CHANGE_CH_COUNT])
+{
+    memset(m_channels, 0, sizeof(m_channels));
+
+    for (uint8_t ch = 0; ch < ESTC_CHANGE_CH_COUNT; ch++)
+    {
+        m_channels[ch].cfg = p_cfg[ch];
+    }
+}
+
+void estc_change_reset(void)
+{
+    for (uint8_t ch = 0; ch < ESTC_CHANGE_CH_COUNT; ch++)
+    {
+        m_channels[ch].sent      = false;
+        m_channels[ch].evaluated = false;
+    }
+}
+
+uint8_t estc_change_eval(estc_change_ch_t ch, int32_t value, uint32_t now_ms)
+{
+    if (ch >= ESTC_CHANGE_CH_COUNT)
+    {
+        return 0;
+    }
+
+    estc_change_ch_state_t  * p_ch  = &m_channels[ch];
+    estc_change_cfg_t const * p_cfg = &p_ch->cfg;
+    uint8_t                   fired = 0;
+
+    if (p_cfg->triggers & ESTC_CHANGE_TRIG_ALWAYS)
+    {
+        fired |= ESTC_CHANGE_TRIG_ALWAYS;
+    }
+
+    // The rate looks at consecutive evaluations, so it tracks the signal even while nothing is sent
+    if ((p_cfg->triggers & ESTC_CHANGE_TRIG_RATE) && p_ch->evaluated && (now_ms != p_ch->prev_ms))
+    {
+        uint64_t change = (uint64_t)distance(value, p_ch->prev_value) * 1000;
+
+        if (change >= (uint64_t)p_cfg->rate * (uint32_t)(now_ms - p_ch->prev_ms))
+        {
+            fired |= ESTC_CHANGE_TRIG_RATE;
+        }
+    }
+    p_ch->evaluated  = true;
+    p_ch->prev_value = value;
+    p_ch->prev_ms    = now_ms;
+
+    if (!p_ch->sent)
+    {
+        return fired | ESTC_CHANGE_REASON_FIRST;
+    }
+
+    // Deadband, threshold and heartbeat compare against the last value that went out, a failed send is retried
+    if ((p_cfg->triggers & ESTC_CHANGE_TRIG_DEADBAND) && (distance(value, p_ch->sent_value) >= p_cfg->deadband))
+    {
+        fired |= ESTC_CHANGE_TRIG_DEADBAND;
+    }
+
+    if ((p_cfg->triggers & ESTC_CHANGE_TRIG_THRESHOLD) && (zone(p_cfg, value) != zone(p_cfg, p_ch->sent_value)))
+    {
+        fired |= ESTC_CHANGE_TRIG_THRESHOLD;
+    }
+
+    if ((p_cfg->triggers & ESTC_CHANGE_TRIG_HEARTBEAT) &&
+        ((uint32_t)(now_ms - p_ch->sent_ms) >= (uint32_t)p_cfg->heartbeat_s * 1000))
+    {
+        fired |= ESTC_CHANGE_TRIG_HEARTBEAT;
+    }
+
+    return fired;
+}
+
+void estc_change_sent(estc_change_ch_t ch, int32_t value, uint32_t now_ms)
+{
+    if (ch >= ESTC_CHANGE_CH_COUNT)
+    {
+        return;
+    }
+
+    m_channels[ch].sent       = true;
+    m_channels[ch].sent_value = value;
+    m_channels[ch].sent_ms    = now_ms;
+}
+
+bool estc_change_cfg_write(uint8_t const * p_buf, uint16_t len)
+{
+    estc_change_cfg_t cfg;
+    uint16_t          value;
+
+    if ((p_buf == NULL) || (len != ESTC_CHANGE_CFG_RECORD_LEN))
+    {
+        return false;
+    }
+
+    uint8_t const * p  = p_buf;
+    uint8_t         ch = *p++;
+
+    cfg.triggers     = *p++;
+    p                = estc_le_get_u16(p, &cfg.deadband);
+    p                = estc_le_get_u16(p, &value);
+    cfg.threshold_lo = (int16_t)value;
+    p                = estc_le_get_u16(p, &value);
+    cfg.threshold_hi = (int16_t)value;
+    p                = estc_le_get_u16(p, &cfg.rate);
+    p                = estc_le_get_u16(p, &cfg.heartbeat_s);
+
+    if ((ch >= ESTC_CHANGE_CH_COUNT) ||
+        (cfg.triggers & ~ESTC_CHANGE_TRIG_MASK) ||
+        (cfg.threshold_lo > cfg.threshold_hi))
+    {
+        return false;
+    }
+
+    // The next evaluation starts over from the new triggers, the last value sent stays the reference
+    m_channels[ch].cfg = cfg;
+
+    return true;
+}
+
+uint16_t estc_change_cfg_encode(uint8_t * p_buf, uint16_t buf_len)
+{
+    if ((p_buf == NULL) || (buf_len < ESTC_CHANGE_CFG_TABLE_LEN))
+    {
+        return 0;
+    }
+
+    uint8_t * p = p_buf;
+
+    for (uint8_t ch = 0; ch < ESTC_CHANGE_CH_COUNT; ch++)
+    {
+        estc_change_cfg_t const * p_cfg = &m_channels[ch].cfg;
+
+        *p++ = ch;
+        *p++ = p_cfg->triggers;
+        p    = estc_le_put_u16(p, p_cfg->deadband);
+        p    = estc_le_put_u16(p, (uint16_t)p_cfg->threshold_lo);
+        p    = estc_le_put_u16(p, (uint16_t)p_cfg->threshold_hi);
+        p    = estc_le_put_u16(p, p_cfg->rate);
+        p    = estc_le_put_u16(p, p_cfg->heartbeat_s);
+    }
+
+    return ESTC_CHANGE_CFG_TABLE_LEN;
+}
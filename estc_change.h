@@ -0,0 +1,105 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_CHANGE_H__
+#define ESTC_CHANGE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Change detection in front of the ESTC notifications. Every channel watches one signal; a notification goes out only
+// when one of the enabled triggers fires, and the heartbeat bounds the silence in between.
+//
+// Configuration record, all fields little-endian:
+//   channel (1) | triggers (1) | deadband (2) | threshold_lo (2) | threshold_hi (2) | rate (2) | heartbeat_s (2)
+// The configuration characteristic takes one record per write and reads back the records of every channel, in
+// channel order. Like the telemetry frame this only depends on the C library.
+
+#define ESTC_CHANGE_CFG_RECORD_LEN      12
+#define ESTC_CHANGE_CFG_TABLE_LEN       (ESTC_CHANGE_CH_COUNT * ESTC_CHANGE_CFG_RECORD_LEN)
+
+#define ESTC_CHANGE_TRIG_DEADBAND       (1 << 0)    /**< Moved at least deadband away from the last value sent. */
+#define ESTC_CHANGE_TRIG_THRESHOLD      (1 << 1)    /**< Crossed threshold_lo or threshold_hi, in either direction. */
+#define ESTC_CHANGE_TRIG_RATE           (1 << 2)    /**< Changed by at least rate per second since the last evaluation. */
+#define ESTC_CHANGE_TRIG_HEARTBEAT      (1 << 3)    /**< Nothing sent for heartbeat_s seconds. */
+#define ESTC_CHANGE_TRIG_ALWAYS         (1 << 4)    /**< Every evaluation, the periodic behavior. */
+#define ESTC_CHANGE_TRIG_MASK           0x1F
+
+#define ESTC_CHANGE_REASON_FIRST        (1 << 7)    /**< Nothing sent yet on this channel. */
+
+typedef enum
+{
+    ESTC_CHANGE_CH_HELLO,       /**< Hello characteristic, the value never changes so only the heartbeat applies. */
+    ESTC_CHANGE_CH_TELEMETRY,   /**< Telemetry frames, watches the frame mean. */
+    ESTC_CHANGE_CH_METRICS,     /**< Metrics snapshot, watches the CPU load in permille. */
+
+    ESTC_CHANGE_CH_COUNT
+} estc_change_ch_t;
+
+typedef struct
+{
+    uint8_t  triggers;          /**< Combination of ESTC_CHANGE_TRIG_* flags. */
+    uint16_t deadband;
+    int16_t  threshold_lo;
+    int16_t  threshold_hi;
+    uint16_t rate;              /**< Signal units per second. */
+    uint16_t heartbeat_s;
+} estc_change_cfg_t;
+
+/**@brief Reset every channel to the given configuration and forget what was sent. */
+void estc_change_init(estc_change_cfg_t const p_cfg[ESTC_CHANGE_CH_COUNT]);
+
+/**@brief Forget what was sent, e.g. for a new peer. The next value of every channel goes out. */
+void estc_change_reset(void);
+
+/**@brief Decide whether a new value of a channel is worth a notification.
+ *
+ * @param[in] now_ms    Monotonic time in milliseconds, wrapping is fine.
+ *
+ * @return Combination of the ESTC_CHANGE_TRIG_* flags that fired and ESTC_CHANGE_REASON_FIRST, 0 to stay silent.
+ */
+uint8_t estc_change_eval(estc_change_ch_t ch, int32_t value, uint32_t now_ms);
+
+/**@brief Record that a value went out. Until then every evaluation compares against the previous value sent. */
+void estc_change_sent(estc_change_ch_t ch, int32_t value, uint32_t now_ms);
+
+/**@brief Apply one configuration record written by the peer.
+ *
+ * @return false if the length, channel or triggers are invalid, or threshold_lo is above threshold_hi.
+ */
+bool estc_change_cfg_write(uint8_t const * p_buf, uint16_t len);
+
+/**@brief Serialize the configuration of every channel.
+ *
+ * @return Encoded length, or 0 if it does not fit into @p buf_len.
+ */
+uint16_t estc_change_cfg_encode(uint8_t * p_buf, uint16_t buf_len);
+
+#endif /* ESTC_CHANGE_H__ */
@@ -0,0 +1,221 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_crc.h"
+
+#include "estc_crc_tables.h"
+#include "estc_le.h"
+
+// Most significant bit first CRC-16: the register meets the next bytes from its high byte down
+
+static inline uint16_t msb16_slice1(uint16_t const (*p_table)[256], uint16_t crc, uint8_t const * p, size_t len)
+{
+    while (len-- > 0)
+    {
+        crc = (uint16_t)((crc << 8) ^ p_table[0][(uint8_t)((crc >> 8) ^ *p++)]);
+    }
+    return crc;
+}
+
+#if ESTC_CRC_SLICES >= 4
+static inline uint16_t msb16_slice4(uint16_t const (*p_table)[256], uint16_t crc, uint8_t const * p, size_t len)
+{
+    for (; len >= 4; len -= 4, p += 4)
+    {
+        crc = p_table[3][(uint8_t)(p[0] ^ (crc >> 8))] ^ p_table[2][(uint8_t)(p[1] ^ crc)] ^
+              p_table[1][p[2]] ^ p_table[0][p[3]];
+    }
+    return msb16_slice1(p_table, crc, p, len);
+}
+#endif
+
+#if ESTC_CRC_SLICES >= 8
+static inline uint16_t msb16_slice8(uint16_t const (*p_table)[256], uint16_t crc, uint8_t const * p, size_t len)
+{
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        crc = p_table[7][(uint8_t)(p[0] ^ (crc >> 8))] ^ p_table[6][(uint8_t)(p[1] ^ crc)] ^
+              p_table[5][p[2]] ^ p_table[4][p[3]] ^ p_table[3][p[4]] ^ p_table[2][p[5]] ^
+              p_table[1][p[6]] ^ p_table[0][p[7]];
+    }
+    return msb16_slice1(p_table, crc, p, len);
+}
+#endif
+
+// Reflected 32-bit CRCs: the register meets the next bytes from its low byte up, so a little-endian word is xored in
+// at once
+
+static inline uint32_t refl32_slice1(uint32_t const (*p_table)[256], uint32_t crc, uint8_t const * p, size_t len)
+{
+    while (len-- > 0)
+    {
+        crc = (crc >> 8) ^ p_table[0][(uint8_t)(crc ^ *p++)];
+    }
+    return crc;
+}
+
+#if ESTC_CRC_SLICES >= 4
+static inline uint32_t refl32_slice4(uint32_t const (*p_table)[256], uint32_t crc, uint8_t const * p, size_t len)
+{
+    for (; len >= 4; len -= 4, p += 4)
+    {
+        crc ^= estc_le_u32(p);
+        crc  = p_table[3][(uint8_t)crc] ^ p_table[2][(uint8_t)(crc >> 8)] ^
+               p_table[1][(uint8_t)(crc >> 16)] ^ p_table[0][crc >> 24];
+    }
+    return refl32_slice1(p_table, crc, p, len);
+}
+#endif
+
+#if ESTC_CRC_SLICES >= 8
+static inline uint32_t refl32_slice8(uint32_t const (*p_table)[256], uint32_t crc, uint8_t const * p, size_t len)
+{
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        uint32_t lo = crc ^ estc_le_u32(p);
+        uint32_t hi = estc_le_u32(p + 4);
+
+        crc = p_table[7][(uint8_t)lo] ^ p_table[6][(uint8_t)(lo >> 8)] ^
+              p_table[5][(uint8_t)(lo >> 16)] ^ p_table[4][lo >> 24] ^
+              p_table[3][(uint8_t)hi] ^ p_table[2][(uint8_t)(hi >> 8)] ^
+              p_table[1][(uint8_t)(hi >> 16)] ^ p_table[0][hi >> 24];
+    }
+    return refl32_slice1(p_table, crc, p, len);
+}
+#endif
+
+uint16_t estc_crc16_update_slice1(uint16_t crc, void const * p_data, size_t len)
+{
+    return msb16_slice1(m_crc16_table, crc, p_data, len);
+}
+
+uint32_t estc_crc32_update_slice1(uint32_t crc, void const * p_data, size_t len)
+{
+    return ~refl32_slice1(m_crc32_table, ~crc, p_data, len);
+}
+
+uint32_t estc_crc32c_update_slice1(uint32_t crc, void const * p_data, size_t len)
+{
+    return ~refl32_slice1(m_crc32c_table, ~crc, p_data, len);
+}
+
+#if ESTC_CRC_SLICES >= 4
+uint16_t estc_crc16_update_slice4(uint16_t crc, void const * p_data, size_t len)
+{
+    return msb16_slice4(m_crc16_table, crc, p_data, len);
+}
+
+uint32_t estc_crc32_update_slice4(uint32_t crc, void const * p_data, size_t len)
+{
+    return ~refl32_slice4(m_crc32_table, ~crc, p_data, len);
+}
+
+uint32_t estc_crc32c_update_slice4(uint32_t crc, void const * p_data, size_t len)
+{
+    return ~refl32_slice4(m_crc32c_table, ~crc, p_data, len);
+}
+#endif
+
+#if ESTC_CRC_SLICES >= 8
+uint16_t estc_crc16_update_slice8(uint16_t crc, void const * p_data, size_t len)
+{
+    return msb16_slice8(m_crc16_table, crc, p_data, len);
+}
+
+uint32_t estc_crc32_update_slice8(uint32_t crc, void const * p_data, size_t len)
+{
+    return ~refl32_slice8(m_crc32_table, ~crc, p_data, len);
+}
+
+uint32_t estc_crc32c_update_slice8(uint32_t crc, void const * p_data, size_t len)
+{
+    return ~refl32_slice8(m_crc32c_table, ~crc, p_data, len);
+}
+#endif
+
+#if ESTC_CRC_SLICES == 8
+#define CRC_VARIANT(name)   name ## _slice8
+#elif ESTC_CRC_SLICES == 4
+#define CRC_VARIANT(name)   name ## _slice4
+#else
+#define CRC_VARIANT(name)   name ## _slice1
+#endif
+
+uint16_t estc_crc16_update(uint16_t crc, void const * p_data, size_t len)
+{
+    return CRC_VARIANT(estc_crc16_update)(crc, p_data, len);
+}
+
+uint32_t estc_crc32_update(uint32_t crc, void const * p_data, size_t len)
+{
+    return CRC_VARIANT(estc_crc32_update)(crc, p_data, len);
+}
+
+uint32_t estc_crc32c_update(uint32_t crc, void const * p_data, size_t len)
+{
+    return CRC_VARIANT(estc_crc32c_update)(crc, p_data, len);
+}
+
+size_t estc_crc16_append(uint8_t * p_frame, size_t len)
+{
+    uint16_t crc = estc_crc16(p_frame, len);
+
+    p_frame[len]     = (uint8_t)(crc >> 8);
+    p_frame[len + 1] = (uint8_t)crc;
+    return len + ESTC_CRC16_LEN;
+}
+
+bool estc_crc16_check(uint8_t const * p_frame, size_t len)
+{
+    // Not reflected and no final xor, so the CRC over data and its big-endian CRC is 0
+    return (len >= ESTC_CRC16_LEN) && (estc_crc16(p_frame, len) == 0);
+}
+
+size_t estc_crc32c_append(uint8_t * p_record, size_t len)
+{
+    uint32_t crc = estc_crc32c(p_record, len);
+
+    p_record[len]     = (uint8_t)crc;
+    p_record[len + 1] = (uint8_t)(crc >> 8);
+    p_record[len + 2] = (uint8_t)(crc >> 16);
+    p_record[len + 3] = (uint8_t)(crc >> 24);
+    return len + ESTC_CRC32C_LEN;
+}
+
+bool estc_crc32c_check(uint8_t const * p_record, size_t len)
+{
+    if (len < ESTC_CRC32C_LEN)
+    {
+        return false;
+    }
+
+    len -= ESTC_CRC32C_LEN;
+    return estc_crc32c(p_record, len) == estc_le_u32(&p_record[len]);
+}
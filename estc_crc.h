@@ -0,0 +1,127 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_CRC_H__
+#define ESTC_CRC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Table driven CRCs for frames, stored records and images:
+//   CRC-16/CCITT-FALSE   poly 0x1021, init 0xFFFF, not reflected, no final xor; the one crc16_compute() computes
+//   CRC-32               poly 0x04C11DB7 reflected, init and final xor 0xFFFFFFFF; the one crc32_compute() and the
+//                        bootloader compute, used for images
+//   CRC-32C (Castagnoli) poly 0x1EDC6F41 reflected, init and final xor 0xFFFFFFFF; better error detection on short
+//                        frames than CRC-32
+// ESTC_CRC_SLICES bytes are folded in per step, with one 256 entry table per byte: 1 KB of flash per slice for each
+// 32-bit CRC and 512 bytes for CRC-16. Slice-by-1 is the smallest, slice-by-8 the fastest. The _update functions take
+// data in pieces of any size, so a CRC can follow a stream without buffering it.
+//
+// Only depends on the C library and the configuration. Host builds (ESTC_CRC_HOST) have every variant, so
+// armgcc/crc_bench.c can check and time them against each other.
+
+#ifndef ESTC_CRC_HOST
+#include "sdk_config.h"
+#elif !defined(ESTC_CRC_SLICES)
+#define ESTC_CRC_SLICES     8
+#endif
+
+#if (ESTC_CRC_SLICES != 1) && (ESTC_CRC_SLICES != 4) && (ESTC_CRC_SLICES != 8)
+#error "ESTC_CRC_SLICES has to be 1, 4 or 8"
+#endif
+
+#define ESTC_CRC16_INIT     0xFFFF
+#define ESTC_CRC16_LEN      sizeof(uint16_t)
+#define ESTC_CRC32C_LEN     sizeof(uint32_t)
+
+/**@brief Continue a CRC-16 over more data. Start with ESTC_CRC16_INIT. */
+uint16_t estc_crc16_update(uint16_t crc, void const * p_data, size_t len);
+
+/**@brief Continue a CRC-32 over more data.
+ *
+ * @param[in] crc  The result over the data so far, 0 to start. Same as the p_crc argument of crc32_compute().
+ */
+uint32_t estc_crc32_update(uint32_t crc, void const * p_data, size_t len);
+
+/**@brief Continue a CRC-32C over more data. Like estc_crc32_update(), 0 to start. */
+uint32_t estc_crc32c_update(uint32_t crc, void const * p_data, size_t len);
+
+static inline uint16_t estc_crc16(void const * p_data, size_t len)
+{
+    return estc_crc16_update(ESTC_CRC16_INIT, p_data, len);
+}
+
+static inline uint32_t estc_crc32(void const * p_data, size_t len)
+{
+    return estc_crc32_update(0, p_data, len);
+}
+
+static inline uint32_t estc_crc32c(void const * p_data, size_t len)
+{
+    return estc_crc32c_update(0, p_data, len);
+}
+
+/**@brief Append the CRC-16 of the first @p len bytes, big-endian, so the CRC-16 of the whole frame is 0.
+ *
+ * @return Length of the frame including the CRC.
+ */
+size_t estc_crc16_append(uint8_t * p_frame, size_t len);
+
+/**@brief Check a frame that ends with its CRC-16, @p len includes the CRC. */
+bool estc_crc16_check(uint8_t const * p_frame, size_t len);
+
+/**@brief Append the CRC-32C of the first @p len bytes, little-endian.
+ *
+ * @return Length of the record including the CRC.
+ */
+size_t estc_crc32c_append(uint8_t * p_record, size_t len);
+
+/**@brief Check a record that ends with its CRC-32C, @p len includes the CRC. */
+bool estc_crc32c_check(uint8_t const * p_record, size_t len);
+
+// Variants, the functions above use the widest one configured
+uint16_t estc_crc16_update_slice1(uint16_t crc, void const * p_data, size_t len);
+uint32_t estc_crc32_update_slice1(uint32_t crc, void const * p_data, size_t len);
+uint32_t estc_crc32c_update_slice1(uint32_t crc, void const * p_data, size_t len);
+
+#if ESTC_CRC_SLICES >= 4
+uint16_t estc_crc16_update_slice4(uint16_t crc, void const * p_data, size_t len);
+uint32_t estc_crc32_update_slice4(uint32_t crc, void const * p_data, size_t len);
+uint32_t estc_crc32c_update_slice4(uint32_t crc, void const * p_data, size_t len);
+#endif
+
+#if ESTC_CRC_SLICES >= 8
+uint16_t estc_crc16_update_slice8(uint16_t crc, void const * p_data, size_t len);
+uint32_t estc_crc32_update_slice8(uint32_t crc, void const * p_data, size_t len);
+uint32_t estc_crc32c_update_slice8(uint32_t crc, void const * p_data, size_t len);
+#endif
+
+#endif /* ESTC_CRC_H__ */
@@ -0,0 +1,585 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_crypt.h"
+
+#include <string.h>
+
+#include "estc_le.h"
+
+#ifndef ESTC_CRYPT_HOST
+#include "nrf_soc.h"
+#include "app_util_platform.h"
+#include "nrf_log.h"
+#include "estc_perf.h"
+#else
+#define CRITICAL_REGION_ENTER()
+#define CRITICAL_REGION_EXIT()
+#endif
+
+#define CCM_L               2           /**< Bytes of the length field and the block counter. */
+#define CCM_FLAG_ADATA      0x40
+
+#define STREAM_BATCH_LEN    (ESTC_CRYPT_BATCH_BLOCKS * ESTC_CRYPT_BLOCK_LEN)
+
+typedef struct
+{
+    uint8_t x[ESTC_CRYPT_BLOCK_LEN];
+    uint8_t fill;
+} cbc_mac_t;
+
+static const uint8_t m_sbox[256] =
+{
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B, 0xFE, 0xD7, 0xAB, 0x76,
+    0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0, 0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0,
+    0xB7, 0xFD, 0x93, 0x26, 0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2, 0xEB, 0x27, 0xB2, 0x75,
+    0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0, 0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84,
+    0x53, 0xD1, 0x00, 0xED, 0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F, 0x50, 0x3C, 0x9F, 0xA8,
+    0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5, 0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2,
+    0xCD, 0x0C, 0x13, 0xEC, 0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14, 0xDE, 0x5E, 0x0B, 0xDB,
+    0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C, 0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79,
+    0xE7, 0xC8, 0x37, 0x6D, 0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F, 0x4B, 0xBD, 0x8B, 0x8A,
+    0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E, 0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E,
+    0xE1, 0xF8, 0x98, 0x11, 0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F, 0xB0, 0x54, 0xBB, 0x16,
+};
+
+static void xor_bytes(uint8_t * p_out, uint8_t const * p_in, uint8_t const * p_stream, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++)
+    {
+        p_out[i] = p_in[i] ^ p_stream[i];
+    }
+}
+
+static uint8_t xtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00));
+}
+
+void estc_crypt_key_init(estc_crypt_key_t * p_key, uint8_t const key[ESTC_CRYPT_KEY_LEN])
+{
+    static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+    uint8_t * p_rk = p_key->round_keys;
+
+    memcpy(p_key->key, key, ESTC_CRYPT_KEY_LEN);
+    memcpy(p_rk, key, ESTC_CRYPT_KEY_LEN);
+
+    for (uint32_t i = ESTC_CRYPT_KEY_LEN; i < sizeof(p_key->round_keys); i += 4)
+    {
+        uint8_t t[4] = { p_rk[i - 4], p_rk[i - 3], p_rk[i - 2], p_rk[i - 1] };
+
+        if ((i % ESTC_CRYPT_KEY_LEN) == 0)
+        {
+            uint8_t first = t[0];
+            t[0] = m_sbox[t[1]] ^ rcon[i / ESTC_CRYPT_KEY_LEN - 1];
+            t[1] = m_sbox[t[2]];
+            t[2] = m_sbox[t[3]];
+            t[3] = m_sbox[first];
+        }
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            p_rk[i + j] = p_rk[i + j - ESTC_CRYPT_KEY_LEN] ^ t[j];
+        }
+    }
+}
+
+static void aes_block(uint8_t const * p_rk, uint8_t const * p_in, uint8_t * p_out)
+{
+    // State byte 4 * column + row, the order of the input
+    uint8_t s[ESTC_CRYPT_BLOCK_LEN];
+    uint8_t t[ESTC_CRYPT_BLOCK_LEN];
+
+    for (uint32_t i = 0; i < ESTC_CRYPT_BLOCK_LEN; i++)
+    {
+        s[i] = p_in[i] ^ p_rk[i];
+    }
+
+    for (uint32_t round = 1; round <= 10; round++)
+    {
+        // SubBytes and ShiftRows: row r of column c comes from column c + r
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            for (uint32_t r = 0; r < 4; r++)
+            {
+                t[4 * c + r] = m_sbox[s[4 * ((c + r) & 3) + r]];
+            }
+        }
+
+        p_rk += ESTC_CRYPT_BLOCK_LEN;
+        if (round == 10)
+        {
+            for (uint32_t i = 0; i < ESTC_CRYPT_BLOCK_LEN; i++)
+            {
+                s[i] = t[i] ^ p_rk[i];
+            }
+            break;
+        }
+
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            uint8_t const * a = &t[4 * c];
+            uint8_t all = a[0] ^ a[1] ^ a[2] ^ a[3];
+
+            s[4 * c + 0] = a[0] ^ all ^ xtime(a[0] ^ a[1]) ^ p_rk[4 * c + 0];
+            s[4 * c + 1] = a[1] ^ all ^ xtime(a[1] ^ a[2]) ^ p_rk[4 * c + 1];
+            s[4 * c + 2] = a[2] ^ all ^ xtime(a[2] ^ a[3]) ^ p_rk[4 * c + 2];
+            s[4 * c + 3] = a[3] ^ all ^ xtime(a[3] ^ a[0]) ^ p_rk[4 * c + 3];
+        }
+    }
+
+    memcpy(p_out, s, ESTC_CRYPT_BLOCK_LEN);
+}
+
+void estc_crypt_ecb_soft(estc_crypt_key_t const * p_key, uint8_t const * p_in, uint8_t * p_out, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        aes_block(p_key->round_keys, &p_in[i * ESTC_CRYPT_BLOCK_LEN], &p_out[i * ESTC_CRYPT_BLOCK_LEN]);
+    }
+}
+
+void estc_crypt_ecb(estc_crypt_key_t const * p_key, uint8_t const * p_in, uint8_t * p_out, uint32_t count)
+{
+#ifndef ESTC_CRYPT_HOST
+    nrf_ecb_hal_data_block_t blocks[ESTC_CRYPT_BATCH_BLOCKS];
+
+    while (count > 0)
+    {
+        uint32_t n = (count < ESTC_CRYPT_BATCH_BLOCKS) ? count : ESTC_CRYPT_BATCH_BLOCKS;
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            blocks[i].p_key        = (soc_ecb_key_t const *)p_key->key;
+            blocks[i].p_cleartext  = (soc_ecb_cleartext_t const *)&p_in[i * ESTC_CRYPT_BLOCK_LEN];
+            blocks[i].p_ciphertext = (soc_ecb_ciphertext_t *)&p_out[i * ESTC_CRYPT_BLOCK_LEN];
+        }
+
+        // One supervisor call for the batch; the peripheral is shared with the SoftDevice, which may refuse
+        if (sd_ecb_blocks_encrypt((uint8_t)n, blocks) != NRF_SUCCESS)
+        {
+            estc_crypt_ecb_soft(p_key, p_in, p_out, n);
+        }
+
+        p_in  += n * ESTC_CRYPT_BLOCK_LEN;
+        p_out += n * ESTC_CRYPT_BLOCK_LEN;
+        count -= n;
+    }
+#else
+    estc_crypt_ecb_soft(p_key, p_in, p_out, count);
+#endif
+}
+
+/**@brief Counter blocks A_first.. of CCM, encrypted into the keystream S_first.. */
+static void keystream(estc_crypt_key_t const * p_key, uint8_t const nonce[ESTC_CRYPT_NONCE_LEN], uint16_t first,
+                      uint32_t count, uint8_t * p_out)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint8_t * p_block = &p_out[i * ESTC_CRYPT_BLOCK_LEN];
+        uint16_t index = (uint16_t)(first + i);
+
+        p_block[0] = CCM_L - 1;
+        memcpy(&p_block[1], nonce, ESTC_CRYPT_NONCE_LEN);
+        p_block[14] = (uint8_t)(index >> 8);
+        p_block[15] = (uint8_t)index;
+    }
+    estc_crypt_ecb(p_key, p_out, p_out, count);
+}
+
+static void ctr_xor(estc_crypt_key_t const * p_key, uint8_t const nonce[ESTC_CRYPT_NONCE_LEN], uint16_t first,
+                    uint8_t const * p_in, uint8_t * p_out, uint32_t len)
+{
+    uint8_t stream[STREAM_BATCH_LEN];
+
+    while (len > 0)
+    {
+        uint32_t n = (len < sizeof(stream)) ? len : sizeof(stream);
+        uint32_t blocks = (n + ESTC_CRYPT_BLOCK_LEN - 1) / ESTC_CRYPT_BLOCK_LEN;
+
+        keystream(p_key, nonce, first, blocks, stream);
+        xor_bytes(p_out, p_in, stream, n);
+
+        first += (uint16_t)blocks;
+        p_in  += n;
+        p_out += n;
+        len   -= n;
+    }
+}
+
+static void cbc_mac_absorb(estc_crypt_key_t const * p_key, cbc_mac_t * p_mac, uint8_t const * p_data, uint32_t len)
+{
+    while (len > 0)
+    {
+        uint32_t n = ESTC_CRYPT_BLOCK_LEN - p_mac->fill;
+        if (n > len)
+        {
+            n = len;
+        }
+        xor_bytes(&p_mac->x[p_mac->fill], &p_mac->x[p_mac->fill], p_data, n);
+        p_mac->fill += (uint8_t)n;
+        p_data += n;
+        len    -= n;
+
+        if (p_mac->fill == ESTC_CRYPT_BLOCK_LEN)
+        {
+            estc_crypt_ecb(p_key, p_mac->x, p_mac->x, 1);
+            p_mac->fill = 0;
+        }
+    }
+}
+
+static void cbc_mac_pad(estc_crypt_key_t const * p_key, cbc_mac_t * p_mac)
+{
+    if (p_mac->fill > 0)
+    {
+        estc_crypt_ecb(p_key, p_mac->x, p_mac->x, 1);
+        p_mac->fill = 0;
+    }
+}
+
+/**@brief Unencrypted tag, the first ESTC_CRYPT_TAG_LEN bytes of the CBC-MAC. */
+static void cbc_mac(estc_crypt_key_t const * p_key, uint8_t const nonce[ESTC_CRYPT_NONCE_LEN], uint8_t const * p_aad,
+                    uint16_t aad_len, uint8_t const * p_data, uint16_t len, uint8_t * p_tag)
+{
+    cbc_mac_t mac = { .fill = 0 };
+    uint8_t b0[ESTC_CRYPT_BLOCK_LEN];
+
+    memset(mac.x, 0, sizeof(mac.x));
+    b0[0] = ((aad_len > 0) ? CCM_FLAG_ADATA : 0) | (((ESTC_CRYPT_TAG_LEN - 2) / 2) << 3) | (CCM_L - 1);
+    memcpy(&b0[1], nonce, ESTC_CRYPT_NONCE_LEN);
+    b0[14] = (uint8_t)(len >> 8);
+    b0[15] = (uint8_t)len;
+    cbc_mac_absorb(p_key, &mac, b0, sizeof(b0));
+
+    if (aad_len > 0)
+    {
+        // Lengths below 0xFF00 take two bytes
+        uint8_t aad_hdr[2] = { (uint8_t)(aad_len >> 8), (uint8_t)aad_len };
+        cbc_mac_absorb(p_key, &mac, aad_hdr, sizeof(aad_hdr));
+        cbc_mac_absorb(p_key, &mac, p_aad, aad_len);
+        cbc_mac_pad(p_key, &mac);
+    }
+
+    cbc_mac_absorb(p_key, &mac, p_data, len);
+    cbc_mac_pad(p_key, &mac);
+    memcpy(p_tag, mac.x, ESTC_CRYPT_TAG_LEN);
+}
+
+void estc_crypt_ccm_encrypt(estc_crypt_key_t const * p_key, uint8_t const nonce[ESTC_CRYPT_NONCE_LEN],
+                            uint8_t const * p_aad, uint16_t aad_len, uint8_t const * p_in, uint16_t len,
+                            uint8_t * p_out, uint8_t * p_tag)
+{
+    uint8_t s0[ESTC_CRYPT_BLOCK_LEN];
+    uint8_t mac[ESTC_CRYPT_TAG_LEN];
+
+    cbc_mac(p_key, nonce, p_aad, aad_len, p_in, len, mac);
+    keystream(p_key, nonce, 0, 1, s0);
+    ctr_xor(p_key, nonce, 1, p_in, p_out, len);
+    xor_bytes(p_tag, mac, s0, ESTC_CRYPT_TAG_LEN);
+}
+
+bool estc_crypt_ccm_decrypt(estc_crypt_key_t const * p_key, uint8_t const nonce[ESTC_CRYPT_NONCE_LEN],
+                            uint8_t const * p_aad, uint16_t aad_len, uint8_t const * p_in, uint16_t len,
+                            uint8_t * p_out, uint8_t const * p_tag)
+{
+    uint8_t s0[ESTC_CRYPT_BLOCK_LEN];
+    uint8_t mac[ESTC_CRYPT_TAG_LEN];
+    uint8_t diff = 0;
+
+    ctr_xor(p_key, nonce, 1, p_in, p_out, len);
+    cbc_mac(p_key, nonce, p_aad, aad_len, p_out, len, mac);
+    keystream(p_key, nonce, 0, 1, s0);
+
+    // Every byte compared, the time does not tell where the tags differ
+    for (uint32_t i = 0; i < ESTC_CRYPT_TAG_LEN; i++)
+    {
+        diff |= (uint8_t)(mac[i] ^ s0[i] ^ p_tag[i]);
+    }
+    if (diff != 0)
+    {
+        memset(p_out, 0, len);
+        return false;
+    }
+    return true;
+}
+
+static void record_nonce(uint8_t const nonce_head[ESTC_CRYPT_NONCE_HEAD_LEN], uint8_t const * p_rec_hdr,
+                         uint8_t nonce[ESTC_CRYPT_NONCE_LEN])
+{
+    memcpy(nonce, nonce_head, ESTC_CRYPT_NONCE_HEAD_LEN);
+    memcpy(&nonce[ESTC_CRYPT_NONCE_HEAD_LEN], p_rec_hdr, ESTC_CRYPT_RECORD_HDR_LEN);
+}
+
+void estc_crypt_init(estc_crypt_t * p_crypt, estc_crypt_mode_t mode, uint8_t const key[ESTC_CRYPT_KEY_LEN],
+                     uint8_t const nonce_head[ESTC_CRYPT_NONCE_HEAD_LEN], uint32_t boot_id)
+{
+    memset(p_crypt, 0, sizeof(*p_crypt));
+    estc_crypt_key_init(&p_crypt->key, key);
+    p_crypt->mode    = mode;
+    p_crypt->boot_id = boot_id;
+    memcpy(p_crypt->nonce_head, nonce_head, ESTC_CRYPT_NONCE_HEAD_LEN);
+
+    for (uint32_t i = 0; i < ESTC_CRYPT_POOL_RECORDS; i++)
+    {
+        p_crypt->pool[i].counter = i;
+    }
+}
+
+bool estc_crypt_refill(estc_crypt_t * p_crypt)
+{
+    estc_crypt_slot_t * p_slot = NULL;
+    uint32_t counter = 0;
+    uint8_t first = 0;
+
+    // The record sealed next first
+    CRITICAL_REGION_ENTER();
+    for (uint32_t i = 0; i < ESTC_CRYPT_POOL_RECORDS; i++)
+    {
+        estc_crypt_slot_t * p_next = &p_crypt->pool[(p_crypt->next + i) % ESTC_CRYPT_POOL_RECORDS];
+        if (p_next->blocks < ESTC_CRYPT_POOL_BLOCKS)
+        {
+            p_slot  = p_next;
+            counter = p_next->counter;
+            first   = p_next->blocks;
+            break;
+        }
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (p_slot == NULL)
+    {
+        return false;
+    }
+
+    uint8_t stream[STREAM_BATCH_LEN];
+    uint8_t hdr[ESTC_CRYPT_RECORD_HDR_LEN];
+    uint8_t nonce[ESTC_CRYPT_NONCE_LEN];
+    uint32_t count = ESTC_CRYPT_POOL_BLOCKS - first;
+
+    if (count > ESTC_CRYPT_BATCH_BLOCKS)
+    {
+        count = ESTC_CRYPT_BATCH_BLOCKS;
+    }
+    (void)estc_le_put_u32(hdr, p_crypt->boot_id);
+    (void)estc_le_put_u32(&hdr[4], counter);
+    record_nonce(p_crypt->nonce_head, hdr, nonce);
+    keystream(&p_crypt->key, nonce, first, count, stream);
+
+    // A record sealed in the meantime took the slot over
+    CRITICAL_REGION_ENTER();
+    if ((p_slot->counter == counter) && (p_slot->blocks == first))
+    {
+        memcpy(&p_slot->stream[first * ESTC_CRYPT_BLOCK_LEN], stream, count * ESTC_CRYPT_BLOCK_LEN);
+        p_slot->blocks = (uint8_t)(first + count);
+        p_crypt->stats.refill_blocks += count;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return true;
+}
+
+uint16_t estc_crypt_seal(estc_crypt_t * p_crypt, uint8_t const * p_data, uint16_t len, uint8_t * p_rec,
+                         uint16_t rec_size)
+{
+    uint32_t rec_len = estc_crypt_record_len(p_crypt->mode, len);
+    uint32_t counter;
+
+    if (rec_len > rec_size)
+    {
+        return 0;
+    }
+
+    CRITICAL_REGION_ENTER();
+    counter = p_crypt->next++;
+    p_crypt->stats.sealed++;
+    CRITICAL_REGION_EXIT();
+
+    estc_crypt_slot_t * p_slot = &p_crypt->pool[counter % ESTC_CRYPT_POOL_RECORDS];
+    uint8_t * p_out = &p_rec[ESTC_CRYPT_RECORD_HDR_LEN];
+    uint8_t nonce[ESTC_CRYPT_NONCE_LEN];
+    uint8_t tag[ESTC_CRYPT_TAG_LEN];
+    uint8_t blocks = (p_slot->counter == counter) ? p_slot->blocks : 0;
+
+    (void)estc_le_put_u32(p_rec, p_crypt->boot_id);
+    (void)estc_le_put_u32(&p_rec[4], counter);
+    record_nonce(p_crypt->nonce_head, p_rec, nonce);
+
+    if (p_crypt->mode == ESTC_CRYPT_MODE_CCM)
+    {
+        cbc_mac(&p_crypt->key, nonce, NULL, 0, p_data, len, tag);
+    }
+
+    // The keystream computed ahead, then the rest of it now
+    uint32_t ready = (blocks > 1) ? (uint32_t)(blocks - 1) * ESTC_CRYPT_BLOCK_LEN : 0;
+    uint32_t n = (len < ready) ? len : ready;
+
+    xor_bytes(p_out, p_data, &p_slot->stream[ESTC_CRYPT_BLOCK_LEN], n);
+    if (n < len)
+    {
+        ctr_xor(&p_crypt->key, nonce, (uint16_t)(1 + n / ESTC_CRYPT_BLOCK_LEN), &p_data[n], &p_out[n], len - n);
+    }
+
+    bool precomputed = (n == len);
+    if (p_crypt->mode == ESTC_CRYPT_MODE_CCM)
+    {
+        uint8_t s0[ESTC_CRYPT_BLOCK_LEN];
+        uint8_t const * p_s0 = p_slot->stream;
+
+        if (blocks == 0)
+        {
+            keystream(&p_crypt->key, nonce, 0, 1, s0);
+            p_s0 = s0;
+            precomputed = false;
+        }
+        xor_bytes(&p_out[len], tag, p_s0, ESTC_CRYPT_TAG_LEN);
+    }
+
+    // The slot moves on to the first record the pool does not cover yet
+    CRITICAL_REGION_ENTER();
+    if (p_slot->counter == counter)
+    {
+        p_slot->counter = counter + ESTC_CRYPT_POOL_RECORDS;
+        p_slot->blocks  = 0;
+    }
+    if (precomputed)
+    {
+        p_crypt->stats.precomputed++;
+    }
+    CRITICAL_REGION_EXIT();
+
+    return (uint16_t)rec_len;
+}
+
+bool estc_crypt_open(estc_crypt_key_t const * p_key, estc_crypt_mode_t mode,
+                     uint8_t const nonce_head[ESTC_CRYPT_NONCE_HEAD_LEN], uint8_t const * p_rec, uint16_t rec_len,
+                     uint8_t * p_data, uint16_t * p_len)
+{
+    uint32_t overhead = estc_crypt_record_len(mode, 0);
+    uint8_t nonce[ESTC_CRYPT_NONCE_LEN];
+
+    if (rec_len < overhead)
+    {
+        return false;
+    }
+
+    uint16_t len = (uint16_t)(rec_len - overhead);
+    uint8_t const * p_in = &p_rec[ESTC_CRYPT_RECORD_HDR_LEN];
+
+    record_nonce(nonce_head, p_rec, nonce);
+    if (mode == ESTC_CRYPT_MODE_CCM)
+    {
+        if (!estc_crypt_ccm_decrypt(p_key, nonce, NULL, 0, p_in, len, p_data, &p_in[len]))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        ctr_xor(p_key, nonce, 1, p_in, p_data, len);
+    }
+
+    *p_len = len;
+    return true;
+}
+
+#if !defined(ESTC_CRYPT_HOST) && ESTC_PERF_ENABLED
+
+#define BENCH_BLOCKS        16
+#define BENCH_SEAL_LEN      ((ESTC_CRYPT_PRECOMPUTE_LEN < BENCH_BLOCKS * ESTC_CRYPT_BLOCK_LEN) ? \
+                             ESTC_CRYPT_PRECOMPUTE_LEN : BENCH_BLOCKS * ESTC_CRYPT_BLOCK_LEN)
+
+// Tenths of a cycle, the log has no floats
+static uint32_t per_byte_x10(uint32_t cycles, uint32_t len)
+{
+    return (uint32_t)(((uint64_t)cycles * 10 + len / 2) / len);
+}
+
+static uint32_t bench_seal(estc_crypt_t * p_crypt, estc_crypt_mode_t mode, uint8_t const * p_data, uint8_t * p_rec)
+{
+    estc_crypt_mode_t saved = p_crypt->mode;
+
+    while (estc_crypt_refill(p_crypt))
+    {
+    }
+
+    p_crypt->mode = mode;
+    uint32_t start = DWT->CYCCNT;
+    (void)estc_crypt_seal(p_crypt, p_data, BENCH_SEAL_LEN, p_rec, (uint16_t)estc_crypt_record_len(mode, BENCH_SEAL_LEN));
+    uint32_t cycles = DWT->CYCCNT - start;
+    p_crypt->mode = saved;
+
+    return per_byte_x10(cycles, BENCH_SEAL_LEN);
+}
+
+void estc_crypt_bench(estc_crypt_t * p_crypt)
+{
+    uint8_t buf[BENCH_BLOCKS * ESTC_CRYPT_BLOCK_LEN] = {0};
+    uint8_t rec[BENCH_SEAL_LEN + ESTC_CRYPT_RECORD_HDR_LEN + ESTC_CRYPT_TAG_LEN];
+    uint32_t start;
+
+    start = DWT->CYCCNT;
+    estc_crypt_ecb(&p_crypt->key, buf, buf, BENCH_BLOCKS);
+    uint32_t batched = DWT->CYCCNT - start;
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < BENCH_BLOCKS; i++)
+    {
+        estc_crypt_ecb(&p_crypt->key, &buf[i * ESTC_CRYPT_BLOCK_LEN], &buf[i * ESTC_CRYPT_BLOCK_LEN], 1);
+    }
+    uint32_t single = DWT->CYCCNT - start;
+
+    start = DWT->CYCCNT;
+    estc_crypt_ecb_soft(&p_crypt->key, buf, buf, BENCH_BLOCKS);
+    uint32_t soft = DWT->CYCCNT - start;
+
+    NRF_LOG_INFO("crypt bench, cycles/byte x10: ECB %d in batches of %d, %d one block per call, software %d",
+                 per_byte_x10(batched, sizeof(buf)), ESTC_CRYPT_BATCH_BLOCKS, per_byte_x10(single, sizeof(buf)),
+                 per_byte_x10(soft, sizeof(buf)));
+
+    // The records sealed here are thrown away, they only use up two counters
+    uint32_t ctr = bench_seal(p_crypt, ESTC_CRYPT_MODE_CTR, buf, rec);
+    uint32_t ccm = bench_seal(p_crypt, ESTC_CRYPT_MODE_CCM, buf, rec);
+    NRF_LOG_INFO("crypt bench, cycles/byte x10: sealing %d bytes from the pool, CTR %d, CCM %d",
+                 BENCH_SEAL_LEN, ctr, ccm);
+}
+
+#else
+
+void estc_crypt_bench(estc_crypt_t * p_crypt)
+{
+    (void)p_crypt;
+}
+
+#endif
@@ -0,0 +1,185 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_CRYPT_H__
+#define ESTC_CRYPT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Application-layer encryption of records with AES-128, so they stay protected past the link the gateway decrypts:
+// when they are stored or relayed onward. Records are sealed with CCM (RFC 3610, a 2 byte length field and an
+// 8 byte tag), or with its CTR part alone where something above authenticates them:
+//   boot id (4) | counter (4) | ciphertext | tag (8, CCM only)          all fields little-endian
+// The nonce is nonce head (5) | boot id (4) | counter (4). The head identifies the device to whoever holds the key,
+// the boot id has to be random per boot so the counter can start over from 0 without reusing a nonce.
+//
+// AES runs on the ECB peripheral through sd_ecb_blocks_encrypt(), ESTC_CRYPT_BATCH_BLOCKS blocks per call. The CTR
+// keystream of the next ESTC_CRYPT_POOL_RECORDS records is computed ahead by estc_crypt_refill() in idle time, so
+// sealing a record of up to ESTC_CRYPT_PRECOMPUTE_LEN bytes only XORs it, plus one block per 16 bytes for the
+// CBC-MAC in CCM mode. The CBC-MAC depends on the data and cannot be computed ahead.
+//
+// The software AES is the fallback when the SoftDevice refuses the request, and the only one in host builds
+// (ESTC_CRYPT_HOST), which only need the C library: armgcc/crypt_bench.c checks it against the FIPS-197 and
+// RFC 3610 vectors. estc_crypt_bench() times both on the device.
+//
+// estc_crypt_seal() may be called from the main loop and from one interrupt priority, estc_crypt_refill() only from
+// the main loop.
+
+#ifndef ESTC_CRYPT_HOST
+#include "sdk_config.h"
+#else
+#ifndef ESTC_CRYPT_POOL_RECORDS
+#define ESTC_CRYPT_POOL_RECORDS     4
+#endif
+#ifndef ESTC_CRYPT_PRECOMPUTE_LEN
+#define ESTC_CRYPT_PRECOMPUTE_LEN   160
+#endif
+#ifndef ESTC_CRYPT_BATCH_BLOCKS
+#define ESTC_CRYPT_BATCH_BLOCKS     8
+#endif
+#endif
+
+#if (ESTC_CRYPT_PRECOMPUTE_LEN % 16) != 0
+#error "ESTC_CRYPT_PRECOMPUTE_LEN has to be a multiple of the AES block"
+#endif
+
+#define ESTC_CRYPT_KEY_LEN          16
+#define ESTC_CRYPT_BLOCK_LEN        16
+#define ESTC_CRYPT_NONCE_LEN        13
+#define ESTC_CRYPT_NONCE_HEAD_LEN   5
+#define ESTC_CRYPT_RECORD_HDR_LEN   8
+#define ESTC_CRYPT_TAG_LEN          8
+
+// S0, which encrypts the tag, then the blocks XORed with the data
+#define ESTC_CRYPT_POOL_BLOCKS      (1 + ESTC_CRYPT_PRECOMPUTE_LEN / ESTC_CRYPT_BLOCK_LEN)
+
+typedef enum
+{
+    ESTC_CRYPT_MODE_CTR,            /**< Confidentiality only, sealing is an XOR. */
+    ESTC_CRYPT_MODE_CCM,            /**< Authenticated. */
+} estc_crypt_mode_t;
+
+typedef struct
+{
+    uint8_t key[ESTC_CRYPT_KEY_LEN];        /**< For the ECB peripheral. */
+    uint8_t round_keys[11 * ESTC_CRYPT_BLOCK_LEN];  /**< For the software AES. */
+} estc_crypt_key_t;
+
+typedef struct
+{
+    uint32_t counter;               /**< Record the keystream is for. */
+    uint8_t  blocks;                /**< Blocks computed so far. */
+    uint8_t  stream[ESTC_CRYPT_POOL_BLOCKS * ESTC_CRYPT_BLOCK_LEN];
+} estc_crypt_slot_t;
+
+typedef struct
+{
+    uint32_t sealed;
+    uint32_t precomputed;           /**< Sealed with no AES block computed for the keystream. */
+    uint32_t refill_blocks;
+} estc_crypt_stats_t;
+
+typedef struct
+{
+    estc_crypt_key_t   key;
+    estc_crypt_mode_t  mode;
+    uint8_t            nonce_head[ESTC_CRYPT_NONCE_HEAD_LEN];
+    uint32_t           boot_id;
+    uint32_t           next;        /**< Counter of the next record. */
+    estc_crypt_slot_t  pool[ESTC_CRYPT_POOL_RECORDS];
+    estc_crypt_stats_t stats;
+} estc_crypt_t;
+
+/**@brief Expand a key for both AES paths. */
+void estc_crypt_key_init(estc_crypt_key_t * p_key, uint8_t const key[ESTC_CRYPT_KEY_LEN]);
+
+/**@brief Encrypt @p count blocks, batched through the ECB peripheral. @p p_in and @p p_out may be the same. */
+void estc_crypt_ecb(estc_crypt_key_t const * p_key, uint8_t const * p_in, uint8_t * p_out, uint32_t count);
+
+/**@brief Encrypt @p count blocks with the software AES. */
+void estc_crypt_ecb_soft(estc_crypt_key_t const * p_key, uint8_t const * p_in, uint8_t * p_out, uint32_t count);
+
+/**@brief CCM encryption with associated data, an 8 byte tag and a 2 byte length field.
+ *
+ * @param[out] p_out  Ciphertext, @p len bytes, may be @p p_in.
+ * @param[out] p_tag  ESTC_CRYPT_TAG_LEN bytes.
+ */
+void estc_crypt_ccm_encrypt(estc_crypt_key_t const * p_key, uint8_t const nonce[ESTC_CRYPT_NONCE_LEN],
+                            uint8_t const * p_aad, uint16_t aad_len, uint8_t const * p_in, uint16_t len,
+                            uint8_t * p_out, uint8_t * p_tag);
+
+/**@brief CCM decryption, see estc_crypt_ccm_encrypt().
+ *
+ * @return false if the tag does not match. @p p_out is cleared then.
+ */
+bool estc_crypt_ccm_decrypt(estc_crypt_key_t const * p_key, uint8_t const nonce[ESTC_CRYPT_NONCE_LEN],
+                            uint8_t const * p_aad, uint16_t aad_len, uint8_t const * p_in, uint16_t len,
+                            uint8_t * p_out, uint8_t const * p_tag);
+
+void estc_crypt_init(estc_crypt_t * p_crypt, estc_crypt_mode_t mode, uint8_t const key[ESTC_CRYPT_KEY_LEN],
+                     uint8_t const nonce_head[ESTC_CRYPT_NONCE_HEAD_LEN], uint32_t boot_id);
+
+/**@brief Compute one batch of the keystream of the next records.
+ *
+ * @return false if the pool is full and nothing was computed.
+ */
+bool estc_crypt_refill(estc_crypt_t * p_crypt);
+
+/**@brief Length of the sealed record of @p len bytes of data. */
+static inline uint32_t estc_crypt_record_len(estc_crypt_mode_t mode, uint16_t len)
+{
+    return ESTC_CRYPT_RECORD_HDR_LEN + (uint32_t)len + ((mode == ESTC_CRYPT_MODE_CCM) ? ESTC_CRYPT_TAG_LEN : 0);
+}
+
+/**@brief Seal @p len bytes of data into a record.
+ *
+ * @return Record length, 0 if it does not fit into @p rec_size.
+ */
+uint16_t estc_crypt_seal(estc_crypt_t * p_crypt, uint8_t const * p_data, uint16_t len, uint8_t * p_rec,
+                         uint16_t rec_size);
+
+/**@brief Open a record, on the side that holds the key.
+ *
+ * @param[out] p_data  estc_crypt_record_len() less the overhead, may be the ciphertext in @p p_rec.
+ * @param[out] p_len   Data length.
+ *
+ * @return false if the record is too short or, in CCM mode, does not authenticate.
+ */
+bool estc_crypt_open(estc_crypt_key_t const * p_key, estc_crypt_mode_t mode,
+                     uint8_t const nonce_head[ESTC_CRYPT_NONCE_HEAD_LEN], uint8_t const * p_rec, uint16_t rec_len,
+                     uint8_t * p_data, uint16_t * p_len);
+
+/**@brief Log the cycles per byte of the ECB peripheral in batches and one block per call, of the software AES, and
+ *        of sealing a record from the pool. Seals records of @p p_crypt. Does nothing without ESTC_PERF_ENABLED.
+ */
+void estc_crypt_bench(estc_crypt_t * p_crypt);
+
+#endif /* ESTC_CRYPT_H__ */
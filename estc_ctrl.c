@@ -0,0 +1,362 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_ctrl.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "sdk_common.h"
+#include "ble_conn_params.h"
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+
+#include "estc_telemetry.h"
+#include "estc_usb_bridge.h"
+#include "estc_adv.h"
+#include "estc_le.h"
+
+#define RSP_HDR_LEN         3           /**< Opcode, length and status. */
+#define VALUE_LEN_MAX       8           /**< Longest setting, the connection parameters. */
+
+#define LOG_BACKEND_ID      0           /**< log_init() adds the USB backend only, it gets the first id. */
+
+#define SAMPLE_PERIOD_MIN_MS    10
+#define SAMPLE_PERIOD_MAX_MS    3600000
+
+typedef estc_ctrl_status_t (*ctrl_set_t)(uint16_t conn_handle, uint8_t const * p_value);
+typedef uint8_t            (*ctrl_get_t)(uint8_t * p_value);
+
+/**@brief Dispatch table entry. The table is const and stays in flash. */
+typedef struct
+{
+    uint8_t     op;
+    uint8_t     len;                    /**< Exact request value length. */
+    ctrl_set_t  set;
+    ctrl_get_t  get;
+} ctrl_cmd_t;
+
+static ble_gap_conn_params_t m_conn_params;
+static ble_gap_phys_t        m_phys;
+static uint8_t               m_log_level;
+
+static void log_level_apply(uint8_t level)
+{
+#if NRF_LOG_FILTERS_ENABLED
+    for (uint32_t module = 0; module < nrf_log_module_cnt_get(); module++)
+    {
+        nrf_log_module_filter_set(LOG_BACKEND_ID, module, (nrf_log_severity_t)level);
+    }
+#endif
+}
+
+static estc_ctrl_status_t sample_period_set(uint16_t conn_handle, uint8_t const * p_value)
+{
+    uint32_t period_ms = estc_le_u32(p_value);
+    if ((period_ms < SAMPLE_PERIOD_MIN_MS) || (period_ms > SAMPLE_PERIOD_MAX_MS))
+    {
+        return ESTC_CTRL_STATUS_INVALID_VALUE;
+    }
+
+    return (estc_telemetry_period_set(period_ms) == NRF_SUCCESS) ? ESTC_CTRL_STATUS_SUCCESS : ESTC_CTRL_STATUS_FAILED;
+}
+
+static uint8_t sample_period_get(uint8_t * p_value)
+{
+    uint32_t period_ms = estc_telemetry_period_get();
+
+    (void)estc_le_put_u32(p_value, period_ms);
+    return sizeof(uint32_t);
+}
+
+static estc_ctrl_status_t batch_set(uint16_t conn_handle, uint8_t const * p_value)
+{
+    // The frame has to fit into a notification at the largest MTU and into a bridge record, as checked at build time
+    uint16_t frame_len = ESTC_TELEMETRY_FRAME_LEN(ESTC_TELEMETRY_LAYOUT, p_value[0]);
+    if ((frame_len > NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3) || (frame_len > ESTC_USB_BRIDGE_PAYLOAD_MAX))
+    {
+        return ESTC_CTRL_STATUS_INVALID_VALUE;
+    }
+
+    return (estc_telemetry_batch_set(p_value[0]) == NRF_SUCCESS) ? ESTC_CTRL_STATUS_SUCCESS
+                                                                 : ESTC_CTRL_STATUS_INVALID_VALUE;
+}
+
+static uint8_t batch_get(uint8_t * p_value)
+{
+    p_value[0] = estc_telemetry_batch_get();
+    return sizeof(uint8_t);
+}
+
+static estc_ctrl_status_t conn_params_set(uint16_t conn_handle, uint8_t const * p_value)
+{
+    ble_gap_conn_params_t params;
+
+    p_value = estc_le_get_u16(p_value, &params.min_conn_interval);
+    p_value = estc_le_get_u16(p_value, &params.max_conn_interval);
+    p_value = estc_le_get_u16(p_value, &params.slave_latency);
+    p_value = estc_le_get_u16(p_value, &params.conn_sup_timeout);
+
+    // Same rules as the build time checks in main.c
+    if ((params.min_conn_interval < BLE_GAP_CP_MIN_CONN_INTVL_MIN) ||
+        (params.min_conn_interval > params.max_conn_interval) ||
+        (params.max_conn_interval > BLE_GAP_CP_MAX_CONN_INTVL_MAX) ||
+        (params.slave_latency > BLE_GAP_CP_SLAVE_LATENCY_MAX) ||
+        (params.conn_sup_timeout < BLE_GAP_CP_CONN_SUP_TIMEOUT_MIN) ||
+        (params.conn_sup_timeout > BLE_GAP_CP_CONN_SUP_TIMEOUT_MAX) ||
+        ((uint32_t)params.conn_sup_timeout * 10 <= (1UL + params.slave_latency) * params.max_conn_interval * 5 / 4 * 2))
+    {
+        return ESTC_CTRL_STATUS_INVALID_VALUE;
+    }
+
+    // The connection parameters module keeps the new targets and negotiates them with the central
+    if (conn_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return ESTC_CTRL_STATUS_INVALID_STATE;
+    }
+    if (ble_conn_params_change_conn_params(conn_handle, &params) != NRF_SUCCESS)
+    {
+        return ESTC_CTRL_STATUS_FAILED;
+    }
+
+    m_conn_params = params;
+    return ESTC_CTRL_STATUS_SUCCESS;
+}
+
+static uint8_t conn_params_get(uint8_t * p_value)
+{
+    p_value = estc_le_put_u16(p_value, m_conn_params.min_conn_interval);
+    p_value = estc_le_put_u16(p_value, m_conn_params.max_conn_interval);
+    p_value = estc_le_put_u16(p_value, m_conn_params.slave_latency);
+    p_value = estc_le_put_u16(p_value, m_conn_params.conn_sup_timeout);
+    return 4 * sizeof(uint16_t);
+}
+
+static estc_ctrl_status_t phy_set(uint16_t conn_handle, uint8_t const * p_value)
+{
+    uint8_t const         valid = BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_CODED;
+    ble_gap_phys_t const  phys  = { .tx_phys = p_value[0], .rx_phys = p_value[1] };
+
+    if ((phys.tx_phys & ~valid) || (phys.rx_phys & ~valid))
+    {
+        return ESTC_CTRL_STATUS_INVALID_VALUE;
+    }
+
+    // Without a connection only the preference changes, it applies to the next PHY update request
+    if ((conn_handle != BLE_CONN_HANDLE_INVALID) && (sd_ble_gap_phy_update(conn_handle, &phys) != NRF_SUCCESS))
+    {
+        return ESTC_CTRL_STATUS_FAILED;
+    }
+
+    m_phys = phys;
+    return ESTC_CTRL_STATUS_SUCCESS;
+}
+
+static uint8_t phy_get(uint8_t * p_value)
+{
+    p_value[0] = m_phys.tx_phys;
+    p_value[1] = m_phys.rx_phys;
+    return 2 * sizeof(uint8_t);
+}
+
+static estc_ctrl_status_t log_level_set(uint16_t conn_handle, uint8_t const * p_value)
+{
+#if NRF_LOG_FILTERS_ENABLED
+    if (p_value[0] > NRF_LOG_SEVERITY_DEBUG)
+    {
+        return ESTC_CTRL_STATUS_INVALID_VALUE;
+    }
+
+    m_log_level = p_value[0];
+    log_level_apply(m_log_level);
+    return ESTC_CTRL_STATUS_SUCCESS;
+#else
+    return ESTC_CTRL_STATUS_FAILED;
+#endif
+}
+
+static uint8_t log_level_get(uint8_t * p_value)
+{
+    p_value[0] = m_log_level;
+    return sizeof(uint8_t);
+}
+
+static estc_ctrl_status_t adv_profile_set(uint16_t conn_handle, uint8_t const * p_value)
+{
+    if (p_value[0] >= ESTC_ADV_PROFILE_COUNT)
+    {
+        return ESTC_CTRL_STATUS_INVALID_VALUE;
+    }
+
+    // The link keeps the advertising set stopped, the profile starts when it goes. A broadcast profile takes the
+    // gateway off the air until the button brings back a connectable one.
+    ret_code_t err_code = estc_adv_profile_set((estc_adv_profile_id_t)p_value[0]);
+    return (err_code == NRF_SUCCESS) ? ESTC_CTRL_STATUS_SUCCESS : ESTC_CTRL_STATUS_FAILED;
+}
+
+static uint8_t adv_profile_get(uint8_t * p_value)
+{
+    p_value[0] = (uint8_t)estc_adv_profile_get();
+    return sizeof(uint8_t);
+}
+
+static const ctrl_cmd_t m_cmds[] =
+{
+    { ESTC_CTRL_OP_SAMPLE_PERIOD, sizeof(uint32_t),     sample_period_set, sample_period_get },
+    { ESTC_CTRL_OP_BATCH,         sizeof(uint8_t),      batch_set,         batch_get         },
+    { ESTC_CTRL_OP_CONN_PARAMS,   4 * sizeof(uint16_t), conn_params_set,   conn_params_get   },
+    { ESTC_CTRL_OP_PHY,           2 * sizeof(uint8_t),  phy_set,           phy_get           },
+    { ESTC_CTRL_OP_LOG_LEVEL,     sizeof(uint8_t),      log_level_set,     log_level_get     },
+    { ESTC_CTRL_OP_ADV_PROFILE,   sizeof(uint8_t),      adv_profile_set,   adv_profile_get   },
+};
+
+// A read answers with every setting in one response
+STATIC_ASSERT(ARRAY_SIZE(m_cmds) * (RSP_HDR_LEN + VALUE_LEN_MAX) <= ESTC_CTRL_RSP_LEN_MAX);
+
+static ctrl_cmd_t const * cmd_find(uint8_t op)
+{
+    for (uint8_t i = 0; i < ARRAY_SIZE(m_cmds); i++)
+    {
+        if (m_cmds[i].op == op)
+        {
+            return &m_cmds[i];
+        }
+    }
+    return NULL;
+}
+
+/**@brief Append one response entry, with the current value of @p p_cmd on success. */
+static uint8_t * rsp_put(uint8_t * p_rsp, uint8_t op, estc_ctrl_status_t status, ctrl_cmd_t const * p_cmd)
+{
+    uint8_t value_len = 0;
+
+    if ((status == ESTC_CTRL_STATUS_SUCCESS) && (p_cmd != NULL))
+    {
+        value_len = p_cmd->get(&p_rsp[RSP_HDR_LEN]);
+    }
+
+    p_rsp[0] = op | ESTC_CTRL_RSP_FLAG;
+    p_rsp[1] = 1 + value_len;
+    p_rsp[2] = (uint8_t)status;
+
+    return p_rsp + RSP_HDR_LEN + value_len;
+}
+
+ret_code_t estc_ctrl_init(estc_ctrl_init_t const * p_init)
+{
+    VERIFY_PARAM_NOT_NULL(p_init);
+
+    m_conn_params = p_init->conn_params;
+    m_phys        = p_init->phys;
+    m_log_level   = p_init->log_level;
+    log_level_apply(m_log_level);
+
+    return NRF_SUCCESS;
+}
+
+uint16_t estc_ctrl_request(uint16_t conn_handle, uint8_t const * p_req, uint16_t len, uint8_t * p_rsp)
+{
+    uint8_t       * p     = p_rsp;
+    uint8_t const * p_end = p_rsp + ESTC_CTRL_RSP_LEN_MAX;
+    uint16_t        pos   = 0;
+
+    while (pos < len)
+    {
+        uint8_t op = p_req[pos];
+
+        if (op == ESTC_CTRL_OP_READ)
+        {
+            if (p_end - p < (ptrdiff_t)(ARRAY_SIZE(m_cmds) * (RSP_HDR_LEN + VALUE_LEN_MAX)))
+            {
+                break;
+            }
+        }
+        else if (p_end - p < RSP_HDR_LEN + VALUE_LEN_MAX)
+        {
+            break;
+        }
+
+        if ((len - pos < 2) || (p_req[pos + 1] > len - pos - 2))
+        {
+            // Truncated request, nothing after it can be parsed
+            p = rsp_put(p, op, ESTC_CTRL_STATUS_INVALID_LEN, NULL);
+            break;
+        }
+
+        uint8_t         value_len = p_req[pos + 1];
+        uint8_t const * p_value   = &p_req[pos + 2];
+
+        pos += 2 + value_len;
+
+        if (op == ESTC_CTRL_OP_READ)
+        {
+            p += estc_ctrl_settings_get(p);
+            continue;
+        }
+
+        ctrl_cmd_t const * p_cmd = cmd_find(op);
+        estc_ctrl_status_t status;
+
+        if (p_cmd == NULL)
+        {
+            status = ESTC_CTRL_STATUS_UNKNOWN_OP;
+        }
+        else if (value_len != p_cmd->len)
+        {
+            status = ESTC_CTRL_STATUS_INVALID_LEN;
+        }
+        else
+        {
+            status = p_cmd->set(conn_handle, p_value);
+        }
+
+        NRF_LOG_INFO("Control point: op 0x%02x status %d", op, status);
+        p = rsp_put(p, op, status, p_cmd);
+    }
+
+    return (uint16_t)(p - p_rsp);
+}
+
+uint16_t estc_ctrl_settings_get(uint8_t * p_rsp)
+{
+    uint8_t * p = p_rsp;
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(m_cmds); i++)
+    {
+        p = rsp_put(p, m_cmds[i].op, ESTC_CTRL_STATUS_SUCCESS, &m_cmds[i]);
+    }
+
+    return (uint16_t)(p - p_rsp);
+}
+
+void estc_ctrl_phy_pref_get(ble_gap_phys_t * p_phys)
+{
+    *p_phys = m_phys;
+}
@@ -0,0 +1,101 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_CTRL_H__
+#define ESTC_CTRL_H__
+
+#include <stdint.h>
+
+#include "ble_gap.h"
+#include "sdk_errors.h"
+
+// Control point protocol. A write carries one or more requests, all fields little-endian:
+//   opcode (1) | len (1) | value (len)
+// The response goes out as a notification of the control point and stays readable as its value. It has one entry
+// per request, in request order:
+//   opcode | 0x80 (1) | len (1) | status (1) | value (len - 1)
+// On success the value is the setting now in effect, encoded like the request. ESTC_CTRL_OP_READ answers with one
+// entry per setting. Requests whose responses would not fit into ESTC_CTRL_RSP_LEN_MAX are not processed.
+
+#define ESTC_CTRL_RSP_FLAG              0x80
+#define ESTC_CTRL_RSP_LEN_MAX           72
+#define ESTC_CTRL_REQ_LEN_MAX           64
+
+typedef enum
+{
+    ESTC_CTRL_OP_READ           = 0x00,     /**< No value. Reads every setting. */
+    ESTC_CTRL_OP_SAMPLE_PERIOD  = 0x01,     /**< uint32 telemetry sample period in ms. */
+    ESTC_CTRL_OP_BATCH          = 0x02,     /**< uint8 telemetry samples per frame. */
+    ESTC_CTRL_OP_CONN_PARAMS    = 0x03,     /**< uint16 min and max interval, latency, supervision timeout. */
+    ESTC_CTRL_OP_PHY            = 0x04,     /**< uint8 tx and rx BLE_GAP_PHY_* masks, 0 for automatic. */
+    ESTC_CTRL_OP_LOG_LEVEL      = 0x05,     /**< uint8 nrf_log severity, 0 (off) to 4 (debug). */
+    ESTC_CTRL_OP_ADV_PROFILE    = 0x06,     /**< uint8 estc_adv_profile_id_t, advertised once the link is gone. */
+} estc_ctrl_op_t;
+
+typedef enum
+{
+    ESTC_CTRL_STATUS_SUCCESS,
+    ESTC_CTRL_STATUS_UNKNOWN_OP,
+    ESTC_CTRL_STATUS_INVALID_LEN,
+    ESTC_CTRL_STATUS_INVALID_VALUE,
+    ESTC_CTRL_STATUS_INVALID_STATE,         /**< The setting needs a connection. */
+    ESTC_CTRL_STATUS_FAILED,                /**< Valid, but the SoftDevice or the module refused it. */
+} estc_ctrl_status_t;
+
+typedef struct
+{
+    ble_gap_conn_params_t conn_params;      /**< Targets the connection parameters module starts from. */
+    ble_gap_phys_t        phys;             /**< Preferred PHYs, answered on peer PHY update requests. */
+    uint8_t               log_level;
+} estc_ctrl_init_t;
+
+ret_code_t estc_ctrl_init(estc_ctrl_init_t const * p_init);
+
+/**@brief Process the requests of one control point write.
+ *
+ * @param[in]  conn_handle  Connection the write came from.
+ * @param[out] p_rsp        Response, at least ESTC_CTRL_RSP_LEN_MAX bytes.
+ *
+ * @return Response length.
+ */
+uint16_t estc_ctrl_request(uint16_t conn_handle, uint8_t const * p_req, uint16_t len, uint8_t * p_rsp);
+
+/**@brief Encode every setting as the response to ESTC_CTRL_OP_READ would.
+ *
+ * @param[out] p_rsp  At least ESTC_CTRL_RSP_LEN_MAX bytes.
+ *
+ * @return Encoded length.
+ */
+uint16_t estc_ctrl_settings_get(uint8_t * p_rsp);
+
+/**@brief PHYs to answer a peer PHY update request with. */
+void estc_ctrl_phy_pref_get(ble_gap_phys_t * p_phys);
+
+#endif /* ESTC_CTRL_H__ */
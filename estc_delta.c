@@ -0,0 +1,317 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_delta.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "estc_le.h"
+
+#define ARG_BITS        5
+#define ARG_MASK        ((1 << ARG_BITS) - 1)
+#define EXT_FLAG        (1 << ARG_BITS)
+#define LEB128_MORE     0x80
+
+typedef enum
+{
+    STATE_HEADER,
+    STATE_OP,
+    STATE_ARG,                  /**< LEB128 continuation of the argument. */
+    STATE_COPY,
+    STATE_ADD,
+    STATE_INSERT,
+    STATE_DONE,
+    STATE_ERR_FORMAT,
+    STATE_ERR_BOUNDS,
+} delta_state_t;
+
+static estc_delta_status_t fail(estc_delta_t * p_delta, estc_delta_status_t status)
+{
+    // Sticky, a broken patch cannot be resynchronized
+    p_delta->state = (status == ESTC_DELTA_STATUS_ERR_BOUNDS) ? STATE_ERR_BOUNDS : STATE_ERR_FORMAT;
+    return status;
+}
+
+static estc_delta_status_t header_parse(estc_delta_t * p_delta)
+{
+    uint8_t const * p = p_delta->hdr;
+    uint32_t        magic;
+
+    p = estc_le_get_u32(p, &magic);
+    if ((magic != ESTC_DELTA_MAGIC) || (*p != ESTC_DELTA_VERSION))
+    {
+        return fail(p_delta, ESTC_DELTA_STATUS_ERR_FORMAT);
+    }
+    p += sizeof(uint32_t);  // Version and reserved
+
+    p = estc_le_get_u32(p, &p_delta->header.old_size);
+    p = estc_le_get_u32(p, &p_delta->header.old_crc);
+    p = estc_le_get_u32(p, &p_delta->header.new_size);
+    (void)estc_le_get_u32(p, &p_delta->header.new_crc);
+
+    if (p_delta->header.new_size == 0)
+    {
+        return fail(p_delta, ESTC_DELTA_STATUS_ERR_FORMAT);
+    }
+
+    // Commands may only read what the old image checksum covers
+    if (p_delta->header.old_size > p_delta->old_len)
+    {
+        return fail(p_delta, ESTC_DELTA_STATUS_ERR_BOUNDS);
+    }
+    p_delta->old_len = p_delta->header.old_size;
+    p_delta->state   = STATE_OP;
+
+    return ESTC_DELTA_STATUS_HEADER;
+}
+
+static void command_done(estc_delta_t * p_delta)
+{
+    p_delta->state = (p_delta->out_pos == p_delta->header.new_size) ? STATE_DONE : STATE_OP;
+}
+
+static estc_delta_status_t command_start(estc_delta_t * p_delta)
+{
+    uint32_t arg      = p_delta->arg;
+    uint32_t out_left = p_delta->header.new_size - p_delta->out_pos;
+
+    switch (p_delta->op)
+    {
+        case ESTC_DELTA_OP_COPY:
+        case ESTC_DELTA_OP_ADD:
+            if ((arg > out_left) || (arg > p_delta->old_len - p_delta->old_pos))
+            {
+                return fail(p_delta, ESTC_DELTA_STATUS_ERR_BOUNDS);
+            }
+            p_delta->state = (p_delta->op == ESTC_DELTA_OP_COPY) ? STATE_COPY : STATE_ADD;
+            break;
+
+        case ESTC_DELTA_OP_INSERT:
+            if (arg > out_left)
+            {
+                return fail(p_delta, ESTC_DELTA_STATUS_ERR_BOUNDS);
+            }
+            p_delta->state = STATE_INSERT;
+            break;
+
+        default:
+        {
+            int64_t offset = (arg & 1) ? -(int64_t)(arg >> 1) - 1 : (int64_t)(arg >> 1);
+            int64_t pos    = (int64_t)p_delta->old_pos + offset;
+
+            if ((pos < 0) || (pos > p_delta->old_len))
+            {
+                return fail(p_delta, ESTC_DELTA_STATUS_ERR_BOUNDS);
+            }
+            p_delta->old_pos = (uint32_t)pos;
+            p_delta->state   = STATE_OP;
+        } break;
+    }
+
+    p_delta->remaining = arg;
+    return ESTC_DELTA_STATUS_NEED_INPUT;
+}
+
+/**@brief Feed one command byte. */
+static estc_delta_status_t command_parse(estc_delta_t * p_delta, uint8_t byte)
+{
+    if (p_delta->state == STATE_OP)
+    {
+        p_delta->op        = byte >> 6;
+        p_delta->arg       = byte & ARG_MASK;
+        p_delta->arg_shift = ARG_BITS;
+
+        if (byte & EXT_FLAG)
+        {
+            p_delta->state = STATE_ARG;
+            return ESTC_DELTA_STATUS_NEED_INPUT;
+        }
+        return command_start(p_delta);
+    }
+
+    uint32_t bits = byte & ~LEB128_MORE;
+    uint8_t  room = 32 - p_delta->arg_shift;
+
+    // The argument has to fit into 32 bits
+    if ((p_delta->arg_shift >= 32) || ((room < 7) && ((bits >> room) != 0)))
+    {
+        return fail(p_delta, ESTC_DELTA_STATUS_ERR_FORMAT);
+    }
+
+    p_delta->arg       |= bits << p_delta->arg_shift;
+    p_delta->arg_shift += 7;
+
+    return (byte & LEB128_MORE) ? ESTC_DELTA_STATUS_NEED_INPUT : command_start(p_delta);
+}
+
+void estc_delta_init(estc_delta_t * p_delta, uint8_t const * p_old, uint32_t old_len)
+{
+    memset(p_delta, 0, sizeof(*p_delta));
+
+    p_delta->p_old     = p_old;
+    p_delta->old_len   = old_len;
+    p_delta->remaining = ESTC_DELTA_HEADER_LEN;
+    p_delta->state     = STATE_HEADER;
+}
+
+estc_delta_status_t estc_delta_apply(estc_delta_t * p_delta,
+                                     uint8_t const * p_in, uint32_t * p_in_len,
+                                     uint8_t * p_out, uint32_t * p_out_len)
+{
+    estc_delta_status_t status   = ESTC_DELTA_STATUS_NEED_INPUT;
+    uint32_t            in_used  = 0;
+    uint32_t            out_used = 0;
+    bool                running  = true;
+
+    while (running)
+    {
+        uint32_t in_avail  = *p_in_len - in_used;
+        uint32_t out_avail = *p_out_len - out_used;
+        uint32_t n;
+
+        switch (p_delta->state)
+        {
+            case STATE_HEADER:
+                if (in_avail == 0)
+                {
+                    status  = ESTC_DELTA_STATUS_NEED_INPUT;
+                    running = false;
+                    break;
+                }
+
+                n = (in_avail < p_delta->remaining) ? in_avail : p_delta->remaining;
+                memcpy(&p_delta->hdr[ESTC_DELTA_HEADER_LEN - p_delta->remaining], &p_in[in_used], n);
+                in_used            += n;
+                p_delta->remaining -= n;
+
+                if (p_delta->remaining == 0)
+                {
+                    status  = header_parse(p_delta);
+                    running = false;
+                }
+                break;
+
+            case STATE_OP:
+            case STATE_ARG:
+                if (in_avail == 0)
+                {
+                    status  = ESTC_DELTA_STATUS_NEED_INPUT;
+                    running = false;
+                    break;
+                }
+
+                status = command_parse(p_delta, p_in[in_used++]);
+                if (status != ESTC_DELTA_STATUS_NEED_INPUT)
+                {
+                    running = false;
+                }
+                break;
+
+            case STATE_COPY:
+            case STATE_ADD:
+            case STATE_INSERT:
+                if (p_delta->remaining == 0)
+                {
+                    command_done(p_delta);
+                    break;
+                }
+
+                if (out_avail == 0)
+                {
+                    status  = ESTC_DELTA_STATUS_OUTPUT_FULL;
+                    running = false;
+                    break;
+                }
+
+                n = (out_avail < p_delta->remaining) ? out_avail : p_delta->remaining;
+                if (p_delta->state != STATE_COPY)
+                {
+                    if (in_avail == 0)
+                    {
+                        status  = ESTC_DELTA_STATUS_NEED_INPUT;
+                        running = false;
+                        break;
+                    }
+                    n = (in_avail < n) ? in_avail : n;
+                }
+
+                if (p_delta->state == STATE_COPY)
+                {
+                    memcpy(&p_out[out_used], &p_delta->p_old[p_delta->old_pos], n);
+                }
+                else if (p_delta->state == STATE_ADD)
+                {
+                    uint8_t const * p_old = &p_delta->p_old[p_delta->old_pos];
+
+                    for (uint32_t i = 0; i < n; i++)
+                    {
+                        p_out[out_used + i] = (uint8_t)(p_old[i] + p_in[in_used + i]);
+                    }
+                }
+                else
+                {
+                    memcpy(&p_out[out_used], &p_in[in_used], n);
+                }
+
+                if (p_delta->state != STATE_INSERT)
+                {
+                    p_delta->old_pos += n;
+                }
+                if (p_delta->state != STATE_COPY)
+                {
+                    in_used += n;
+                }
+                out_used           += n;
+                p_delta->out_pos   += n;
+                p_delta->remaining -= n;
+                break;
+
+            case STATE_DONE:
+                status  = ESTC_DELTA_STATUS_DONE;
+                running = false;
+                break;
+
+            case STATE_ERR_BOUNDS:
+                status  = ESTC_DELTA_STATUS_ERR_BOUNDS;
+                running = false;
+                break;
+
+            default:
+                status  = ESTC_DELTA_STATUS_ERR_FORMAT;
+                running = false;
+                break;
+        }
+    }
+
+    *p_in_len  = in_used;
+    *p_out_len = out_used;
+    return status;
+}
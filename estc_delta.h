@@ -0,0 +1,116 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_DELTA_H__
+#define ESTC_DELTA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Streaming applier of delta patches made by armgcc/delta_patch.py. The new image is rebuilt from the old one,
+// read in place, and the patch, which may arrive in pieces of any size. Output is produced into caller buffers of
+// any size, so the RAM needed does not depend on the image or patch size.
+//
+// Patch layout, all fields little-endian:
+//   magic (4) | version (1) | reserved (3) | old size (4) | old crc32 (4) | new size (4) | new crc32 (4)
+//   commands, until new size bytes are produced: op (2 bits) | ext (1 bit) | arg (5 bits) [| arg >> 5, LEB128 if ext]
+//     ESTC_DELTA_OP_COPY     arg bytes of the old image, unchanged
+//     ESTC_DELTA_OP_ADD      arg bytes of the old image, each plus the next patch byte modulo 256
+//     ESTC_DELTA_OP_INSERT   the next arg patch bytes
+//     ESTC_DELTA_OP_SEEK     move the old image cursor by arg, zigzag encoded
+// COPY and ADD advance the old image cursor, INSERT does not. ADD covers code that only moved: the branch offsets and
+// addresses in it change by small amounts, so the difference is mostly zeros. The encoder turns runs of zeros into
+// COPY rather than sending them. The checksums are CRC-32, see estc_crc.h.
+//
+// Like the telemetry frame this only depends on the C library and builds on a host as is.
+
+#define ESTC_DELTA_MAGIC            0x544C4445  /**< "EDLT". */
+#define ESTC_DELTA_VERSION          1
+#define ESTC_DELTA_HEADER_LEN       24
+
+#define ESTC_DELTA_OP_COPY          0
+#define ESTC_DELTA_OP_ADD           1
+#define ESTC_DELTA_OP_INSERT        2
+#define ESTC_DELTA_OP_SEEK          3
+
+typedef enum
+{
+    ESTC_DELTA_STATUS_NEED_INPUT,   /**< All input consumed. */
+    ESTC_DELTA_STATUS_OUTPUT_FULL,  /**< The output buffer is full, call again with a new one. */
+    ESTC_DELTA_STATUS_HEADER,       /**< The header has just been parsed and can be checked, call again to continue. */
+    ESTC_DELTA_STATUS_DONE,         /**< The whole new image was produced. Input after that is left unconsumed. */
+    ESTC_DELTA_STATUS_ERR_FORMAT,   /**< Bad magic, version or command encoding. */
+    ESTC_DELTA_STATUS_ERR_BOUNDS,   /**< A command reads outside the old image or writes past the new one. */
+} estc_delta_status_t;
+
+typedef struct
+{
+    uint32_t old_size;
+    uint32_t old_crc;
+    uint32_t new_size;
+    uint32_t new_crc;
+} estc_delta_header_t;
+
+typedef struct
+{
+    estc_delta_header_t header;     /**< Valid once ESTC_DELTA_STATUS_HEADER was returned. */
+    uint32_t            out_pos;    /**< Bytes of the new image produced so far. */
+
+    // Private
+    uint8_t const     * p_old;
+    uint32_t            old_len;
+    uint32_t            old_pos;
+    uint32_t            remaining;  /**< Of the current command, or header bytes still expected. */
+    uint32_t            arg;
+    uint8_t             arg_shift;
+    uint8_t             op;
+    uint8_t             state;
+    uint8_t             hdr[ESTC_DELTA_HEADER_LEN];
+} estc_delta_t;
+
+/**@brief Start applying a patch.
+ *
+ * @param[in] p_old    Old image the patch was made against. Has to stay readable until the patch is applied.
+ * @param[in] old_len  Bytes readable at @p p_old. The old image size in the header may not exceed it.
+ */
+void estc_delta_init(estc_delta_t * p_delta, uint8_t const * p_old, uint32_t old_len);
+
+/**@brief Consume patch bytes and produce new image bytes, until either buffer runs out.
+ *
+ * @param[in]     p_in       Patch bytes.
+ * @param[in,out] p_in_len   Bytes available at @p p_in, on return the bytes consumed.
+ * @param[out]    p_out      Output buffer.
+ * @param[in,out] p_out_len  Room at @p p_out, on return the bytes produced.
+ */
+estc_delta_status_t estc_delta_apply(estc_delta_t * p_delta,
+                                     uint8_t const * p_in, uint32_t * p_in_len,
+                                     uint8_t * p_out, uint32_t * p_out_len);
+
+#endif /* ESTC_DELTA_H__ */
@@ -0,0 +1,772 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_dfu.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdk_common.h"
+#include "app_util.h"
+#include "app_error.h"
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+#include "nrf_sdh_ble.h"
+#include "nrf_soc.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+#include "nrf_dfu_settings.h"
+#include "nrf_dfu_types.h"
+
+#include "ble.h"
+#include "ble_gatts.h"
+#include "ble_srv_common.h"
+
+#include "estc_crc.h"
+#include "estc_delta.h"
+#include "estc_service.h"
+#include "estc_metrics.h"
+#include "estc_time.h"
+#include "estc_timer_wheel.h"
+#include "estc_le.h"
+
+#if ESTC_DFU_ENABLED
+
+#define RSP_LEN             6
+#define PROGRESS_LEN        14
+#define REQ_LEN_MAX         9           /**< ESTC_DFU_OP_IMAGE. */
+#define WINDOW              (2 * ESTC_DFU_BUF_SIZE)
+#define RESET_DELAY_MS      500         /**< Lets the activation response go out. */
+#define APP_START           0x27000     /**< End of the S140 7.2 SoftDevice, origin of FLASH in estc_memory.ld.in. */
+
+// A block never spans a page, so the page is erased right before its first block is written
+STATIC_ASSERT((CODE_PAGE_SIZE % ESTC_DFU_BUF_SIZE) == 0);
+STATIC_ASSERT((ESTC_DFU_BUF_SIZE % sizeof(uint32_t)) == 0);
+STATIC_ASSERT(((ESTC_DFU_BANK_START % CODE_PAGE_SIZE) == 0) && ((ESTC_DFU_BANK_END % CODE_PAGE_SIZE) == 0));
+STATIC_ASSERT(ESTC_DFU_BANK_START < ESTC_DFU_BANK_END);
+// Every application the linker accepts has to fit into the bank
+STATIC_ASSERT(ESTC_DFU_BANK_END - ESTC_DFU_BANK_START >= ESTC_DFU_BANK_START - APP_START);
+
+typedef enum
+{
+    STATE_IDLE,
+    STATE_INIT,                 /**< Receiving the init packet. */
+    STATE_IMAGE,                /**< Receiving the image. */
+    STATE_DELTA,                /**< Receiving a patch and rebuilding the image from it. */
+} dfu_state_t;
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t * p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_fs) =
+{
+    .evt_handler = fstorage_evt_handler,
+    .start_addr  = ESTC_DFU_BANK_START,
+    .end_addr    = ESTC_DFU_BANK_END - 1,
+};
+
+static ble_uuid128_t            m_base_uuid = { .uuid128 = ESTC_BASE_UUID };
+static uint16_t                 m_service_handle;
+static ble_gatts_char_handles_t m_ctrl_point;
+static ble_gatts_char_handles_t m_data;
+static uint8_t                  m_data_value[NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3];
+static uint16_t                 m_conn_handle = BLE_CONN_HANDLE_INVALID;
+static estc_timer_wheel_job_t   m_reset_job;
+
+static dfu_state_t              m_state;
+static uint16_t                 m_init_size;
+static uint16_t                 m_init_received;
+static bool                     m_init_valid;
+static uint32_t                 m_image_size;
+static uint32_t                 m_image_crc;
+static uint32_t                 m_received;     /**< Image bytes, or patch bytes consumed by the applier. */
+static uint32_t                 m_submitted;    /**< Bytes handed to fstorage. */
+static uint32_t                 m_flashed;
+static bool                     m_image_valid;
+static uint64_t                 m_start_ticks;
+
+static uint8_t                  m_buf[2][ESTC_DFU_BUF_SIZE] __ALIGN(4);
+static bool                     m_pending[2];   /**< Buffer is being programmed. */
+static uint8_t                  m_fill;         /**< Buffer receiving data. */
+static uint16_t                 m_fill_len;
+
+static estc_delta_t             m_delta;
+static uint8_t                  m_patch[ESTC_DFU_DELTA_WINDOW];    /**< Ring of patch bytes not applied yet. */
+static uint16_t                 m_patch_head;
+static uint16_t                 m_patch_len;
+static uint32_t                 m_patch_size;
+static uint32_t                 m_patch_received;
+static uint32_t                 m_received_notified;
+
+static void notify(uint8_t * p_data, uint16_t len)
+{
+    ble_gatts_hvx_params_t hvx_params = {
+        .handle = m_ctrl_point.value_handle,
+        .type   = BLE_GATT_HVX_NOTIFICATION,
+        .p_data = p_data,
+        .p_len  = &len,
+    };
+
+    ret_code_t err_code = sd_ble_gatts_hvx(m_conn_handle, &hvx_params);
+    estc_metrics_hvx_queue_record(err_code);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_DEBUG("DFU notification not sent: 0x%x", err_code);
+    }
+}
+
+static void rsp_send(uint8_t op, estc_dfu_status_t status)
+{
+    uint8_t rsp[RSP_LEN];
+
+    rsp[0] = op | ESTC_DFU_RSP_FLAG;
+    rsp[1] = (uint8_t)status;
+    (void)estc_le_put_u32(&rsp[2], (m_state == STATE_DELTA) ? ESTC_DFU_DELTA_WINDOW : WINDOW);
+
+    notify(rsp, sizeof(rsp));
+}
+
+/**@brief Bytes per second since the image transfer started. */
+static uint32_t throughput_get(void)
+{
+    uint64_t us = estc_time_ticks_to_us(estc_time_ticks() - m_start_ticks);
+
+    return (us == 0) ? 0 : (uint32_t)(((uint64_t)m_flashed * 1000000) / us);
+}
+
+static void progress_send(estc_dfu_status_t status, uint32_t received, uint32_t flashed, uint32_t rate)
+{
+    uint8_t   progress[PROGRESS_LEN];
+    uint8_t * p = progress;
+
+    *p++ = ESTC_DFU_OP_PROGRESS | ESTC_DFU_RSP_FLAG;
+    *p++ = (uint8_t)status;
+    p    = estc_le_put_u32(p, received);
+    p    = estc_le_put_u32(p, flashed);
+    (void)estc_le_put_u32(p, rate);
+
+    m_received_notified = received;
+    notify(progress, sizeof(progress));
+}
+
+static bool image_transfer(void)
+{
+    return (m_state == STATE_IMAGE) || (m_state == STATE_DELTA);
+}
+
+static void transfer_abort(estc_dfu_status_t status)
+{
+    NRF_LOG_WARNING("DFU aborted at %u of %u bytes, status %d", m_received, m_image_size, status);
+
+    // Writes still in flight complete into the bank and are ignored, m_pending tracks them
+    m_state       = STATE_IDLE;
+    m_image_valid = false;
+    progress_send(status, m_received, m_flashed, 0);
+}
+
+static void block_submit(void)
+{
+    uint32_t   addr     = ESTC_DFU_BANK_START + m_submitted;
+    ret_code_t err_code = NRF_SUCCESS;
+
+    if ((addr % CODE_PAGE_SIZE) == 0)
+    {
+        err_code = nrf_fstorage_erase(&m_fs, addr, 1, NULL);
+    }
+
+    // The last block is padded to a whole word
+    uint16_t len = m_fill_len;
+    while ((len % sizeof(uint32_t)) != 0)
+    {
+        m_buf[m_fill][len++] = 0xFF;
+    }
+
+    if (err_code == NRF_SUCCESS)
+    {
+        err_code = nrf_fstorage_write(&m_fs, addr, m_buf[m_fill], len, (void *)(uintptr_t)m_fill);
+    }
+
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("DFU flash operation not queued: 0x%x", err_code);
+        transfer_abort(ESTC_DFU_STATUS_FLASH_ERROR);
+        return;
+    }
+
+    // Receiving continues into the other buffer while this one is programmed
+    m_pending[m_fill] = true;
+    m_submitted      += m_fill_len;
+    m_fill           ^= 1;
+    m_fill_len        = 0;
+}
+
+static void image_data(uint8_t const * p_data, uint16_t len)
+{
+    if (len > m_image_size - m_received)
+    {
+        transfer_abort(ESTC_DFU_STATUS_OVERFLOW);
+        return;
+    }
+
+    while (len > 0)
+    {
+        if (m_pending[m_fill])
+        {
+            // The client ignored the window
+            transfer_abort(ESTC_DFU_STATUS_OVERFLOW);
+            return;
+        }
+
+        uint16_t n = MIN(len, ESTC_DFU_BUF_SIZE - m_fill_len);
+
+        memcpy(&m_buf[m_fill][m_fill_len], p_data, n);
+        m_fill_len += n;
+        m_received += n;
+        p_data     += n;
+        len        -= n;
+
+        if ((m_fill_len == ESTC_DFU_BUF_SIZE) || (m_received == m_image_size))
+        {
+            block_submit();
+            if (m_state != STATE_IMAGE)
+            {
+                return;
+            }
+        }
+    }
+}
+
+static void init_data(uint8_t const * p_data, uint16_t len)
+{
+    if (len > m_init_size - m_init_received)
+    {
+        transfer_abort(ESTC_DFU_STATUS_OVERFLOW);
+        return;
+    }
+
+    // Validated by the bootloader together with the image it describes
+    memcpy(&s_dfu_settings.init_command[m_init_received], p_data, len);
+    m_init_received += len;
+
+    if (m_init_received == m_init_size)
+    {
+        m_init_valid = true;
+        m_state      = STATE_IDLE;
+        progress_send(ESTC_DFU_STATUS_SUCCESS, m_init_received, m_init_received, 0);
+    }
+}
+
+/**@brief Called once the patch header is in. The old image is the application running now. */
+static estc_dfu_status_t delta_header_check(void)
+{
+    estc_delta_header_t const * p_header = &m_delta.header;
+
+    if (p_header->new_size > ESTC_DFU_BANK_END - ESTC_DFU_BANK_START)
+    {
+        return ESTC_DFU_STATUS_INVALID_PARAM;
+    }
+
+    if (estc_crc32((uint8_t const *)CODE_START, p_header->old_size) != p_header->old_crc)
+    {
+        return ESTC_DFU_STATUS_SOURCE_MISMATCH;
+    }
+
+    m_image_size = p_header->new_size;
+    m_image_crc  = p_header->new_crc;
+
+    NRF_LOG_INFO("DFU patch of %u bytes from a %u byte image to a %u byte image", m_patch_size,
+                 p_header->old_size, p_header->new_size);
+    return ESTC_DFU_STATUS_SUCCESS;
+}
+
+/**@brief Apply buffered patch bytes until they run out or both flash buffers are busy.
+ *
+ * Called again whenever either changes: a COPY command alone can fill many blocks.
+ */
+static void delta_pump(void)
+{
+    while ((m_state == STATE_DELTA) && !m_pending[m_fill])
+    {
+        uint32_t in_len  = MIN(m_patch_len, ESTC_DFU_DELTA_WINDOW - m_patch_head);
+        uint32_t out_len = ESTC_DFU_BUF_SIZE - m_fill_len;
+
+        estc_delta_status_t status = estc_delta_apply(&m_delta, &m_patch[m_patch_head], &in_len,
+                                                      &m_buf[m_fill][m_fill_len], &out_len);
+
+        m_patch_head  = (m_patch_head + in_len) % ESTC_DFU_DELTA_WINDOW;
+        m_patch_len  -= in_len;
+        m_received   += in_len;
+        m_fill_len   += out_len;
+
+        // A full buffer goes out even if the applier stopped for input
+        if ((m_fill_len == ESTC_DFU_BUF_SIZE) ||
+            ((status == ESTC_DELTA_STATUS_DONE) && (m_fill_len > 0)))
+        {
+            block_submit();
+        }
+
+        switch (status)
+        {
+            case ESTC_DELTA_STATUS_HEADER:
+            {
+                estc_dfu_status_t check = delta_header_check();
+                if (check != ESTC_DFU_STATUS_SUCCESS)
+                {
+                    transfer_abort(check);
+                    return;
+                }
+            } break;
+
+            case ESTC_DELTA_STATUS_OUTPUT_FULL:
+                break;
+
+            case ESTC_DELTA_STATUS_NEED_INPUT:
+                if (m_patch_len > 0)
+                {
+                    // The ring wrapped
+                    break;
+                }
+                if (m_received == m_patch_size)
+                {
+                    transfer_abort(ESTC_DFU_STATUS_PATCH_ERROR);
+                }
+                return;
+
+            case ESTC_DELTA_STATUS_DONE:
+                // The image is checked once its last block is flashed
+                if ((m_patch_len > 0) || (m_received != m_patch_size))
+                {
+                    transfer_abort(ESTC_DFU_STATUS_PATCH_ERROR);
+                }
+                return;
+
+            default:
+                transfer_abort(ESTC_DFU_STATUS_PATCH_ERROR);
+                return;
+        }
+    }
+}
+
+static void delta_data(uint8_t const * p_data, uint16_t len)
+{
+    if ((len > m_patch_size - m_patch_received) || (len > ESTC_DFU_DELTA_WINDOW - m_patch_len))
+    {
+        transfer_abort(ESTC_DFU_STATUS_OVERFLOW);
+        return;
+    }
+
+    uint16_t tail  = (m_patch_head + m_patch_len) % ESTC_DFU_DELTA_WINDOW;
+    uint16_t first = MIN(len, ESTC_DFU_DELTA_WINDOW - tail);
+
+    memcpy(&m_patch[tail], p_data, first);
+    memcpy(m_patch, &p_data[first], len - first);
+    m_patch_len      += len;
+    m_patch_received += len;
+
+    delta_pump();
+
+    // Flash writes report progress too, this covers patches that are mostly new bytes and fill blocks slowly
+    if ((m_state == STATE_DELTA) && (m_received - m_received_notified >= ESTC_DFU_DELTA_WINDOW / 2))
+    {
+        progress_send(ESTC_DFU_STATUS_IN_PROGRESS, m_received, m_flashed, throughput_get());
+    }
+}
+
+static void image_check(void)
+{
+    uint32_t crc  = estc_crc32((uint8_t const *)ESTC_DFU_BANK_START, m_image_size);
+    uint32_t ms   = (uint32_t)estc_time_ticks_to_ms(estc_time_ticks() - m_start_ticks);
+    uint32_t rate = throughput_get();
+
+    m_state       = STATE_IDLE;
+    m_image_valid = (crc == m_image_crc);
+
+    NRF_LOG_INFO("DFU image: %u bytes in %u ms, %u B/s, crc %s", m_image_size, ms, rate,
+                 m_image_valid ? "ok" : "mismatch");
+    progress_send(m_image_valid ? ESTC_DFU_STATUS_SUCCESS : ESTC_DFU_STATUS_CRC_MISMATCH, m_received, m_flashed, rate);
+}
+
+static void fstorage_evt_handler(nrf_fstorage_evt_t * p_evt)
+{
+    if (p_evt->id != NRF_FSTORAGE_EVT_WRITE_RESULT)
+    {
+        if ((p_evt->result != NRF_SUCCESS) && image_transfer())
+        {
+            transfer_abort(ESTC_DFU_STATUS_FLASH_ERROR);
+        }
+        return;
+    }
+
+    m_pending[(uintptr_t)p_evt->p_param] = false;
+
+    if (!image_transfer())
+    {
+        return;
+    }
+
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        transfer_abort(ESTC_DFU_STATUS_FLASH_ERROR);
+        return;
+    }
+
+    m_flashed = MIN(m_flashed + p_evt->len, m_image_size);
+
+    uint32_t rate = throughput_get();
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_DFU_PROGRESS, (uint16_t)(((uint64_t)m_flashed * 1000) / m_image_size));
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_DFU_RATE, (uint16_t)MIN(rate / 100, UINT16_MAX));
+
+    if (m_flashed == m_image_size)
+    {
+        image_check();
+        return;
+    }
+
+    if (m_state == STATE_DELTA)
+    {
+        // The buffer just written is free for the patch applier again
+        delta_pump();
+    }
+
+    if (m_state != STATE_IDLE)
+    {
+        progress_send(ESTC_DFU_STATUS_IN_PROGRESS, m_received, m_flashed, rate);
+    }
+}
+
+static estc_dfu_status_t init_start(uint8_t const * p_req, uint16_t len)
+{
+    if (len != 1 + sizeof(uint16_t))
+    {
+        return ESTC_DFU_STATUS_INVALID_PARAM;
+    }
+
+    uint16_t size = (uint16_t)(p_req[1] | (p_req[2] << 8));
+    if ((size == 0) || (size > INIT_COMMAND_MAX_SIZE))
+    {
+        return ESTC_DFU_STATUS_INVALID_PARAM;
+    }
+
+    m_state         = STATE_INIT;
+    m_init_size     = size;
+    m_init_received = 0;
+    m_init_valid    = false;
+
+    return ESTC_DFU_STATUS_SUCCESS;
+}
+
+static void transfer_start(dfu_state_t state, uint32_t image_size, uint32_t image_crc)
+{
+    m_state       = state;
+    m_image_size  = image_size;
+    m_image_crc   = image_crc;
+    m_received    = 0;
+    m_submitted   = 0;
+    m_flashed     = 0;
+    m_fill        = 0;
+    m_fill_len    = 0;
+    m_image_valid = false;
+    m_start_ticks = estc_time_ticks();
+
+    m_received_notified = 0;
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_DFU_PROGRESS, 0);
+}
+
+static estc_dfu_status_t image_start(uint8_t const * p_req, uint16_t len)
+{
+    if (len != 1 + 2 * sizeof(uint32_t))
+    {
+        return ESTC_DFU_STATUS_INVALID_PARAM;
+    }
+
+    uint32_t size = estc_le_u32(&p_req[1]);
+    if ((size == 0) || (size > ESTC_DFU_BANK_END - ESTC_DFU_BANK_START))
+    {
+        return ESTC_DFU_STATUS_INVALID_PARAM;
+    }
+
+    // Blocks of an aborted transfer are still being programmed
+    if (m_pending[0] || m_pending[1])
+    {
+        return ESTC_DFU_STATUS_INVALID_STATE;
+    }
+
+    transfer_start(STATE_IMAGE, size, estc_le_u32(&p_req[5]));
+    NRF_LOG_INFO("DFU image of %u bytes started", size);
+
+    return ESTC_DFU_STATUS_SUCCESS;
+}
+
+static estc_dfu_status_t delta_start(uint8_t const * p_req, uint16_t len)
+{
+    if (len != 1 + sizeof(uint32_t))
+    {
+        return ESTC_DFU_STATUS_INVALID_PARAM;
+    }
+
+    uint32_t size = estc_le_u32(&p_req[1]);
+    if (size <= ESTC_DELTA_HEADER_LEN)
+    {
+        return ESTC_DFU_STATUS_INVALID_PARAM;
+    }
+
+    if (m_pending[0] || m_pending[1])
+    {
+        return ESTC_DFU_STATUS_INVALID_STATE;
+    }
+
+    // Size and CRC of the image come with the patch header
+    transfer_start(STATE_DELTA, 0, 0);
+    m_patch_size     = size;
+    m_patch_received = 0;
+    m_patch_head     = 0;
+    m_patch_len      = 0;
+
+    // The patch may read all of the application region, the header says how much of it is the image
+    estc_delta_init(&m_delta, (uint8_t const *)CODE_START, ESTC_DFU_BANK_START - CODE_START);
+    NRF_LOG_INFO("DFU patch of %u bytes started", size);
+
+    return ESTC_DFU_STATUS_SUCCESS;
+}
+
+static void reset_handler(void * p_context)
+{
+    NRF_LOG_FINAL_FLUSH();
+    (void)sd_nvic_SystemReset();
+}
+
+static void settings_written(void * p_buf)
+{
+    ret_code_t err_code = estc_timer_wheel_start(&m_reset_job, RESET_DELAY_MS, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+static estc_dfu_status_t activate(void)
+{
+    if ((m_state != STATE_IDLE) || !m_init_valid || !m_image_valid)
+    {
+        return ESTC_DFU_STATUS_INVALID_STATE;
+    }
+
+    // At startup the bootloader postvalidates the current bank 1 against the init packet. It then copies
+    // application banks from update_start_address over bank 0, resuming at write_offset, and checks the CRC
+    // of the copy. An external application bank would stay where it is.
+    s_dfu_settings.bank_1.image_size                = m_image_size;
+    s_dfu_settings.bank_1.image_crc                 = m_image_crc;
+    s_dfu_settings.bank_1.bank_code                 = NRF_DFU_BANK_VALID_APP;
+    s_dfu_settings.bank_current                     = NRF_DFU_CURRENT_BANK_1;
+    s_dfu_settings.write_offset                     = 0;
+    s_dfu_settings.progress.command_size            = m_init_size;
+    s_dfu_settings.progress.update_start_address    = ESTC_DFU_BANK_START;
+
+    ret_code_t err_code = nrf_dfu_settings_write_and_backup(settings_written);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("DFU settings not written: 0x%x", err_code);
+        return ESTC_DFU_STATUS_FLASH_ERROR;
+    }
+
+    NRF_LOG_INFO("DFU image handed to the bootloader, resetting");
+    return ESTC_DFU_STATUS_SUCCESS;
+}
+
+static void on_ctrl_point_write(uint8_t const * p_req, uint16_t len)
+{
+    estc_dfu_status_t status;
+
+    if (len == 0)
+    {
+        return;
+    }
+
+    switch (p_req[0])
+    {
+        case ESTC_DFU_OP_INIT:
+            status = init_start(p_req, len);
+            break;
+
+        case ESTC_DFU_OP_IMAGE:
+            status = image_start(p_req, len);
+            break;
+
+        case ESTC_DFU_OP_DELTA:
+            status = delta_start(p_req, len);
+            break;
+
+        case ESTC_DFU_OP_ACTIVATE:
+            status = activate();
+            break;
+
+        case ESTC_DFU_OP_ABORT:
+            m_state = STATE_IDLE;
+            status  = ESTC_DFU_STATUS_SUCCESS;
+            break;
+
+        default:
+            status = ESTC_DFU_STATUS_INVALID_OP;
+            break;
+    }
+
+    rsp_send(p_req[0], status);
+}
+
+static void on_data_write(uint8_t const * p_data, uint16_t len)
+{
+    switch (m_state)
+    {
+        case STATE_INIT:
+            init_data(p_data, len);
+            break;
+
+        case STATE_IMAGE:
+            image_data(p_data, len);
+            break;
+
+        case STATE_DELTA:
+            delta_data(p_data, len);
+            break;
+
+        default:
+            // Leftovers of an aborted transfer
+            break;
+    }
+}
+
+static void on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            if (p_ble_evt->evt.gap_evt.conn_handle == m_conn_handle)
+            {
+                // A staged image that passed its check survives, a partial one has to start over
+                m_conn_handle = BLE_CONN_HANDLE_INVALID;
+                m_state       = STATE_IDLE;
+            }
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+        {
+            ble_gatts_evt_write_t const * p_write = &p_ble_evt->evt.gatts_evt.params.write;
+
+            if (p_write->handle == m_data.value_handle)
+            {
+                on_data_write(p_write->data, p_write->len);
+            }
+            else if (p_write->handle == m_ctrl_point.value_handle)
+            {
+                on_ctrl_point_write(p_write->data, p_write->len);
+            }
+        } break;
+
+        default:
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_estc_dfu_observer, ESTC_DFU_BLE_OBSERVER_PRIO, on_ble_evt, NULL);
+
+/**@brief Add a characteristic of the DFU service. A @p p_value buffer of @p max_len bytes holds the value outside
+ *        the attribute table, NULL keeps it in the table.
+ */
+static ret_code_t characteristic_add(uint16_t uuid, bool ctrl_point, uint8_t * p_value, uint16_t max_len,
+                                     ble_gatts_char_handles_t * p_handles)
+{
+    ret_code_t err_code;
+    ble_uuid_t char_uuid = { .uuid = uuid };
+
+    err_code = sd_ble_uuid_vs_add(&m_base_uuid, &char_uuid.type);
+    VERIFY_SUCCESS(err_code);
+
+    ble_gatts_attr_md_t cccd_md = { .vloc = BLE_GATTS_VLOC_STACK };
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_ENC_NO_MITM(&cccd_md.write_perm);
+
+    ble_gatts_char_md_t char_md = {0};
+    if (ctrl_point)
+    {
+        char_md.char_props.write  = 1;
+        char_md.char_props.notify = 1;
+        char_md.p_cccd_md         = &cccd_md;
+    }
+    else
+    {
+        char_md.char_props.write_wo_resp = 1;
+    }
+
+    // Only encrypted links may stage an image
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = (p_value != NULL) ? BLE_GATTS_VLOC_USER : BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_ENC_NO_MITM(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid    = &char_uuid;
+    attr_char_value.p_value   = p_value;
+    attr_char_value.max_len   = max_len;
+
+    return sd_ble_gatts_characteristic_add(m_service_handle, &char_md, &attr_char_value, p_handles);
+}
+
+ret_code_t estc_dfu_init(void)
+{
+    ret_code_t err_code;
+    ble_uuid_t service_uuid = { .uuid = ESTC_DFU_SERVICE_UUID };
+
+    err_code = nrf_dfu_settings_init(true);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = nrf_fstorage_init(&m_fs, &nrf_fstorage_sd, NULL);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = estc_timer_wheel_job_init(&m_reset_job, "dfu reset", ESTC_TIMER_WHEEL_MODE_SINGLE_SHOT,
+                                         reset_handler, 0);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = sd_ble_uuid_vs_add(&m_base_uuid, &service_uuid.type);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = sd_ble_gatts_service_add(BLE_GATTS_SRVC_TYPE_PRIMARY, &service_uuid, &m_service_handle);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = characteristic_add(ESTC_DFU_CTRL_POINT_UUID, true, NULL, MAX(REQ_LEN_MAX, PROGRESS_LEN), &m_ctrl_point);
+    VERIFY_SUCCESS(err_code);
+
+    // A whole ATT payload per write. Data arrives through the write events, the SoftDevice only stores it in
+    // m_data_value, outside the attribute table.
+    return characteristic_add(ESTC_DFU_DATA_UUID, false, m_data_value, sizeof(m_data_value), &m_data);
+}
+
+#endif // ESTC_DFU_ENABLED
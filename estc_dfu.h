@@ -0,0 +1,97 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_DFU_H__
+#define ESTC_DFU_H__
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// Over-the-air update received by the application. The image is staged in bank 1, from ESTC_DFU_BANK_START to
+// ESTC_DFU_BANK_END, while the node keeps running. On activation the bootloader settings are pointed at it and the
+// node resets. The bootloader has to be built with NRF_BL_DFU_ALLOW_UPDATE_FROM_APP: it checks the signed init
+// packet against the staged image before it copies it over the application.
+//
+// The DFU service has a control point (write, notify) and a data characteristic (write without response), both
+// requiring an encrypted link. All fields little-endian.
+//   Control point requests: opcode (1) | parameters
+//     ESTC_DFU_OP_INIT      size (2)                 the next size bytes of data are the init packet (.dat)
+//     ESTC_DFU_OP_IMAGE     size (4) | crc32 (4)     the next size bytes of data are the image (.bin)
+//     ESTC_DFU_OP_DELTA     size (4)                 the next size bytes of data are a patch to the running image
+//     ESTC_DFU_OP_ACTIVATE                           hand the staged image to the bootloader and reset
+//     ESTC_DFU_OP_ABORT
+//   Responses: opcode | 0x80 (1) | status (1) | window (4), the unflashed bytes a client may have in flight
+//   Progress, after every flash write: ESTC_DFU_OP_PROGRESS | 0x80 (1) | status (1) | received (4) | flashed (4) |
+//   throughput in bytes per second (4)
+// Data is written to flash in ESTC_DFU_BUF_SIZE blocks, double buffered: one block is programmed while the next one
+// is received. A client keeps (sent - flashed) within the window. Data arriving with both buffers busy aborts the
+// transfer with ESTC_DFU_STATUS_OVERFLOW. The image is complete once flashed reaches its size and its CRC matched,
+// reported by a progress notification with ESTC_DFU_STATUS_SUCCESS.
+// A delta update sends a patch made by armgcc/delta_patch.py instead of the image, see estc_delta.h. The image is
+// rebuilt into the bank as the patch arrives, its size and CRC come from the patch header. The patch only applies if
+// the running image matches the one it was made against, else ESTC_DFU_STATUS_SOURCE_MISMATCH. Progress then reports
+// the patch bytes the applier consumed as received, and a client keeps (sent - received) within the window of the
+// ESTC_DFU_OP_DELTA response.
+
+#define ESTC_DFU_SERVICE_UUID           0xABD0
+#define ESTC_DFU_CTRL_POINT_UUID        0xABD1
+#define ESTC_DFU_DATA_UUID              0xABD2
+
+#define ESTC_DFU_RSP_FLAG               0x80
+
+typedef enum
+{
+    ESTC_DFU_OP_INIT        = 0x01,
+    ESTC_DFU_OP_IMAGE       = 0x02,
+    ESTC_DFU_OP_ACTIVATE    = 0x03,
+    ESTC_DFU_OP_ABORT       = 0x04,
+    ESTC_DFU_OP_DELTA       = 0x05,
+    ESTC_DFU_OP_PROGRESS    = 0x10,     /**< Notification only. */
+} estc_dfu_op_t;
+
+typedef enum
+{
+    ESTC_DFU_STATUS_SUCCESS,
+    ESTC_DFU_STATUS_IN_PROGRESS,        /**< Progress of a transfer that is not complete yet. */
+    ESTC_DFU_STATUS_INVALID_OP,
+    ESTC_DFU_STATUS_INVALID_PARAM,      /**< Wrong length, or the object does not fit. */
+    ESTC_DFU_STATUS_INVALID_STATE,      /**< No transfer of that object, or nothing complete to activate. */
+    ESTC_DFU_STATUS_OVERFLOW,           /**< More data than announced, or than the window allows. */
+    ESTC_DFU_STATUS_CRC_MISMATCH,
+    ESTC_DFU_STATUS_FLASH_ERROR,
+    ESTC_DFU_STATUS_PATCH_ERROR,        /**< Malformed or truncated patch. */
+    ESTC_DFU_STATUS_SOURCE_MISMATCH,    /**< The patch was made against another image than the one running. */
+} estc_dfu_status_t;
+
+/**@brief Add the DFU service and read the bootloader settings. The SoftDevice has to be enabled. */
+ret_code_t estc_dfu_init(void);
+
+#endif /* ESTC_DFU_H__ */
@@ -0,0 +1,358 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_dsp.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if ESTC_DSP_SIMD
+#include "nrf.h"
+
+#define dsp_smlald(x, y, acc)   ((int64_t)__SMLALD((x), (y), (uint64_t)(acc)))
+#define dsp_qadd16(x, y)        __QADD16((x), (y))
+#define dsp_pkhbt(lo, hi)       __PKHBT((lo), (hi), 16)
+#define dsp_ssat16(v)           __SSAT((v), 16)
+#else
+// Exact models of the Cortex-M4 instructions used below
+
+static inline int64_t dsp_smlald(uint32_t x, uint32_t y, int64_t acc)
+{
+    return acc + (int64_t)((int32_t)(int16_t)x * (int16_t)y) + (int64_t)((int32_t)(int16_t)(x >> 16) * (int16_t)(y >> 16));
+}
+
+static inline int32_t dsp_ssat16(int32_t value)
+{
+    return (value > INT16_MAX) ? INT16_MAX : ((value < INT16_MIN) ? INT16_MIN : value);
+}
+
+static inline uint32_t dsp_qadd16(uint32_t x, uint32_t y)
+{
+    uint16_t lo = (uint16_t)dsp_ssat16((int16_t)x + (int16_t)y);
+    uint16_t hi = (uint16_t)dsp_ssat16((int16_t)(x >> 16) + (int16_t)(y >> 16));
+    return ((uint32_t)hi << 16) | lo;
+}
+
+static inline uint32_t dsp_pkhbt(uint32_t lo, uint32_t hi)
+{
+    return (lo & 0xFFFF) | (hi << 16);
+}
+#endif
+
+static inline int32_t sat16(int32_t value)
+{
+    if (value > INT16_MAX)
+    {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN)
+    {
+        return INT16_MIN;
+    }
+    return value;
+}
+
+static inline uint32_t load_pair(int16_t const * p_in)
+{
+    uint32_t pair;
+    memcpy(&pair, p_in, sizeof(pair));
+    return pair;
+}
+
+static inline void store_pair(int16_t * p_out, uint32_t pair)
+{
+    memcpy(p_out, &pair, sizeof(pair));
+}
+
+static int16_t coef_q14(float value)
+{
+    int32_t q = (int32_t)lroundf(value * (1 << ESTC_DSP_BIQUAD_COEF_SHIFT));
+    return (int16_t)sat16(q);
+}
+
+static uint32_t isqrt32(uint32_t value)
+{
+    uint32_t root = 0;
+    uint32_t bit  = 1UL << 30;
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root   = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+static void stats_finish(estc_dsp_stats_t * p_stats, uint32_t cnt, int64_t sum, int64_t sum_sq)
+{
+    p_stats->mean = (int16_t)(sum / (int64_t)cnt);
+    p_stats->rms  = (uint16_t)isqrt32((uint32_t)((uint64_t)sum_sq / cnt));
+}
+
+bool estc_dsp_biquad_lowpass(estc_dsp_biquad_coefs_t * p_coefs, uint16_t cutoff_permille)
+{
+    if ((p_coefs == NULL) || (cutoff_permille < ESTC_DSP_BIQUAD_CUTOFF_MIN_PERMILLE) || (cutoff_permille >= 500))
+    {
+        return false;
+    }
+
+    // Audio EQ cookbook low-pass with Q = 1/sqrt(2). Runs once at init, so float is fine here.
+    float w0    = 2.0f * (float)M_PI * cutoff_permille / 1000.0f;
+    float cosw  = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * (float)M_SQRT1_2);
+    float a0    = 1.0f + alpha;
+
+    p_coefs->b0 = coef_q14((1.0f - cosw) / 2.0f / a0);
+    p_coefs->b1 = coef_q14((1.0f - cosw) / a0);
+    p_coefs->b2 = p_coefs->b0;
+    p_coefs->a1 = coef_q14(2.0f * cosw / a0);
+    p_coefs->a2 = coef_q14(-(1.0f - alpha) / a0);
+
+    return true;
+}
+
+void estc_dsp_biquad_init(estc_dsp_biquad_t * p_biquad, estc_dsp_biquad_coefs_t const * p_coefs)
+{
+    memset(p_biquad, 0, sizeof(*p_biquad));
+    p_biquad->coefs = *p_coefs;
+}
+
+void estc_dsp_biquad_q15_scalar(estc_dsp_biquad_t * p_biquad, int16_t const * p_in, int16_t * p_out, uint32_t cnt)
+{
+    estc_dsp_biquad_coefs_t const * p_c = &p_biquad->coefs;
+
+    int16_t x1 = p_biquad->x1;
+    int16_t x2 = p_biquad->x2;
+    int16_t y1 = p_biquad->y1;
+    int16_t y2 = p_biquad->y2;
+
+    for (uint32_t i = 0; i < cnt; i++)
+    {
+        int16_t x0  = p_in[i];
+        int64_t acc = (int64_t)p_c->b0 * x0 + (int64_t)p_c->b1 * x1 + (int64_t)p_c->b2 * x2
+                    + (int64_t)p_c->a1 * y1 + (int64_t)p_c->a2 * y2;
+        int16_t y0  = (int16_t)sat16((int32_t)((acc + (1 << (ESTC_DSP_BIQUAD_COEF_SHIFT - 1))) >> ESTC_DSP_BIQUAD_COEF_SHIFT));
+
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
+        p_out[i] = y0;
+    }
+
+    p_biquad->x1 = x1;
+    p_biquad->x2 = x2;
+    p_biquad->y1 = y1;
+    p_biquad->y2 = y2;
+}
+
+void estc_dsp_biquad_q15_simd(estc_dsp_biquad_t * p_biquad, int16_t const * p_in, int16_t * p_out, uint32_t cnt)
+{
+    estc_dsp_biquad_coefs_t const * p_c = &p_biquad->coefs;
+
+    // Coefficient and state pairs packed as (n-1) in the low and (n-2) in the high halfword, so the four delayed
+    // terms take two dual multiply-accumulates
+    int32_t  b0  = p_c->b0;
+    uint32_t b12 = dsp_pkhbt((uint16_t)p_c->b1, (uint16_t)p_c->b2);
+    uint32_t a12 = dsp_pkhbt((uint16_t)p_c->a1, (uint16_t)p_c->a2);
+    uint32_t x12 = dsp_pkhbt((uint16_t)p_biquad->x1, (uint16_t)p_biquad->x2);
+    uint32_t y12 = dsp_pkhbt((uint16_t)p_biquad->y1, (uint16_t)p_biquad->y2);
+
+    for (uint32_t i = 0; i < cnt; i++)
+    {
+        int32_t x0  = p_in[i];
+        int64_t acc = (int64_t)(b0 * x0);
+
+        acc = dsp_smlald(b12, x12, acc);
+        acc = dsp_smlald(a12, y12, acc);
+
+        int32_t y0 = dsp_ssat16((int32_t)((acc + (1 << (ESTC_DSP_BIQUAD_COEF_SHIFT - 1))) >> ESTC_DSP_BIQUAD_COEF_SHIFT));
+
+        // The new sample goes to the low half, the old low half moves up and the old high half drops out
+        x12 = dsp_pkhbt((uint32_t)x0, x12);
+        y12 = dsp_pkhbt((uint32_t)y0, y12);
+        p_out[i] = (int16_t)y0;
+    }
+
+    p_biquad->x1 = (int16_t)x12;
+    p_biquad->x2 = (int16_t)(x12 >> 16);
+    p_biquad->y1 = (int16_t)y12;
+    p_biquad->y2 = (int16_t)(y12 >> 16);
+}
+
+void estc_dsp_ma_init(estc_dsp_ma_t * p_ma, uint8_t log2_window)
+{
+    memset(p_ma, 0, sizeof(*p_ma));
+    p_ma->log2_window = (log2_window > ESTC_DSP_MA_LOG2_MAX) ? ESTC_DSP_MA_LOG2_MAX : log2_window;
+}
+
+void estc_dsp_ma_q15(estc_dsp_ma_t * p_ma, int16_t const * p_in, int16_t * p_out, uint32_t cnt)
+{
+    uint8_t mask = (uint8_t)((1 << p_ma->log2_window) - 1);
+
+    // The running sum is Q15 times at most 32 samples, it never leaves Q31
+    for (uint32_t i = 0; i < cnt; i++)
+    {
+        int16_t x0 = p_in[i];
+
+        p_ma->sum             += x0 - p_ma->hist[p_ma->idx];
+        p_ma->hist[p_ma->idx]  = x0;
+        p_ma->idx              = (p_ma->idx + 1) & mask;
+        p_out[i]               = (int16_t)(p_ma->sum >> p_ma->log2_window);
+    }
+}
+
+void estc_dsp_decim_init(estc_dsp_decim_t * p_decim, uint8_t factor)
+{
+    p_decim->factor = (factor == 0) ? 1 : factor;
+    p_decim->phase  = 0;
+}
+
+uint32_t estc_dsp_decim_q15(estc_dsp_decim_t * p_decim, int16_t const * p_in, int16_t * p_out, uint32_t cnt)
+{
+    uint32_t out_cnt = 0;
+    uint32_t i       = (p_decim->factor - p_decim->phase) % p_decim->factor;
+
+    for (; i < cnt; i += p_decim->factor)
+    {
+        p_out[out_cnt++] = p_in[i];
+    }
+
+    p_decim->phase = (uint8_t)((p_decim->phase + cnt) % p_decim->factor);
+
+    return out_cnt;
+}
+
+void estc_dsp_stats_q15_scalar(int16_t const * p_in, uint32_t cnt, estc_dsp_stats_t * p_stats)
+{
+    int64_t sum    = 0;
+    int64_t sum_sq = 0;
+
+    memset(p_stats, 0, sizeof(*p_stats));
+    if (cnt == 0)
+    {
+        return;
+    }
+
+    p_stats->min = INT16_MAX;
+    p_stats->max = INT16_MIN;
+    for (uint32_t i = 0; i < cnt; i++)
+    {
+        int16_t x = p_in[i];
+
+        p_stats->min  = (x < p_stats->min) ? x : p_stats->min;
+        p_stats->max  = (x > p_stats->max) ? x : p_stats->max;
+        sum          += x;
+        sum_sq       += (int32_t)x * x;
+    }
+
+    stats_finish(p_stats, cnt, sum, sum_sq);
+}
+
+void estc_dsp_stats_q15_simd(int16_t const * p_in, uint32_t cnt, estc_dsp_stats_t * p_stats)
+{
+    int64_t  sum    = 0;
+    int64_t  sum_sq = 0;
+    uint32_t i      = 0;
+
+    memset(p_stats, 0, sizeof(*p_stats));
+    if (cnt == 0)
+    {
+        return;
+    }
+
+    p_stats->min = INT16_MAX;
+    p_stats->max = INT16_MIN;
+
+    // Two samples per load: the sum is a dual multiply by one, the sum of squares a dual multiply by itself
+    for (; i + 1 < cnt; i += 2)
+    {
+        uint32_t pair = load_pair(&p_in[i]);
+        int16_t  lo   = (int16_t)pair;
+        int16_t  hi   = (int16_t)(pair >> 16);
+
+        sum    = dsp_smlald(pair, 0x00010001UL, sum);
+        sum_sq = dsp_smlald(pair, pair, sum_sq);
+
+        p_stats->min = (lo < p_stats->min) ? lo : p_stats->min;
+        p_stats->min = (hi < p_stats->min) ? hi : p_stats->min;
+        p_stats->max = (lo > p_stats->max) ? lo : p_stats->max;
+        p_stats->max = (hi > p_stats->max) ? hi : p_stats->max;
+    }
+
+    if (i < cnt)
+    {
+        int16_t x = p_in[i];
+
+        p_stats->min  = (x < p_stats->min) ? x : p_stats->min;
+        p_stats->max  = (x > p_stats->max) ? x : p_stats->max;
+        sum          += x;
+        sum_sq       += (int32_t)x * x;
+    }
+
+    stats_finish(p_stats, cnt, sum, sum_sq);
+}
+
+void estc_dsp_offset_q15_scalar(int16_t const * p_in, int16_t * p_out, uint32_t cnt, int16_t offset)
+{
+    for (uint32_t i = 0; i < cnt; i++)
+    {
+        p_out[i] = (int16_t)sat16(p_in[i] + offset);
+    }
+}
+
+void estc_dsp_offset_q15_simd(int16_t const * p_in, int16_t * p_out, uint32_t cnt, int16_t offset)
+{
+    uint32_t offsets = dsp_pkhbt((uint16_t)offset, (uint16_t)offset);
+    uint32_t i       = 0;
+
+    for (; i + 1 < cnt; i += 2)
+    {
+        store_pair(&p_out[i], dsp_qadd16(load_pair(&p_in[i]), offsets));
+    }
+
+    if (i < cnt)
+    {
+        p_out[i] = (int16_t)sat16(p_in[i] + offset);
+    }
+}
@@ -0,0 +1,144 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_DSP_H__
+#define ESTC_DSP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Fixed-point kernels for the telemetry producer. Samples are Q15, accumulators Q31 or 64-bit.
+// Every kernel with a packed 16-bit inner loop has a scalar reference and a SIMD variant. The SIMD variant uses the
+// Cortex-M4 DSP instructions when the compiler targets them and an exact C model of them otherwise, so both variants
+// build on a host and armgcc/dsp_bench.c can check that they agree bit for bit. Like the telemetry frame this only
+// depends on the C library.
+
+#define ESTC_DSP_BIQUAD_COEF_SHIFT  14          /**< Biquad coefficients are Q2.14, so |coef| < 2. */
+#define ESTC_DSP_MA_LOG2_MAX        5           /**< Longest moving average window is 32 samples. */
+
+// Below this cutoff b0 drops under 60 in Q2.14, its rounding error passes 1 % and it reaches 0 at 1 permille
+#define ESTC_DSP_BIQUAD_CUTOFF_MIN_PERMILLE 20
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#define ESTC_DSP_SIMD               1
+#else
+#define ESTC_DSP_SIMD               0
+#endif
+
+/**@brief Direct form I biquad: y = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2].
+ *
+ * @note a1 and a2 are stored negated compared to the usual transfer function, so the filter is a single sum.
+ */
+typedef struct
+{
+    int16_t b0;
+    int16_t b1;
+    int16_t b2;
+    int16_t a1;
+    int16_t a2;
+} estc_dsp_biquad_coefs_t;
+
+typedef struct
+{
+    estc_dsp_biquad_coefs_t coefs;
+    int16_t                 x1;
+    int16_t                 x2;
+    int16_t                 y1;
+    int16_t                 y2;
+} estc_dsp_biquad_t;
+
+typedef struct
+{
+    int16_t  hist[1 << ESTC_DSP_MA_LOG2_MAX];
+    int32_t  sum;
+    uint8_t  log2_window;
+    uint8_t  idx;
+} estc_dsp_ma_t;
+
+typedef struct
+{
+    uint8_t  factor;
+    uint8_t  phase;                             /**< Input samples consumed since the last kept one, the kept one included. */
+} estc_dsp_decim_t;
+
+typedef struct
+{
+    int16_t  min;
+    int16_t  max;
+    int16_t  mean;
+    uint16_t rms;
+} estc_dsp_stats_t;
+
+/**@brief Second order Butterworth low-pass.
+ *
+ * @param[in] cutoff_permille   Cutoff frequency in permille of the sample rate, ESTC_DSP_BIQUAD_CUTOFF_MIN_PERMILLE to 499.
+ *
+ * @return false if the cutoff is out of range.
+ */
+bool estc_dsp_biquad_lowpass(estc_dsp_biquad_coefs_t * p_coefs, uint16_t cutoff_permille);
+
+void estc_dsp_biquad_init(estc_dsp_biquad_t * p_biquad, estc_dsp_biquad_coefs_t const * p_coefs);
+
+/**@brief Filter @p cnt samples. @p p_in and @p p_out may be the same buffer. */
+void estc_dsp_biquad_q15_scalar(estc_dsp_biquad_t * p_biquad, int16_t const * p_in, int16_t * p_out, uint32_t cnt);
+void estc_dsp_biquad_q15_simd(estc_dsp_biquad_t * p_biquad, int16_t const * p_in, int16_t * p_out, uint32_t cnt);
+
+/**@brief Moving average over 2^log2_window samples, primed with zeros. */
+void estc_dsp_ma_init(estc_dsp_ma_t * p_ma, uint8_t log2_window);
+
+void estc_dsp_ma_q15(estc_dsp_ma_t * p_ma, int16_t const * p_in, int16_t * p_out, uint32_t cnt);
+
+void estc_dsp_decim_init(estc_dsp_decim_t * p_decim, uint8_t factor);
+
+/**@brief Keep every factor-th sample. The phase carries over, so a stream can be fed in blocks of any size.
+ *
+ * @return Number of samples written to @p p_out, at most cnt / factor + 1. @p p_out may be @p p_in.
+ */
+uint32_t estc_dsp_decim_q15(estc_dsp_decim_t * p_decim, int16_t const * p_in, int16_t * p_out, uint32_t cnt);
+
+/**@brief Min, max, mean and RMS of a window. The mean is truncated toward zero, the RMS rounded down. */
+void estc_dsp_stats_q15_scalar(int16_t const * p_in, uint32_t cnt, estc_dsp_stats_t * p_stats);
+void estc_dsp_stats_q15_simd(int16_t const * p_in, uint32_t cnt, estc_dsp_stats_t * p_stats);
+
+/**@brief Add a constant with saturation, e.g. to remove a sensor offset. In place is fine. */
+void estc_dsp_offset_q15_scalar(int16_t const * p_in, int16_t * p_out, uint32_t cnt, int16_t offset);
+void estc_dsp_offset_q15_simd(int16_t const * p_in, int16_t * p_out, uint32_t cnt, int16_t offset);
+
+#if ESTC_DSP_SIMD
+#define estc_dsp_biquad_q15     estc_dsp_biquad_q15_simd
+#define estc_dsp_stats_q15      estc_dsp_stats_q15_simd
+#define estc_dsp_offset_q15     estc_dsp_offset_q15_simd
+#else
+#define estc_dsp_biquad_q15     estc_dsp_biquad_q15_scalar
+#define estc_dsp_stats_q15      estc_dsp_stats_q15_scalar
+#define estc_dsp_offset_q15     estc_dsp_offset_q15_scalar
+#endif
+
+#endif /* ESTC_DSP_H__ */
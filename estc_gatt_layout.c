@@ -0,0 +1,201 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_gatt_layout.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdk_common.h"
+#include "ble.h"
+#include "ble_gatts.h"
+#include "fds.h"
+#include "peer_manager.h"
+#include "nrf_log.h"
+
+#include "estc_crc.h"
+
+#define LAYOUT_FILE_ID          0x4C59      /**< Outside the range reserved by the Peer Manager. */
+#define LAYOUT_RECORD_KEY       0x0001
+#define LAYOUT_RECORD_WORDS     2           /**< Hash and its CRC-32C. */
+
+static uint32_t m_hash;
+static uint32_t m_stored[LAYOUT_RECORD_WORDS];   /**< Word aligned and static, FDS writes it asynchronously. */
+static bool     m_fds_ready;
+static bool     m_check_pending;
+
+static uint32_t attr_hash(uint16_t handle, ble_uuid_t const * p_uuid, ble_gatts_attr_md_t const * p_md, uint32_t crc)
+{
+    uint8_t buf[2 + 16 + 3];
+    uint8_t uuid_len = 0;
+
+    buf[0] = (uint8_t)handle;
+    buf[1] = (uint8_t)(handle >> 8);
+
+    if (sd_ble_uuid_encode(p_uuid, &uuid_len, &buf[2]) != NRF_SUCCESS)
+    {
+        uuid_len = 0;
+    }
+
+    uint8_t * p = &buf[2 + uuid_len];
+    p[0] = (uint8_t)(p_md->read_perm.sm | (p_md->read_perm.lv << 4));
+    p[1] = (uint8_t)(p_md->write_perm.sm | (p_md->write_perm.lv << 4));
+    p[2] = (uint8_t)(p_md->vlen | (p_md->rd_auth << 1) | (p_md->wr_auth << 2));
+
+    crc = estc_crc32_update(crc, buf, 2 + uuid_len + 3);
+
+    // Declarations keep the properties and the UUIDs of services and characteristics in their value
+    if ((p_uuid->type == BLE_UUID_TYPE_BLE) &&
+        (p_uuid->uuid >= BLE_UUID_SERVICE_PRIMARY) && (p_uuid->uuid <= BLE_UUID_CHARACTERISTIC))
+    {
+        uint8_t           decl[1 + 2 + 16];
+        ble_gatts_value_t value = {
+            .len     = sizeof(decl),
+            .offset  = 0,
+            .p_value = decl,
+        };
+
+        if (sd_ble_gatts_value_get(BLE_CONN_HANDLE_INVALID, handle, &value) == NRF_SUCCESS)
+        {
+            crc = estc_crc32_update(crc, decl, MIN(value.len, sizeof(decl)));
+        }
+    }
+
+    return crc;
+}
+
+static void stored_compare(void)
+{
+    fds_record_desc_t  desc  = {0};
+    fds_find_token_t   token = {0};
+    fds_flash_record_t flash_record;
+    ret_code_t         err_code;
+    bool               found = false;
+    bool               valid = false;
+
+    m_check_pending = false;
+
+    err_code = fds_record_find(LAYOUT_FILE_ID, LAYOUT_RECORD_KEY, &desc, &token);
+    if (err_code == NRF_SUCCESS)
+    {
+        found = (fds_record_open(&desc, &flash_record) == NRF_SUCCESS);
+        if (found)
+        {
+            // FDS checks its own CRC only with FDS_CRC_CHECK_ON_READ, records of older firmware hold the bare hash
+            valid = (flash_record.p_header->length_words == LAYOUT_RECORD_WORDS) &&
+                    estc_crc32c_check(flash_record.p_data, sizeof(m_stored));
+            if (valid)
+            {
+                memcpy(m_stored, flash_record.p_data, sizeof(m_stored));
+            }
+            (void)fds_record_close(&desc);
+        }
+    }
+
+    if (valid && (m_stored[0] == m_hash))
+    {
+        return;
+    }
+
+    // Also on the first boot with this module, bonds made by older firmware may hold a cache of another layout
+    NRF_LOG_INFO("GATT layout changed, hash 0x%08x", m_hash);
+    pm_local_database_has_changed();
+
+    m_stored[0] = m_hash;
+    (void)estc_crc32c_append((uint8_t *)m_stored, sizeof(m_stored[0]));
+
+    fds_record_t record = {
+        .file_id           = LAYOUT_FILE_ID,
+        .key               = LAYOUT_RECORD_KEY,
+        .data.p_data       = m_stored,
+        .data.length_words = LAYOUT_RECORD_WORDS,
+    };
+
+    err_code = found ? fds_record_update(&desc, &record) : fds_record_write(NULL, &record);
+    if (err_code == FDS_ERR_NO_SPACE_IN_FLASH)
+    {
+        // Signalled already, the next boot stores it once the Peer Manager has collected garbage
+        NRF_LOG_WARNING("GATT layout hash not stored, flash full");
+    }
+    else if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("GATT layout hash not stored: 0x%x", err_code);
+    }
+}
+
+static void fds_evt_handler(fds_evt_t const * p_evt)
+{
+    if ((p_evt->id == FDS_EVT_INIT) && (p_evt->result == NRF_SUCCESS))
+    {
+        m_fds_ready = true;
+        if (m_check_pending)
+        {
+            stored_compare();
+        }
+    }
+}
+
+ret_code_t estc_gatt_layout_init(void)
+{
+    ble_uuid_t          uuid;
+    ble_gatts_attr_md_t md;
+    uint32_t            crc = 0;
+
+    for (uint16_t handle = BLE_GATT_HANDLE_START; ; handle++)
+    {
+        if (sd_ble_gatts_attr_get(handle, &uuid, &md) != NRF_SUCCESS)
+        {
+            break;
+        }
+        crc = attr_hash(handle, &uuid, &md, crc);
+    }
+
+    m_hash = crc;
+    NRF_LOG_DEBUG("GATT layout hash 0x%08x", m_hash);
+
+    return fds_register(fds_evt_handler);
+}
+
+void estc_gatt_layout_check(void)
+{
+    // First boot: FDS is still formatting its pages
+    if (!m_fds_ready)
+    {
+        m_check_pending = true;
+        return;
+    }
+
+    stored_compare();
+}
+
+uint32_t estc_gatt_layout_hash_get(void)
+{
+    return m_hash;
+}
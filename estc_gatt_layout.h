@@ -0,0 +1,58 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_GATT_LAYOUT_H__
+#define ESTC_GATT_LAYOUT_H__
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// The SoftDevice exposes no Database Hash characteristic, so clients that cache the attribute table check the
+// layout characteristic of the ESTC service instead. Its value is ESTC_SERVICE_LAYOUT_VERSION followed by a hash
+// of the whole table: the handle, UUID, permissions and authorization flags of every attribute, generic services
+// included. Of the values only those of the declarations are part of it, they hold the service UUIDs and the
+// characteristic properties.
+//
+// The hash is kept in flash. When it differs at boot, bonded peers get a Service Changed indication on their next
+// connection through the Peer Manager.
+
+/**@brief Hash the attribute table and register with FDS.
+ *
+ * @details Call once every service has been added, and before pm_init(), which initializes FDS.
+ */
+ret_code_t estc_gatt_layout_init(void);
+
+/**@brief Compare the hash with the stored one. Call after pm_init(). */
+void estc_gatt_layout_check(void);
+
+uint32_t estc_gatt_layout_hash_get(void);
+
+#endif /* ESTC_GATT_LAYOUT_H__ */
@@ -0,0 +1,78 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_LE_H__
+#define ESTC_LE_H__
+
+#include <stdint.h>
+
+// Little-endian fields of the wire formats. Byte accesses only, so buffers need not be aligned, and nothing beyond
+// stdint.h, so the host builds share them. The get and put forms return the position past the field to chain
+// consecutive fields.
+
+static inline uint16_t estc_le_u16(uint8_t const * p_buf)
+{
+    return (uint16_t)(p_buf[0] | (p_buf[1] << 8));
+}
+
+static inline uint32_t estc_le_u32(uint8_t const * p_buf)
+{
+    return p_buf[0] | (p_buf[1] << 8) | (p_buf[2] << 16) | ((uint32_t)p_buf[3] << 24);
+}
+
+static inline uint8_t const * estc_le_get_u16(uint8_t const * p_buf, uint16_t * p_value)
+{
+    *p_value = estc_le_u16(p_buf);
+    return p_buf + sizeof(uint16_t);
+}
+
+static inline uint8_t const * estc_le_get_u32(uint8_t const * p_buf, uint32_t * p_value)
+{
+    *p_value = estc_le_u32(p_buf);
+    return p_buf + sizeof(uint32_t);
+}
+
+static inline uint8_t * estc_le_put_u16(uint8_t * p_buf, uint16_t value)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    return p_buf + sizeof(uint16_t);
+}
+
+static inline uint8_t * estc_le_put_u32(uint8_t * p_buf, uint32_t value)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return p_buf + sizeof(uint32_t);
+}
+
+#endif /* ESTC_LE_H__ */
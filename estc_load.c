@@ -0,0 +1,133 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_load.h"
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "nrf.h"
+#include "app_timer.h"
+#include "nrf_log.h"
+
+#include "estc_perf.h"
+#include "estc_metrics.h"
+
+static const estc_perf_probe_t m_probes[ESTC_LOAD_SUBSYSTEM_COUNT] =
+{
+    [ESTC_LOAD_BLE]       = ESTC_PERF_BLE_EVT,
+    [ESTC_LOAD_PRODUCERS] = ESTC_PERF_TELEMETRY,
+    [ESTC_LOAD_USB]       = ESTC_PERF_USB_BRIDGE,
+    [ESTC_LOAD_LOG]       = ESTC_PERF_LOG,
+};
+
+static const estc_metrics_gauge_t m_gauges[ESTC_LOAD_SUBSYSTEM_COUNT] =
+{
+    [ESTC_LOAD_BLE]       = ESTC_METRICS_GAUGE_LOAD_BLE,
+    [ESTC_LOAD_PRODUCERS] = ESTC_METRICS_GAUGE_LOAD_PRODUCERS,
+    [ESTC_LOAD_USB]       = ESTC_METRICS_GAUGE_LOAD_USB,
+    [ESTC_LOAD_LOG]       = ESTC_METRICS_GAUGE_LOAD_LOG,
+};
+
+static uint32_t    m_window_ticks;
+static uint32_t    m_window_cycles;
+static uint64_t    m_window_totals[ESTC_LOAD_SUBSYSTEM_COUNT];
+static estc_load_t m_load;
+
+static void window_start(void)
+{
+    estc_perf_stats_t stats;
+
+    m_window_ticks  = app_timer_cnt_get();
+    m_window_cycles = DWT->CYCCNT;
+
+    for (uint32_t i = 0; i < ESTC_LOAD_SUBSYSTEM_COUNT; i++)
+    {
+        estc_perf_stats_get(m_probes[i], &stats);
+        m_window_totals[i] = stats.total;
+    }
+}
+
+static uint16_t permille(uint64_t part, uint64_t whole)
+{
+    if (whole == 0)
+    {
+        return 0;
+    }
+
+    // A window closed while a lower priority probe was half way through its update can overshoot
+    return (uint16_t)MIN((part * 1000) / whole, 1000);
+}
+
+void estc_load_init(void)
+{
+    memset(&m_load, 0, sizeof(m_load));
+    window_start();
+}
+
+void estc_load_update(void)
+{
+#if ESTC_PERF_ENABLED
+    estc_perf_stats_t stats;
+    uint32_t          ticks  = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_window_ticks);
+    uint32_t          active = DWT->CYCCNT - m_window_cycles;
+    uint64_t          wall   = ((uint64_t)ticks * SystemCoreClock) / APP_TIMER_CLOCK_FREQ;
+
+    m_load.cpu = permille(active, wall);
+
+    for (uint32_t i = 0; i < ESTC_LOAD_SUBSYSTEM_COUNT; i++)
+    {
+        estc_perf_stats_get(m_probes[i], &stats);
+        m_load.subsystems[i] = permille(stats.total - m_window_totals[i], wall);
+        estc_metrics_gauge_set(m_gauges[i], m_load.subsystems[i]);
+    }
+
+    m_load.current_ua = (uint16_t)((ESTC_LOAD_RUN_CURRENT_UA * m_load.cpu +
+                                    ESTC_LOAD_SLEEP_CURRENT_UA * (1000 - m_load.cpu)) / 1000);
+
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_CPU_LOAD, m_load.cpu);
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_CPU_CURRENT, m_load.current_ua);
+
+    NRF_LOG_DEBUG("load %d permille, ~%d uA (ble %d, producers %d, usb %d, log %d)",
+                  m_load.cpu, m_load.current_ua,
+                  m_load.subsystems[ESTC_LOAD_BLE], m_load.subsystems[ESTC_LOAD_PRODUCERS],
+                  m_load.subsystems[ESTC_LOAD_USB], m_load.subsystems[ESTC_LOAD_LOG]);
+#endif
+
+    window_start();
+}
+
+void estc_load_get(estc_load_t * p_load)
+{
+    if (p_load != NULL)
+    {
+        *p_load = m_load;
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_LOAD_H__
+#define ESTC_LOAD_H__
+
+#include <stdint.h>
+
+// CPU utilization over fixed windows. The DWT cycle counter only runs while the core is clocked,
+// so its delta over a window is the active time and the RTC delta is the wall time. With a
+// debugger attached the core clock keeps running in sleep and the load reads close to 100%.
+
+typedef enum
+{
+    ESTC_LOAD_BLE,              /**< Application BLE event handler. */
+    ESTC_LOAD_PRODUCERS,        /**< Telemetry sampling, encoding and publishing. */
+    ESTC_LOAD_USB,              /**< USB bridge. */
+    ESTC_LOAD_LOG,              /**< Log processing and flushing. */
+
+    ESTC_LOAD_SUBSYSTEM_COUNT
+} estc_load_subsystem_t;
+
+typedef struct
+{
+    uint16_t cpu;                                   /**< Active share of the window, permille. */
+    uint16_t subsystems[ESTC_LOAD_SUBSYSTEM_COUNT]; /**< Per subsystem share of the window, permille. */
+    uint16_t current_ua;                            /**< Projected average CPU current. */
+} estc_load_t;
+
+/**@brief Start the first window. Requires estc_perf_init() to have enabled the cycle counter. */
+void estc_load_init(void);
+
+/**@brief Close the current window, publish it to the metrics gauges and start the next one. */
+void estc_load_update(void);
+
+/**@brief Result of the last closed window. */
+void estc_load_get(estc_load_t * p_load);
+
+#endif /* ESTC_LOAD_H__ */
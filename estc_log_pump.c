@@ -0,0 +1,96 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_log_pump.h"
+
+#include "sdk_common.h"
+#include "nrf.h"
+#include "nrf_log.h"
+#include "nrf_log_ctrl.h"
+#include "nrf_log_backend_usb.h"
+
+#include "estc_metrics.h"
+#include "estc_perf.h"
+#include "estc_usb_bridge.h"
+
+#define US_TO_CYCLES(us)    ((uint32_t)(((uint64_t)(us) * SystemCoreClock) / 1000000))
+
+static estc_log_pump_stats_t m_stats;
+
+bool estc_log_pump_run(bool ble_backlog)
+{
+    bool     pending;
+    bool     busy   = ble_backlog || (estc_usb_bridge_tx_depth() != 0);
+    uint32_t budget = US_TO_CYCLES(busy ? ESTC_LOG_PUMP_BUSY_BUDGET_US : ESTC_LOG_PUMP_BUDGET_US);
+    uint32_t start  = DWT->CYCCNT;
+    uint32_t count  = 0;
+
+    ESTC_PERF_BEGIN(ESTC_PERF_LOG);
+
+    do
+    {
+        pending = NRF_LOG_PROCESS();
+        count++;
+    } while (pending && ((DWT->CYCCNT - start) < budget));
+
+    // Hands the formatted output to the CDC ACM class, once per pass
+    LOG_BACKEND_USB_PROCESS();
+
+    ESTC_PERF_END(ESTC_PERF_LOG);
+
+    // NRF_LOG_PROCESS() reports whether entries are left, not whether it processed one, so a
+    // single call cannot tell an idle pass from one that flushed the last entry
+    if (count > 1)
+    {
+        m_stats.passes++;
+        m_stats.budget_exhausted += pending ? 1 : 0;
+        m_stats.throttled += busy ? 1 : 0;
+        m_stats.max_batch = MAX(m_stats.max_batch, count);
+
+        estc_metrics_gauge_set(ESTC_METRICS_GAUGE_LOG_DEFERRED, (uint16_t)MIN(m_stats.budget_exhausted, UINT16_MAX));
+        estc_metrics_gauge_set(ESTC_METRICS_GAUGE_LOG_THROTTLED, (uint16_t)MIN(m_stats.throttled, UINT16_MAX));
+    }
+
+    return pending;
+}
+
+void estc_log_pump_stats_get(estc_log_pump_stats_t * p_stats)
+{
+    if (p_stats != NULL)
+    {
+        *p_stats = m_stats;
+    }
+}
+
+void estc_log_pump_report(void)
+{
+    NRF_LOG_INFO("log pump: %d backlog passes, %d out of budget, %d throttled, max batch %d",
+                 m_stats.passes, m_stats.budget_exhausted, m_stats.throttled, m_stats.max_batch);
+}
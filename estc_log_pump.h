@@ -0,0 +1,63 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_LOG_PUMP_H__
+#define ESTC_LOG_PUMP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Processes deferred log entries from the main loop within a cycle budget per pass. While
+// notifications wait for room in the SoftDevice or records wait in the USB bridge the budget shrinks
+// to ESTC_LOG_PUMP_BUSY_BUDGET_US, so debug logging does not hold back the data path. At least one
+// entry is processed per pass, the log always makes progress. The pass counters are also published
+// as metrics gauges.
+
+typedef struct
+{
+    uint32_t passes;            /**< Passes that found a backlog of more than one entry. */
+    uint32_t budget_exhausted;  /**< Passes that stopped with entries left. */
+    uint32_t throttled;         /**< Backlog passes that ran with the busy budget. */
+    uint32_t max_batch;         /**< Most entries processed in a single pass. */
+} estc_log_pump_stats_t;
+
+/**@brief Process log entries and the USB log backend for one main loop pass.
+ *
+ * @param[in] ble_backlog  Notifications were refused for a full SoftDevice queue, see estc_ble_service_hvx_backlog().
+ *
+ * @return true if entries are left and the loop should not go to sleep.
+ */
+bool estc_log_pump_run(bool ble_backlog);
+
+void estc_log_pump_stats_get(estc_log_pump_stats_t * p_stats);
+
+void estc_log_pump_report(void);
+
+#endif /* ESTC_LOG_PUMP_H__ */
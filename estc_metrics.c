@@ -0,0 +1,213 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_metrics.h"
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "nrf_atomic.h"
+#include "nrf_sdh_ble.h"
+
+#include "ble.h"
+#include "ble_gap.h"
+#include "ble_gatts.h"
+
+#include "estc_section.h"
+
+typedef struct
+{
+    nrf_atomic_u32_t hvx_attempts;
+    nrf_atomic_u32_t hvx_success;
+    nrf_atomic_u32_t hvx_resources;
+    nrf_atomic_u32_t tx_bytes;
+    nrf_atomic_u32_t rx_bytes;
+} char_counters_t;
+
+static nrf_atomic_u32_t  m_connections;
+static nrf_atomic_u32_t  m_hvx_queued;
+static volatile uint16_t m_gauges[ESTC_METRICS_GAUGE_COUNT];
+static char_counters_t   m_chars[ESTC_METRICS_CHAR_COUNT];
+static uint16_t          m_handles[ESTC_METRICS_CHAR_COUNT];
+
+void estc_metrics_init(void)
+{
+    m_connections = 0;
+    m_hvx_queued  = 0;
+    memset((void *)m_gauges, 0, sizeof(m_gauges));
+    memset(m_chars, 0, sizeof(m_chars));
+    memset(m_handles, 0, sizeof(m_handles));
+}
+
+void estc_metrics_char_bind(estc_metrics_char_t id, uint16_t value_handle)
+{
+    if (id < ESTC_METRICS_CHAR_COUNT)
+    {
+        m_handles[id] = value_handle;
+    }
+}
+
+ESTC_HOT void estc_metrics_hvx_record(estc_metrics_char_t id, ret_code_t err_code, uint16_t len)
+{
+    if (id >= ESTC_METRICS_CHAR_COUNT)
+    {
+        return;
+    }
+
+    char_counters_t * p_char = &m_chars[id];
+
+    (void)nrf_atomic_u32_add(&p_char->hvx_attempts, 1);
+
+    if (err_code == NRF_SUCCESS)
+    {
+        (void)nrf_atomic_u32_add(&p_char->hvx_success, 1);
+        (void)nrf_atomic_u32_add(&p_char->tx_bytes, len);
+    }
+    else if (err_code == NRF_ERROR_RESOURCES)
+    {
+        (void)nrf_atomic_u32_add(&p_char->hvx_resources, 1);
+    }
+
+    estc_metrics_hvx_queue_record(err_code);
+}
+
+ESTC_HOT void estc_metrics_hvx_queue_record(ret_code_t err_code)
+{
+    if (err_code == NRF_SUCCESS)
+    {
+        m_gauges[ESTC_METRICS_GAUGE_HVX_QUEUED] = (uint16_t)nrf_atomic_u32_add(&m_hvx_queued, 1);
+    }
+}
+
+void estc_metrics_gauge_set(estc_metrics_gauge_t gauge, uint16_t value)
+{
+    if (gauge < ESTC_METRICS_GAUGE_COUNT)
+    {
+        m_gauges[gauge] = value;
+    }
+}
+
+uint16_t estc_metrics_gauge_get(estc_metrics_gauge_t gauge)
+{
+    return (gauge < ESTC_METRICS_GAUGE_COUNT) ? m_gauges[gauge] : 0;
+}
+
+void estc_metrics_snapshot_get(estc_metrics_snapshot_t * p_snapshot)
+{
+    if (p_snapshot == NULL)
+    {
+        return;
+    }
+
+    p_snapshot->connections = m_connections;
+
+    for (uint8_t i = 0; i < ESTC_METRICS_GAUGE_COUNT; i++)
+    {
+        p_snapshot->gauges[i] = m_gauges[i];
+    }
+
+    for (uint8_t i = 0; i < ESTC_METRICS_CHAR_COUNT; i++)
+    {
+        p_snapshot->chars[i].hvx_attempts  = m_chars[i].hvx_attempts;
+        p_snapshot->chars[i].hvx_success   = m_chars[i].hvx_success;
+        p_snapshot->chars[i].hvx_resources = m_chars[i].hvx_resources;
+        p_snapshot->chars[i].tx_bytes      = m_chars[i].tx_bytes;
+        p_snapshot->chars[i].rx_bytes      = m_chars[i].rx_bytes;
+    }
+}
+
+static void on_write(ble_gatts_evt_write_t const * p_write)
+{
+    for (uint8_t i = 0; i < ESTC_METRICS_CHAR_COUNT; i++)
+    {
+        if ((m_handles[i] != 0) && (m_handles[i] == p_write->handle))
+        {
+            (void)nrf_atomic_u32_add(&m_chars[i].rx_bytes, p_write->len);
+            return;
+        }
+    }
+}
+
+ESTC_HOT static void on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            (void)nrf_atomic_u32_add(&m_connections, 1);
+            m_gauges[ESTC_METRICS_GAUGE_PHY_TX]        = BLE_GAP_PHY_1MBPS;
+            m_gauges[ESTC_METRICS_GAUGE_PHY_RX]        = BLE_GAP_PHY_1MBPS;
+            m_gauges[ESTC_METRICS_GAUGE_MTU]           = BLE_GATT_ATT_MTU_DEFAULT;
+            m_gauges[ESTC_METRICS_GAUGE_CONN_INTERVAL] =
+                p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval;
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            // Notifications still queued are dropped together with the link
+            m_hvx_queued = 0;
+            m_gauges[ESTC_METRICS_GAUGE_HVX_QUEUED]    = 0;
+            m_gauges[ESTC_METRICS_GAUGE_PHY_TX]        = 0;
+            m_gauges[ESTC_METRICS_GAUGE_PHY_RX]        = 0;
+            m_gauges[ESTC_METRICS_GAUGE_MTU]           = 0;
+            m_gauges[ESTC_METRICS_GAUGE_CONN_INTERVAL] = 0;
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            m_gauges[ESTC_METRICS_GAUGE_CONN_INTERVAL] =
+                p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval;
+            break;
+
+        case BLE_GAP_EVT_PHY_UPDATE:
+            if (p_ble_evt->evt.gap_evt.params.phy_update.status == BLE_HCI_STATUS_CODE_SUCCESS)
+            {
+                m_gauges[ESTC_METRICS_GAUGE_PHY_TX] = p_ble_evt->evt.gap_evt.params.phy_update.tx_phy;
+                m_gauges[ESTC_METRICS_GAUGE_PHY_RX] = p_ble_evt->evt.gap_evt.params.phy_update.rx_phy;
+            }
+            break;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+        {
+            uint8_t  count  = p_ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+            uint32_t queued = m_hvx_queued;
+
+            // A disconnect may have reset the counter while packets were in flight
+            count = (count > queued) ? (uint8_t)queued : count;
+            m_gauges[ESTC_METRICS_GAUGE_HVX_QUEUED] = (uint16_t)nrf_atomic_u32_sub(&m_hvx_queued, count);
+        } break;
+
+        case BLE_GATTS_EVT_WRITE:
+            on_write(&p_ble_evt->evt.gatts_evt.params.write);
+            break;
+
+        default:
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_estc_metrics_observer, ESTC_METRICS_BLE_OBSERVER_PRIO, on_ble_evt, NULL);
@@ -0,0 +1,68 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_METRICS_H__
+#define ESTC_METRICS_H__
+
+#include <stdint.h>
+
+#include "ble.h"
+#include "sdk_errors.h"
+
+#include "estc_metrics_snapshot.h"
+
+// Counters are bumped with nrf_atomic from any context and gauges are plain word stores, so
+// recording never masks interrupts. A snapshot may mix values from before and after a concurrent
+// update, but every field is consistent on its own.
+
+/**@brief Reset all counters and gauges. */
+void estc_metrics_init(void);
+
+/**@brief Associate a characteristic value handle with its statistics slot, used to count written bytes. */
+void estc_metrics_char_bind(estc_metrics_char_t id, uint16_t value_handle);
+
+/**@brief Account one sd_ble_gatts_hvx() call and its outcome. */
+void estc_metrics_hvx_record(estc_metrics_char_t id, ret_code_t err_code, uint16_t len);
+
+/**@brief Account a notification that has no statistics slot of its own.
+ *
+ * @details BLE_GATTS_EVT_HVN_TX_COMPLETE counts the notifications of every characteristic, so every
+ *          sd_ble_gatts_hvx() notification goes through this or estc_metrics_hvx_record() to keep
+ *          ESTC_METRICS_GAUGE_HVX_QUEUED exact.
+ */
+void estc_metrics_hvx_queue_record(ret_code_t err_code);
+
+void estc_metrics_gauge_set(estc_metrics_gauge_t gauge, uint16_t value);
+
+uint16_t estc_metrics_gauge_get(estc_metrics_gauge_t gauge);
+
+void estc_metrics_snapshot_get(estc_metrics_snapshot_t * p_snapshot);
+
+#endif /* ESTC_METRICS_H__ */
@@ -0,0 +1,127 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_metrics_snapshot.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "estc_le.h"
+
+uint16_t estc_metrics_snapshot_encode(estc_metrics_snapshot_t const * p_snapshot, uint8_t * p_buf, uint16_t buf_len)
+{
+    if ((p_snapshot == NULL) || (p_buf == NULL) || (buf_len < ESTC_METRICS_SNAPSHOT_LEN_MAX))
+    {
+        return 0;
+    }
+
+    uint8_t * p = p_buf;
+
+    *p++ = ESTC_METRICS_SNAPSHOT_VERSION;
+    *p++ = ESTC_METRICS_GAUGE_COUNT;
+    *p++ = ESTC_METRICS_CHAR_COUNT;
+    p    = estc_le_put_u32(p, p_snapshot->connections);
+
+    for (uint8_t i = 0; i < ESTC_METRICS_GAUGE_COUNT; i++)
+    {
+        p = estc_le_put_u16(p, p_snapshot->gauges[i]);
+    }
+
+    for (uint8_t i = 0; i < ESTC_METRICS_CHAR_COUNT; i++)
+    {
+        estc_metrics_char_stats_t const * p_char = &p_snapshot->chars[i];
+
+        p = estc_le_put_u32(p, p_char->hvx_attempts);
+        p = estc_le_put_u32(p, p_char->hvx_success);
+        p = estc_le_put_u32(p, p_char->hvx_resources);
+        p = estc_le_put_u32(p, p_char->tx_bytes);
+        p = estc_le_put_u32(p, p_char->rx_bytes);
+    }
+
+    return (uint16_t)(p - p_buf);
+}
+
+bool estc_metrics_snapshot_decode(uint8_t const * p_buf, uint16_t len, estc_metrics_snapshot_t * p_snapshot)
+{
+    uint8_t  gauge_cnt;
+    uint8_t  char_cnt;
+    uint16_t gauge;
+
+    if ((p_buf == NULL) || (p_snapshot == NULL) || (len < ESTC_METRICS_SNAPSHOT_HDR_LEN))
+    {
+        return false;
+    }
+
+    uint8_t const * p = p_buf;
+
+    if (*p++ != ESTC_METRICS_SNAPSHOT_VERSION)
+    {
+        return false;
+    }
+
+    gauge_cnt = *p++;
+    char_cnt  = *p++;
+
+    if (ESTC_METRICS_SNAPSHOT_LEN(gauge_cnt, char_cnt) > len)
+    {
+        return false;
+    }
+
+    memset(p_snapshot, 0, sizeof(*p_snapshot));
+    p = estc_le_get_u32(p, &p_snapshot->connections);
+
+    for (uint8_t i = 0; i < gauge_cnt; i++)
+    {
+        p = estc_le_get_u16(p, &gauge);
+        if (i < ESTC_METRICS_GAUGE_COUNT)
+        {
+            p_snapshot->gauges[i] = gauge;
+        }
+    }
+
+    for (uint8_t i = 0; i < char_cnt; i++)
+    {
+        if (i >= ESTC_METRICS_CHAR_COUNT)
+        {
+            p += ESTC_METRICS_SNAPSHOT_CHAR_LEN;
+            continue;
+        }
+
+        estc_metrics_char_stats_t * p_char = &p_snapshot->chars[i];
+
+        p = estc_le_get_u32(p, &p_char->hvx_attempts);
+        p = estc_le_get_u32(p, &p_char->hvx_success);
+        p = estc_le_get_u32(p, &p_char->hvx_resources);
+        p = estc_le_get_u32(p, &p_char->tx_bytes);
+        p = estc_le_get_u32(p, &p_char->rx_bytes);
+    }
+
+    return true;
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_METRICS_SNAPSHOT_H__
+#define ESTC_METRICS_SNAPSHOT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Snapshot layout, all fields little-endian:
+//   version (1) | gauge_cnt (1) | char_cnt (1) | connections (4)
+//   gauges: gauge_cnt x uint16
+//   per characteristic: char_cnt x (hvx_attempts, hvx_success, hvx_resources, tx_bytes, rx_bytes) as uint32
+// Counts are carried in the header, so a decoder skips gauges and characteristics it does not know.
+// Like the telemetry frame this only depends on the C library and builds on a host as is.
+
+#define ESTC_METRICS_SNAPSHOT_VERSION       1
+#define ESTC_METRICS_SNAPSHOT_HDR_LEN       7
+#define ESTC_METRICS_SNAPSHOT_CHAR_LEN      (5 * sizeof(uint32_t))
+
+#define ESTC_METRICS_SNAPSHOT_LEN(gauge_cnt, char_cnt)                                                  \
+    (ESTC_METRICS_SNAPSHOT_HDR_LEN + (gauge_cnt) * sizeof(uint16_t) + (char_cnt) * ESTC_METRICS_SNAPSHOT_CHAR_LEN)
+
+typedef enum
+{
+    ESTC_METRICS_GAUGE_MTU,             /**< Effective ATT MTU. */
+    ESTC_METRICS_GAUGE_PHY_TX,          /**< BLE_GAP_PHY_* in use. */
+    ESTC_METRICS_GAUGE_PHY_RX,
+    ESTC_METRICS_GAUGE_CONN_INTERVAL,   /**< In 1.25 ms units. */
+    ESTC_METRICS_GAUGE_HVX_QUEUED,      /**< Notifications queued in the SoftDevice. */
+    ESTC_METRICS_GAUGE_USB_TX_QUEUED,   /**< Records waiting in the USB bridge. */
+    ESTC_METRICS_GAUGE_CPU_LOAD,        /**< Share of the last load window the CPU was awake, in permille. */
+    ESTC_METRICS_GAUGE_CPU_CURRENT,     /**< Projected average CPU current in uA, radio excluded. */
+    ESTC_METRICS_GAUGE_LOAD_BLE,        /**< Permille of the window spent in the application BLE handler. */
+    ESTC_METRICS_GAUGE_LOAD_PRODUCERS,  /**< Permille spent sampling and publishing telemetry. */
+    ESTC_METRICS_GAUGE_LOAD_USB,        /**< Permille spent in the USB bridge. */
+    ESTC_METRICS_GAUGE_LOAD_LOG,        /**< Permille spent processing and flushing logs. */
+    ESTC_METRICS_GAUGE_LATENCY_MEAN,    /**< Mean telemetry sample-to-air latency in 100 us units. */
+    ESTC_METRICS_GAUGE_LATENCY_MAX,     /**< Longest telemetry sample-to-air latency since boot in 100 us units. */
+    ESTC_METRICS_GAUGE_DFU_PROGRESS,    /**< Permille of the image staged in flash. */
+    ESTC_METRICS_GAUGE_DFU_RATE,        /**< Staging throughput in 100 B/s units. */
+    ESTC_METRICS_GAUGE_TTC_VERY_FAST,   /**< Mean time to connect of links made in this ADV stage, in 100 ms units. */
+    ESTC_METRICS_GAUGE_TTC_FAST,
+    ESTC_METRICS_GAUGE_TTC_SLOW,
+    ESTC_METRICS_GAUGE_TTC_VERY_SLOW,
+    ESTC_METRICS_GAUGE_LOG_DEFERRED,    /**< Log pump passes that left entries for the next one, saturating. */
+    ESTC_METRICS_GAUGE_LOG_THROTTLED,   /**< Log pump passes cut to the busy budget, saturating. */
+
+    ESTC_METRICS_GAUGE_COUNT
+} estc_metrics_gauge_t;
+
+typedef enum
+{
+    ESTC_METRICS_CHAR_1,
+    ESTC_METRICS_CHAR_HELLO,
+    ESTC_METRICS_CHAR_TELEMETRY,
+
+    ESTC_METRICS_CHAR_COUNT
+} estc_metrics_char_t;
+
+typedef struct
+{
+    uint32_t hvx_attempts;
+    uint32_t hvx_success;
+    uint32_t hvx_resources;     /**< Attempts rejected with NRF_ERROR_RESOURCES, the SoftDevice queue was full. */
+    uint32_t tx_bytes;          /**< Bytes of successfully queued notifications. */
+    uint32_t rx_bytes;          /**< Bytes written by the peer. */
+} estc_metrics_char_stats_t;
+
+typedef struct
+{
+    uint32_t                  connections;
+    uint16_t                  gauges[ESTC_METRICS_GAUGE_COUNT];
+    estc_metrics_char_stats_t chars[ESTC_METRICS_CHAR_COUNT];
+} estc_metrics_snapshot_t;
+
+#define ESTC_METRICS_SNAPSHOT_LEN_MAX   ESTC_METRICS_SNAPSHOT_LEN(ESTC_METRICS_GAUGE_COUNT, ESTC_METRICS_CHAR_COUNT)
+
+/**@brief Serialize a snapshot.
+ *
+ * @return Encoded length, or 0 if it does not fit into @p buf_len.
+ */
+uint16_t estc_metrics_snapshot_encode(estc_metrics_snapshot_t const * p_snapshot, uint8_t * p_buf, uint16_t buf_len);
+
+/**@brief Parse a snapshot read from the device. Fields missing from an older encoder are zeroed.
+ *
+ * @return false if the buffer is truncated or has an unknown version.
+ */
+bool estc_metrics_snapshot_decode(uint8_t const * p_buf, uint16_t len, estc_metrics_snapshot_t * p_snapshot);
+
+#endif /* ESTC_METRICS_SNAPSHOT_H__ */
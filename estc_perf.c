@@ -0,0 +1,161 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_perf.h"
+
+#include <string.h>
+
+#include "nrf_log.h"
+
+#include "estc_section.h"
+
+#define BENCH_SLOTS         8
+#define BENCH_SLOT_SIZE     32
+#define BENCH_PAYLOAD_LEN   20      /**< Notification payload at the default MTU. */
+#define BENCH_CALLS         256
+
+static const char * const m_probe_names[ESTC_PERF_PROBE_COUNT] =
+{
+    [ESTC_PERF_BLE_EVT]    = "ble_evt",
+    [ESTC_PERF_TELEMETRY]  = "telemetry",
+    [ESTC_PERF_NOTIFY]     = "notify",
+    [ESTC_PERF_USB_BRIDGE] = "usb_bridge",
+    [ESTC_PERF_LOG]        = "log",
+};
+
+// Probes of different priorities touch different entries, so no locking is needed
+static estc_perf_stats_t m_stats[ESTC_PERF_PROBE_COUNT];
+
+#if ESTC_PERF_ENABLED
+static uint8_t m_bench_ring[BENCH_SLOTS][BENCH_SLOT_SIZE];
+static uint8_t m_bench_head;
+
+// Both placements run the same body: enqueue one payload into a slot ring, byte by byte so the
+// compiler cannot turn it into a memcpy() call that would execute from flash
+static inline __attribute__((always_inline)) void bench_body(uint8_t const * p_data)
+{
+    uint8_t volatile * p_slot = m_bench_ring[m_bench_head++ % BENCH_SLOTS];
+
+    for (uint32_t i = 0; i < BENCH_PAYLOAD_LEN; i++)
+    {
+        p_slot[i] = p_data[i];
+    }
+}
+
+ESTC_HOT __attribute__((noinline)) static void bench_flash(uint8_t const * p_data)
+{
+    bench_body(p_data);
+}
+
+ESTC_RAMFUNC __attribute__((noinline)) static void bench_ram(uint8_t const * p_data)
+{
+    bench_body(p_data);
+}
+
+/**@return Average cycles per call; @p p_first receives the cycles of the first, cold call. */
+static uint32_t bench_run(void (* fn)(uint8_t const *), uint32_t * p_first)
+{
+    uint8_t  payload[BENCH_PAYLOAD_LEN] = {0};
+    uint32_t start;
+
+    start    = DWT->CYCCNT;
+    fn(payload);
+    *p_first = DWT->CYCCNT - start;
+
+    start = DWT->CYCCNT;
+    for (uint32_t i = 0; i < BENCH_CALLS; i++)
+    {
+        fn(payload);
+    }
+
+    return (DWT->CYCCNT - start) / BENCH_CALLS;
+}
+#endif // ESTC_PERF_ENABLED
+
+void estc_perf_init(void)
+{
+    memset(m_stats, 0, sizeof(m_stats));
+
+    // Runs without the probes as well, the log pump budget is measured in cycles
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT       = 0;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void estc_perf_record(estc_perf_probe_t probe, uint32_t cycles)
+{
+    estc_perf_stats_t * p_stats = &m_stats[probe];
+
+    if ((p_stats->calls == 0) || (cycles < p_stats->min))
+    {
+        p_stats->min = cycles;
+    }
+    if (cycles > p_stats->max)
+    {
+        p_stats->max = cycles;
+    }
+    p_stats->total += cycles;
+    p_stats->calls++;
+}
+
+void estc_perf_stats_get(estc_perf_probe_t probe, estc_perf_stats_t * p_stats)
+{
+    *p_stats = m_stats[probe];
+}
+
+void estc_perf_report(void)
+{
+    for (uint32_t i = 0; i < ESTC_PERF_PROBE_COUNT; i++)
+    {
+        estc_perf_stats_t const * p_stats = &m_stats[i];
+
+        if (p_stats->calls == 0)
+        {
+            continue;
+        }
+
+        NRF_LOG_INFO("perf %s: %d calls, min %d, avg %d, max %d cycles",
+                     m_probe_names[i], p_stats->calls, p_stats->min,
+                     (uint32_t)(p_stats->total / p_stats->calls), p_stats->max);
+    }
+}
+
+void estc_perf_ramfunc_bench(void)
+{
+#if ESTC_PERF_ENABLED
+    uint32_t flash_first;
+    uint32_t ram_first;
+    uint32_t flash_avg = bench_run(bench_flash, &flash_first);
+    uint32_t ram_avg   = bench_run(bench_ram, &ram_first);
+
+    NRF_LOG_INFO("ramfunc bench: flash %d cycles/call (first %d), RAM %d cycles/call (first %d), delta %d",
+                 flash_avg, flash_first, ram_avg, ram_first, (int32_t)(flash_avg - ram_avg));
+#endif
+}
@@ -0,0 +1,86 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_PERF_H__
+#define ESTC_PERF_H__
+
+#include <stdint.h>
+
+#include "sdk_config.h"
+#include "nrf.h"
+
+// Cycle counting with the DWT cycle counter. Probes cost a few cycles each and can stay in
+// release builds; with ESTC_PERF_ENABLED set to 0 they compile to nothing.
+
+typedef enum
+{
+    ESTC_PERF_BLE_EVT,          /**< Application BLE event handler. */
+    ESTC_PERF_TELEMETRY,        /**< Sample timer, including frame encoding and publishing. */
+    ESTC_PERF_NOTIFY,           /**< Telemetry value update and notification. */
+    ESTC_PERF_USB_BRIDGE,       /**< USB bridge processing in the main loop. */
+    ESTC_PERF_LOG,              /**< Log processing and the USB log backend in the main loop. */
+
+    ESTC_PERF_PROBE_COUNT
+} estc_perf_probe_t;
+
+typedef struct
+{
+    uint32_t calls;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+} estc_perf_stats_t;
+
+#if ESTC_PERF_ENABLED
+
+#define ESTC_PERF_BEGIN(probe)  uint32_t const estc_perf_start_##probe = DWT->CYCCNT
+#define ESTC_PERF_END(probe)    estc_perf_record((probe), DWT->CYCCNT - estc_perf_start_##probe)
+
+#else
+
+#define ESTC_PERF_BEGIN(probe)
+#define ESTC_PERF_END(probe)
+
+#endif
+
+/**@brief Start the cycle counter. */
+void estc_perf_init(void);
+
+void estc_perf_record(estc_perf_probe_t probe, uint32_t cycles);
+
+void estc_perf_stats_get(estc_perf_probe_t probe, estc_perf_stats_t * p_stats);
+
+/**@brief Log calls, average and worst case cycles of every probe that has fired. */
+void estc_perf_report(void);
+
+/**@brief Run one ring buffer workload placed in flash and in RAM and log the cycles per call of both. */
+void estc_perf_ramfunc_bench(void);
+
+#endif /* ESTC_PERF_H__ */
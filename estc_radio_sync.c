@@ -0,0 +1,166 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_radio_sync.h"
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "app_util_platform.h"
+#include "ble_radio_notification.h"
+#include "nrf_log.h"
+#include "nrf_sdh_ble.h"
+
+#include "ble.h"
+#include "ble_gap.h"
+
+#include "estc_metrics.h"
+#include "estc_time.h"
+
+static const uint32_t m_bucket_limits_us[ESTC_RADIO_SYNC_LATENCY_BUCKETS - 1] =
+{
+    1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+static estc_radio_sync_prepare_handler_t m_prepare_handler;
+static uint8_t                           m_links;
+static bool                              m_mark_open;
+static uint64_t                          m_mark_ticks;
+static estc_radio_sync_latency_t         m_latency;
+
+static void latency_record(uint32_t latency_us)
+{
+    uint32_t bucket = 0;
+
+    while ((bucket < ARRAY_SIZE(m_bucket_limits_us)) && (latency_us >= m_bucket_limits_us[bucket]))
+    {
+        bucket++;
+    }
+
+    if ((m_latency.samples == 0) || (latency_us < m_latency.min_us))
+    {
+        m_latency.min_us = latency_us;
+    }
+    m_latency.max_us    = MAX(m_latency.max_us, latency_us);
+    m_latency.total_us += latency_us;
+    m_latency.samples++;
+    m_latency.buckets[bucket]++;
+
+    // Gauges are in 100 us units
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_LATENCY_MEAN, (uint16_t)MIN(m_latency.total_us / m_latency.samples / 100, UINT16_MAX));
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_LATENCY_MAX, (uint16_t)MIN(m_latency.max_us / 100, UINT16_MAX));
+}
+
+static void on_radio_evt(bool radio_active)
+{
+    if (m_links == 0)
+    {
+        return;
+    }
+
+    if (radio_active)
+    {
+        if (m_prepare_handler != NULL)
+        {
+            m_prepare_handler();
+        }
+    }
+    else if (m_mark_open)
+    {
+        m_mark_open = false;
+        latency_record((uint32_t)estc_time_ticks_to_us(estc_time_ticks() - m_mark_ticks));
+    }
+}
+
+static void on_ble_evt(ble_evt_t const * p_ble_evt, void * p_context)
+{
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            m_links++;
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            m_links--;
+            m_mark_open = false;
+            break;
+
+        default:
+            break;
+    }
+}
+
+NRF_SDH_BLE_OBSERVER(m_estc_radio_sync_observer, ESTC_RADIO_SYNC_BLE_OBSERVER_PRIO, on_ble_evt, NULL);
+
+ret_code_t estc_radio_sync_init(estc_radio_sync_prepare_handler_t prepare_handler)
+{
+    m_prepare_handler = prepare_handler;
+    m_links           = 0;
+    m_mark_open       = false;
+    memset(&m_latency, 0, sizeof(m_latency));
+
+    // Same priority as the SoftDevice events and app_timer, so the handlers never preempt each other
+    return ble_radio_notification_init(APP_IRQ_PRIORITY_LOW, ESTC_RADIO_SYNC_DISTANCE, on_radio_evt);
+}
+
+void estc_radio_sync_latency_start(void)
+{
+    CRITICAL_REGION_ENTER();
+    if (!m_mark_open)
+    {
+        m_mark_ticks = estc_time_ticks();
+        m_mark_open  = true;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void estc_radio_sync_latency_get(estc_radio_sync_latency_t * p_latency)
+{
+    if (p_latency != NULL)
+    {
+        *p_latency = m_latency;
+    }
+}
+
+void estc_radio_sync_report(void)
+{
+    if (m_latency.samples == 0)
+    {
+        return;
+    }
+
+    NRF_LOG_INFO("sample-to-air: %d samples, min %d us, avg %d us, max %d us",
+                 m_latency.samples, m_latency.min_us,
+                 (uint32_t)(m_latency.total_us / m_latency.samples), m_latency.max_us);
+    NRF_LOG_INFO("  <1ms %d, <2ms %d, <5ms %d, <10ms %d",
+                 m_latency.buckets[0], m_latency.buckets[1], m_latency.buckets[2], m_latency.buckets[3]);
+    NRF_LOG_INFO("  <20ms %d, <50ms %d, <100ms %d, more %d",
+                 m_latency.buckets[4], m_latency.buckets[5], m_latency.buckets[6], m_latency.buckets[7]);
+}
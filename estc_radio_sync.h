@@ -0,0 +1,71 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_RADIO_SYNC_H__
+#define ESTC_RADIO_SYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+// Aligns data production with the connection events. The SoftDevice radio notification fires
+// ESTC_RADIO_SYNC_DISTANCE before every radio event; while connected the prepare handler runs
+// there, so whatever it queues goes out in the event that follows. The notification at the end of
+// the event closes the latency measurement started by estc_radio_sync_latency_start(). The
+// notification does not say which role a radio event belongs to; estc_adv keeps every advertising
+// set stopped while a link is up, so all of them are connection events.
+
+#define ESTC_RADIO_SYNC_LATENCY_BUCKETS 8
+
+/**@brief Called shortly before a radio event while a link is up. */
+typedef void (*estc_radio_sync_prepare_handler_t)(void);
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[ESTC_RADIO_SYNC_LATENCY_BUCKETS];  /**< Upper bounds in estc_radio_sync.c. */
+} estc_radio_sync_latency_t;
+
+ret_code_t estc_radio_sync_init(estc_radio_sync_prepare_handler_t prepare_handler);
+
+/**@brief Note that data was just produced and queued. The time until the end of the next radio
+ *        event is recorded as its sample-to-air latency. A mark that is still open is kept.
+ */
+void estc_radio_sync_latency_start(void);
+
+void estc_radio_sync_latency_get(estc_radio_sync_latency_t * p_latency);
+
+void estc_radio_sync_report(void);
+
+#endif /* ESTC_RADIO_SYNC_H__ */
@@ -0,0 +1,66 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_SECTION_H__
+#define ESTC_SECTION_H__
+
+// Placement of performance critical code. Only depends on the compiler and the configuration, so
+// modules that are also built on a host can use it.
+
+#include "sdk_config.h"
+
+#if defined(__GNUC__) && defined(__arm__)
+
+/**@brief Code on the BLE notification path.
+ *
+ * @details Collected into one contiguous block right after .text by estc_gatt_srv_gcc_nrf52.ld,
+ *          so the hot path shares cache lines instead of being spread over the image.
+ */
+#define ESTC_HOT        __attribute__((section(".estc_hot")))
+
+#if ESTC_RAMFUNC_ENABLED
+/**@brief Code executed from RAM, free of flash wait states and cache misses under radio activity.
+ *
+ * @details Copied to RAM by the startup code together with .data. Calls between flash and RAM go
+ *          through linker generated veneers, so keep RAM functions to the leaves of the hot path.
+ */
+#define ESTC_RAMFUNC    __attribute__((section(".estc_ramfunc"), noinline))
+#else
+#define ESTC_RAMFUNC    ESTC_HOT
+#endif
+
+#else
+
+#define ESTC_HOT
+#define ESTC_RAMFUNC
+
+#endif
+
+#endif /* ESTC_SECTION_H__ */
@@ -30,12 +30,25 @@
 
 #include "estc_service.h"
 
+#include <string.h>
+
 #include "app_error.h"
 #include "nrf_log.h"
 
 #include "ble.h"
 #include "ble_gatts.h"
 #include "ble_srv_common.h"
+#include "app_timer.h"
+#include "nrf_soc.h"
+
+#include "estc_telemetry_frame.h"
+#include "estc_change.h"
+#include "estc_ctrl.h"
+#include "estc_metrics.h"
+#include "estc_metrics_snapshot.h"
+#include "estc_perf.h"
+#include "estc_section.h"
+#include "estc_time.h"
 
 ble_uuid128_t base_uuid = {
     .uuid128 = ESTC_BASE_UUID
@@ -43,10 +56,42 @@ ble_uuid128_t base_uuid = {
 
 uint8_t m_char_user_desc[] = "Custom Characteristic";
 
+static uint8_t m_metrics_cache[ESTC_METRICS_SNAPSHOT_LEN_MAX];
+
+#define ESTC_SNAPSHOT_SECTION_CNT 6
+#define ESTC_SNAPSHOT_LEN_MAX                                                                           \
+    (ESTC_SNAPSHOT_HDR_LEN + ESTC_SNAPSHOT_SECTION_CNT * ESTC_SNAPSHOT_SECTION_HDR_LEN + sizeof(uint16_t)   \
+     + sizeof(m_char_hello_val) + ESTC_TELEMETRY_FRAME_LEN_MAX + ESTC_METRICS_SNAPSHOT_LEN_MAX              \
+     + ESTC_CHANGE_CFG_TABLE_LEN + ESTC_CTRL_RSP_LEN_MAX)
+
 uint8_t m_char_hello_val[] = "Hello";
 uint8_t m_char_hello_val_reversed[] = "olleH";
 
+static uint8_t m_snapshot_cache[ESTC_SNAPSHOT_LEN_MAX];
+
+// Long reads can fetch up to the largest attribute value, section lengths are one byte
+STATIC_ASSERT(sizeof(m_snapshot_cache) <= BLE_GATTS_VAR_ATTR_LEN_MAX);
+STATIC_ASSERT(MAX(ESTC_TELEMETRY_FRAME_LEN_MAX, ESTC_METRICS_SNAPSHOT_LEN_MAX) <= UINT8_MAX);
+
+static uint8_t m_transport_buf[ESTC_TRANSPORT_BUF_SIZE];
+static uint8_t m_transport_value[ESTC_TRANSPORT_SEG_HDR_LEN + ESTC_TRANSPORT_SEG_PAYLOAD_MAX];
+static uint8_t m_transport_state[ESTC_TRANSPORT_STATE_LEN];
+
+STATIC_ASSERT((ESTC_TRANSPORT_BUF_SIZE & (ESTC_TRANSPORT_BUF_SIZE - 1)) == 0);
+STATIC_ASSERT(ESTC_TRANSPORT_MSG_LEN_MAX + ESTC_TRANSPORT_MSG_OVERHEAD <= ESTC_TRANSPORT_BUF_SIZE);
+
+static ret_code_t estc_ble_add_layout_characteristic(ble_estc_service_t *service);
 static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service);
+static ret_code_t estc_ble_add_telemetry_characteristic(ble_estc_service_t *service);
+static ret_code_t estc_ble_add_metrics_characteristic(ble_estc_service_t *service);
+static ret_code_t estc_ble_add_change_cfg_characteristic(ble_estc_service_t *service);
+static ret_code_t estc_ble_add_ctrl_point_characteristic(ble_estc_service_t *service);
+static ret_code_t estc_ble_add_snapshot_characteristic(ble_estc_service_t *service);
+static ret_code_t estc_ble_add_transport_characteristic(ble_estc_service_t *service);
+static ret_code_t estc_ble_add_transport_ack_characteristic(ble_estc_service_t *service);
+static uint16_t estc_ble_service_snapshot_encode(void *ctx, uint8_t *buf, uint16_t buf_len);
+static bool estc_ble_service_transport_segment_send(void *ctx, const uint8_t *seg, uint16_t len);
+static uint16_t estc_ble_service_transport_state_encode(void *ctx, uint8_t *buf, uint16_t buf_len);
 
 ret_code_t estc_ble_service_init(ble_estc_service_t *service)
 {
@@ -69,6 +114,75 @@ ret_code_t estc_ble_service_init(ble_estc_service_t *service)
     NRF_LOG_DEBUG("%s:%d | Service handle: 0x%04x", __FUNCTION__, __LINE__, service->service_handle);
 
     service->connection_handle = BLE_CONN_HANDLE_INVALID;
+    service->att_mtu = BLE_GATT_ATT_MTU_DEFAULT;
+    service->hvx_backlog = false;
+
+    service->metrics_value.buf = m_metrics_cache;
+    service->metrics_value.buf_len = sizeof(m_metrics_cache);
+    service->metrics_value.valid = false;
+
+    service->snapshot_value.provider = estc_ble_service_snapshot_encode;
+    service->snapshot_value.ctx = service;
+    service->snapshot_value.buf = m_snapshot_cache;
+    service->snapshot_value.buf_len = sizeof(m_snapshot_cache);
+    service->snapshot_value.valid = false;
+
+    // A new session tells the peer that sequence numbers start over. Early after enabling the SoftDevice the pool
+    // may not hold enough random bytes yet, the boot time still differs from the last session most of the time.
+    uint16_t session;
+    if(sd_rand_application_vector_get((uint8_t *)&session, sizeof(session)) != NRF_SUCCESS)
+    {
+        session = (uint16_t)estc_time_ticks();
+    }
+
+    service->transport_state_value.provider = estc_ble_service_transport_state_encode;
+    service->transport_state_value.ctx = service;
+    service->transport_state_value.buf = m_transport_state;
+    service->transport_state_value.buf_len = sizeof(m_transport_state);
+    service->transport_state_value.valid = false;
+
+    estc_transport_init(&service->transport, estc_ble_service_transport_segment_send, service,
+                        m_transport_buf, sizeof(m_transport_buf), session);
+
+    return estc_ble_add_layout_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_layout_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_LAYOUT_UUID
+    };
+    uint8_t value[ESTC_SERVICE_LAYOUT_LEN] = {
+        (uint8_t)ESTC_SERVICE_LAYOUT_VERSION, (uint8_t)(ESTC_SERVICE_LAYOUT_VERSION >> 8)
+    };
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_char_pf_t char_pf = {
+        .format = BLE_GATT_CPF_FORMAT_STRUCT,
+    };
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.read = 1;
+    char_md.p_char_pf = &char_pf;
+
+    // The hash is only known once every service is added, see estc_ble_service_layout_set()
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_value = value;
+    attr_char_value.init_len = sizeof(value);
+    attr_char_value.max_len = sizeof(value);
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_layout);
+    APP_ERROR_CHECK(error_code);
 
     return estc_ble_add_characteristics(service);
 }
@@ -157,16 +271,618 @@ static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service)
     APP_ERROR_CHECK(error_code);
     
 
+    return estc_ble_add_telemetry_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_telemetry_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_TELEMETRY_UUID
+    };
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_attr_md_t cccd_md = {
+        .vloc = BLE_GATTS_VLOC_STACK
+    };
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+
+    ble_gatts_char_pf_t char_pf = {
+        .format = BLE_GATT_CPF_FORMAT_STRUCT,
+    };
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.read = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_char_pf = &char_pf;
+    char_md.p_cccd_md = &cccd_md;
+
+    // Frame length depends on the configured layout and batch size
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.init_len = 0;
+    attr_char_value.max_len = ESTC_TELEMETRY_FRAME_LEN_MAX;
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_telemetry);
+    APP_ERROR_CHECK(error_code);
+
+    estc_metrics_char_bind(ESTC_METRICS_CHAR_1, service->char_1.value_handle);
+    estc_metrics_char_bind(ESTC_METRICS_CHAR_HELLO, service->char_hello.value_handle);
+    estc_metrics_char_bind(ESTC_METRICS_CHAR_TELEMETRY, service->char_telemetry.value_handle);
+
+    return estc_ble_add_metrics_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_metrics_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_METRICS_UUID
+    };
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_attr_md_t cccd_md = {
+        .vloc = BLE_GATTS_VLOC_STACK
+    };
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+
+    ble_gatts_char_pf_t char_pf = {
+        .format = BLE_GATT_CPF_FORMAT_STRUCT,
+    };
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.read = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_char_pf = &char_pf;
+    char_md.p_cccd_md = &cccd_md;
+
+    // Snapshot layout is described in estc_metrics_snapshot.h. Computed when read, see estc_ble_service_on_lazy_read().
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    attr_md.rd_auth = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.init_len = 0;
+    attr_char_value.max_len = ESTC_METRICS_SNAPSHOT_LEN_MAX;
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_metrics);
+    APP_ERROR_CHECK(error_code);
+
+    return estc_ble_add_change_cfg_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_change_cfg_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_CHANGE_CFG_UUID
+    };
+    uint8_t table[ESTC_CHANGE_CFG_TABLE_LEN];
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_char_pf_t char_pf = {
+        .format = BLE_GATT_CPF_FORMAT_STRUCT,
+    };
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.read = 1;
+    char_md.char_props.write = 1;
+    char_md.p_char_pf = &char_pf;
+
+    // Writes carry one record and are validated before they are stored, reads return every channel.
+    // See estc_change.h for the record layout.
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    attr_md.wr_auth = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_value = table;
+    attr_char_value.init_len = estc_change_cfg_encode(table, sizeof(table));
+    attr_char_value.max_len = ESTC_CHANGE_CFG_TABLE_LEN;
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_change_cfg);
+    APP_ERROR_CHECK(error_code);
+
+    return estc_ble_add_ctrl_point_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_ctrl_point_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_CTRL_POINT_UUID
+    };
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_attr_md_t cccd_md = {
+        .vloc = BLE_GATTS_VLOC_STACK
+    };
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.read = 1;
+    char_md.char_props.write = 1;
+    char_md.char_props.write_wo_resp = 1;
+    char_md.char_props.notify = 1;
+    char_md.p_cccd_md = &cccd_md;
+
+    // Requests and responses are described in estc_ctrl.h. The value holds the last response.
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.init_len = 0;
+    attr_char_value.max_len = MAX(ESTC_CTRL_REQ_LEN_MAX, ESTC_CTRL_RSP_LEN_MAX);
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_ctrl_point);
+    APP_ERROR_CHECK(error_code);
+
+    return estc_ble_add_snapshot_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_snapshot_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_SNAPSHOT_UUID
+    };
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_char_pf_t char_pf = {
+        .format = BLE_GATT_CPF_FORMAT_STRUCT,
+    };
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.read = 1;
+    char_md.p_char_pf = &char_pf;
+
+    // Layout is described in estc_service.h. Computed when read, see estc_ble_service_on_lazy_read().
+    // Lives in the read cache rather than in the attribute table, which it would mostly fill.
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_USER;
+    attr_md.vlen = 1;
+    attr_md.rd_auth = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_value = m_snapshot_cache;
+    attr_char_value.init_len = 0;
+    attr_char_value.max_len = sizeof(m_snapshot_cache);
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_snapshot);
+    APP_ERROR_CHECK(error_code);
+
+    return estc_ble_add_transport_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_transport_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_TRANSPORT_UUID
+    };
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_attr_md_t cccd_md = {
+        .vloc = BLE_GATTS_VLOC_STACK
+    };
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.notify = 1;
+    char_md.p_cccd_md = &cccd_md;
+
+    // Segments only travel as notifications, the value is not readable. A full segment would take a sixth of the
+    // attribute table, so the value lives in application memory that only the SoftDevice writes.
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_USER;
+    attr_md.vlen = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.p_value = m_transport_value;
+    attr_char_value.init_len = 0;
+    attr_char_value.max_len = sizeof(m_transport_value);
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_transport);
+    APP_ERROR_CHECK(error_code);
+
+    return estc_ble_add_transport_ack_characteristic(service);
+}
+
+static ret_code_t estc_ble_add_transport_ack_characteristic(ble_estc_service_t *service)
+{
+    ret_code_t error_code = NRF_SUCCESS;
+    ble_uuid_t char_uuid = {
+        .uuid = ESTC_GATT_CHAR_TRANSPORT_ACK_UUID
+    };
+
+    error_code = sd_ble_uuid_vs_add(&base_uuid, &char_uuid.type);
+    APP_ERROR_CHECK(error_code);
+
+    ble_gatts_char_md_t char_md = {0};
+    char_md.char_props.read = 1;
+    char_md.char_props.write = 1;
+    char_md.char_props.write_wo_resp = 1;
+
+    // Acknowledgements are written into the value, reads are answered with the transport state instead
+    ble_gatts_attr_md_t attr_md = {0};
+    attr_md.vloc = BLE_GATTS_VLOC_STACK;
+    attr_md.vlen = 1;
+    attr_md.rd_auth = 1;
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_OPEN(&attr_md.write_perm);
+
+    ble_gatts_attr_t attr_char_value = {0};
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.p_uuid = &char_uuid;
+    attr_char_value.init_len = 0;
+    attr_char_value.max_len = MAX(ESTC_TRANSPORT_ACK_LEN, ESTC_TRANSPORT_STATE_LEN);
+
+    error_code = sd_ble_gatts_characteristic_add(service->service_handle, &char_md, &attr_char_value, &service->char_transport_ack);
+    APP_ERROR_CHECK(error_code);
+
     return NRF_SUCCESS;
 }
 
+/**@brief Append a snapshot section holding the current value of a characteristic kept by the SoftDevice. */
+static uint8_t *estc_ble_service_snapshot_put_attr(uint8_t *p, const uint8_t *end, uint16_t uuid, uint16_t value_handle)
+{
+    ble_gatts_value_t value = {
+        .len = MIN(end - p - ESTC_SNAPSHOT_SECTION_HDR_LEN, UINT8_MAX),
+        .offset = 0,
+        .p_value = &p[ESTC_SNAPSHOT_SECTION_HDR_LEN]
+    };
+
+    if(sd_ble_gatts_value_get(BLE_CONN_HANDLE_INVALID, value_handle, &value) != NRF_SUCCESS)
+    {
+        value.len = 0;
+    }
+
+    p[0] = (uint8_t)uuid;
+    p[1] = (uint8_t)(uuid >> 8);
+    p[2] = (uint8_t)value.len;
+
+    return p + ESTC_SNAPSHOT_SECTION_HDR_LEN + value.len;
+}
+
+/**@brief Append a snapshot section whose value is already encoded after the section header. */
+static uint8_t *estc_ble_service_snapshot_put(uint8_t *p, uint16_t uuid, uint16_t len)
+{
+    p[0] = (uint8_t)uuid;
+    p[1] = (uint8_t)(uuid >> 8);
+    p[2] = (uint8_t)len;
+
+    return p + ESTC_SNAPSHOT_SECTION_HDR_LEN + len;
+}
+
+static uint16_t estc_ble_service_snapshot_encode(void *ctx, uint8_t *buf, uint16_t buf_len)
+{
+    ble_estc_service_t *service = (ble_estc_service_t *)ctx;
+    const uint8_t *end = buf + buf_len;
+    uint8_t *p = buf + ESTC_SNAPSHOT_HDR_LEN;
+    uint16_t len;
+
+    if(buf_len < ESTC_SNAPSHOT_LEN_MAX)
+    {
+        return 0;
+    }
+
+    p = estc_ble_service_snapshot_put_attr(p, end, ESTC_GATT_CHAR_1_UUID, service->char_1.value_handle);
+    p = estc_ble_service_snapshot_put_attr(p, end, ESTC_GATT_CHAR_HELLO_UUID, service->char_hello.value_handle);
+    p = estc_ble_service_snapshot_put_attr(p, end, ESTC_GATT_CHAR_TELEMETRY_UUID, service->char_telemetry.value_handle);
+
+    // Freshly computed, the metrics cache is left to the metrics characteristic
+    len = 0;
+    if(service->metrics_value.provider != NULL)
+    {
+        len = service->metrics_value.provider(service->metrics_value.ctx, &p[ESTC_SNAPSHOT_SECTION_HDR_LEN],
+                                              ESTC_METRICS_SNAPSHOT_LEN_MAX);
+    }
+    p = estc_ble_service_snapshot_put(p, ESTC_GATT_CHAR_METRICS_UUID, len);
+
+    len = estc_change_cfg_encode(&p[ESTC_SNAPSHOT_SECTION_HDR_LEN], ESTC_CHANGE_CFG_TABLE_LEN);
+    p = estc_ble_service_snapshot_put(p, ESTC_GATT_CHAR_CHANGE_CFG_UUID, len);
+
+    len = estc_ctrl_settings_get(&p[ESTC_SNAPSHOT_SECTION_HDR_LEN]);
+    p = estc_ble_service_snapshot_put(p, ESTC_GATT_CHAR_CTRL_POINT_UUID, len);
+
+    len = (uint16_t)(p - buf);
+    buf[0] = ESTC_SNAPSHOT_VERSION;
+    buf[1] = ESTC_SNAPSHOT_SECTION_CNT;
+    buf[2] = (uint8_t)len;
+    buf[3] = (uint8_t)(len >> 8);
+
+    return len;
+}
+
+static void estc_ble_service_on_change_cfg_write(ble_estc_service_t *service, uint16_t conn_handle,
+                                                 const ble_gatts_evt_write_t *write)
+{
+    uint8_t table[ESTC_CHANGE_CFG_TABLE_LEN];
+    ble_gatts_rw_authorize_reply_params_t reply = {
+        .type = BLE_GATTS_AUTHORIZE_TYPE_WRITE,
+    };
+
+    if(write->op != BLE_GATTS_OP_WRITE_REQ || write->offset != 0)
+    {
+        reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_REQUEST_NOT_SUPPORTED;
+    }
+    else if(write->len != ESTC_CHANGE_CFG_RECORD_LEN)
+    {
+        reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+    }
+    else if(!estc_change_cfg_write(write->data, write->len))
+    {
+        reply.params.write.gatt_status = BLE_GATT_STATUS_ATTERR_CPS_OUT_OF_RANGE;
+    }
+    else
+    {
+        // The stored value is the whole table, not the record that was written
+        reply.params.write.gatt_status = BLE_GATT_STATUS_SUCCESS;
+        reply.params.write.update = 1;
+        reply.params.write.p_data = table;
+        reply.params.write.len = estc_change_cfg_encode(table, sizeof(table));
+        NRF_LOG_INFO("Change detection: channel %d set", write->data[0]);
+    }
+
+    ret_code_t error_code = sd_ble_gatts_rw_authorize_reply(conn_handle, &reply);
+    if(error_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Change detection config reply failed: 0x%x", error_code);
+    }
+}
+
+static void estc_ble_service_on_hvx(ble_estc_service_t *service, ret_code_t error_code)
+{
+    // Cleared by the next BLE_GATTS_EVT_HVN_TX_COMPLETE, when the SoftDevice has room again
+    if(error_code == NRF_ERROR_RESOURCES)
+    {
+        service->hvx_backlog = true;
+    }
+}
+
+static void estc_ble_service_on_ctrl_point_write(ble_estc_service_t *service, uint16_t conn_handle,
+                                                 const ble_gatts_evt_write_t *write)
+{
+    uint8_t rsp[ESTC_CTRL_RSP_LEN_MAX];
+    uint16_t len = estc_ctrl_request(conn_handle, write->data, write->len, rsp);
+
+    ble_gatts_value_t value = {
+        .len = len,
+        .offset = 0,
+        .p_value = rsp
+    };
+
+    ret_code_t error_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, service->char_ctrl_point.value_handle, &value);
+    if(error_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Control point response not stored: 0x%x", error_code);
+        return;
+    }
+
+    ble_gatts_hvx_params_t hvx_params = {
+        .handle = service->char_ctrl_point.value_handle,
+        .type = BLE_GATT_HVX_NOTIFICATION,
+        .offset = 0,
+        .p_data = NULL,
+        .p_len = &len
+    };
+
+    // Not subscribed or a small MTU: the response can still be read
+    error_code = sd_ble_gatts_hvx(conn_handle, &hvx_params);
+    estc_metrics_hvx_queue_record(error_code);
+    estc_ble_service_on_hvx(service, error_code);
+    if(error_code != NRF_SUCCESS)
+    {
+        NRF_LOG_DEBUG("Control point response not notified: 0x%x", error_code);
+    }
+}
+
+static void estc_ble_service_on_lazy_read(estc_ble_service_lazy_value_t *lazy, uint16_t conn_handle,
+                                          const ble_gatts_evt_read_t *read)
+{
+    ble_gatts_rw_authorize_reply_params_t reply = {
+        .type = BLE_GATTS_AUTHORIZE_TYPE_READ,
+    };
+
+    // A long read continues with the value its first part came from, only a new read recomputes a stale one
+    bool stale = !lazy->valid ||
+                 estc_time_ticks() - lazy->computed_at >= APP_TIMER_TICKS(ESTC_SERVICE_READ_CACHE_MS);
+    if(read->offset == 0 && stale && lazy->provider != NULL)
+    {
+        lazy->len = lazy->provider(lazy->ctx, lazy->buf, lazy->buf_len);
+        lazy->computed_at = estc_time_ticks();
+        lazy->valid = true;
+    }
+
+    if(read->offset > lazy->len)
+    {
+        reply.params.read.gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_OFFSET;
+    }
+    else
+    {
+        // The whole value is stored, the SoftDevice answers from the requested offset
+        reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
+        reply.params.read.update = 1;
+        reply.params.read.offset = 0;
+        reply.params.read.len = lazy->len;
+        reply.params.read.p_data = lazy->buf;
+    }
+
+    ret_code_t error_code = sd_ble_gatts_rw_authorize_reply(conn_handle, &reply);
+    if(error_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Read reply failed: 0x%x", error_code);
+    }
+}
+
+static bool estc_ble_service_transport_segment_send(void *ctx, const uint8_t *seg, uint16_t len)
+{
+    ble_estc_service_t *service = (ble_estc_service_t *)ctx;
+
+    if(service->connection_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return false;
+    }
+
+    ble_gatts_hvx_params_t hvx_params = {
+        .handle = service->char_transport.value_handle,
+        .type = BLE_GATT_HVX_NOTIFICATION,
+        .offset = 0,
+        .p_data = seg,
+        .p_len = &len
+    };
+
+    // NRF_ERROR_RESOURCES is the usual one, the segment goes out after the next BLE_GATTS_EVT_HVN_TX_COMPLETE
+    ret_code_t error_code = sd_ble_gatts_hvx(service->connection_handle, &hvx_params);
+    estc_metrics_hvx_queue_record(error_code);
+    estc_ble_service_on_hvx(service, error_code);
+    if(error_code != NRF_SUCCESS && error_code != NRF_ERROR_RESOURCES)
+    {
+        NRF_LOG_DEBUG("Transport segment not notified: 0x%x", error_code);
+    }
+    return error_code == NRF_SUCCESS;
+}
+
+static uint16_t estc_ble_service_transport_state_encode(void *ctx, uint8_t *buf, uint16_t buf_len)
+{
+    ble_estc_service_t *service = (ble_estc_service_t *)ctx;
+    uint16_t session = estc_transport_session(&service->transport);
+
+    if(buf_len < ESTC_TRANSPORT_STATE_LEN)
+    {
+        return 0;
+    }
+
+    buf[0] = (uint8_t)session;
+    buf[1] = (uint8_t)(session >> 8);
+    buf[2] = ESTC_TRANSPORT_WINDOW;
+    return ESTC_TRANSPORT_STATE_LEN;
+}
+
+void estc_ble_service_on_ble_event(const ble_evt_t *ble_evt, void *ctx)
+{
+    ble_estc_service_t *service = (ble_estc_service_t *)ctx;
+
+    switch(ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            estc_ble_service_mtu_set(service, BLE_GATT_ATT_MTU_DEFAULT);
+            service->hvx_backlog = false;
+            // The session may have changed since a read of the last connection
+            service->transport_state_value.valid = false;
+            return;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            estc_transport_on_disconnect(&service->transport);
+            service->hvx_backlog = false;
+            return;
+
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            service->hvx_backlog = false;
+            estc_transport_pump(&service->transport);
+            return;
+
+        default:
+            break;
+    }
+
+    if(ble_evt->header.evt_id == BLE_GATTS_EVT_WRITE)
+    {
+        const ble_gatts_evt_write_t *write = &ble_evt->evt.gatts_evt.params.write;
+
+        if(write->handle == service->char_ctrl_point.value_handle && write->offset == 0)
+        {
+            estc_ble_service_on_ctrl_point_write(service, ble_evt->evt.gatts_evt.conn_handle, write);
+        }
+        else if(write->handle == service->char_transport_ack.value_handle && write->offset == 0 &&
+                !estc_transport_on_ack(&service->transport, write->data, write->len))
+        {
+            NRF_LOG_DEBUG("Transport acknowledgement ignored");
+        }
+        return;
+    }
+
+    if(ble_evt->header.evt_id != BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST)
+    {
+        return;
+    }
+
+    const ble_gatts_evt_rw_authorize_request_t *request = &ble_evt->evt.gatts_evt.params.authorize_request;
+
+    if(request->type == BLE_GATTS_AUTHORIZE_TYPE_WRITE &&
+       request->request.write.handle == service->char_change_cfg.value_handle)
+    {
+        estc_ble_service_on_change_cfg_write(service, ble_evt->evt.gatts_evt.conn_handle, &request->request.write);
+    }
+    else if(request->type == BLE_GATTS_AUTHORIZE_TYPE_READ &&
+            request->request.read.handle == service->char_metrics.value_handle)
+    {
+        estc_ble_service_on_lazy_read(&service->metrics_value, ble_evt->evt.gatts_evt.conn_handle, &request->request.read);
+    }
+    else if(request->type == BLE_GATTS_AUTHORIZE_TYPE_READ &&
+            request->request.read.handle == service->char_snapshot.value_handle)
+    {
+        estc_ble_service_on_lazy_read(&service->snapshot_value, ble_evt->evt.gatts_evt.conn_handle, &request->request.read);
+    }
+    else if(request->type == BLE_GATTS_AUTHORIZE_TYPE_READ &&
+            request->request.read.handle == service->char_transport_ack.value_handle)
+    {
+        estc_ble_service_on_lazy_read(&service->transport_state_value, ble_evt->evt.gatts_evt.conn_handle,
+                                      &request->request.read);
+    }
+}
+
 ret_code_t estc_ble_service_hello_notify(ble_estc_service_t *service)
 {
     static uint8_t inverter = 0;
-    NRF_LOG_INFO("Trying to notify ...");
     if(service->connection_handle == BLE_CONN_HANDLE_INVALID)
     {
-        NRF_LOG_INFO("... connection handle is invalid");
         return BLE_ERROR_INVALID_CONN_HANDLE;
     }
 
@@ -184,11 +900,140 @@ ret_code_t estc_ble_service_hello_notify(ble_estc_service_t *service)
     };
 
     error_code = sd_ble_gatts_hvx(service->connection_handle, &hvx_params);
-    NRF_LOG_INFO("Retval of sd_ble_gatts_hvx : %x", error_code);
-    // APP_ERROR_CHECK(error_code);
-    
-    NRF_LOG_INFO("Notified with val %s, val_len = %d", val, val_len);
-    inverter ^= 1;
+    estc_metrics_hvx_record(ESTC_METRICS_CHAR_HELLO, error_code, val_len);
+    estc_ble_service_on_hvx(service, error_code);
 
-    return NRF_SUCCESS;
-}
\ No newline at end of file
+    // A refused heartbeat is retried with the same value
+    if(error_code == NRF_SUCCESS)
+    {
+        inverter ^= 1;
+    }
+
+    return error_code;
+}
+
+ESTC_HOT ret_code_t estc_ble_service_telemetry_update(ble_estc_service_t *service, const uint8_t *frame, uint16_t len,
+                                                     bool notify)
+{
+    VERIFY_PARAM_NOT_NULL(service);
+    VERIFY_PARAM_NOT_NULL(frame);
+    ESTC_PERF_BEGIN(ESTC_PERF_NOTIFY);
+
+    // Keep the value readable even when nobody is subscribed
+    ble_gatts_value_t value = {
+        .len = len,
+        .offset = 0,
+        .p_value = (uint8_t *)frame
+    };
+
+    ret_code_t error_code = sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, service->char_telemetry.value_handle, &value);
+    if(error_code != NRF_SUCCESS || !notify || service->connection_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        ESTC_PERF_END(ESTC_PERF_NOTIFY);
+        return error_code;
+    }
+
+    // NULL data notifies the value that was just stored
+    ble_gatts_hvx_params_t hvx_params = {
+        .handle = service->char_telemetry.value_handle,
+        .type = BLE_GATT_HVX_NOTIFICATION,
+        .offset = 0,
+        .p_data = NULL,
+        .p_len = &len
+    };
+
+    error_code = sd_ble_gatts_hvx(service->connection_handle, &hvx_params);
+    estc_metrics_hvx_record(ESTC_METRICS_CHAR_TELEMETRY, error_code, len);
+    estc_ble_service_on_hvx(service, error_code);
+    ESTC_PERF_END(ESTC_PERF_NOTIFY);
+
+    return error_code;
+}
+
+ret_code_t estc_ble_service_metrics_notify(ble_estc_service_t *service, const uint8_t *snapshot, uint16_t len)
+{
+    VERIFY_PARAM_NOT_NULL(service);
+    VERIFY_PARAM_NOT_NULL(snapshot);
+
+    if(service->connection_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+
+    // The SoftDevice would cut it to ATT_MTU - 3 without an error, a truncated snapshot does not decode
+    if(len > service->att_mtu - 3)
+    {
+        return NRF_ERROR_DATA_SIZE;
+    }
+
+    // Sent from the caller's buffer, the read cache may still serve the rest of a long read
+    ble_gatts_hvx_params_t hvx_params = {
+        .handle = service->char_metrics.value_handle,
+        .type = BLE_GATT_HVX_NOTIFICATION,
+        .offset = 0,
+        .p_data = snapshot,
+        .p_len = &len
+    };
+
+    // Not counted as a characteristic, otherwise reading the metrics would move them
+    ret_code_t error_code = sd_ble_gatts_hvx(service->connection_handle, &hvx_params);
+    estc_metrics_hvx_queue_record(error_code);
+    estc_ble_service_on_hvx(service, error_code);
+    return error_code;
+}
+
+ret_code_t estc_ble_service_layout_set(ble_estc_service_t *service, uint32_t hash)
+{
+    VERIFY_PARAM_NOT_NULL(service);
+
+    uint8_t layout[ESTC_SERVICE_LAYOUT_LEN] = {
+        (uint8_t)ESTC_SERVICE_LAYOUT_VERSION, (uint8_t)(ESTC_SERVICE_LAYOUT_VERSION >> 8),
+        (uint8_t)hash, (uint8_t)(hash >> 8), (uint8_t)(hash >> 16), (uint8_t)(hash >> 24)
+    };
+
+    ble_gatts_value_t value = {
+        .len = sizeof(layout),
+        .offset = 0,
+        .p_value = layout
+    };
+
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, service->char_layout.value_handle, &value);
+}
+
+ret_code_t estc_ble_service_char_1_set(ble_estc_service_t *service, const uint8_t *value, uint16_t len)
+{
+    VERIFY_PARAM_NOT_NULL(service);
+    VERIFY_PARAM_NOT_NULL(value);
+
+    if(len != sizeof(uint16_t))
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    ble_gatts_value_t gatts_value = {
+        .len = len,
+        .offset = 0,
+        .p_value = (uint8_t *)value
+    };
+
+    return sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID, service->char_1.value_handle, &gatts_value);
+}
+
+ret_code_t estc_ble_service_transport_send(ble_estc_service_t *service, const uint8_t *msg, uint16_t len)
+{
+    VERIFY_PARAM_NOT_NULL(service);
+    VERIFY_PARAM_NOT_NULL(msg);
+
+    if(len > ESTC_TRANSPORT_MSG_LEN_MAX)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    return estc_transport_send(&service->transport, msg, len) ? NRF_SUCCESS : NRF_ERROR_NO_MEM;
+}
+
+void estc_ble_service_mtu_set(ble_estc_service_t *service, uint16_t att_mtu)
+{
+    service->att_mtu = att_mtu;
+    estc_transport_mtu_set(&service->transport, att_mtu);
+}
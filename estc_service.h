@@ -32,10 +32,13 @@
 #define ESTC_SERVICE_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "ble.h"
 #include "sdk_errors.h"
 
+#include "estc_transport.h"
+
 // TODO: 1. Generate random BLE UUID (Version 4 UUID) and define it in the following format:
 // A5DBxxxx-03AB-450D-B840-4B3F25293BAD
 #define ESTC_BASE_UUID { 0xAD, 0x3B, 0x29, 0x25, 0x3F, 0x4B,    \
@@ -51,6 +54,53 @@
 // TODO: 3. Pick a characteristic UUID and define it:
 #define ESTC_GATT_CHAR_1_UUID 0xABBB
 #define ESTC_GATT_CHAR_HELLO_UUID 0xABBC
+#define ESTC_GATT_CHAR_TELEMETRY_UUID 0xABBD
+#define ESTC_GATT_CHAR_METRICS_UUID 0xABBE
+#define ESTC_GATT_CHAR_CHANGE_CFG_UUID 0xABBF
+#define ESTC_GATT_CHAR_CTRL_POINT_UUID 0xABC0
+#define ESTC_GATT_CHAR_SNAPSHOT_UUID 0xABC1
+#define ESTC_GATT_CHAR_LAYOUT_UUID 0xABC2
+#define ESTC_GATT_CHAR_TRANSPORT_UUID 0xABC3
+#define ESTC_GATT_CHAR_TRANSPORT_ACK_UUID 0xABC4
+
+// Layout characteristic, the first one of the service so it keeps its handle: layout version (2) | table hash (4),
+// little-endian. Bump the version whenever characteristics are added, removed or reordered. See estc_gatt_layout.h.
+#define ESTC_SERVICE_LAYOUT_VERSION 2
+#define ESTC_SERVICE_LAYOUT_LEN 6
+
+// Snapshot characteristic: the current value of every other characteristic in one read, all fields little-endian.
+//   version (1) | section count (1) | total length (2)
+//   per section: characteristic UUID (2) | len (1) | value (len)
+// Sections follow in order of the UUIDs, the control point section holds the settings as ESTC_CTRL_OP_READ answers
+// them. The value is computed for a read at offset 0 and kept for the blob reads that continue it, so a snapshot
+// longer than ATT_MTU - 1 stays consistent. Clients compare the received length with the total length.
+#define ESTC_SNAPSHOT_VERSION 1
+#define ESTC_SNAPSHOT_HDR_LEN 4
+#define ESTC_SNAPSHOT_SECTION_HDR_LEN 3
+
+// Reliable transport: segments are notified on the transport characteristic, acknowledgements written to the
+// transport ack characteristic, see estc_transport.h. Reading the ack characteristic gives the session, random per
+// boot and changed whenever a receiver starts over, and the window: session (2) | window (1), little-endian. Neither
+// is part of the snapshot.
+#define ESTC_TRANSPORT_STATE_LEN 3
+
+/**@brief Computes a characteristic value on demand.
+ *
+ * @return Value length, at most @p buf_len.
+ */
+typedef uint16_t (*estc_ble_service_value_provider_t)(void *ctx, uint8_t *buf, uint16_t buf_len);
+
+/**@brief Value computed when a peer reads it, see estc_ble_service_on_ble_event(). */
+typedef struct
+{
+    estc_ble_service_value_provider_t provider;     /**< Set by the application before estc_ble_service_init(). */
+    void *ctx;                                      /**< Passed to the provider. */
+    uint8_t *buf;
+    uint16_t buf_len;
+    uint16_t len;
+    uint64_t computed_at;                           /**< estc_time ticks. */
+    bool valid;
+} estc_ble_service_lazy_value_t;
 
 typedef struct
 {
@@ -58,8 +108,24 @@ typedef struct
     uint16_t connection_handle;
 
     // TODO: 6.3. Add handles for characterstic (type: ble_gatts_char_handles_t)
+    ble_gatts_char_handles_t char_layout;
     ble_gatts_char_handles_t char_1;
     ble_gatts_char_handles_t char_hello;
+    ble_gatts_char_handles_t char_telemetry;
+    ble_gatts_char_handles_t char_metrics;
+    ble_gatts_char_handles_t char_change_cfg;
+    ble_gatts_char_handles_t char_ctrl_point;
+    ble_gatts_char_handles_t char_snapshot;
+    ble_gatts_char_handles_t char_transport;
+    ble_gatts_char_handles_t char_transport_ack;
+
+    estc_ble_service_lazy_value_t metrics_value;
+    estc_ble_service_lazy_value_t snapshot_value;
+    estc_ble_service_lazy_value_t transport_state_value;
+
+    estc_transport_t transport;
+    uint16_t att_mtu;                                      /**< Effective MTU of the connection. */
+    volatile bool hvx_backlog;                             /**< See estc_ble_service_hvx_backlog(). */
 } ble_estc_service_t;
 
 
@@ -69,6 +135,39 @@ void estc_ble_service_on_ble_event(const ble_evt_t *ble_evt, void *ctx);
 
 void estc_update_characteristic_1_value(ble_estc_service_t *service, int32_t *value);
 
+/**@brief Notify the next hello value. Returns the sd_ble_gatts_hvx() result, the value alternates only on success. */
 ret_code_t estc_ble_service_hello_notify(ble_estc_service_t *service);
 
+/**@brief Store a frame as the telemetry value and, if @p notify is set, notify it. */
+ret_code_t estc_ble_service_telemetry_update(ble_estc_service_t *service, const uint8_t *frame, uint16_t len, bool notify);
+
+/**@brief Notify a metrics snapshot. Reads compute their own snapshot, this one is not kept for them.
+ *
+ * @retval NRF_ERROR_DATA_SIZE  The snapshot does not fit a notification at the current MTU, the peer reads it instead.
+ */
+ret_code_t estc_ble_service_metrics_notify(ble_estc_service_t *service, const uint8_t *snapshot, uint16_t len);
+
+/**@brief Store the table hash in the layout characteristic, next to ESTC_SERVICE_LAYOUT_VERSION. */
+ret_code_t estc_ble_service_layout_set(ble_estc_service_t *service, uint32_t hash);
+
+ret_code_t estc_ble_service_char_1_set(ble_estc_service_t *service, const uint8_t *value, uint16_t len);
+
+/**@brief Queue a message on the reliable transport. It is delivered once, across reconnections.
+ *
+ * @retval NRF_ERROR_INVALID_LENGTH  Longer than ESTC_TRANSPORT_MSG_LEN_MAX.
+ * @retval NRF_ERROR_NO_MEM          The ring holds too many unacknowledged messages, try again later.
+ */
+ret_code_t estc_ble_service_transport_send(ble_estc_service_t *service, const uint8_t *msg, uint16_t len);
+
+/**@brief Whether a notification of the service was refused with NRF_ERROR_RESOURCES since the SoftDevice last
+ *        reported sent ones. Work that competes with the data path backs off while it is set.
+ */
+static inline bool estc_ble_service_hvx_backlog(const ble_estc_service_t *service)
+{
+    return service->hvx_backlog;
+}
+
+/**@brief Size the notifications that follow for @p att_mtu. Call with the effective MTU whenever it changes. */
+void estc_ble_service_mtu_set(ble_estc_service_t *service, uint16_t att_mtu);
+
 #endif /* ESTC_SERVICE_H__ */
\ No newline at end of file
@@ -0,0 +1,266 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_telemetry.h"
+
+#include <string.h>
+
+#include "sdk_common.h"
+#include "app_error.h"
+#include "nrf_log.h"
+#include "sensorsim.h"
+
+#include "estc_dsp.h"
+#include "estc_perf.h"
+#include "estc_section.h"
+#include "estc_timer_wheel.h"
+#include "estc_time.h"
+
+static uint32_t                       m_sample_period_ms;
+static uint8_t                        m_samples_per_frame;
+static uint8_t                        m_layout;
+static estc_telemetry_filter_t        m_filter;
+static uint8_t                        m_decimation;
+static int16_t                        m_sensor_offset;
+static estc_telemetry_frame_handler_t m_frame_handler;
+static estc_timer_wheel_job_t         m_sample_job;
+static bool                           m_started;
+static bool                           m_aligned;
+static bool                           m_sample_due;
+
+static sensorsim_cfg_t                m_sensor_cfg;
+static sensorsim_state_t              m_sensor_state;
+
+static estc_dsp_biquad_t              m_biquad;
+static estc_dsp_ma_t                  m_ma;
+static estc_dsp_decim_t               m_decim;
+static int16_t                        m_block[ESTC_TELEMETRY_BLOCK_MAX];
+static uint16_t                       m_block_cnt;
+static uint64_t                       m_block_ticks;    /**< When the first sample of the block was taken. */
+
+static estc_telemetry_frame_t         m_frame;
+static uint8_t                        m_frame_buf[ESTC_TELEMETRY_FRAME_LEN_MAX];
+
+ESTC_HOT static void frame_publish(void)
+{
+    estc_dsp_stats_t stats;
+
+    // The whole block goes through the filter at once, the filter state carries over to the next block
+    if (m_sensor_offset != 0)
+    {
+        estc_dsp_offset_q15(m_block, m_block, m_block_cnt, m_sensor_offset);
+    }
+
+    switch (m_filter)
+    {
+        case ESTC_TELEMETRY_FILTER_LOWPASS:
+            estc_dsp_biquad_q15(&m_biquad, m_block, m_block, m_block_cnt);
+            break;
+
+        case ESTC_TELEMETRY_FILTER_MOVING_AVERAGE:
+            estc_dsp_ma_q15(&m_ma, m_block, m_block, m_block_cnt);
+            break;
+
+        default:
+            break;
+    }
+
+    // Statistics cover every filtered sample, not only the ones kept by the decimation
+    estc_dsp_stats_q15(m_block, m_block_cnt, &stats);
+    m_frame.min          = stats.min;
+    m_frame.max          = stats.max;
+    m_frame.mean         = stats.mean;
+    m_frame.rms          = stats.rms;
+    m_frame.sample_cnt   = (uint8_t)estc_dsp_decim_q15(&m_decim, m_block, m_frame.samples, m_block_cnt);
+    m_frame.layout       = m_layout;
+    m_frame.timestamp_ms = (uint32_t)estc_time_ticks_to_ms(m_block_ticks);
+
+    uint16_t len = estc_telemetry_frame_encode(&m_frame, m_frame_buf, sizeof(m_frame_buf));
+    if ((len > 0) && (m_frame_handler != NULL))
+    {
+        m_frame_handler(m_frame_buf, len, &m_frame);
+    }
+
+    m_frame.seq++;
+    m_block_cnt = 0;
+}
+
+ESTC_HOT static void sample_take(void)
+{
+    ESTC_PERF_BEGIN(ESTC_PERF_TELEMETRY);
+
+    if (m_block_cnt == 0)
+    {
+        m_block_ticks = estc_time_ticks();
+    }
+    m_block[m_block_cnt++] = (int16_t)sensorsim_measure(&m_sensor_state, &m_sensor_cfg);
+
+    // Whole blocks of decimation periods, so every frame carries exactly samples_per_frame samples
+    if (m_block_cnt >= m_samples_per_frame * m_decimation)
+    {
+        frame_publish();
+    }
+
+    ESTC_PERF_END(ESTC_PERF_TELEMETRY);
+}
+
+ESTC_HOT static void sample_timer_handler(void * p_context)
+{
+    // When aligned the sample waits for the next connection event, see estc_telemetry_on_radio_prepare()
+    if (m_aligned)
+    {
+        m_sample_due = true;
+        return;
+    }
+
+    sample_take();
+}
+
+ret_code_t estc_telemetry_init(estc_telemetry_init_t const * p_init)
+{
+    VERIFY_PARAM_NOT_NULL(p_init);
+
+    if ((p_init->samples_per_frame == 0) ||
+        (p_init->samples_per_frame > ESTC_TELEMETRY_FRAME_SAMPLES_MAX) ||
+        (p_init->decimation == 0) ||
+        (p_init->samples_per_frame * p_init->decimation > ESTC_TELEMETRY_BLOCK_MAX) ||
+        (p_init->ma_log2_window > ESTC_DSP_MA_LOG2_MAX) ||
+        (p_init->layout == 0))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (p_init->filter == ESTC_TELEMETRY_FILTER_LOWPASS)
+    {
+        estc_dsp_biquad_coefs_t coefs;
+
+        if (!estc_dsp_biquad_lowpass(&coefs, p_init->cutoff_permille))
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        estc_dsp_biquad_init(&m_biquad, &coefs);
+    }
+    estc_dsp_ma_init(&m_ma, p_init->ma_log2_window);
+    estc_dsp_decim_init(&m_decim, p_init->decimation);
+
+    m_sample_period_ms  = p_init->sample_period_ms;
+    m_samples_per_frame = p_init->samples_per_frame;
+    m_layout            = p_init->layout;
+    m_filter            = p_init->filter;
+    m_decimation        = p_init->decimation;
+    m_sensor_offset     = p_init->sensor_offset;
+    m_block_cnt         = 0;
+    m_frame_handler     = p_init->frame_handler;
+
+    memset(&m_frame, 0, sizeof(m_frame));
+
+    // Simulated sensor until a real one is wired in: a triangle wave between min and max
+    m_sensor_cfg.min          = ESTC_TELEMETRY_SENSOR_MIN;
+    m_sensor_cfg.max          = ESTC_TELEMETRY_SENSOR_MAX;
+    m_sensor_cfg.incr         = ESTC_TELEMETRY_SENSOR_INCR;
+    m_sensor_cfg.start_at_max = false;
+    sensorsim_init(&m_sensor_state, &m_sensor_cfg);
+
+    // No slack, the sample period is the time base of the frame
+    return estc_timer_wheel_job_init(&m_sample_job, "telemetry", ESTC_TIMER_WHEEL_MODE_REPEATED,
+                                     sample_timer_handler, 0);
+}
+
+ret_code_t estc_telemetry_start(void)
+{
+    ret_code_t err_code = estc_timer_wheel_start(&m_sample_job, m_sample_period_ms, NULL);
+
+    m_started = (err_code == NRF_SUCCESS);
+    return err_code;
+}
+
+void estc_telemetry_stop(void)
+{
+    estc_timer_wheel_stop(&m_sample_job);
+    m_started = false;
+}
+
+ret_code_t estc_telemetry_period_set(uint32_t sample_period_ms)
+{
+    if (sample_period_ms == 0)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_sample_period_ms = sample_period_ms;
+
+    return m_started ? estc_timer_wheel_start(&m_sample_job, m_sample_period_ms, NULL) : NRF_SUCCESS;
+}
+
+uint32_t estc_telemetry_period_get(void)
+{
+    return m_sample_period_ms;
+}
+
+ret_code_t estc_telemetry_batch_set(uint8_t samples_per_frame)
+{
+    if ((samples_per_frame == 0) ||
+        (samples_per_frame > ESTC_TELEMETRY_FRAME_SAMPLES_MAX) ||
+        (samples_per_frame * m_decimation > ESTC_TELEMETRY_BLOCK_MAX))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // A block already longer than the new size is published with the next sample
+    m_samples_per_frame = samples_per_frame;
+
+    return NRF_SUCCESS;
+}
+
+uint8_t estc_telemetry_batch_get(void)
+{
+    return m_samples_per_frame;
+}
+
+void estc_telemetry_align_set(bool aligned)
+{
+    m_aligned = aligned;
+
+    // Nothing will call the prepare handler any more, do not lose a sample that was waiting for it
+    if (!aligned && m_sample_due)
+    {
+        m_sample_due = false;
+        sample_take();
+    }
+}
+
+ESTC_HOT void estc_telemetry_on_radio_prepare(void)
+{
+    if (m_sample_due)
+    {
+        m_sample_due = false;
+        sample_take();
+    }
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_TELEMETRY_H__
+#define ESTC_TELEMETRY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+#include "estc_telemetry_frame.h"
+
+// Raw samples buffered per frame before filtering and decimation: samples_per_frame x decimation
+#define ESTC_TELEMETRY_BLOCK_MAX    256
+
+/**@brief Called with every completed frame, encoded and as the structure it was built from.
+ *        Both are only valid during the call.
+ */
+typedef void (*estc_telemetry_frame_handler_t)(uint8_t const * p_frame, uint16_t len,
+                                               estc_telemetry_frame_t const * p_decoded);
+
+typedef enum
+{
+    ESTC_TELEMETRY_FILTER_NONE,
+    ESTC_TELEMETRY_FILTER_LOWPASS,          /**< Second order Butterworth, see estc_dsp_biquad_lowpass(). */
+    ESTC_TELEMETRY_FILTER_MOVING_AVERAGE,
+} estc_telemetry_filter_t;
+
+typedef struct
+{
+    uint32_t                       sample_period_ms;    /**< Sensor sample period, before decimation. */
+    uint8_t                        samples_per_frame;   /**< Samples in a frame, after decimation. */
+    uint8_t                        layout;              /**< Combination of ESTC_TELEMETRY_LAYOUT_* flags. */
+    estc_telemetry_filter_t        filter;
+    uint16_t                       cutoff_permille;     /**< Low-pass cutoff in permille of the sample rate. */
+    uint8_t                        ma_log2_window;      /**< Moving average over 2^ma_log2_window samples. */
+    uint8_t                        decimation;          /**< Keep one filtered sample out of this many. */
+    int16_t                        sensor_offset;       /**< Added to every raw sample, with saturation. */
+    estc_telemetry_frame_handler_t frame_handler;
+} estc_telemetry_init_t;
+
+ret_code_t estc_telemetry_init(estc_telemetry_init_t const * p_init);
+
+ret_code_t estc_telemetry_start(void);
+
+void estc_telemetry_stop(void);
+
+/**@brief Change the sample period. A running producer switches over right away. */
+ret_code_t estc_telemetry_period_set(uint32_t sample_period_ms);
+
+uint32_t estc_telemetry_period_get(void);
+
+/**@brief Change the samples per frame. The frame being collected is completed at the new size. */
+ret_code_t estc_telemetry_batch_set(uint8_t samples_per_frame);
+
+uint8_t estc_telemetry_batch_get(void);
+
+/**@brief Defer each sample from its timer to the next estc_telemetry_on_radio_prepare() call.
+ *        The sample period is kept, every sample is delayed by less than a connection interval.
+ */
+void estc_telemetry_align_set(bool aligned);
+
+/**@brief Take the sample that is due, if any. Called right before a connection event. */
+void estc_telemetry_on_radio_prepare(void);
+
+#endif /* ESTC_TELEMETRY_H__ */
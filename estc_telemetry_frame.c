@@ -0,0 +1,141 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_telemetry_frame.h"
+
+#include <stddef.h>
+
+#include "estc_le.h"
+
+uint16_t estc_telemetry_frame_encode(estc_telemetry_frame_t const * p_frame, uint8_t * p_buf, uint16_t buf_len)
+{
+    if ((p_frame == NULL) || (p_buf == NULL) || (p_frame->sample_cnt > ESTC_TELEMETRY_FRAME_SAMPLES_MAX))
+    {
+        return 0;
+    }
+
+    uint16_t len = ESTC_TELEMETRY_FRAME_LEN(p_frame->layout, p_frame->sample_cnt);
+    if (len > buf_len)
+    {
+        return 0;
+    }
+
+    uint8_t * p = p_buf;
+
+    *p++ = ESTC_TELEMETRY_FRAME_VERSION;
+    *p++ = p_frame->layout;
+    p    = estc_le_put_u16(p, p_frame->seq);
+    *p++ = p_frame->sample_cnt;
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_SAMPLES)
+    {
+        for (uint8_t i = 0; i < p_frame->sample_cnt; i++)
+        {
+            p = estc_le_put_u16(p, (uint16_t)p_frame->samples[i]);
+        }
+    }
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_SUMMARY)
+    {
+        p = estc_le_put_u16(p, (uint16_t)p_frame->min);
+        p = estc_le_put_u16(p, (uint16_t)p_frame->max);
+        p = estc_le_put_u16(p, (uint16_t)p_frame->mean);
+    }
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_RMS)
+    {
+        p = estc_le_put_u16(p, p_frame->rms);
+    }
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_TIMESTAMP)
+    {
+        p = estc_le_put_u32(p, p_frame->timestamp_ms);
+    }
+
+    return len;
+}
+
+bool estc_telemetry_frame_decode(uint8_t const * p_buf, uint16_t len, estc_telemetry_frame_t * p_frame)
+{
+    uint16_t value;
+
+    if ((p_buf == NULL) || (p_frame == NULL) || (len < ESTC_TELEMETRY_FRAME_HDR_LEN))
+    {
+        return false;
+    }
+
+    uint8_t const * p = p_buf;
+
+    if (*p++ != ESTC_TELEMETRY_FRAME_VERSION)
+    {
+        return false;
+    }
+
+    p_frame->layout     = *p++;
+    p                   = estc_le_get_u16(p, &p_frame->seq);
+    p_frame->sample_cnt = *p++;
+
+    if ((p_frame->sample_cnt > ESTC_TELEMETRY_FRAME_SAMPLES_MAX) ||
+        (ESTC_TELEMETRY_FRAME_LEN(p_frame->layout, p_frame->sample_cnt) != len))
+    {
+        return false;
+    }
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_SAMPLES)
+    {
+        for (uint8_t i = 0; i < p_frame->sample_cnt; i++)
+        {
+            p = estc_le_get_u16(p, &value);
+            p_frame->samples[i] = (int16_t)value;
+        }
+    }
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_SUMMARY)
+    {
+        p = estc_le_get_u16(p, &value);
+        p_frame->min = (int16_t)value;
+        p = estc_le_get_u16(p, &value);
+        p_frame->max = (int16_t)value;
+        p = estc_le_get_u16(p, &value);
+        p_frame->mean = (int16_t)value;
+    }
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_RMS)
+    {
+        p = estc_le_get_u16(p, &p_frame->rms);
+    }
+
+    if (p_frame->layout & ESTC_TELEMETRY_LAYOUT_TIMESTAMP)
+    {
+        p = estc_le_get_u32(p, &p_frame->timestamp_ms);
+    }
+
+    return true;
+}
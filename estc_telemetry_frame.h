@@ -0,0 +1,95 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_TELEMETRY_FRAME_H__
+#define ESTC_TELEMETRY_FRAME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Frame layout, all fields little-endian:
+//   version (1) | layout (1) | seq (2) | sample_cnt (1)
+//   [samples: sample_cnt x int16]          if ESTC_TELEMETRY_LAYOUT_SAMPLES
+//   [summary: min, max, mean as int16]     if ESTC_TELEMETRY_LAYOUT_SUMMARY
+//   [rms: uint16]                          if ESTC_TELEMETRY_LAYOUT_RMS
+//   [timestamp: uint32 ms since boot]      if ESTC_TELEMETRY_LAYOUT_TIMESTAMP, of the first raw sample
+// The encoder and decoder only depend on the C library, so host tools can build this file as is.
+
+#define ESTC_TELEMETRY_FRAME_VERSION        2
+
+#define ESTC_TELEMETRY_LAYOUT_SAMPLES       (1 << 0)    /**< Every sample of the batch. */
+#define ESTC_TELEMETRY_LAYOUT_SUMMARY       (1 << 1)    /**< Min, max and mean of the batch. */
+#define ESTC_TELEMETRY_LAYOUT_RMS           (1 << 2)    /**< Root mean square of the batch. */
+#define ESTC_TELEMETRY_LAYOUT_TIMESTAMP     (1 << 3)    /**< When the batch started. */
+
+#define ESTC_TELEMETRY_FRAME_HDR_LEN        5
+#define ESTC_TELEMETRY_FRAME_SUMMARY_LEN    (3 * sizeof(int16_t))
+#define ESTC_TELEMETRY_FRAME_RMS_LEN        sizeof(uint16_t)
+#define ESTC_TELEMETRY_FRAME_TIMESTAMP_LEN  sizeof(uint32_t)
+#define ESTC_TELEMETRY_FRAME_SAMPLES_MAX    64
+
+#define ESTC_TELEMETRY_FRAME_LEN(layout, sample_cnt)                                                    \
+    (ESTC_TELEMETRY_FRAME_HDR_LEN                                                                       \
+     + (((layout) & ESTC_TELEMETRY_LAYOUT_SAMPLES) ? (sample_cnt) * sizeof(int16_t) : 0)                \
+     + (((layout) & ESTC_TELEMETRY_LAYOUT_SUMMARY) ? ESTC_TELEMETRY_FRAME_SUMMARY_LEN : 0)              \
+     + (((layout) & ESTC_TELEMETRY_LAYOUT_RMS) ? ESTC_TELEMETRY_FRAME_RMS_LEN : 0)                      \
+     + (((layout) & ESTC_TELEMETRY_LAYOUT_TIMESTAMP) ? ESTC_TELEMETRY_FRAME_TIMESTAMP_LEN : 0))
+
+#define ESTC_TELEMETRY_FRAME_LEN_MAX                                                                    \
+    ESTC_TELEMETRY_FRAME_LEN(ESTC_TELEMETRY_LAYOUT_SAMPLES | ESTC_TELEMETRY_LAYOUT_SUMMARY |            \
+                             ESTC_TELEMETRY_LAYOUT_RMS | ESTC_TELEMETRY_LAYOUT_TIMESTAMP,               \
+                             ESTC_TELEMETRY_FRAME_SAMPLES_MAX)
+
+typedef struct
+{
+    uint8_t  layout;
+    uint16_t seq;
+    uint8_t  sample_cnt;
+    int16_t  samples[ESTC_TELEMETRY_FRAME_SAMPLES_MAX];
+    int16_t  min;
+    int16_t  max;
+    int16_t  mean;
+    uint16_t rms;
+    uint32_t timestamp_ms;
+} estc_telemetry_frame_t;
+
+/**@brief Serialize a frame.
+ *
+ * @return Encoded length, or 0 if the frame is invalid or does not fit into @p buf_len.
+ */
+uint16_t estc_telemetry_frame_encode(estc_telemetry_frame_t const * p_frame, uint8_t * p_buf, uint16_t buf_len);
+
+/**@brief Parse a frame received over the air.
+ *
+ * @return false if the buffer is truncated, has an unknown version or inconsistent length.
+ */
+bool estc_telemetry_frame_decode(uint8_t const * p_buf, uint16_t len, estc_telemetry_frame_t * p_frame);
+
+#endif /* ESTC_TELEMETRY_FRAME_H__ */
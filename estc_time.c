@@ -0,0 +1,109 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_time.h"
+
+#ifndef ESTC_TIME_HOST
+
+#include "sdk_common.h"
+#include "app_timer.h"
+#include "app_error.h"
+#include "nrf_atomic.h"
+
+#include "estc_timer_wheel.h"
+
+#define COUNTER_BITS        24
+#define HALF_SHIFT          (COUNTER_BITS - 1)
+
+// A quarter of the half period, with as much slack again it still runs once in every half period
+#define KEEPALIVE_MS        ((uint32_t)((1000ULL << HALF_SHIFT) / ESTC_TIME_FREQ / 4))
+
+static nrf_atomic_u32_t       m_halves;     /**< Half periods of the RTC counter seen so far. */
+static estc_timer_wheel_job_t m_keepalive_job;
+
+static void keepalive_handler(void * p_context)
+{
+    (void)estc_time_ticks();
+}
+
+void estc_time_init(void)
+{
+    ret_code_t err_code;
+
+    err_code = estc_timer_wheel_job_init(&m_keepalive_job, "time", ESTC_TIMER_WHEEL_MODE_REPEATED,
+                                         keepalive_handler, KEEPALIVE_MS);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = estc_timer_wheel_start(&m_keepalive_job, KEEPALIVE_MS, NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+uint64_t estc_time_ticks(void)
+{
+    // Halves first: a caller preempted in between reads a later counter, never an earlier one
+    uint32_t halves  = m_halves;
+    uint32_t counter = app_timer_cnt_get();
+
+    if (((counter >> HALF_SHIFT) ^ halves) & 1)
+    {
+        uint32_t expected = halves;
+
+        // Fails only when a preempting caller made the same step first
+        halves++;
+        (void)nrf_atomic_u32_cmp_exch(&m_halves, &expected, halves);
+    }
+
+    return ((uint64_t)(halves >> 1) << COUNTER_BITS) | counter;
+}
+
+#else
+
+#include <time.h>
+
+void estc_time_init(void)
+{
+}
+
+uint64_t estc_time_ticks(void)
+{
+    struct timespec now;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((uint64_t)now.tv_sec << ESTC_TIME_FREQ_LOG2) +
+           (((uint64_t)now.tv_nsec << ESTC_TIME_FREQ_LOG2) / 1000000000);
+}
+
+#endif
+
+uint32_t estc_time_log_timestamp(void)
+{
+    return (uint32_t)estc_time_ticks();
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_TIME_H__
+#define ESTC_TIME_H__
+
+#include <stdint.h>
+
+// Monotonic 64-bit time since boot, in app_timer ticks. The 24-bit RTC counter is extended by counting its half
+// periods: a read that finds the counter in the other half than the last one advances the count with a compare and
+// exchange, so neither the common path nor the update needs a critical section and any context can call it. A read
+// is needed at least once per half period, estc_time_init() starts a timer wheel job for the idle case.
+//
+// Host builds (ESTC_TIME_HOST) read CLOCK_MONOTONIC at the same tick rate, so the simulated producers and the host
+// tools share the conversions below.
+
+#ifndef ESTC_TIME_HOST
+#include "sdk_config.h"
+#define ESTC_TIME_RTC_PRESCALER     APP_TIMER_CONFIG_RTC_FREQUENCY
+#else
+#define ESTC_TIME_RTC_PRESCALER     1
+#endif
+
+// The conversions are a multiply and a shift, which needs a power of two tick rate
+#if   ESTC_TIME_RTC_PRESCALER == 0
+#define ESTC_TIME_FREQ_LOG2         15
+#elif ESTC_TIME_RTC_PRESCALER == 1
+#define ESTC_TIME_FREQ_LOG2         14
+#elif ESTC_TIME_RTC_PRESCALER == 3
+#define ESTC_TIME_FREQ_LOG2         13
+#elif ESTC_TIME_RTC_PRESCALER == 7
+#define ESTC_TIME_FREQ_LOG2         12
+#elif ESTC_TIME_RTC_PRESCALER == 15
+#define ESTC_TIME_FREQ_LOG2         11
+#elif ESTC_TIME_RTC_PRESCALER == 31
+#define ESTC_TIME_FREQ_LOG2         10
+#else
+#error "estc_time needs APP_TIMER_CONFIG_RTC_FREQUENCY + 1 to be a power of two up to 32"
+#endif
+
+#define ESTC_TIME_FREQ              (1UL << ESTC_TIME_FREQ_LOG2)
+
+// 10^6 = 15625 x 2^6 and 10^3 = 125 x 2^3: ticks x 10^6 / 2^n becomes ticks x 15625 >> (n - 6). The products only
+// overflow after centuries of uptime.
+#define ESTC_TIME_US_MUL            15625
+#define ESTC_TIME_US_SHIFT          (ESTC_TIME_FREQ_LOG2 - 6)
+#define ESTC_TIME_MS_MUL            125
+#define ESTC_TIME_MS_SHIFT          (ESTC_TIME_FREQ_LOG2 - 3)
+
+/**@brief Start the job that keeps the extension going while nothing else reads the time.
+ *        The timer wheel has to be initialized first. Not needed on the host.
+ */
+void estc_time_init(void);
+
+/**@brief Ticks since boot. */
+uint64_t estc_time_ticks(void);
+
+/**@brief Low 32 bits of the ticks, for NRF_LOG_INIT() with ESTC_TIME_FREQ. Wraps after three days. */
+uint32_t estc_time_log_timestamp(void);
+
+static inline uint64_t estc_time_ticks_to_us(uint64_t ticks)
+{
+    return (ticks * ESTC_TIME_US_MUL) >> ESTC_TIME_US_SHIFT;
+}
+
+static inline uint64_t estc_time_ticks_to_ms(uint64_t ticks)
+{
+    return (ticks * ESTC_TIME_MS_MUL) >> ESTC_TIME_MS_SHIFT;
+}
+
+static inline uint64_t estc_time_us(void)
+{
+    return estc_time_ticks_to_us(estc_time_ticks());
+}
+
+static inline uint64_t estc_time_ms(void)
+{
+    return estc_time_ticks_to_ms(estc_time_ticks());
+}
+
+#endif /* ESTC_TIME_H__ */
@@ -0,0 +1,481 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_timer_wheel.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "sdk_common.h"
+#include "nrf.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_log.h"
+
+#define LEVEL_COUNT         2
+#define LEVEL_SHIFT         6
+#define SLOT_MASK           (ESTC_TIMER_WHEEL_SLOTS - 1)
+
+#define MS_TO_TICKS(ms)     CEIL_DIV(APP_TIMER_TICKS(ms), ESTC_TIMER_WHEEL_TICK_RTC)
+
+STATIC_ASSERT((1UL << LEVEL_SHIFT) == ESTC_TIMER_WHEEL_SLOTS);
+STATIC_ASSERT(ESTC_TIMER_WHEEL_TICK_RTC >= APP_TIMER_MIN_TIMEOUT_TICKS);
+
+APP_TIMER_DEF(m_wheel_timer);
+
+static estc_timer_wheel_job_t   * m_slots[LEVEL_COUNT][ESTC_TIMER_WHEEL_SLOTS];
+static uint64_t                   m_occupied[LEVEL_COUNT];  /**< Bit per non-empty slot. */
+static uint32_t                   m_now;                    /**< Last tick processed. */
+static uint32_t                   m_rtc_last;               /**< RTC counter value of m_now. */
+static uint32_t                   m_wake;                   /**< Tick the app_timer is armed for. */
+static bool                       m_armed;
+static bool                       m_running;                /**< Inside the timer handler, arming happens on exit. */
+
+static estc_timer_wheel_job_t   * m_jobs[ESTC_TIMER_WHEEL_JOBS_MAX];
+static estc_timer_wheel_stats_t   m_stats;
+
+static uint64_t ror64(uint64_t value, uint32_t shift)
+{
+    shift &= SLOT_MASK;
+    return (shift == 0) ? value : ((value >> shift) | (value << (64 - shift)));
+}
+
+static void slot_push(estc_timer_wheel_job_t * p_job, uint8_t level, uint8_t slot)
+{
+    p_job->level  = level;
+    p_job->slot   = slot;
+    p_job->p_prev = NULL;
+    p_job->p_next = m_slots[level][slot];
+
+    if (p_job->p_next != NULL)
+    {
+        p_job->p_next->p_prev = p_job;
+    }
+
+    m_slots[level][slot] = p_job;
+    m_occupied[level]   |= 1ULL << slot;
+}
+
+static void slot_unlink(estc_timer_wheel_job_t * p_job)
+{
+    if (p_job->p_prev != NULL)
+    {
+        p_job->p_prev->p_next = p_job->p_next;
+    }
+    else
+    {
+        m_slots[p_job->level][p_job->slot] = p_job->p_next;
+    }
+
+    if (p_job->p_next != NULL)
+    {
+        p_job->p_next->p_prev = p_job->p_prev;
+    }
+
+    if (m_slots[p_job->level][p_job->slot] == NULL)
+    {
+        m_occupied[p_job->level] &= ~(1ULL << p_job->slot);
+    }
+}
+
+/**@brief Put a job into the slot of its expiry tick, relative to m_now. Called with interrupts masked.
+ *
+ * @param[in] p_job     Job to place.
+ * @param[in] earliest  Tick an overdue job is moved to.
+ */
+static void job_place(estc_timer_wheel_job_t * p_job, uint32_t earliest)
+{
+    if ((int32_t)(p_job->expires - earliest) < 0)
+    {
+        p_job->expires = earliest;
+    }
+
+    uint32_t delta = p_job->expires - m_now;
+
+    if (delta < ESTC_TIMER_WHEEL_SLOTS)
+    {
+        if (p_job->slack != 0)
+        {
+            // Join the earliest tick within the slack that already has work
+            uint32_t reach  = p_job->nominal + p_job->slack - m_now;
+            uint32_t hi     = MIN(reach, ESTC_TIMER_WHEEL_SLOTS - 1);
+            uint64_t window = ((2ULL << hi) - 1) & ~((1ULL << delta) - 1);
+            uint64_t hit    = ror64(m_occupied[0], m_now) & window;
+
+            if (hit != 0)
+            {
+                delta          = (uint32_t)__builtin_ctzll(hit);
+                p_job->expires = m_now + delta;
+            }
+            else
+            {
+                // The next round is not visible yet. If it has work and the slack reaches its
+                // boundary, cascade together with that work.
+                uint32_t boundary = ESTC_TIMER_WHEEL_SLOTS - (m_now & SLOT_MASK);
+                uint8_t  round    = ((m_now >> LEVEL_SHIFT) + 1) & SLOT_MASK;
+
+                if ((reach >= boundary) && ((m_occupied[1] & (1ULL << round)) != 0))
+                {
+                    slot_push(p_job, 1, round);
+                    return;
+                }
+            }
+        }
+
+        slot_push(p_job, 0, (m_now + delta) & SLOT_MASK);
+        return;
+    }
+
+    // Beyond level 1 the job waits in its last slot and is placed again when that one cascades
+    uint32_t rounds = (p_job->expires >> LEVEL_SHIFT) - (m_now >> LEVEL_SHIFT);
+    uint32_t slot   = (rounds < ESTC_TIMER_WHEEL_SLOTS) ? (p_job->expires >> LEVEL_SHIFT) :
+                                                          ((m_now >> LEVEL_SHIFT) + ESTC_TIMER_WHEEL_SLOTS - 1);
+
+    slot_push(p_job, 1, slot & SLOT_MASK);
+}
+
+/**@brief Arm the app_timer for the next occupied slot or level 1 cascade. Called with interrupts masked. */
+static void wake_schedule(void)
+{
+    uint32_t delta = UINT32_MAX;
+    uint64_t next  = ror64(m_occupied[0], m_now + 1);
+
+    if (next != 0)
+    {
+        delta = (uint32_t)__builtin_ctzll(next) + 1;
+    }
+    // Level 1 only needs a wakeup at the boundary of its next occupied round
+    next = ror64(m_occupied[1], (m_now >> LEVEL_SHIFT) + 1);
+    if (next != 0)
+    {
+        uint32_t boundary = ((m_now >> LEVEL_SHIFT) + 1 + (uint32_t)__builtin_ctzll(next)) << LEVEL_SHIFT;
+
+        delta = MIN(delta, boundary - m_now);
+    }
+
+    // An earlier wakeup re-evaluates the wheel anyway, a stale later one is harmless
+    if ((delta == UINT32_MAX) || (m_armed && ((int32_t)(m_now + delta - m_wake) >= 0)))
+    {
+        return;
+    }
+
+    if (m_armed)
+    {
+        (void)app_timer_stop(m_wheel_timer);
+    }
+
+    uint32_t elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_rtc_last);
+    uint32_t timeout = delta * ESTC_TIMER_WHEEL_TICK_RTC;
+
+    timeout = (timeout >= elapsed + APP_TIMER_MIN_TIMEOUT_TICKS) ? (timeout - elapsed) : APP_TIMER_MIN_TIMEOUT_TICKS;
+
+    ret_code_t err_code = app_timer_start(m_wheel_timer, timeout, NULL);
+    APP_ERROR_CHECK(err_code);
+
+    m_wake  = m_now + delta;
+    m_armed = true;
+}
+
+/**@brief Move jobs from a level 1 slot to level 0. Called with interrupts masked.
+ *
+ * @param[in] slot  Level 1 slot.
+ * @param[in] all   Move every job, at the boundary of the slot's round. Otherwise only the jobs that
+ *                  are already within the level 0 horizon are moved.
+ */
+static void cascade(uint8_t slot, bool all)
+{
+    estc_timer_wheel_job_t * p_job;
+    estc_timer_wheel_job_t * p_next;
+
+    // Jobs without slack go first, so the ones with slack can join them
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        for (p_job = m_slots[1][slot]; p_job != NULL; p_job = p_next)
+        {
+            p_next = p_job->p_next;
+
+            if (((pass == 0) && (p_job->slack != 0)) ||
+                (!all && ((p_job->expires - m_now) >= ESTC_TIMER_WHEEL_SLOTS)))
+            {
+                continue;
+            }
+
+            // At the boundary the slot of m_now is processed next, otherwise it already was
+            slot_unlink(p_job);
+            job_place(p_job, all ? m_now : (m_now + 1));
+            m_stats.cascades++;
+        }
+    }
+}
+
+/**@brief Advance to @p tick and run its jobs.
+ *
+ * @param[in] tick  Tick to process.
+ * @param[in] now   Current tick, later than @p tick when catching up.
+ *
+ * @return Number of jobs run.
+ */
+static uint32_t tick_process(uint32_t tick, uint32_t now)
+{
+    uint32_t runs = 0;
+    uint8_t  slot = tick & SLOT_MASK;
+
+    CRITICAL_REGION_ENTER();
+    m_now       = tick;
+    m_rtc_last += ESTC_TIMER_WHEEL_TICK_RTC;
+    if (slot == 0)
+    {
+        cascade((tick >> LEVEL_SHIFT) & SLOT_MASK, true);
+    }
+    CRITICAL_REGION_EXIT();
+
+    for (;;)
+    {
+        estc_timer_wheel_job_t     * p_job;
+        estc_timer_wheel_handler_t   handler   = NULL;
+        void                       * p_context = NULL;
+
+        CRITICAL_REGION_ENTER();
+        p_job = m_slots[0][slot];
+        if (p_job != NULL)
+        {
+            uint32_t late = now - p_job->expires;
+
+            slot_unlink(p_job);
+
+            p_job->stats.runs++;
+            if (late != 0)
+            {
+                p_job->stats.late++;
+                p_job->stats.max_late_ticks = MAX(p_job->stats.max_late_ticks, late);
+            }
+
+            // Reschedule before the handler runs, so the handler may stop or restart the job
+            if (p_job->mode == ESTC_TIMER_WHEEL_MODE_REPEATED)
+            {
+                uint32_t next = p_job->nominal + p_job->period;
+
+                while ((int32_t)(next - now) <= 0)
+                {
+                    next += p_job->period;
+                    p_job->stats.skipped++;
+                }
+
+                p_job->nominal = next;
+                p_job->expires = next;
+                job_place(p_job, next);
+            }
+            else
+            {
+                p_job->active = 0;
+            }
+
+            handler   = p_job->handler;
+            p_context = p_job->p_context;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (p_job == NULL)
+        {
+            break;
+        }
+
+        uint32_t start = DWT->CYCCNT;
+        handler(p_context);
+        p_job->stats.max_cycles = MAX(p_job->stats.max_cycles, DWT->CYCCNT - start);
+        runs++;
+    }
+
+    return runs;
+}
+
+static void wheel_timer_handler(void * p_context)
+{
+    uint32_t elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_rtc_last);
+    uint32_t now     = m_now + (elapsed / ESTC_TIMER_WHEEL_TICK_RTC);
+    uint32_t runs    = 0;
+
+    m_armed   = false;
+    m_running = true;
+
+    while (m_now != now)
+    {
+        if ((m_occupied[0] == 0) && (m_occupied[1] == 0))
+        {
+            // Nothing scheduled, skip the idle stretch
+            CRITICAL_REGION_ENTER();
+            m_rtc_last += (now - m_now) * ESTC_TIMER_WHEEL_TICK_RTC;
+            m_now       = now;
+            CRITICAL_REGION_EXIT();
+            break;
+        }
+
+        runs += tick_process(m_now + 1, now);
+    }
+
+    CRITICAL_REGION_ENTER();
+    m_running = false;
+    if (runs != 0)
+    {
+        m_stats.wakeups++;
+        m_stats.runs += runs;
+    }
+
+    // Cascade the next round early while awake, its boundary may then not need a wakeup of its own
+    cascade(((m_now >> LEVEL_SHIFT) + 1) & SLOT_MASK, false);
+    wake_schedule();
+    CRITICAL_REGION_EXIT();
+}
+
+ret_code_t estc_timer_wheel_init(void)
+{
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_occupied, 0, sizeof(m_occupied));
+    memset(m_jobs, 0, sizeof(m_jobs));
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    m_now      = 0;
+    m_armed    = false;
+    m_running  = false;
+    m_rtc_last = app_timer_cnt_get();
+
+    return app_timer_create(&m_wheel_timer, APP_TIMER_MODE_SINGLE_SHOT, wheel_timer_handler);
+}
+
+ret_code_t estc_timer_wheel_job_init(estc_timer_wheel_job_t     * p_job,
+                                     char const                 * p_name,
+                                     estc_timer_wheel_mode_t      mode,
+                                     estc_timer_wheel_handler_t   handler,
+                                     uint32_t                     slack_ms)
+{
+    VERIFY_PARAM_NOT_NULL(p_job);
+    VERIFY_PARAM_NOT_NULL(handler);
+
+    uint32_t i;
+
+    for (i = 0; (i < ESTC_TIMER_WHEEL_JOBS_MAX) && (m_jobs[i] != NULL) && (m_jobs[i] != p_job); i++)
+    {
+    }
+    if (i == ESTC_TIMER_WHEEL_JOBS_MAX)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    memset(p_job, 0, sizeof(*p_job));
+    p_job->p_name  = p_name;
+    p_job->mode    = mode;
+    p_job->handler = handler;
+    p_job->slack   = (slack_ms != 0) ? MS_TO_TICKS(slack_ms) : 0;
+    m_jobs[i]      = p_job;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t estc_timer_wheel_start(estc_timer_wheel_job_t * p_job, uint32_t timeout_ms, void * p_context)
+{
+    VERIFY_PARAM_NOT_NULL(p_job);
+
+    if (p_job->handler == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    uint32_t ticks = MAX(MS_TO_TICKS(timeout_ms), 1);
+
+    CRITICAL_REGION_ENTER();
+
+    if (p_job->active)
+    {
+        slot_unlink(p_job);
+    }
+
+    // An empty wheel has nothing left to catch up, restart its time base at the current count
+    if ((m_occupied[0] == 0) && (m_occupied[1] == 0) && !m_running)
+    {
+        m_rtc_last = app_timer_cnt_get();
+    }
+
+    uint32_t elapsed = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_rtc_last) / ESTC_TIMER_WHEEL_TICK_RTC;
+
+    p_job->p_context = p_context;
+    p_job->period    = (p_job->mode == ESTC_TIMER_WHEEL_MODE_REPEATED) ? ticks : 0;
+    p_job->nominal   = m_now + elapsed + ticks;
+    p_job->expires   = p_job->nominal;
+    p_job->active    = 1;
+    job_place(p_job, p_job->expires);
+
+    if (!m_running)
+    {
+        wake_schedule();
+    }
+
+    CRITICAL_REGION_EXIT();
+
+    return NRF_SUCCESS;
+}
+
+void estc_timer_wheel_stop(estc_timer_wheel_job_t * p_job)
+{
+    if (p_job == NULL)
+    {
+        return;
+    }
+
+    CRITICAL_REGION_ENTER();
+    if (p_job->active)
+    {
+        slot_unlink(p_job);
+        p_job->active = 0;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+void estc_timer_wheel_stats_get(estc_timer_wheel_stats_t * p_stats)
+{
+    if (p_stats != NULL)
+    {
+        *p_stats = m_stats;
+    }
+}
+
+void estc_timer_wheel_report(void)
+{
+    NRF_LOG_INFO("timer wheel: %d runs in %d wakeups, %d cascades", m_stats.runs, m_stats.wakeups, m_stats.cascades);
+
+    for (uint32_t i = 0; (i < ESTC_TIMER_WHEEL_JOBS_MAX) && (m_jobs[i] != NULL); i++)
+    {
+        estc_timer_wheel_job_stats_t const * p_stats = &m_jobs[i]->stats;
+
+        NRF_LOG_INFO("timer %s: %d runs, %d late (max %d ticks), %d skipped, max %d cycles",
+                     m_jobs[i]->p_name, p_stats->runs, p_stats->late, p_stats->max_late_ticks,
+                     p_stats->skipped, p_stats->max_cycles);
+    }
+}
@@ -0,0 +1,116 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_TIMER_WHEEL_H__
+#define ESTC_TIMER_WHEEL_H__
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+// Periodic and one-shot jobs on a two level timer wheel behind a single app_timer. Level 0 has
+// one slot per tick of ESTC_TIMER_WHEEL_TICK_MS, level 1 one slot per level 0 revolution and is
+// cascaded into level 0 as time advances. The app_timer is armed single shot for the next occupied
+// slot, so an idle wheel does not wake the CPU. Insert and cancel are O(1).
+//
+// A job with slack may run up to slack_ms late. It is then placed on the earliest tick within its
+// slack that already has a job, so jobs due at about the same time share one wakeup. Periodic jobs
+// keep their nominal schedule, slack never accumulates.
+
+#define ESTC_TIMER_WHEEL_SLOTS  64
+
+typedef void (*estc_timer_wheel_handler_t)(void * p_context);
+
+typedef enum
+{
+    ESTC_TIMER_WHEEL_MODE_SINGLE_SHOT,
+    ESTC_TIMER_WHEEL_MODE_REPEATED,
+} estc_timer_wheel_mode_t;
+
+typedef struct
+{
+    uint32_t runs;
+    uint32_t late;              /**< Runs that started at least one tick after the nominal time. */
+    uint32_t max_late_ticks;
+    uint32_t skipped;           /**< Periods dropped because the job was still late by a whole period. */
+    uint32_t max_cycles;        /**< Longest handler execution. */
+} estc_timer_wheel_job_stats_t;
+
+typedef struct estc_timer_wheel_job_s estc_timer_wheel_job_t;
+
+/**@brief Job control block, owned by the caller. Fields other than the stats are internal. */
+struct estc_timer_wheel_job_s
+{
+    estc_timer_wheel_job_t       * p_next;
+    estc_timer_wheel_job_t       * p_prev;
+    char const                   * p_name;
+    estc_timer_wheel_handler_t     handler;
+    void                         * p_context;
+    estc_timer_wheel_mode_t        mode;
+    uint32_t                       period;      /**< In ticks. */
+    uint32_t                       slack;       /**< In ticks. */
+    uint32_t                       nominal;     /**< Tick the job is due at. */
+    uint32_t                       expires;     /**< Tick the job runs at, nominal plus grouping. */
+    uint8_t                        level;
+    uint8_t                        slot;
+    uint8_t                        active;
+    estc_timer_wheel_job_stats_t   stats;
+};
+
+typedef struct
+{
+    uint32_t wakeups;           /**< Timer expirations that ran at least one job. */
+    uint32_t runs;              /**< Job runs, divide by wakeups for the grouping factor. */
+    uint32_t cascades;          /**< Jobs moved from level 1 to level 0. */
+} estc_timer_wheel_stats_t;
+
+/**@brief Create the app_timer driving the wheel. app_timer_init() has to be called first. */
+ret_code_t estc_timer_wheel_init(void);
+
+/**@brief Set up a job, the counterpart of app_timer_create(). */
+ret_code_t estc_timer_wheel_job_init(estc_timer_wheel_job_t     * p_job,
+                                     char const                 * p_name,
+                                     estc_timer_wheel_mode_t      mode,
+                                     estc_timer_wheel_handler_t   handler,
+                                     uint32_t                     slack_ms);
+
+/**@brief Schedule a job @p timeout_ms from now. Repeated jobs then run every @p timeout_ms.
+ *        Restarts the job if it is already scheduled.
+ */
+ret_code_t estc_timer_wheel_start(estc_timer_wheel_job_t * p_job, uint32_t timeout_ms, void * p_context);
+
+void estc_timer_wheel_stop(estc_timer_wheel_job_t * p_job);
+
+void estc_timer_wheel_stats_get(estc_timer_wheel_stats_t * p_stats);
+
+/**@brief Log the wheel and per-job statistics. */
+void estc_timer_wheel_report(void);
+
+#endif /* ESTC_TIMER_WHEEL_H__ */
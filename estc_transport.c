@@ -0,0 +1,437 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_transport.h"
+
+#include <string.h>
+
+#include "estc_crc.h"
+#include "estc_le.h"
+
+#define SEQ_DIFF(a, b)      ((uint16_t)((uint16_t)(a) - (uint16_t)(b)))
+#define ATT_MTU_DEFAULT     23
+
+static uint8_t ring_byte(estc_transport_t const * p_transport, uint32_t pos)
+{
+    return p_transport->p_buf[pos & (p_transport->buf_size - 1)];
+}
+
+static void ring_read(estc_transport_t const * p_transport, uint32_t pos, uint8_t * p_dst, uint32_t len)
+{
+    uint32_t offset = pos & (p_transport->buf_size - 1);
+    uint32_t first  = p_transport->buf_size - offset;
+
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(p_dst, &p_transport->p_buf[offset], first);
+    memcpy(&p_dst[first], p_transport->p_buf, len - first);
+}
+
+static void ring_write(estc_transport_t * p_transport, uint8_t const * p_src, uint32_t len)
+{
+    uint32_t offset = p_transport->tail & (p_transport->buf_size - 1);
+    uint32_t first  = p_transport->buf_size - offset;
+
+    if (first > len)
+    {
+        first = len;
+    }
+    memcpy(&p_transport->p_buf[offset], p_src, first);
+    memcpy(p_transport->p_buf, &p_src[first], len - first);
+    p_transport->tail += len;
+}
+
+// Cut the next segment off the queued messages. Its size is fixed from now on, until a reconnection
+static bool segment_cut(estc_transport_t * p_transport)
+{
+    if (SEQ_DIFF(p_transport->next_seq, p_transport->base_seq) >= ESTC_TRANSPORT_WINDOW ||
+       p_transport->seg_pos == p_transport->tail)
+    {
+        return false;
+    }
+
+    uint8_t flags = 0;
+    if (p_transport->seg_pos == p_transport->msg_end)
+    {
+        uint16_t len = (uint16_t)(ring_byte(p_transport, p_transport->seg_pos) |
+                                  (ring_byte(p_transport, p_transport->seg_pos + 1) << 8));
+        p_transport->msg_end = p_transport->seg_pos + estc_transport_msg_size(len);
+        flags |= ESTC_TRANSPORT_FLAG_FIRST;
+    }
+
+    uint32_t len = p_transport->msg_end - p_transport->seg_pos;
+    if (len > p_transport->seg_max)
+    {
+        len = p_transport->seg_max;
+    }
+    if (p_transport->seg_pos + len == p_transport->msg_end)
+    {
+        flags |= ESTC_TRANSPORT_FLAG_LAST;
+    }
+
+    estc_transport_seg_t * p_seg = &p_transport->window[p_transport->next_seq % ESTC_TRANSPORT_WINDOW];
+    p_seg->start   = p_transport->seg_pos;
+    p_seg->msg_end = p_transport->msg_end;
+    p_seg->len     = (uint16_t)len;
+    p_seg->flags   = flags;
+    p_seg->sacked  = false;
+    p_seg->sent    = false;
+
+    p_transport->seg_pos += len;
+    p_transport->next_seq++;
+    return true;
+}
+
+static bool segment_send(estc_transport_t * p_transport, uint16_t seq)
+{
+    estc_transport_seg_t * p_seg = &p_transport->window[seq % ESTC_TRANSPORT_WINDOW];
+    uint8_t buf[ESTC_TRANSPORT_SEG_HDR_LEN + ESTC_TRANSPORT_SEG_PAYLOAD_MAX];
+
+    (void)estc_le_put_u16(buf, seq);
+    buf[2] = p_seg->flags;
+    ring_read(p_transport, p_seg->start, &buf[ESTC_TRANSPORT_SEG_HDR_LEN], p_seg->len);
+
+    if (!p_transport->send(p_transport->p_ctx, buf, ESTC_TRANSPORT_SEG_HDR_LEN + p_seg->len))
+    {
+        return false;
+    }
+
+    if (p_seg->sent)
+    {
+        p_transport->stats.resent++;
+    }
+    p_seg->sent = true;
+    p_transport->stats.segments++;
+    return true;
+}
+
+void estc_transport_init(estc_transport_t * p_transport, estc_transport_send_t send, void * p_ctx,
+                         uint8_t * p_buf, uint32_t buf_size, uint16_t session)
+{
+    memset(p_transport, 0, sizeof(*p_transport));
+    p_transport->send     = send;
+    p_transport->p_ctx    = p_ctx;
+    p_transport->p_buf    = p_buf;
+    p_transport->buf_size = buf_size;
+    p_transport->session  = session;
+    p_transport->paused   = true;
+    estc_transport_mtu_set(p_transport, ATT_MTU_DEFAULT);
+}
+
+bool estc_transport_send(estc_transport_t * p_transport, uint8_t const * p_data, uint16_t len)
+{
+    if (estc_transport_msg_size(len) > p_transport->buf_size - (p_transport->tail - p_transport->head))
+    {
+        return false;
+    }
+
+    uint8_t hdr[ESTC_TRANSPORT_MSG_HDR_LEN];
+    uint8_t crc[ESTC_TRANSPORT_MSG_CRC_LEN];
+    uint16_t value = estc_crc16(p_data, len);
+
+    (void)estc_le_put_u16(hdr, len);
+    crc[0] = (uint8_t)(value >> 8);
+    crc[1] = (uint8_t)value;
+
+    ring_write(p_transport, hdr, sizeof(hdr));
+    ring_write(p_transport, p_data, len);
+    ring_write(p_transport, crc, sizeof(crc));
+    p_transport->stats.messages++;
+
+    estc_transport_pump(p_transport);
+    return true;
+}
+
+void estc_transport_pump(estc_transport_t * p_transport)
+{
+    if (p_transport->paused)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        if (p_transport->send_seq == p_transport->next_seq && !segment_cut(p_transport))
+        {
+            return;
+        }
+        if (p_transport->window[p_transport->send_seq % ESTC_TRANSPORT_WINDOW].sacked)
+        {
+            p_transport->stats.skipped++;
+        }
+        else if (!segment_send(p_transport, p_transport->send_seq))
+        {
+            return;
+        }
+        p_transport->send_seq++;
+    }
+}
+
+bool estc_transport_on_ack(estc_transport_t * p_transport, uint8_t const * p_data, uint16_t len)
+{
+    if (len != ESTC_TRANSPORT_ACK_LEN || p_data[0] < ESTC_TRANSPORT_OP_ACK || p_data[0] > ESTC_TRANSPORT_OP_START)
+    {
+        return false;
+    }
+
+    uint16_t next      = estc_le_u16(&p_data[1]);
+    uint32_t sack      = estc_le_u32(&p_data[3]);
+    uint16_t acked     = SEQ_DIFF(next, p_transport->base_seq);
+    uint16_t in_flight = SEQ_DIFF(p_transport->next_seq, p_transport->base_seq);
+
+    if (p_data[0] == ESTC_TRANSPORT_OP_START)
+    {
+        if (!p_transport->paused)
+        {
+            return false;
+        }
+
+        // Everything from the message at head is cut again, receivers with state from before have to start over too
+        p_transport->seg_pos  = p_transport->head;
+        p_transport->msg_end  = p_transport->head;
+        p_transport->base_seq = next;
+        p_transport->session++;
+        acked     = 0;
+        in_flight = 0;
+    }
+
+    if (acked > in_flight)
+    {
+        return false;
+    }
+
+    if (acked > 0)
+    {
+        uint32_t head = p_transport->head;
+
+        // Only whole messages leave the ring, a receiver that starts over needs the start of a partial one
+        for (uint16_t seq = p_transport->base_seq; seq != next; seq++)
+        {
+            estc_transport_seg_t const * p_seg = &p_transport->window[seq % ESTC_TRANSPORT_WINDOW];
+
+            if (p_seg->flags & ESTC_TRANSPORT_FLAG_LAST)
+            {
+                head = p_seg->start + p_seg->len;
+            }
+        }
+
+        p_transport->stats.acked_bytes += head - p_transport->head;
+        p_transport->head     = head;
+        p_transport->base_seq = next;
+        in_flight -= acked;
+        if (SEQ_DIFF(p_transport->send_seq, next) > in_flight)
+        {
+            p_transport->send_seq = next;
+        }
+    }
+
+    if (p_transport->paused)
+    {
+        // The receiver has nothing past next, so what is left can be cut again for this connection's MTU
+        if (in_flight > 0)
+        {
+            estc_transport_seg_t const * p_seg = &p_transport->window[next % ESTC_TRANSPORT_WINDOW];
+
+            p_transport->seg_pos = p_seg->start;
+            p_transport->msg_end = (p_seg->flags & ESTC_TRANSPORT_FLAG_FIRST) ? p_seg->start : p_seg->msg_end;
+        }
+        p_transport->next_seq = next;
+        p_transport->send_seq = next;
+        p_transport->paused   = false;
+    }
+    else
+    {
+        for (uint16_t i = 0; i < 32 && i + 1 < in_flight; i++)
+        {
+            if (sack & (1UL << i))
+            {
+                p_transport->window[(uint16_t)(next + 1 + i) % ESTC_TRANSPORT_WINDOW].sacked = true;
+            }
+        }
+        if (p_data[0] == ESTC_TRANSPORT_OP_NACK)
+        {
+            p_transport->send_seq = next;
+        }
+    }
+
+    estc_transport_pump(p_transport);
+    return true;
+}
+
+void estc_transport_on_disconnect(estc_transport_t * p_transport)
+{
+    // Segments still queued in the link are gone, the receiver tells where to go on from
+    p_transport->paused = true;
+}
+
+void estc_transport_mtu_set(estc_transport_t * p_transport, uint16_t att_mtu)
+{
+    uint16_t seg_max = (uint16_t)(att_mtu - 3 - ESTC_TRANSPORT_SEG_HDR_LEN);
+
+    p_transport->seg_max = (seg_max > ESTC_TRANSPORT_SEG_PAYLOAD_MAX) ? ESTC_TRANSPORT_SEG_PAYLOAD_MAX : seg_max;
+}
+
+void estc_transport_rx_init(estc_transport_rx_t * p_rx, uint8_t * p_buf, uint32_t buf_size,
+                            estc_transport_rx_seg_t * p_held)
+{
+    p_rx->p_buf    = p_buf;
+    p_rx->buf_size = buf_size;
+    p_rx->p_held   = p_held;
+    estc_transport_rx_reset(p_rx);
+}
+
+void estc_transport_rx_reset(estc_transport_rx_t * p_rx)
+{
+    p_rx->held     = 0;
+    p_rx->len      = 0;
+    p_rx->msg_len  = 0;
+    p_rx->expected = 0;
+    p_rx->in_msg   = false;
+}
+
+void estc_transport_rx_on_disconnect(estc_transport_rx_t * p_rx)
+{
+    p_rx->held = 0;
+}
+
+// The segment at expected: the sequence moves on, and so do the kept segments behind it
+static estc_transport_rx_status_t rx_in_order(estc_transport_rx_t * p_rx, uint8_t const * p_seg, uint16_t len,
+                                              uint8_t const ** pp_msg, uint16_t * p_msg_len)
+{
+    uint8_t flags = p_seg[2];
+
+    p_rx->expected++;
+    p_rx->held >>= 1;
+
+    p_seg += ESTC_TRANSPORT_SEG_HDR_LEN;
+    len   -= ESTC_TRANSPORT_SEG_HDR_LEN;
+
+    if (flags & ESTC_TRANSPORT_FLAG_FIRST)
+    {
+        if (len < ESTC_TRANSPORT_MSG_HDR_LEN)
+        {
+            p_rx->in_msg = false;
+            return ESTC_TRANSPORT_RX_ERROR;
+        }
+        p_rx->msg_len = (uint32_t)estc_le_u16(p_seg) + ESTC_TRANSPORT_MSG_CRC_LEN;
+        p_rx->len     = 0;
+        p_rx->in_msg  = true;
+        p_seg += ESTC_TRANSPORT_MSG_HDR_LEN;
+        len   -= ESTC_TRANSPORT_MSG_HDR_LEN;
+    }
+
+    // A message that does not fit is still followed to its end, so the next one starts in sync
+    if (!p_rx->in_msg || p_rx->len + len > p_rx->msg_len)
+    {
+        p_rx->in_msg = false;
+        return ESTC_TRANSPORT_RX_ERROR;
+    }
+    if (p_rx->msg_len <= p_rx->buf_size)
+    {
+        memcpy(&p_rx->p_buf[p_rx->len], p_seg, len);
+    }
+    p_rx->len += len;
+
+    if (!(flags & ESTC_TRANSPORT_FLAG_LAST))
+    {
+        return ESTC_TRANSPORT_RX_ACCEPTED;
+    }
+
+    p_rx->in_msg = false;
+    if (p_rx->len != p_rx->msg_len || p_rx->msg_len > p_rx->buf_size || !estc_crc16_check(p_rx->p_buf, p_rx->len))
+    {
+        return ESTC_TRANSPORT_RX_ERROR;
+    }
+
+    *pp_msg    = p_rx->p_buf;
+    *p_msg_len = (uint16_t)(p_rx->len - ESTC_TRANSPORT_MSG_CRC_LEN);
+    return ESTC_TRANSPORT_RX_MESSAGE;
+}
+
+estc_transport_rx_status_t estc_transport_rx_segment(estc_transport_rx_t * p_rx, uint8_t const * p_seg, uint16_t len,
+                                                     uint8_t const ** pp_msg, uint16_t * p_msg_len)
+{
+    if (len < ESTC_TRANSPORT_SEG_HDR_LEN)
+    {
+        return ESTC_TRANSPORT_RX_ERROR;
+    }
+
+    uint16_t seq  = estc_le_u16(p_seg);
+    uint16_t diff = SEQ_DIFF(seq, p_rx->expected);
+
+    if (diff == 0)
+    {
+        return rx_in_order(p_rx, p_seg, len, pp_msg, p_msg_len);
+    }
+    if (diff >= 0x8000)
+    {
+        return ESTC_TRANSPORT_RX_DUPLICATE;
+    }
+
+    // The sender never gets further ahead than its window
+    if ((p_rx->p_held != NULL) && (diff < ESTC_TRANSPORT_WINDOW) && (len <= sizeof(p_rx->p_held->data)))
+    {
+        if (p_rx->held & (1UL << diff))
+        {
+            return ESTC_TRANSPORT_RX_DUPLICATE;
+        }
+
+        estc_transport_rx_seg_t * p_slot = &p_rx->p_held[seq % ESTC_TRANSPORT_WINDOW];
+
+        memcpy(p_slot->data, p_seg, len);
+        p_slot->len = len;
+        p_rx->held |= 1UL << diff;
+    }
+    return ESTC_TRANSPORT_RX_GAP;
+}
+
+estc_transport_rx_status_t estc_transport_rx_next(estc_transport_rx_t * p_rx, uint8_t const ** pp_msg,
+                                                  uint16_t * p_msg_len)
+{
+    if (!(p_rx->held & 1))
+    {
+        return ESTC_TRANSPORT_RX_NONE;
+    }
+
+    estc_transport_rx_seg_t const * p_slot = &p_rx->p_held[p_rx->expected % ESTC_TRANSPORT_WINDOW];
+
+    return rx_in_order(p_rx, p_slot->data, p_slot->len, pp_msg, p_msg_len);
+}
+
+uint16_t estc_transport_rx_ack_encode(estc_transport_rx_t const * p_rx, uint8_t op, uint8_t * p_buf)
+{
+    // Bit 0 of the kept segments is expected itself, the selective bits start behind it
+    p_buf[0] = op;
+    (void)estc_le_put_u16(&p_buf[1], p_rx->expected);
+    (void)estc_le_put_u32(&p_buf[3], p_rx->held >> 1);
+    return ESTC_TRANSPORT_ACK_LEN;
+}
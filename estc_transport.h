@@ -0,0 +1,232 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_TRANSPORT_H__
+#define ESTC_TRANSPORT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Reliable message transport over notifications. Messages, as long as the byte ring allows, are queued into it, cut into
+// segments that fit the ATT MTU and kept until the receiver acknowledges them, so nothing is lost across a
+// reconnection and nothing is delivered twice to a receiver that keeps its state. A receiver that starts over gets
+// the messages again that it had received but not acknowledged yet.
+//
+// Segment, notified, all fields little-endian:
+//   seq (2) | flags (1) | payload
+// The payloads of the segments of one message, from ESTC_TRANSPORT_FLAG_FIRST to ESTC_TRANSPORT_FLAG_LAST, are:
+//   length (2) | data (length) | CRC-16 of the data (2, big-endian, see estc_crc16_append())
+// Acknowledgement, written by the receiver:
+//   op (1) | next expected seq (2) | selective ack (4), bit i set if segment next + 1 + i was received out of order
+//   ESTC_TRANSPORT_OP_ACK    everything before next arrived
+//   ESTC_TRANSPORT_OP_NACK   the same, and send again from next on, skipping the segments acknowledged selectively
+//   ESTC_TRANSPORT_OP_START  first of a connection only, the receiver starts over at next
+// At most ESTC_TRANSPORT_WINDOW segments are unacknowledged. Inside a connection the link layer delivers
+// notifications in order, so a receiver that sees a gap has dropped a segment itself and answers with a NACK. The
+// segments behind the gap it keeps until the gap is filled, and acknowledges them selectively so they are not sent
+// again.
+//
+// On every connection the receiver first reads the session, subscribes and writes an acknowledgement. The sender
+// holds back until that first acknowledgement, then cuts what is left into segments again with the MTU of the new
+// connection and numbers them from the receiver's next expected seq on. Segments kept out of order are dropped by the
+// receiver when the link goes, that first acknowledgement has no selective bits.
+//
+// A receiver without state for the session, because the sender or the receiver restarted or it is another receiver
+// than the last one, resets its expected seq to 0 and answers with ESTC_TRANSPORT_OP_START. The sender then numbers
+// the segments from there, starting with the oldest message not acknowledged completely, which is sent again from
+// its start. The session changes with every start over, so a receiver that kept state from before another one took
+// over starts over as well, instead of going on with segments that were since cut differently.
+//
+// Only depends on the C library and estc_crc, so it builds on a host; armgcc/transport_bench.c runs the sender
+// against the reference receiver below over a lossy, disconnecting link.
+
+#define ESTC_TRANSPORT_SEG_HDR_LEN      3
+#define ESTC_TRANSPORT_MSG_HDR_LEN      2
+#define ESTC_TRANSPORT_MSG_CRC_LEN      2
+#define ESTC_TRANSPORT_MSG_OVERHEAD     (ESTC_TRANSPORT_MSG_HDR_LEN + ESTC_TRANSPORT_MSG_CRC_LEN)
+#define ESTC_TRANSPORT_SEG_PAYLOAD_MAX  241         /**< A 247 byte ATT MTU. */
+#define ESTC_TRANSPORT_ACK_LEN          7
+#define ESTC_TRANSPORT_WINDOW           32          /**< Segments in flight, one selective ack bit each. */
+
+#define ESTC_TRANSPORT_FLAG_FIRST       (1 << 0)
+#define ESTC_TRANSPORT_FLAG_LAST        (1 << 1)
+
+#define ESTC_TRANSPORT_OP_ACK           0x01
+#define ESTC_TRANSPORT_OP_NACK          0x02
+#define ESTC_TRANSPORT_OP_START         0x03
+
+/**@brief Hand a segment to the link.
+ *
+ * @return false if it was not taken, it is offered again on the next estc_transport_pump().
+ */
+typedef bool (*estc_transport_send_t)(void * p_ctx, uint8_t const * p_seg, uint16_t len);
+
+typedef struct
+{
+    uint32_t start;             /**< Ring offset of the payload, counted from the first byte ever queued. */
+    uint32_t msg_end;           /**< Ring offset where its message ends. */
+    uint16_t len;
+    uint8_t  flags;
+    bool     sacked;            /**< Acknowledged selectively, not sent again. */
+    bool     sent;
+} estc_transport_seg_t;
+
+typedef struct
+{
+    uint32_t messages;          /**< Queued. */
+    uint32_t segments;          /**< Sent, including the ones sent again. */
+    uint32_t resent;
+    uint32_t skipped;           /**< Not sent again because they were acknowledged selectively. */
+    uint32_t acked_bytes;
+} estc_transport_stats_t;
+
+typedef struct
+{
+    estc_transport_send_t  send;
+    void                 * p_ctx;
+    uint8_t              * p_buf;
+    uint32_t               buf_size;
+    uint32_t               head;        /**< Start of the oldest message not acknowledged completely. */
+    uint32_t               tail;        /**< End of the queued messages. */
+    uint32_t               seg_pos;     /**< Next byte to put into a new segment. */
+    uint32_t               msg_end;     /**< End of the message being cut, equal to seg_pos between messages. */
+    uint16_t               seg_max;     /**< Payload bytes per segment. */
+    uint16_t               session;     /**< Changes whenever the numbering starts over. */
+    uint16_t               base_seq;    /**< Oldest unacknowledged segment. */
+    uint16_t               next_seq;    /**< Next segment to cut. */
+    uint16_t               send_seq;    /**< Next segment to send, behind next_seq while sending again. */
+    bool                   paused;      /**< Waiting for the first acknowledgement of a connection. */
+    estc_transport_seg_t   window[ESTC_TRANSPORT_WINDOW];
+    estc_transport_stats_t stats;
+} estc_transport_t;
+
+typedef enum
+{
+    ESTC_TRANSPORT_RX_ACCEPTED,         /**< In order, part of a message. */
+    ESTC_TRANSPORT_RX_MESSAGE,          /**< Completed a message. */
+    ESTC_TRANSPORT_RX_DUPLICATE,        /**< Received before, dropped. */
+    ESTC_TRANSPORT_RX_GAP,              /**< A segment before it is missing, kept if the receiver has room for it. Answer
+                                             with a NACK. */
+    ESTC_TRANSPORT_RX_ERROR,            /**< Malformed, too long for the buffer or a wrong CRC. The message is lost. */
+    ESTC_TRANSPORT_RX_NONE,             /**< No kept segment is in order yet, from estc_transport_rx_next(). */
+} estc_transport_rx_status_t;
+
+typedef struct
+{
+    uint8_t  data[ESTC_TRANSPORT_SEG_HDR_LEN + ESTC_TRANSPORT_SEG_PAYLOAD_MAX];
+    uint16_t len;
+} estc_transport_rx_seg_t;
+
+typedef struct
+{
+    uint8_t                 * p_buf;
+    uint32_t                  buf_size;
+    estc_transport_rx_seg_t * p_held;   /**< ESTC_TRANSPORT_WINDOW slots by seq, or NULL. */
+    uint32_t                  held;     /**< Bit i set if segment expected + i is kept. */
+    uint32_t                  len;      /**< Of the message being reassembled, with its CRC. */
+    uint32_t                  msg_len;  /**< Its length from the first segment, with its CRC. */
+    uint16_t                  expected;
+    bool                      in_msg;
+} estc_transport_rx_t;
+
+/**@brief Start a sender, paused until the first acknowledgement.
+ *
+ * @param[in] p_buf     Message ring, a power of two bytes.
+ * @param[in] session   Random, so receivers can tell a restarted sender.
+ */
+void estc_transport_init(estc_transport_t * p_transport, estc_transport_send_t send, void * p_ctx,
+                         uint8_t * p_buf, uint32_t buf_size, uint16_t session);
+
+/**@brief Queue a message. Segments go out right away if the link takes them.
+ *
+ * @return false if the ring has no room for it.
+ */
+bool estc_transport_send(estc_transport_t * p_transport, uint8_t const * p_data, uint16_t len);
+
+/**@brief Offer segments to the link until it refuses one or nothing is left. Call when the link has room again. */
+void estc_transport_pump(estc_transport_t * p_transport);
+
+/**@brief Process an acknowledgement written by the receiver.
+ *
+ * @return false if it is malformed, acknowledges segments that were never sent or starts over within a connection.
+ *         It is ignored then.
+ */
+bool estc_transport_on_ack(estc_transport_t * p_transport, uint8_t const * p_data, uint16_t len);
+
+/**@brief Segments not acknowledged yet are sent again after the next connection's first acknowledgement. */
+void estc_transport_on_disconnect(estc_transport_t * p_transport);
+
+/**@brief Session for the receiver to read, see above. */
+static inline uint16_t estc_transport_session(estc_transport_t const * p_transport)
+{
+    return p_transport->session;
+}
+
+/**@brief Set the segment size from the ATT MTU. Only segments cut afterwards use it. */
+void estc_transport_mtu_set(estc_transport_t * p_transport, uint16_t att_mtu);
+
+/**@brief Bytes a message of @p len takes in the ring. */
+static inline uint32_t estc_transport_msg_size(uint16_t len)
+{
+    return (uint32_t)len + ESTC_TRANSPORT_MSG_OVERHEAD;
+}
+
+/**@brief Start a reference receiver. @p buf_size limits the message length to buf_size - ESTC_TRANSPORT_MSG_CRC_LEN.
+ *
+ * @param[in] p_held  ESTC_TRANSPORT_WINDOW slots for segments behind a gap, or NULL to drop those and never
+ *                    acknowledge selectively.
+ */
+void estc_transport_rx_init(estc_transport_rx_t * p_rx, uint8_t * p_buf, uint32_t buf_size,
+                            estc_transport_rx_seg_t * p_held);
+
+/**@brief Forget the sequence and any partial message, to start over with a new session. */
+void estc_transport_rx_reset(estc_transport_rx_t * p_rx);
+
+/**@brief Drop the segments kept out of order. The sender cuts them again on the next connection. */
+void estc_transport_rx_on_disconnect(estc_transport_rx_t * p_rx);
+
+/**@brief Process a notified segment. Follow up with estc_transport_rx_next() until it returns ESTC_TRANSPORT_RX_NONE.
+ *
+ * @param[out] pp_msg     With ESTC_TRANSPORT_RX_MESSAGE the message data, valid until the next segment.
+ * @param[out] p_msg_len  Its length.
+ */
+estc_transport_rx_status_t estc_transport_rx_segment(estc_transport_rx_t * p_rx, uint8_t const * p_seg, uint16_t len,
+                                                     uint8_t const ** pp_msg, uint16_t * p_msg_len);
+
+/**@brief Process the next kept segment once the gap before it is filled, like estc_transport_rx_segment(). */
+estc_transport_rx_status_t estc_transport_rx_next(estc_transport_rx_t * p_rx, uint8_t const ** pp_msg,
+                                                  uint16_t * p_msg_len);
+
+/**@brief Encode an acknowledgement of everything received so far, with the kept segments acknowledged selectively.
+ *        @p p_buf holds ESTC_TRANSPORT_ACK_LEN bytes.
+ */
+uint16_t estc_transport_rx_ack_encode(estc_transport_rx_t const * p_rx, uint8_t op, uint8_t * p_buf);
+
+#endif /* ESTC_TRANSPORT_H__ */
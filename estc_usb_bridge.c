@@ -0,0 +1,353 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_usb_bridge.h"
+
+#ifndef ESTC_USB_BRIDGE_HOST
+#include "nrf.h"
+#include "estc_section.h"
+#else
+#define ESTC_HOT
+#define ESTC_RAMFUNC
+#define __DMB()         __sync_synchronize()
+#endif
+
+#include <stddef.h>
+#include <string.h>
+
+#if (ESTC_USB_BRIDGE_TX_SLOTS & (ESTC_USB_BRIDGE_TX_SLOTS - 1)) || (ESTC_USB_BRIDGE_RX_SLOTS & (ESTC_USB_BRIDGE_RX_SLOTS - 1))
+#error "ESTC_USB_BRIDGE_TX_SLOTS and ESTC_USB_BRIDGE_RX_SLOTS must be powers of two"
+#endif
+
+// Free running indices, the slot is index % count. Head is advanced by the producer, tail by the consumer.
+static uint8_t                         m_tx_buf[ESTC_USB_BRIDGE_TX_SLOTS][ESTC_USB_BRIDGE_TX_SLOT_SIZE];
+static uint16_t                        m_tx_len[ESTC_USB_BRIDGE_TX_SLOTS];
+static volatile uint8_t                m_tx_head;
+static volatile uint8_t                m_tx_tail;
+static bool                            m_tx_busy;       /**< Slot at the tail is owned by the IN endpoint. */
+static bool                            m_tx_reserved;   /**< Slot at the head is being written by a producer. */
+static uint32_t                        m_tx_refused;    /**< Drops counted by the producer, m_stats by the consumer. */
+
+static uint8_t                         m_rx_buf[ESTC_USB_BRIDGE_RX_SLOTS][ESTC_USB_BRIDGE_RX_SLOT_SIZE];
+static uint16_t                        m_rx_len[ESTC_USB_BRIDGE_RX_SLOTS];
+static uint8_t                         m_rx_head;
+static uint8_t                         m_rx_tail;
+static bool                            m_rx_armed;      /**< Slot at the head is owned by the OUT endpoint. */
+static uint8_t                         m_rx_rec[ESTC_USB_BRIDGE_RX_SLOT_SIZE];
+static uint16_t                        m_rx_rec_len;    /**< Bytes of the record being reassembled. */
+static uint16_t                        m_rx_record_len;
+
+static estc_usb_bridge_port_t const  * mp_port;
+static estc_usb_bridge_rx_handler_t    m_rx_handler;
+static volatile bool                   m_open;
+static estc_usb_bridge_stats_t         m_stats;
+
+static void tx_kick(void)
+{
+    uint8_t    slot;
+    ret_code_t err_code;
+
+    if (!m_open || m_tx_busy || (m_tx_tail == m_tx_head))
+    {
+        return;
+    }
+
+    // Pairs with the barrier in estc_usb_bridge_tx_commit(), the slot is read only after the head that published it
+    __DMB();
+
+    slot     = m_tx_tail % ESTC_USB_BRIDGE_TX_SLOTS;
+    err_code = mp_port->write(m_tx_buf[slot], m_tx_len[slot]);
+    if (err_code == NRF_SUCCESS)
+    {
+        m_tx_busy = true;
+        return;
+    }
+
+    // Endpoint refused the transfer, skip the record rather than stall the ring
+    m_stats.tx_dropped++;
+    m_tx_tail++;
+}
+
+static void rx_arm(void)
+{
+    uint8_t    slot;
+    uint16_t   len;
+    ret_code_t err_code;
+
+    while (m_open && !m_rx_armed && ((uint8_t)(m_rx_head - m_rx_tail) < ESTC_USB_BRIDGE_RX_SLOTS))
+    {
+        slot     = m_rx_head % ESTC_USB_BRIDGE_RX_SLOTS;
+        err_code = mp_port->read(m_rx_buf[slot], ESTC_USB_BRIDGE_RX_SLOT_SIZE, &len);
+        if (err_code == NRF_SUCCESS)
+        {
+            // Already buffered by the class driver, no completion event will follow
+            m_rx_len[slot] = len;
+            m_rx_head++;
+        }
+        else if (err_code == NRF_ERROR_IO_PENDING)
+        {
+            m_rx_armed = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+ret_code_t estc_usb_bridge_init(estc_usb_bridge_init_t const * p_init)
+{
+    if ((p_init == NULL) || (p_init->p_port == NULL))
+    {
+        return NRF_ERROR_NULL;
+    }
+    if (p_init->rx_record_len > ESTC_USB_BRIDGE_RX_SLOT_SIZE)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    mp_port         = p_init->p_port;
+    m_rx_handler    = p_init->rx_handler;
+    m_rx_record_len = p_init->rx_record_len;
+    m_open          = false;
+    m_tx_head       = m_tx_tail = 0;
+    m_tx_busy       = false;
+    m_tx_reserved   = false;
+    m_tx_refused    = 0;
+    m_rx_head       = m_rx_tail = 0;
+    m_rx_armed      = false;
+    m_rx_rec_len    = 0;
+
+    memset(&m_stats, 0, sizeof(m_stats));
+
+    return NRF_SUCCESS;
+}
+
+ESTC_RAMFUNC uint8_t * estc_usb_bridge_tx_alloc(estc_usb_bridge_ch_t channel)
+{
+    uint8_t * p_slot;
+
+    if (m_tx_reserved)
+    {
+        // Only possible if a producer broke the one priority rule, or returned without a commit
+        m_tx_refused++;
+        return NULL;
+    }
+    if (!m_open || ((uint8_t)(m_tx_head - m_tx_tail) >= ESTC_USB_BRIDGE_TX_SLOTS))
+    {
+        m_tx_refused++;
+        return NULL;
+    }
+
+    m_tx_reserved = true;
+    p_slot        = m_tx_buf[m_tx_head % ESTC_USB_BRIDGE_TX_SLOTS];
+    p_slot[0]     = (uint8_t)channel;
+
+    return &p_slot[ESTC_USB_BRIDGE_REC_HDR_LEN];
+}
+
+ESTC_RAMFUNC ret_code_t estc_usb_bridge_tx_commit(uint16_t len)
+{
+    uint8_t   slot = m_tx_head % ESTC_USB_BRIDGE_TX_SLOTS;
+    uint8_t * p_slot = m_tx_buf[slot];
+
+    if (!m_tx_reserved)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_tx_reserved = false;
+
+    if (len == 0)
+    {
+        return NRF_SUCCESS;
+    }
+    if (len > ESTC_USB_BRIDGE_PAYLOAD_MAX)
+    {
+        m_tx_refused++;
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+    if (!m_open)
+    {
+        // The port closed and the consumer flushed the ring while the slot was written
+        m_tx_refused++;
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    p_slot[1]      = (uint8_t)(len & 0xFF);
+    p_slot[2]      = (uint8_t)(len >> 8);
+    m_tx_len[slot] = len + ESTC_USB_BRIDGE_REC_HDR_LEN;
+
+    // Publish the slot only once it is complete: the barrier keeps the record and length stores ahead of the head
+    __DMB();
+    m_tx_head++;
+
+    return NRF_SUCCESS;
+}
+
+ESTC_HOT ret_code_t estc_usb_bridge_send(estc_usb_bridge_ch_t channel, uint8_t const * p_data, uint16_t len)
+{
+    uint8_t * p_payload;
+
+    if (p_data == NULL)
+    {
+        return NRF_ERROR_NULL;
+    }
+    if ((len == 0) || (len > ESTC_USB_BRIDGE_PAYLOAD_MAX))
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    p_payload = estc_usb_bridge_tx_alloc(channel);
+    if (p_payload == NULL)
+    {
+        return m_open ? NRF_ERROR_NO_MEM : NRF_ERROR_INVALID_STATE;
+    }
+
+    memcpy(p_payload, p_data, len);
+
+    return estc_usb_bridge_tx_commit(len);
+}
+
+static void rx_deliver(uint8_t const * p_data, uint16_t len)
+{
+    uint16_t chunk;
+
+    if (m_rx_record_len == 0)
+    {
+        m_rx_handler(p_data, len);
+        return;
+    }
+
+    while (len > 0)
+    {
+        chunk = (uint16_t)(m_rx_record_len - m_rx_rec_len);
+        if (chunk > len)
+        {
+            chunk = len;
+        }
+        memcpy(&m_rx_rec[m_rx_rec_len], p_data, chunk);
+        m_rx_rec_len += chunk;
+        p_data       += chunk;
+        len          -= chunk;
+
+        if (m_rx_rec_len == m_rx_record_len)
+        {
+            m_rx_rec_len = 0;
+            m_rx_handler(m_rx_rec, m_rx_record_len);
+        }
+    }
+}
+
+void estc_usb_bridge_process(void)
+{
+    uint8_t slot;
+
+    tx_kick();
+
+    while (m_rx_tail != m_rx_head)
+    {
+        slot = m_rx_tail % ESTC_USB_BRIDGE_RX_SLOTS;
+
+        m_stats.rx_bytes += m_rx_len[slot];
+        if (m_rx_handler != NULL)
+        {
+            rx_deliver(m_rx_buf[slot], m_rx_len[slot]);
+        }
+        m_rx_tail++;
+    }
+
+    rx_arm();
+}
+
+void estc_usb_bridge_stats_get(estc_usb_bridge_stats_t * p_stats)
+{
+    if (p_stats != NULL)
+    {
+        *p_stats             = m_stats;
+        p_stats->tx_dropped += m_tx_refused;
+    }
+}
+
+uint8_t estc_usb_bridge_tx_depth(void)
+{
+    return (uint8_t)(m_tx_head - m_tx_tail);
+}
+
+void estc_usb_bridge_on_port_open(void)
+{
+    m_open = true;
+    rx_arm();
+}
+
+void estc_usb_bridge_on_port_close(void)
+{
+    m_open     = false;
+    m_tx_busy  = false;
+    m_rx_armed = false;
+
+    // Records queued for a closed port are stale by the time the host reopens it, and so is a partial record
+    // from the host
+    m_stats.tx_dropped += (uint8_t)(m_tx_head - m_tx_tail);
+    m_tx_tail    = m_tx_head;
+    m_rx_tail    = m_rx_head;
+    m_rx_rec_len = 0;
+}
+
+void estc_usb_bridge_on_tx_done(void)
+{
+    if (!m_tx_busy)
+    {
+        // Transfer of a port that has been closed since
+        return;
+    }
+
+    m_stats.tx_bytes += m_tx_len[m_tx_tail % ESTC_USB_BRIDGE_TX_SLOTS] - ESTC_USB_BRIDGE_REC_HDR_LEN;
+
+    m_tx_busy = false;
+    m_tx_tail++;
+
+    // Keep the endpoint busy without waiting for the main loop
+    tx_kick();
+}
+
+void estc_usb_bridge_on_rx_done(uint16_t len)
+{
+    if (!m_rx_armed)
+    {
+        // Transfer of a port that has been closed since
+        return;
+    }
+
+    m_rx_len[m_rx_head % ESTC_USB_BRIDGE_RX_SLOTS] = len;
+    m_rx_head++;
+    m_rx_armed = false;
+
+    rx_arm();
+}
@@ -0,0 +1,146 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_USB_BRIDGE_H__
+#define ESTC_USB_BRIDGE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Device to host records on the bridge data interface:
+//   channel (1) | len (2, LE) | payload (len)
+// Host to device data is cut into records of rx_record_len bytes, however USB splits or merges the transfers.
+// The bridge logic only talks to the port below, so it can be built on a host against a fake USBD
+// (ESTC_USB_BRIDGE_HOST), see armgcc/usb_bridge_bench.c.
+//
+// Contexts: records are produced from one interrupt priority, the one of the SoftDevice events and app_timer
+// handlers, and a slot returned by estc_usb_bridge_tx_alloc() has to be committed before that handler returns.
+// The port events and estc_usb_bridge_process() run in the main loop, with the app_usbd event queue enabled.
+// Every index is written from one of the two sides only.
+
+#ifndef ESTC_USB_BRIDGE_HOST
+#include "sdk_config.h"
+#include "sdk_errors.h"
+#else
+#ifndef ESTC_USB_BRIDGE_TX_SLOTS
+#define ESTC_USB_BRIDGE_TX_SLOTS        8
+#endif
+#ifndef ESTC_USB_BRIDGE_TX_SLOT_SIZE
+#define ESTC_USB_BRIDGE_TX_SLOT_SIZE    160
+#endif
+#ifndef ESTC_USB_BRIDGE_RX_SLOTS
+#define ESTC_USB_BRIDGE_RX_SLOTS        4
+#endif
+#ifndef ESTC_USB_BRIDGE_RX_SLOT_SIZE
+#define ESTC_USB_BRIDGE_RX_SLOT_SIZE    64
+#endif
+typedef uint32_t ret_code_t;
+#define NRF_SUCCESS                     0
+#define NRF_ERROR_NO_MEM                4
+#define NRF_ERROR_INVALID_STATE         8
+#define NRF_ERROR_INVALID_LENGTH        9
+#define NRF_ERROR_NULL                  14
+#define NRF_ERROR_IO_PENDING            0x8012
+#endif
+
+#define ESTC_USB_BRIDGE_REC_HDR_LEN     3
+#define ESTC_USB_BRIDGE_PAYLOAD_MAX     (ESTC_USB_BRIDGE_TX_SLOT_SIZE - ESTC_USB_BRIDGE_REC_HDR_LEN)
+
+typedef enum
+{
+    ESTC_USB_BRIDGE_CH_TELEMETRY,   /**< Telemetry frames notified to the gateway. */
+    ESTC_USB_BRIDGE_CH_WRITE,       /**< Values written by the gateway. */
+} estc_usb_bridge_ch_t;
+
+typedef struct
+{
+    /**@brief Start an IN transfer. Completion is reported with estc_usb_bridge_on_tx_done(). */
+    ret_code_t (*write)(uint8_t const * p_data, uint16_t len);
+
+    /**@brief Arm an OUT transfer into @p p_buf.
+     *
+     * @retval NRF_SUCCESS          Data was already buffered, @p p_rx_len holds its length.
+     * @retval NRF_ERROR_IO_PENDING Completion is reported with estc_usb_bridge_on_rx_done().
+     */
+    ret_code_t (*read)(uint8_t * p_buf, uint16_t len, uint16_t * p_rx_len);
+} estc_usb_bridge_port_t;
+
+/**@brief Called from estc_usb_bridge_process() with a record from the host. The buffer is only valid during the call. */
+typedef void (*estc_usb_bridge_rx_handler_t)(uint8_t const * p_data, uint16_t len);
+
+typedef struct
+{
+    estc_usb_bridge_port_t const * p_port;
+    estc_usb_bridge_rx_handler_t   rx_handler;
+    uint16_t                       rx_record_len;   /**< Up to ESTC_USB_BRIDGE_RX_SLOT_SIZE, 0 to pass every transfer as is. */
+} estc_usb_bridge_init_t;
+
+typedef struct
+{
+    uint32_t tx_bytes;          /**< Payload bytes handed to the IN endpoint. */
+    uint32_t tx_dropped;        /**< Records lost to a full ring, a closed port or a failed transfer. */
+    uint32_t rx_bytes;
+} estc_usb_bridge_stats_t;
+
+ret_code_t estc_usb_bridge_init(estc_usb_bridge_init_t const * p_init);
+
+/**@brief Reserve the next transmit slot.
+ *
+ * @details The payload is written in place and the IN endpoint transmits it from there.
+ *
+ * @return Payload area of ESTC_USB_BRIDGE_PAYLOAD_MAX bytes, or NULL if the port is closed, the ring is full or
+ *         another slot is still reserved.
+ */
+uint8_t * estc_usb_bridge_tx_alloc(estc_usb_bridge_ch_t channel);
+
+/**@brief Queue the reserved slot, or drop it with a length of 0.
+ *
+ * @retval NRF_ERROR_INVALID_STATE  Nothing reserved, or the port closed in the meantime. The slot is dropped.
+ */
+ret_code_t estc_usb_bridge_tx_commit(uint16_t len);
+
+/**@brief Copy a buffer into a transmit slot and queue it. */
+ret_code_t estc_usb_bridge_send(estc_usb_bridge_ch_t channel, uint8_t const * p_data, uint16_t len);
+
+/**@brief Start pending transfers and deliver received data. Call from the main loop. */
+void estc_usb_bridge_process(void);
+
+void estc_usb_bridge_stats_get(estc_usb_bridge_stats_t * p_stats);
+
+/**@brief Number of records queued towards the host, including the one in flight. */
+uint8_t estc_usb_bridge_tx_depth(void);
+
+// Port events, called in the context that processes the USBD events
+void estc_usb_bridge_on_port_open(void);
+void estc_usb_bridge_on_port_close(void);
+void estc_usb_bridge_on_tx_done(void);
+void estc_usb_bridge_on_rx_done(uint16_t len);
+
+#endif /* ESTC_USB_BRIDGE_H__ */
@@ -0,0 +1,120 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "estc_usb_cdc.h"
+
+#include "sdk_common.h"
+#include "nrf_log.h"
+#include "nrf_drv_usbd.h"
+#include "app_usbd.h"
+#include "app_usbd_cdc_acm.h"
+
+static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
+                                    app_usbd_cdc_acm_user_event_t event);
+
+APP_USBD_CDC_ACM_GLOBAL_DEF(m_bridge_cdc_acm,
+                            cdc_acm_user_ev_handler,
+                            ESTC_USB_BRIDGE_COMM_INTERFACE,
+                            ESTC_USB_BRIDGE_DATA_INTERFACE,
+                            NRF_DRV_USBD_EPIN(ESTC_USB_BRIDGE_COMM_EPIN),
+                            NRF_DRV_USBD_EPIN(ESTC_USB_BRIDGE_DATA_EPIN),
+                            NRF_DRV_USBD_EPOUT(ESTC_USB_BRIDGE_DATA_EPOUT),
+                            APP_USBD_CDC_COMM_PROTOCOL_NONE);
+
+static ret_code_t cdc_write(uint8_t const * p_data, uint16_t len)
+{
+    return app_usbd_cdc_acm_write(&m_bridge_cdc_acm, p_data, len);
+}
+
+static ret_code_t cdc_read(uint8_t * p_buf, uint16_t len, uint16_t * p_rx_len)
+{
+    ret_code_t err_code = app_usbd_cdc_acm_read_any(&m_bridge_cdc_acm, p_buf, len);
+    if (err_code == NRF_SUCCESS)
+    {
+        *p_rx_len = (uint16_t)app_usbd_cdc_acm_rx_size(&m_bridge_cdc_acm);
+    }
+
+    return err_code;
+}
+
+static const estc_usb_bridge_port_t m_cdc_port =
+{
+    .write = cdc_write,
+    .read  = cdc_read,
+};
+
+static void cdc_acm_user_ev_handler(app_usbd_class_inst_t const * p_inst,
+                                    app_usbd_cdc_acm_user_event_t event)
+{
+    app_usbd_cdc_acm_t const * p_cdc_acm = app_usbd_cdc_acm_class_get(p_inst);
+
+    switch (event)
+    {
+        case APP_USBD_CDC_ACM_USER_EVT_PORT_OPEN:
+            NRF_LOG_INFO("USB bridge port opened");
+            estc_usb_bridge_on_port_open();
+            break;
+
+        case APP_USBD_CDC_ACM_USER_EVT_PORT_CLOSE:
+            NRF_LOG_INFO("USB bridge port closed");
+            estc_usb_bridge_on_port_close();
+            break;
+
+        case APP_USBD_CDC_ACM_USER_EVT_TX_DONE:
+            estc_usb_bridge_on_tx_done();
+            break;
+
+        case APP_USBD_CDC_ACM_USER_EVT_RX_DONE:
+            estc_usb_bridge_on_rx_done((uint16_t)app_usbd_cdc_acm_rx_size(p_cdc_acm));
+            break;
+
+        default:
+            break;
+    }
+}
+
+ret_code_t estc_usb_cdc_init(estc_usb_bridge_rx_handler_t rx_handler, uint16_t rx_record_len)
+{
+    ret_code_t                    err_code;
+    app_usbd_class_inst_t const * p_inst;
+    estc_usb_bridge_init_t        init =
+    {
+        .p_port        = &m_cdc_port,
+        .rx_handler    = rx_handler,
+        .rx_record_len = rx_record_len,
+    };
+
+    err_code = estc_usb_bridge_init(&init);
+    VERIFY_SUCCESS(err_code);
+
+    p_inst = app_usbd_cdc_acm_class_inst_get(&m_bridge_cdc_acm);
+
+    return app_usbd_class_append(p_inst);
+}
@@ -81,32 +81,82 @@
 #include "nrf_log_backend_usb.h"
 
 #include "estc_service.h"
+#include "estc_adv.h"
+#include "estc_telemetry.h"
+#include "estc_usb_cdc.h"
+#include "estc_perf.h"
+#include "estc_metrics.h"
+#include "estc_load.h"
+#include "estc_log_pump.h"
+#include "estc_timer_wheel.h"
+#include "estc_radio_sync.h"
+#include "estc_change.h"
+#include "estc_ctrl.h"
+#include "estc_gatt_layout.h"
+#include "estc_time.h"
+#include "estc_dfu.h"
+#include "estc_section.h"
+#include "estc_crypt.h"
 
 #define DEVICE_NAME                     "ESTC-GATT"                             /**< Name of device. Will be included in the advertising data. */
 #define MANUFACTURER_NAME               "NordicSemiconductor"                   /**< Manufacturer. Will be passed to Device Information Service. */
+#define APP_ADV_VERY_FAST_INTERVAL      32                                      /**< Advertising interval right after a disconnect (in units of 0.625 ms. This value corresponds to 20 ms). */
+#define APP_ADV_VERY_FAST_DURATION      500                                     /**< Duration of the very fast stage (5 seconds) in units of 10 milliseconds. */
 #define APP_ADV_INTERVAL                300                                     /**< The advertising interval (in units of 0.625 ms. This value corresponds to 187.5 ms). */
 
-#define APP_ADV_DURATION                18000                                   /**< The advertising duration (180 seconds) in units of 10 milliseconds. */
+#define APP_ADV_DURATION                3000                                    /**< The advertising duration (30 seconds) in units of 10 milliseconds. */
+#define APP_ADV_SLOW_INTERVAL           1600                                    /**< Slow stage advertising interval (in units of 0.625 ms. This value corresponds to 1 s). */
+#define APP_ADV_SLOW_DURATION           18000                                   /**< Duration of the slow stage (180 seconds) in units of 10 milliseconds. */
+#define APP_ADV_VERY_SLOW_INTERVAL      3200                                    /**< Very slow stage advertising interval (in units of 0.625 ms. This value corresponds to 2 s). */
+#define APP_ADV_VERY_SLOW_DURATION      0                                       /**< The very slow stage never times out, so the device stays reachable. */
 #define APP_BLE_OBSERVER_PRIO           3                                       /**< Application's BLE observer priority. You shouldn't need to modify this value. */
 #define APP_BLE_CONN_CFG_TAG            1                                       /**< A tag identifying the SoftDevice BLE configuration. */
 
-#define MIN_CONN_INTERVAL               MSEC_TO_UNITS(100, UNIT_1_25_MS)        /**< Minimum acceptable connection interval (0.1 seconds). */
-#define MAX_CONN_INTERVAL               MSEC_TO_UNITS(200, UNIT_1_25_MS)        /**< Maximum acceptable connection interval (0.2 second). */
-#define SLAVE_LATENCY                   0                                       /**< Slave latency. */
+#define MIN_CONN_INTERVAL               ESTC_CONFIG_MIN_CONN_INTERVAL           /**< Minimum acceptable connection interval, set by the build profile. */
+#define MAX_CONN_INTERVAL               ESTC_CONFIG_MAX_CONN_INTERVAL           /**< Maximum acceptable connection interval, set by the build profile. */
+#define SLAVE_LATENCY                   ESTC_CONFIG_SLAVE_LATENCY               /**< Slave latency, set by the build profile. */
 #define CONN_SUP_TIMEOUT                MSEC_TO_UNITS(4000, UNIT_10_MS)         /**< Connection supervisory timeout (4 seconds). */
 
 #define FIRST_CONN_PARAMS_UPDATE_DELAY  APP_TIMER_TICKS(5000)                   /**< Time from initiating event (connect or start of notification) to first time sd_ble_gap_conn_param_update is called (5 seconds). */
 #define NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(30000)                  /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT    3                                       /**< Number of attempts before giving up the connection parameter negotiation. */
 
+#define SEC_PARAM_BOND                  1                                       /**< Perform bonding. */
+#define SEC_PARAM_MITM                  0                                       /**< Man In The Middle protection not required. */
+#define SEC_PARAM_LESC                  0                                       /**< LE Secure Connections not enabled. */
+#define SEC_PARAM_KEYPRESS              0                                       /**< Keypress notifications not enabled. */
+#define SEC_PARAM_IO_CAPABILITIES       BLE_GAP_IO_CAPS_NONE                    /**< No I/O capabilities. */
+#define SEC_PARAM_OOB                   0                                       /**< Out Of Band data not available. */
+#define SEC_PARAM_MIN_KEY_SIZE          7                                       /**< Minimum encryption key size. */
+#define SEC_PARAM_MAX_KEY_SIZE          16                                      /**< Maximum encryption key size. */
+
 #define DEAD_BEEF                       0xDEADBEEF                              /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
+// Build profile consistency, see estc_config_profile.h
+STATIC_ASSERT((NRF_SDH_BLE_GATT_MAX_MTU_SIZE >= BLE_GATT_ATT_MTU_DEFAULT) && (NRF_SDH_BLE_GATT_MAX_MTU_SIZE <= 247));
+STATIC_ASSERT((NRF_SDH_BLE_GAP_DATA_LENGTH >= 27) && (NRF_SDH_BLE_GAP_DATA_LENGTH <= 251));
+STATIC_ASSERT(NRF_SDH_BLE_TOTAL_LINK_COUNT == NRF_SDH_BLE_PERIPHERAL_LINK_COUNT + NRF_SDH_BLE_CENTRAL_LINK_COUNT);
+// m_conn_handle and the service hold one connection, and advertising is not restarted while connected
+STATIC_ASSERT(NRF_SDH_BLE_PERIPHERAL_LINK_COUNT == 1);
+STATIC_ASSERT((MIN_CONN_INTERVAL >= 6) && (MIN_CONN_INTERVAL <= MAX_CONN_INTERVAL) && (MAX_CONN_INTERVAL <= 3200));
+// The supervision timeout must outlast the skipped events plus one missed interval
+STATIC_ASSERT(CONN_SUP_TIMEOUT * 10 > (1 + SLAVE_LATENCY) * MAX_CONN_INTERVAL * 5 / 4 * 2);
+#define TELEMETRY_LAYOUT                (ESTC_TELEMETRY_LAYOUT | (ESTC_TELEMETRY_TIMESTAMP ? ESTC_TELEMETRY_LAYOUT_TIMESTAMP : 0))
+
+// A telemetry frame goes out as a single notification and a single bridge record
+STATIC_ASSERT(ESTC_TELEMETRY_FRAME_LEN(TELEMETRY_LAYOUT, ESTC_TELEMETRY_SAMPLES_PER_FRAME) <= NRF_SDH_BLE_GATT_MAX_MTU_SIZE - 3);
+STATIC_ASSERT(ESTC_TELEMETRY_FRAME_LEN(TELEMETRY_LAYOUT, ESTC_TELEMETRY_SAMPLES_PER_FRAME) <= ESTC_USB_BRIDGE_PAYLOAD_MAX);
+STATIC_ASSERT(ESTC_TELEMETRY_SAMPLES_PER_FRAME * ESTC_TELEMETRY_DECIMATION <= ESTC_TELEMETRY_BLOCK_MAX);
+// The metrics snapshot is notified whole once the MTU allows it and only read below that
+STATIC_ASSERT(ESTC_METRICS_SNAPSHOT_LEN_MAX <= 247 - 3);
+
 NRF_BLE_GATT_DEF(m_gatt);                                                       /**< GATT module instance. */
 NRF_BLE_QWR_DEF(m_qwr);                                                         /**< Context for the Queued Write module.*/
 BLE_ADVERTISING_DEF(m_advertising);                                             /**< Advertising module instance. */
 
 #define PERIODIC_NOTIFIER_PERIOD_MS 5000
-APP_TIMER_DEF(m_periodic_notifier);
+#define PERIODIC_NOTIFIER_SLACK_MS  500                                         /**< The notifier may run this late to share a wakeup with the producers. */
+static estc_timer_wheel_job_t m_periodic_notifier;
 
 static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;                        /**< Handle of the current connection. */
 
@@ -118,11 +168,68 @@ static ble_uuid_t m_adv_uuids[] =
 };
 
 ble_estc_service_t m_estc_service; /**< ESTC example BLE service */
+NRF_SDH_BLE_OBSERVER(m_estc_service_observer, ESTC_SERVICE_BLE_OBSERVER_PRIO, estc_ble_service_on_ble_event, &m_estc_service);
+
+#if ESTC_CRYPT_ENABLED
+static estc_crypt_t m_crypt;                                                    /**< Seals telemetry records for the backend. */
+static bool         m_crypt_ready;                                              /**< A record key is provisioned. */
+#endif
+
+static void advertising_start(bool erase_bonds);
+
+/**@brief Function for encoding the current metrics snapshot.
+ *
+ * @details Also the provider of the metrics characteristic, which is only computed when read.
+ */
+static uint16_t metrics_encode(void * p_context, uint8_t * p_buf, uint16_t buf_len)
+{
+    estc_metrics_snapshot_t snapshot;
+
+    estc_metrics_gauge_set(ESTC_METRICS_GAUGE_USB_TX_QUEUED, estc_usb_bridge_tx_depth());
+    estc_metrics_snapshot_get(&snapshot);
+
+    return estc_metrics_snapshot_encode(&snapshot, p_buf, buf_len);
+}
+
+/**@brief Function for notifying the metrics snapshot when the CPU load changed enough.
+ */
+static void metrics_publish(uint32_t now_ms)
+{
+    int32_t load = estc_metrics_gauge_get(ESTC_METRICS_GAUGE_CPU_LOAD);
+
+    if (estc_change_eval(ESTC_CHANGE_CH_METRICS, load, now_ms) == 0)
+    {
+        return;
+    }
+
+    uint8_t    buf[ESTC_METRICS_SNAPSHOT_LEN_MAX];
+    uint16_t   len      = metrics_encode(NULL, buf, sizeof(buf));
+    ret_code_t err_code = estc_ble_service_metrics_notify(&m_estc_service, buf, len);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_DEBUG("Metrics snapshot not notified: 0x%x", err_code);
+    }
+
+    // The snapshot does not fit a notification at this MTU, the peer has to read it; retrying every period would
+    // not help
+    if ((err_code == NRF_SUCCESS) || (err_code == NRF_ERROR_DATA_SIZE))
+    {
+        estc_change_sent(ESTC_CHANGE_CH_METRICS, load, now_ms);
+    }
+}
 
-static void advertising_start(void);
 static void periodic_notifier_handler(void *p_ctx)
 {
-    estc_ble_service_hello_notify(&m_estc_service);
+    uint32_t now_ms = (uint32_t)estc_time_ms();
+
+    // The hello value carries no information, only its heartbeat is left
+    if ((estc_change_eval(ESTC_CHANGE_CH_HELLO, 0, now_ms) != 0) &&
+        (estc_ble_service_hello_notify(&m_estc_service) == NRF_SUCCESS))
+    {
+        estc_change_sent(ESTC_CHANGE_CH_HELLO, 0, now_ms);
+    }
+    estc_load_update();
+    metrics_publish(now_ms);
 }
 
 /**@brief Callback function for asserts in the SoftDevice.
@@ -151,11 +258,41 @@ static void timers_init(void)
     ret_code_t err_code = app_timer_init();
     APP_ERROR_CHECK(err_code);
 
-    err_code = app_timer_create(&m_periodic_notifier, APP_TIMER_MODE_REPEATED, periodic_notifier_handler);
+    // Periodic jobs share the timer wheel instead of an app_timer each
+    err_code = estc_timer_wheel_init();
+    APP_ERROR_CHECK(err_code);
+
+    // Keeps the 64-bit time base going while nothing else reads it
+    estc_time_init();
+
+    err_code = estc_timer_wheel_job_init(&m_periodic_notifier, "notifier", ESTC_TIMER_WHEEL_MODE_REPEATED,
+                                         periodic_notifier_handler, PERIODIC_NOTIFIER_SLACK_MS);
     APP_ERROR_CHECK(err_code);
 }
 
 
+/**@brief Function for handling Peer Manager events.
+ *
+ * @param[in] p_evt  Peer Manager event.
+ */
+static void pm_evt_handler(pm_evt_t const * p_evt)
+{
+    pm_handler_on_pm_evt(p_evt);
+    pm_handler_disconnect_on_sec_failure(p_evt);
+    pm_handler_flash_clean(p_evt);
+
+    switch (p_evt->evt_id)
+    {
+        case PM_EVT_PEERS_DELETE_SUCCEEDED:
+            advertising_start(false);
+            break;
+
+        default:
+            break;
+    }
+}
+
+
 /**@brief Function for the GAP initialization.
  *
  * @details This function sets up all the necessary GAP (Generic Access Profile) parameters of the
@@ -189,11 +326,23 @@ static void gap_params_init(void)
 }
 
 
+/**@brief Function for handling GATT module events.
+ */
+static void gatt_evt_handler(nrf_ble_gatt_t * p_gatt, nrf_ble_gatt_evt_t const * p_evt)
+{
+    if (p_evt->evt_id == NRF_BLE_GATT_EVT_ATT_MTU_UPDATED)
+    {
+        estc_metrics_gauge_set(ESTC_METRICS_GAUGE_MTU, p_evt->params.att_mtu_effective);
+        estc_ble_service_mtu_set(&m_estc_service, p_evt->params.att_mtu_effective);
+    }
+}
+
+
 /**@brief Function for initializing the GATT module.
  */
 static void gatt_init(void)
 {
-    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, NULL);
+    ret_code_t err_code = nrf_ble_gatt_init(&m_gatt, gatt_evt_handler);
     APP_ERROR_CHECK(err_code);
 }
 
@@ -210,6 +359,71 @@ static void nrf_qwr_error_handler(uint32_t nrf_error)
     APP_ERROR_HANDLER(nrf_error);
 }
 
+/**@brief Function for initializing the change detection in front of the ESTC notifications.
+ *
+ * @details Must run before services_init(), the configuration characteristic starts with these values.
+ */
+static void change_detection_init(void)
+{
+#if ESTC_CHANGE_ENABLED
+    static const estc_change_cfg_t cfg[ESTC_CHANGE_CH_COUNT] =
+    {
+        [ESTC_CHANGE_CH_HELLO] =
+        {
+            .triggers     = ESTC_CHANGE_TRIG_HEARTBEAT,
+            .heartbeat_s  = ESTC_CHANGE_HELLO_HEARTBEAT_S,
+        },
+        [ESTC_CHANGE_CH_TELEMETRY] =
+        {
+            .triggers     = ESTC_CHANGE_TRIG_DEADBAND | ESTC_CHANGE_TRIG_HEARTBEAT,
+            .deadband     = ESTC_CHANGE_TELEMETRY_DEADBAND,
+            .heartbeat_s  = ESTC_CHANGE_TELEMETRY_HEARTBEAT_S,
+        },
+        [ESTC_CHANGE_CH_METRICS] =
+        {
+            .triggers     = ESTC_CHANGE_TRIG_DEADBAND | ESTC_CHANGE_TRIG_HEARTBEAT,
+            .deadband     = ESTC_CHANGE_METRICS_DEADBAND,
+            .heartbeat_s  = ESTC_CHANGE_METRICS_HEARTBEAT_S,
+        },
+    };
+#else
+    // Every evaluation notifies, as without change detection. Still tunable over the air.
+    static const estc_change_cfg_t cfg[ESTC_CHANGE_CH_COUNT] =
+    {
+        [ESTC_CHANGE_CH_HELLO]     = { .triggers = ESTC_CHANGE_TRIG_ALWAYS },
+        [ESTC_CHANGE_CH_TELEMETRY] = { .triggers = ESTC_CHANGE_TRIG_ALWAYS },
+        [ESTC_CHANGE_CH_METRICS]   = { .triggers = ESTC_CHANGE_TRIG_ALWAYS },
+    };
+#endif
+
+    estc_change_init(cfg);
+}
+
+/**@brief Function for initializing the control point with the build time settings.
+ */
+static void ctrl_init(void)
+{
+    estc_ctrl_init_t init =
+    {
+        .conn_params =
+        {
+            .min_conn_interval = MIN_CONN_INTERVAL,
+            .max_conn_interval = MAX_CONN_INTERVAL,
+            .slave_latency     = SLAVE_LATENCY,
+            .conn_sup_timeout  = CONN_SUP_TIMEOUT,
+        },
+        .phys =
+        {
+            .tx_phys = BLE_GAP_PHY_AUTO,
+            .rx_phys = BLE_GAP_PHY_AUTO,
+        },
+        .log_level = NRF_LOG_DEFAULT_LEVEL,
+    };
+
+    ret_code_t err_code = estc_ctrl_init(&init);
+    APP_ERROR_CHECK(err_code);
+}
+
 /**@brief Function for initializing services that will be used by the application.
  */
 static void services_init(void)
@@ -223,8 +437,168 @@ static void services_init(void)
     err_code = nrf_ble_qwr_init(&m_qwr, &qwr_init);
     APP_ERROR_CHECK(err_code);
 
+    m_estc_service.metrics_value.provider = metrics_encode;
     err_code = estc_ble_service_init(&m_estc_service);
     APP_ERROR_CHECK(err_code);
+
+#if ESTC_DFU_ENABLED
+    err_code = estc_dfu_init();
+    APP_ERROR_CHECK(err_code);
+#endif
+
+    // Every attribute exists now, the layout hash covers all of them
+    err_code = estc_gatt_layout_init();
+    APP_ERROR_CHECK(err_code);
+
+    err_code = estc_ble_service_layout_set(&m_estc_service, estc_gatt_layout_hash_get());
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for initializing the record encryption.
+ *
+ * @details The key is provisioned into UICR CUSTOMER[0..3] at production and the nonce head is the device ID, so the
+ *          backend finds both from the device alone. Without a key no records are sealed. Must run after
+ *          ble_stack_init(), the boot ID comes from the SoftDevice RNG.
+ */
+static void crypt_init(void)
+{
+#if ESTC_CRYPT_ENABLED
+    uint8_t  key[ESTC_CRYPT_KEY_LEN];
+    uint8_t  nonce_head[ESTC_CRYPT_NONCE_HEAD_LEN];
+    uint32_t device_id[2] = { NRF_FICR->DEVICEID[0], NRF_FICR->DEVICEID[1] };
+    uint32_t boot_id;
+    uint8_t  available = 0;
+    bool     blank = true;
+
+    for (uint32_t i = 0; i < ESTC_CRYPT_KEY_LEN / sizeof(uint32_t); i++)
+    {
+        uint32_t word = NRF_UICR->CUSTOMER[i];
+
+        blank = blank && (word == 0xFFFFFFFF);
+        memcpy(&key[i * sizeof(word)], &word, sizeof(word));
+    }
+    if (blank)
+    {
+        NRF_LOG_WARNING("No record key in UICR, telemetry records are not sealed");
+        return;
+    }
+
+    // A boot ID that repeats would repeat nonces, so wait for the RNG rather than fall back to anything else
+    do
+    {
+        ret_code_t err_code = sd_rand_application_bytes_available_get(&available);
+        APP_ERROR_CHECK(err_code);
+    } while (available < sizeof(boot_id));
+
+    ret_code_t err_code = sd_rand_application_vector_get((uint8_t *)&boot_id, sizeof(boot_id));
+    APP_ERROR_CHECK(err_code);
+
+    memcpy(nonce_head, device_id, sizeof(nonce_head));
+    estc_crypt_init(&m_crypt, (estc_crypt_mode_t)ESTC_CRYPT_MODE, key, nonce_head, boot_id);
+    memset(key, 0, sizeof(key));
+    m_crypt_ready = true;
+#endif
+}
+
+
+/**@brief Function for computing the keystream of the next records.
+ *
+ * @return true if there was work left, false if the pool is full.
+ */
+static bool crypt_refill(void)
+{
+#if ESTC_CRYPT_ENABLED
+    return m_crypt_ready && estc_crypt_refill(&m_crypt);
+#else
+    return false;
+#endif
+}
+
+
+/**@brief Function for publishing a telemetry frame to subscribers and scanners.
+ *
+ * @param[in] p_frame  Encoded telemetry frame.
+ * @param[in] len      Frame length.
+ */
+static void telemetry_frame_handler(uint8_t const * p_frame, uint16_t len, estc_telemetry_frame_t const * p_decoded)
+{
+    uint32_t   now_ms   = (uint32_t)estc_time_ms();
+    bool       notify   = (estc_change_eval(ESTC_CHANGE_CH_TELEMETRY, p_decoded->mean, now_ms) != 0);
+    ret_code_t err_code = estc_ble_service_telemetry_update(&m_estc_service, p_frame, len, notify);
+    if (err_code != NRF_SUCCESS)
+    {
+        // Not subscribed or out of TX buffers: the next frame supersedes this one.
+        NRF_LOG_DEBUG("Telemetry frame not notified: 0x%x", err_code);
+    }
+    else if (notify && (m_estc_service.connection_handle != BLE_CONN_HANDLE_INVALID))
+    {
+        estc_change_sent(ESTC_CHANGE_CH_TELEMETRY, p_decoded->mean, now_ms);
+        estc_radio_sync_latency_start();
+    }
+
+    err_code = estc_adv_broadcast_data_set(p_frame, len);
+    if (err_code != NRF_SUCCESS)
+    {
+        // Advertising data update refused: the next frame replaces this one
+        NRF_LOG_DEBUG("Telemetry frame not broadcast: 0x%x", err_code);
+    }
+
+    // Encoded straight into the slot the IN endpoint transmits from
+    uint8_t * p_usb_payload = estc_usb_bridge_tx_alloc(ESTC_USB_BRIDGE_CH_TELEMETRY);
+    err_code = (p_usb_payload == NULL)
+             ? NRF_ERROR_NO_MEM
+             : estc_usb_bridge_tx_commit(estc_telemetry_frame_encode(p_decoded, p_usb_payload,
+                                                                     ESTC_USB_BRIDGE_PAYLOAD_MAX));
+    if (err_code != NRF_SUCCESS)
+    {
+        // Bridge port closed or the host is not reading
+        NRF_LOG_DEBUG("Telemetry frame not bridged: 0x%x", err_code);
+    }
+
+#if ESTC_CRYPT_ENABLED
+    // Sealed for the backend and queued on the reliable transport, which keeps the records across disconnections
+    // until the gateway relaying them has acknowledged them
+    if (m_crypt_ready)
+    {
+        uint8_t  record[ESTC_TELEMETRY_FRAME_LEN_MAX + ESTC_CRYPT_RECORD_HDR_LEN + ESTC_CRYPT_TAG_LEN];
+        uint16_t record_len = estc_crypt_seal(&m_crypt, p_frame, len, record, sizeof(record));
+
+        err_code = estc_ble_service_transport_send(&m_estc_service, record, record_len);
+        if (err_code != NRF_SUCCESS)
+        {
+            // Nobody has acknowledged the backlog for a while
+            NRF_LOG_DEBUG("Telemetry record not queued: 0x%x", err_code);
+        }
+    }
+#endif
+}
+
+
+/**@brief Function for initializing the telemetry producer.
+ */
+static void telemetry_init(void)
+{
+    ret_code_t            err_code;
+    estc_telemetry_init_t init =
+    {
+        .sample_period_ms  = ESTC_TELEMETRY_SAMPLE_PERIOD_MS,
+        .samples_per_frame = ESTC_TELEMETRY_SAMPLES_PER_FRAME,
+        .layout            = TELEMETRY_LAYOUT,
+        .filter            = (estc_telemetry_filter_t)ESTC_TELEMETRY_FILTER,
+        .cutoff_permille   = ESTC_TELEMETRY_FILTER_CUTOFF_PERMILLE,
+        .ma_log2_window    = ESTC_TELEMETRY_FILTER_MA_LOG2_WINDOW,
+        .decimation        = ESTC_TELEMETRY_DECIMATION,
+        .sensor_offset     = ESTC_TELEMETRY_SENSOR_OFFSET,
+        .frame_handler     = telemetry_frame_handler,
+    };
+
+    err_code = estc_telemetry_init(&init);
+    APP_ERROR_CHECK(err_code);
+
+    // Radio notifications measure the sample-to-air latency whether or not samples are aligned
+    err_code = estc_radio_sync_init(estc_telemetry_on_radio_prepare);
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -287,7 +661,11 @@ static void conn_params_init(void)
  */
 static void application_timers_start(void)
 {
-    app_timer_start(m_periodic_notifier, APP_TIMER_TICKS(PERIODIC_NOTIFIER_PERIOD_MS), NULL);
+    ret_code_t err_code = estc_timer_wheel_start(&m_periodic_notifier, PERIODIC_NOTIFIER_PERIOD_MS, NULL);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = estc_telemetry_start();
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -324,12 +702,30 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
     switch (ble_adv_evt)
     {
+        case BLE_ADV_EVT_DIRECTED_HIGH_DUTY:
+            NRF_LOG_INFO("ADV Event: Start directed advertising to the last gateway");
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_DIRECTED);
+            APP_ERROR_CHECK(err_code);
+            break;
+
+        case BLE_ADV_EVT_FAST_WHITELIST:
+            NRF_LOG_INFO("ADV Event: Start fast advertising to bonded gateways");
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_WHITELIST);
+            APP_ERROR_CHECK(err_code);
+            break;
+
         case BLE_ADV_EVT_FAST:
             NRF_LOG_INFO("ADV Event: Start fast advertising");
             err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING);
             APP_ERROR_CHECK(err_code);
             break;
 
+        case BLE_ADV_EVT_SLOW:
+            NRF_LOG_INFO("ADV Event: Start slow advertising");
+            err_code = bsp_indication_set(BSP_INDICATE_ADVERTISING_SLOW);
+            APP_ERROR_CHECK(err_code);
+            break;
+
         case BLE_ADV_EVT_IDLE:
             NRF_LOG_INFO("ADV Event: idle, no connectable advertising is ongoing");
             sleep_mode_enter();
@@ -346,9 +742,10 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
  * @param[in]   p_ble_evt   Bluetooth stack event.
  * @param[in]   p_context   Unused.
  */
-static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
+ESTC_HOT static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 {
     ret_code_t err_code = NRF_SUCCESS;
+    ESTC_PERF_BEGIN(ESTC_PERF_BLE_EVT);
 
     switch (p_ble_evt->header.evt_id)
     {
@@ -356,6 +753,11 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             NRF_LOG_INFO("Disconnected (conn_handle: %d)", p_ble_evt->evt.gap_evt.conn_handle);
             // LED indication will be changed when advertising starts.
             m_estc_service.connection_handle = BLE_CONN_HANDLE_INVALID;
+            estc_telemetry_align_set(false);
+            estc_radio_sync_report();
+            estc_perf_report();
+            estc_log_pump_report();
+            estc_timer_wheel_report();
             break;
 
         case BLE_GAP_EVT_CONNECTED:
@@ -369,16 +771,17 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             APP_ERROR_CHECK(err_code);
 
             m_estc_service.connection_handle = m_conn_handle;
+            estc_telemetry_align_set(ESTC_RADIO_SYNC_ALIGN);
+            // The new peer gets every value once, whether it changed or not
+            estc_change_reset();
             break;
 
         case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
         {
             NRF_LOG_DEBUG("PHY update request (conn_handle: %d)", p_ble_evt->evt.gap_evt.conn_handle);
-            ble_gap_phys_t const phys =
-            {
-                .rx_phys = BLE_GAP_PHY_AUTO,
-                .tx_phys = BLE_GAP_PHY_AUTO,
-            };
+            // Automatic unless changed over the control point
+            ble_gap_phys_t phys;
+            estc_ctrl_phy_pref_get(&phys);
             err_code = sd_ble_gap_phy_update(p_ble_evt->evt.gap_evt.conn_handle, &phys);
             APP_ERROR_CHECK(err_code);
         } break;
@@ -391,6 +794,17 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             APP_ERROR_CHECK(err_code);
             break;
 
+        case BLE_GATTS_EVT_WRITE:
+        {
+            ble_gatts_evt_write_t const * p_write = &p_ble_evt->evt.gatts_evt.params.write;
+
+            // Mirror the gateway's writes to the bench host
+            if (p_write->handle == m_estc_service.char_1.value_handle)
+            {
+                (void)estc_usb_bridge_send(ESTC_USB_BRIDGE_CH_WRITE, p_write->data, p_write->len);
+            }
+        } break;
+
         case BLE_GATTS_EVT_TIMEOUT:
             // Disconnect on GATT Server timeout event.
             NRF_LOG_DEBUG("GATT Server Timeout (conn_handle: %d)", p_ble_evt->evt.gatts_evt.conn_handle);
@@ -399,17 +813,12 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             APP_ERROR_CHECK(err_code);
             break;
 
-        case BLE_GATTS_EVT_SYS_ATTR_MISSING:
-            NRF_LOG_INFO("Sys attributes missing");
-            uint16_t conn_handle = p_ble_evt->evt.gatts_evt.conn_handle;
-
-            err_code = sd_ble_gatts_sys_attr_set(conn_handle, NULL, 0, 0);
-            APP_ERROR_CHECK(err_code);
-
         default:
             // No implementation needed.
             break;
     }
+
+    ESTC_PERF_END(ESTC_PERF_BLE_EVT);
 }
 
 
@@ -461,6 +870,24 @@ static void bsp_event_handler(bsp_event_t event)
                 APP_ERROR_CHECK(err_code);
             }
             break; // BSP_EVENT_DISCONNECT
+
+        case BSP_EVENT_WHITELIST_OFF:
+            if (!estc_adv_connectable())
+            {
+                // A broadcast profile cannot be left over the air, this is the way back for the gateway
+                err_code = estc_adv_profile_set(ESTC_ADV_PROFILE_LEGACY);
+                APP_ERROR_CHECK(err_code);
+                break;
+            }
+
+            // Let a new gateway in while the reconnect stage is still running
+            err_code = ble_advertising_restart_without_whitelist(&m_advertising);
+            if (err_code != NRF_ERROR_INVALID_STATE)
+            {
+                APP_ERROR_CHECK(err_code);
+            }
+            break; // BSP_EVENT_WHITELIST_OFF
+
         default:
             break;
     }
@@ -487,12 +914,84 @@ static void advertising_init(void)
     init.config.ble_adv_fast_interval = APP_ADV_INTERVAL;
     init.config.ble_adv_fast_timeout  = APP_ADV_DURATION;
 
-    init.evt_handler = on_adv_evt;
+    // Restart after disconnect is done by estc_adv, so the active profile is kept
+    init.config.ble_adv_on_disconnect_disabled = true;
+
+    // estc_adv runs the advertising stages and forwards the events to on_adv_evt()
+    init.evt_handler = estc_adv_on_adv_evt;
 
     err_code = ble_advertising_init(&m_advertising, &init);
     APP_ERROR_CHECK(err_code);
 
     ble_advertising_conn_cfg_tag_set(&m_advertising, APP_BLE_CONN_CFG_TAG);
+
+    estc_adv_init_t estc_adv_init_params =
+    {
+        .p_advertising = &m_advertising,
+        .evt_handler   = on_adv_evt,
+        .p_uuids       = m_adv_uuids,
+        .uuid_cnt      = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]),
+        .conn_cfg_tag  = APP_BLE_CONN_CFG_TAG,
+        .stages        =
+        {
+            [ESTC_ADV_STAGE_VERY_FAST] = { APP_ADV_VERY_FAST_INTERVAL, APP_ADV_VERY_FAST_DURATION },
+            [ESTC_ADV_STAGE_FAST]      = { APP_ADV_INTERVAL,           APP_ADV_DURATION           },
+            [ESTC_ADV_STAGE_SLOW]      = { APP_ADV_SLOW_INTERVAL,      APP_ADV_SLOW_DURATION      },
+            [ESTC_ADV_STAGE_VERY_SLOW] = { APP_ADV_VERY_SLOW_INTERVAL, APP_ADV_VERY_SLOW_DURATION },
+        },
+    };
+
+    err_code = estc_adv_init(&estc_adv_init_params);
+    APP_ERROR_CHECK(err_code);
+}
+
+
+/**@brief Function for the Peer Manager initialization.
+ */
+static void peer_manager_init(void)
+{
+    ble_gap_sec_params_t sec_param;
+    ret_code_t           err_code;
+
+    err_code = pm_init();
+    APP_ERROR_CHECK(err_code);
+
+    memset(&sec_param, 0, sizeof(ble_gap_sec_params_t));
+
+    // Security parameters to be used for all security procedures.
+    sec_param.bond           = SEC_PARAM_BOND;
+    sec_param.mitm           = SEC_PARAM_MITM;
+    sec_param.lesc           = SEC_PARAM_LESC;
+    sec_param.keypress       = SEC_PARAM_KEYPRESS;
+    sec_param.io_caps        = SEC_PARAM_IO_CAPABILITIES;
+    sec_param.oob            = SEC_PARAM_OOB;
+    sec_param.min_key_size   = SEC_PARAM_MIN_KEY_SIZE;
+    sec_param.max_key_size   = SEC_PARAM_MAX_KEY_SIZE;
+    sec_param.kdist_own.enc  = 1;
+    sec_param.kdist_own.id   = 1;
+    sec_param.kdist_peer.enc = 1;
+    sec_param.kdist_peer.id  = 1;
+
+    err_code = pm_sec_params_set(&sec_param);
+    APP_ERROR_CHECK(err_code);
+
+    err_code = pm_register(pm_evt_handler);
+    APP_ERROR_CHECK(err_code);
+
+    estc_gatt_layout_check();
+}
+
+
+/**@brief Clear bond information from persistent storage.
+ */
+static void delete_bonds(void)
+{
+    ret_code_t err_code;
+
+    NRF_LOG_INFO("Erase bonds!");
+
+    err_code = pm_peers_delete();
+    APP_ERROR_CHECK(err_code);
 }
 
 
@@ -500,15 +999,18 @@ static void advertising_init(void)
  *
  * @param[out] p_erase_bonds  Will be true if the clear bonding button was pressed to wake the application up.
  */
-static void buttons_leds_init(void)
+static void buttons_leds_init(bool * p_erase_bonds)
 {
-    ret_code_t err_code;
+    ret_code_t  err_code;
+    bsp_event_t startup_event;
 
     err_code = bsp_init(BSP_INIT_LEDS | BSP_INIT_BUTTONS, bsp_event_handler);
     APP_ERROR_CHECK(err_code);
 
-    err_code = bsp_btn_ble_init(NULL, NULL);
+    err_code = bsp_btn_ble_init(NULL, &startup_event);
     APP_ERROR_CHECK(err_code);
+
+    *p_erase_bonds = (startup_event == BSP_EVENT_CLEAR_BONDING_DATA);
 }
 
 
@@ -516,13 +1018,39 @@ static void buttons_leds_init(void)
  */
 static void log_init(void)
 {
-    ret_code_t err_code = NRF_LOG_INIT(NULL);
+    ret_code_t err_code = NRF_LOG_INIT(estc_time_log_timestamp, ESTC_TIME_FREQ);
     APP_ERROR_CHECK(err_code);
 
     NRF_LOG_DEFAULT_BACKENDS_INIT();
 }
 
 
+/**@brief Function for handling data written by the host to the USB bridge.
+ *
+ * @details The host takes the same write path as the gateway. Its data is a stream of characteristic 1 values,
+ *          uint16 little-endian each, which the bridge hands over one value at a time.
+ */
+static void usb_bridge_rx_handler(uint8_t const * p_data, uint16_t len)
+{
+    ret_code_t err_code = estc_ble_service_char_1_set(&m_estc_service, p_data, len);
+    if (err_code != NRF_SUCCESS)
+    {
+        NRF_LOG_INFO("USB bridge write rejected: 0x%x", err_code);
+    }
+}
+
+
+/**@brief Function for initializing the USB data bridge.
+ *
+ * @details Must run after log_init(), which brings up the USB stack for the log backend.
+ */
+static void usb_bridge_init(void)
+{
+    ret_code_t err_code = estc_usb_cdc_init(usb_bridge_rx_handler, sizeof(uint16_t));
+    APP_ERROR_CHECK(err_code);
+}
+
+
 /**@brief Function for initializing power management.
  */
 static void power_management_init(void)
@@ -535,24 +1063,38 @@ static void power_management_init(void)
 
 /**@brief Function for handling the idle state (main loop).
  *
- * @details If there is no pending log operation, then sleep until next the next event occurs.
+ * @details Serves the USB bridge, then the log, then computes keystream ahead. If none of them has
+ *          work left, sleep until the next event occurs.
  */
 static void idle_state_handle(void)
 {
-    if (NRF_LOG_PROCESS() == false)
+    ESTC_PERF_BEGIN(ESTC_PERF_USB_BRIDGE);
+    estc_usb_bridge_process();
+    ESTC_PERF_END(ESTC_PERF_USB_BRIDGE);
+
+    // Logs only run once the data path is served, keystream only once the logs are out
+    if (!estc_log_pump_run(estc_ble_service_hvx_backlog(&m_estc_service)) && !crypt_refill())
     {
         nrf_pwr_mgmt_run();
     }
-	LOG_BACKEND_USB_PROCESS();
 }
 
 
 /**@brief Function for starting advertising.
+ *
+ * @param[in] erase_bonds  Delete the bonds first. Advertising is then started on PM_EVT_PEERS_DELETE_SUCCEEDED.
  */
-static void advertising_start(void)
+static void advertising_start(bool erase_bonds)
 {
-    ret_code_t err_code = ble_advertising_start(&m_advertising, BLE_ADV_MODE_FAST);
-    APP_ERROR_CHECK(err_code);
+    if (erase_bonds == true)
+    {
+        delete_bonds();
+    }
+    else
+    {
+        ret_code_t err_code = estc_adv_start();
+        APP_ERROR_CHECK(err_code);
+    }
 }
 
 
@@ -560,23 +1102,41 @@ static void advertising_start(void)
  */
 int main(void)
 {
+    bool erase_bonds;
+
     // Initialize.
+    estc_perf_init();
+    estc_metrics_init();
     log_init();
+    usb_bridge_init();
     timers_init();
-    buttons_leds_init();
+    buttons_leds_init(&erase_bonds);
     power_management_init();
     ble_stack_init();
     gap_params_init();
     gatt_init();
+    change_detection_init();
+    ctrl_init();
     services_init();
+    crypt_init();
+    telemetry_init();
+    peer_manager_init();
     advertising_init();
     conn_params_init();
 
     // Start execution.
     NRF_LOG_INFO("ESTC GATT server example started");
+    estc_perf_ramfunc_bench();
+#if ESTC_CRYPT_ENABLED
+    if (m_crypt_ready)
+    {
+        estc_crypt_bench(&m_crypt);
+    }
+#endif
+    estc_load_init();
     application_timers_start();
 
-    advertising_start();
+    advertising_start(erase_bonds);
 
     // Enter main loop.
     for (;;)
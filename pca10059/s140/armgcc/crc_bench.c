@@ -0,0 +1,295 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host benchmark for estc_crc: checks every variant against the check values of the CRC catalogue and against the
+// bitwise SDK routines, over unaligned buffers split at every offset, then prints the throughput of each. Built and
+// run by `make crc_bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "estc_crc.h"
+
+#define BENCH_LEN       4096
+#define BENCH_ROUNDS    4000
+
+typedef uint16_t (*crc16_fn_t)(uint16_t crc, void const * p_data, size_t len);
+typedef uint32_t (*crc32_fn_t)(uint32_t crc, void const * p_data, size_t len);
+
+static uint8_t  m_data[BENCH_LEN + 8];
+static uint32_t m_rand = 1;
+
+// crc16_compute() and crc32_compute() of the SDK, copied so the host build does not need the SDK headers
+
+static uint16_t crc16_compute(uint8_t const * p_data, uint32_t size, uint16_t const * p_crc)
+{
+    uint16_t crc = (p_crc == NULL) ? 0xFFFF : *p_crc;
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc  = (uint8_t)(crc >> 8) | (crc << 8);
+        crc ^= p_data[i];
+        crc ^= (uint8_t)(crc & 0xFF) >> 4;
+        crc ^= (crc << 8) << 4;
+        crc ^= ((crc & 0xFF) << 4) << 1;
+    }
+
+    return crc;
+}
+
+static uint32_t crc32_compute(uint8_t const * p_data, uint32_t size, uint32_t const * p_crc)
+{
+    uint32_t crc = (p_crc == NULL) ? 0xFFFFFFFF : ~(*p_crc);
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        crc = crc ^ p_data[i];
+        for (uint32_t j = 8; j > 0; j--)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320U & ((crc & 1) ? 0xFFFFFFFF : 0));
+        }
+    }
+    return ~crc;
+}
+
+static uint16_t sdk_crc16(uint16_t crc, void const * p_data, size_t len)
+{
+    return crc16_compute(p_data, (uint32_t)len, &crc);
+}
+
+static uint32_t sdk_crc32(uint32_t crc, void const * p_data, size_t len)
+{
+    return crc32_compute(p_data, (uint32_t)len, &crc);
+}
+
+static const struct
+{
+    char const * p_name;
+    crc16_fn_t   fn;
+} m_crc16[] =
+{
+    { "crc16_compute", sdk_crc16 },
+    { "crc16 slice1", estc_crc16_update_slice1 },
+    { "crc16 slice4", estc_crc16_update_slice4 },
+    { "crc16 slice8", estc_crc16_update_slice8 },
+};
+
+static const struct
+{
+    char const * p_name;
+    crc32_fn_t   fn;
+    uint32_t     check;     /**< CRC of "123456789". */
+} m_crc32[] =
+{
+    { "crc32_compute", sdk_crc32, 0xCBF43926 },
+    { "crc32 slice1", estc_crc32_update_slice1, 0xCBF43926 },
+    { "crc32 slice4", estc_crc32_update_slice4, 0xCBF43926 },
+    { "crc32 slice8", estc_crc32_update_slice8, 0xCBF43926 },
+    { "crc32c slice1", estc_crc32c_update_slice1, 0xE3069283 },
+    { "crc32c slice4", estc_crc32c_update_slice4, 0xE3069283 },
+    { "crc32c slice8", estc_crc32c_update_slice8, 0xE3069283 },
+};
+
+#define COUNT(array)    (sizeof(array) / sizeof((array)[0]))
+
+static uint8_t rand_u8(void)
+{
+    // xorshift32, the same sequence on every host
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return (uint8_t)m_rand;
+}
+
+static double mb_per_s(clock_t start, clock_t end)
+{
+    return (double)BENCH_LEN * BENCH_ROUNDS / ((double)(end - start) / CLOCKS_PER_SEC) / 1e6;
+}
+
+static int vectors_check(void)
+{
+    static const uint8_t check[] = "123456789";
+
+    int failed = 0;
+
+    for (size_t i = 0; i < COUNT(m_crc16); i++)
+    {
+        uint16_t crc = m_crc16[i].fn(ESTC_CRC16_INIT, check, 9);
+        if (crc != 0x29B1)
+        {
+            printf("FAIL %s(\"123456789\") = 0x%04X, expected 0x29B1\n", m_crc16[i].p_name, crc);
+            failed = 1;
+        }
+    }
+
+    for (size_t i = 0; i < COUNT(m_crc32); i++)
+    {
+        uint32_t crc = m_crc32[i].fn(0, check, 9);
+        if (crc != m_crc32[i].check)
+        {
+            printf("FAIL %s(\"123456789\") = 0x%08X, expected 0x%08X\n", m_crc32[i].p_name, (unsigned)crc,
+                   (unsigned)m_crc32[i].check);
+            failed = 1;
+        }
+    }
+
+    // The functions the rest of the code calls
+    if ((estc_crc16(check, 9) != 0x29B1) || (estc_crc32(check, 9) != 0xCBF43926) ||
+        (estc_crc32c(check, 9) != 0xE3069283))
+    {
+        printf("FAIL configured variant\n");
+        failed = 1;
+    }
+    return failed;
+}
+
+/**@brief Every variant over every start alignment and length up to 64, in one piece and split at every offset. */
+static int variants_check(void)
+{
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        uint8_t const * p = &m_data[offset];
+
+        for (size_t len = 0; len <= 64; len++)
+        {
+            uint16_t ref16 = crc16_compute(p, (uint32_t)len, NULL);
+            uint32_t ref32 = crc32_compute(p, (uint32_t)len, NULL);
+            uint32_t ref32c = estc_crc32c_update_slice1(0, p, len);
+
+            for (size_t split = 0; split <= len; split++)
+            {
+                for (size_t i = 0; i < COUNT(m_crc16); i++)
+                {
+                    uint16_t crc = m_crc16[i].fn(m_crc16[i].fn(ESTC_CRC16_INIT, p, split), p + split, len - split);
+                    if (crc != ref16)
+                    {
+                        printf("FAIL %s offset %u len %u split %u\n", m_crc16[i].p_name, (unsigned)offset,
+                               (unsigned)len, (unsigned)split);
+                        return 1;
+                    }
+                }
+
+                for (size_t i = 0; i < COUNT(m_crc32); i++)
+                {
+                    uint32_t ref = (m_crc32[i].check == 0xCBF43926) ? ref32 : ref32c;
+                    uint32_t crc = m_crc32[i].fn(m_crc32[i].fn(0, p, split), p + split, len - split);
+                    if (crc != ref)
+                    {
+                        printf("FAIL %s offset %u len %u split %u\n", m_crc32[i].p_name, (unsigned)offset,
+                               (unsigned)len, (unsigned)split);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int frames_check(void)
+{
+    uint8_t frame[64 + ESTC_CRC32C_LEN];
+
+    for (size_t len = 0; len <= 64; len++)
+    {
+        memcpy(frame, m_data, len);
+
+        size_t total = estc_crc16_append(frame, len);
+        if ((total != len + ESTC_CRC16_LEN) || !estc_crc16_check(frame, total))
+        {
+            printf("FAIL crc16 frame of %u bytes\n", (unsigned)len);
+            return 1;
+        }
+        frame[rand_u8() % total] ^= (uint8_t)(1 << (rand_u8() & 7));
+        if (estc_crc16_check(frame, total))
+        {
+            printf("FAIL crc16 frame of %u bytes with a flipped bit passed\n", (unsigned)len);
+            return 1;
+        }
+
+        memcpy(frame, m_data, len);
+        total = estc_crc32c_append(frame, len);
+        if ((total != len + ESTC_CRC32C_LEN) || !estc_crc32c_check(frame, total))
+        {
+            printf("FAIL crc32c record of %u bytes\n", (unsigned)len);
+            return 1;
+        }
+        frame[rand_u8() % total] ^= (uint8_t)(1 << (rand_u8() & 7));
+        if (estc_crc32c_check(frame, total))
+        {
+            printf("FAIL crc32c record of %u bytes with a flipped bit passed\n", (unsigned)len);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    for (size_t i = 0; i < sizeof(m_data); i++)
+    {
+        m_data[i] = rand_u8();
+    }
+
+    if (vectors_check() || variants_check() || frames_check())
+    {
+        return EXIT_FAILURE;
+    }
+    printf("all variants match the check values and the SDK routines, slice-by-%d configured\n", ESTC_CRC_SLICES);
+
+    // Odd start, like a frame after its header
+    uint8_t const * p = &m_data[1];
+    volatile uint32_t sink = 0;
+
+    for (size_t i = 0; i < COUNT(m_crc16); i++)
+    {
+        clock_t start = clock();
+        for (int r = 0; r < BENCH_ROUNDS; r++)
+        {
+            sink += m_crc16[i].fn(ESTC_CRC16_INIT, p, BENCH_LEN);
+        }
+        printf("%-14s %8.1f MB/s\n", m_crc16[i].p_name, mb_per_s(start, clock()));
+    }
+
+    for (size_t i = 0; i < COUNT(m_crc32); i++)
+    {
+        clock_t start = clock();
+        for (int r = 0; r < BENCH_ROUNDS; r++)
+        {
+            sink += m_crc32[i].fn(0, p, BENCH_LEN);
+        }
+        printf("%-14s %8.1f MB/s\n", m_crc32[i].p_name, mb_per_s(start, clock()));
+    }
+
+    (void)sink;
+    return EXIT_SUCCESS;
+}
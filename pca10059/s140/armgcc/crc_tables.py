@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+# Generate the slice-by-N lookup tables of estc_crc.c into estc_crc_tables.h.
+#
+# Table k holds the CRC of every byte value followed by k zero bytes, so N bytes are folded in with N lookups. The
+# file is checked in, run this again only when a polynomial or the slice count changes.
+
+import os
+
+OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', '..', 'estc_crc_tables.h')
+SLICES = 8
+
+with open(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..', '..', 'estc_crc.h')) as f:
+    LICENSE = f.read().split('*/', 1)[0] + '*/\n'
+
+
+def msb_first_tables(poly, width):
+    top = 1 << (width - 1)
+    mask = (1 << width) - 1
+    t0 = []
+    for n in range(256):
+        crc = n << (width - 8)
+        for _ in range(8):
+            crc = ((crc << 1) ^ poly) if crc & top else (crc << 1)
+        t0.append(crc & mask)
+    tables = [t0]
+    for _ in range(1, SLICES):
+        prev = tables[-1]
+        tables.append([((c << 8) ^ t0[c >> (width - 8)]) & mask for c in prev])
+    return tables
+
+
+def reflected_tables(poly):
+    t0 = []
+    for n in range(256):
+        crc = n
+        for _ in range(8):
+            crc = (crc >> 1) ^ (poly if crc & 1 else 0)
+        t0.append(crc)
+    tables = [t0]
+    for _ in range(1, SLICES):
+        prev = tables[-1]
+        tables.append([(c >> 8) ^ t0[c & 0xFF] for c in prev])
+    return tables
+
+
+def emit(out, name, ctype, digits, tables):
+    out.append('static const %s %s[ESTC_CRC_SLICES][256] =\n{\n' % (ctype, name))
+    for k, table in enumerate(tables):
+        if k == 1:
+            out.append('#if ESTC_CRC_SLICES >= 4\n')
+        elif k == 4:
+            out.append('#if ESTC_CRC_SLICES >= 8\n')
+        out.append('    {\n')
+        for row in range(0, 256, 8):
+            out.append('        ' + ', '.join('0x%0*X' % (digits, v) for v in table[row:row + 8]) + ',\n')
+        out.append('    },\n')
+        if k in (3, 7):
+            out.append('#endif\n')
+    out.append('};\n\n')
+
+
+def main():
+    out = [LICENSE, '\n// Generated by armgcc/crc_tables.py, do not edit. Only included by estc_crc.c.\n\n',
+           '#ifndef ESTC_CRC_TABLES_H__\n#define ESTC_CRC_TABLES_H__\n\n']
+    emit(out, 'm_crc16_table', 'uint16_t', 4, msb_first_tables(0x1021, 16))
+    emit(out, 'm_crc32_table', 'uint32_t', 8, reflected_tables(0xEDB88320))
+    emit(out, 'm_crc32c_table', 'uint32_t', 8, reflected_tables(0x82F63B78))
+    out.append('#endif /* ESTC_CRC_TABLES_H__ */\n')
+
+    with open(OUTPUT, 'w') as f:
+        f.write(''.join(out))
+
+
+if __name__ == '__main__':
+    main()
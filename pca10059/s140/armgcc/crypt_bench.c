@@ -0,0 +1,312 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host benchmark for estc_crypt: checks the software AES against FIPS-197 and SP 800-38A, CCM against RFC 3610,
+// and records sealed from the precomputed pool against the plain CCM functions for every length up to a few blocks
+// past the pool, then prints cycles per byte of the software path. The ECB peripheral path only exists on the
+// device, estc_crypt_bench() logs both there. Built and run by `make crypt_bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES()        __rdtsc()
+#define CYCLES_UNIT     "TSC cycles"
+#else
+#define CYCLES()        ((uint64_t)clock())
+#define CYCLES_UNIT     "clock ticks"
+#endif
+
+#include "estc_crypt.h"
+
+#define RECORD_LEN_MAX  (ESTC_CRYPT_PRECOMPUTE_LEN + 4 * ESTC_CRYPT_BLOCK_LEN)
+#define BENCH_ROUNDS    20000
+
+static uint32_t m_rand = 1;
+
+static uint8_t rand_u8(void)
+{
+    // xorshift32, the same sequence on every host
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return (uint8_t)m_rand;
+}
+
+static void hex_parse(char const * p_hex, uint8_t * p_out)
+{
+    for (size_t i = 0; p_hex[2 * i] != '\0'; i++)
+    {
+        unsigned byte;
+        sscanf(&p_hex[2 * i], "%2x", &byte);
+        p_out[i] = (uint8_t)byte;
+    }
+}
+
+static int aes_check(void)
+{
+    static const struct
+    {
+        char const * p_key;
+        char const * p_plain;
+        char const * p_cipher;
+    } vectors[] =
+    {
+        // FIPS-197 appendix C.1
+        { "000102030405060708090a0b0c0d0e0f", "00112233445566778899aabbccddeeff", "69c4e0d86a7b0430d8cdb78070b4c55a" },
+        // SP 800-38A F.1.1
+        { "2b7e151628aed2a6abf7158809cf4f3c",
+          "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+          "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710",
+          "3ad77bb40d7a3660a89ecaf32466ef97f5d3d58503b9699de785895a96fdbaaf"
+          "43b1cd7f598ece23881b00e3ed0306887b0c785e27e8ad3f8223207104725dd4" },
+    };
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++)
+    {
+        uint8_t key[ESTC_CRYPT_KEY_LEN];
+        uint8_t plain[64];
+        uint8_t cipher[64];
+        uint8_t out[64];
+        uint32_t blocks = (uint32_t)strlen(vectors[i].p_plain) / (2 * ESTC_CRYPT_BLOCK_LEN);
+        estc_crypt_key_t ctx;
+
+        hex_parse(vectors[i].p_key, key);
+        hex_parse(vectors[i].p_plain, plain);
+        hex_parse(vectors[i].p_cipher, cipher);
+        estc_crypt_key_init(&ctx, key);
+        estc_crypt_ecb_soft(&ctx, plain, out, blocks);
+
+        if (memcmp(out, cipher, blocks * ESTC_CRYPT_BLOCK_LEN))
+        {
+            printf("FAIL AES vector %u\n", (unsigned)i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int ccm_check(void)
+{
+    // RFC 3610 packet vector #1: 8 bytes of associated data, 23 of payload, 8 byte tag
+    uint8_t key[ESTC_CRYPT_KEY_LEN];
+    uint8_t nonce[ESTC_CRYPT_NONCE_LEN];
+    uint8_t packet[31];
+    uint8_t expected[39];
+    uint8_t out[23];
+    uint8_t tag[ESTC_CRYPT_TAG_LEN];
+    estc_crypt_key_t ctx;
+
+    hex_parse("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf", key);
+    hex_parse("00000003020100a0a1a2a3a4a5", nonce);
+    hex_parse("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e", packet);
+    hex_parse("0001020304050607588c979a61c663d2f066d0c2c0f989806d5f6b61dac38417e8d12cfdf926e0", expected);
+    estc_crypt_key_init(&ctx, key);
+
+    estc_crypt_ccm_encrypt(&ctx, nonce, packet, 8, &packet[8], 23, out, tag);
+    if (memcmp(out, &expected[8], 23) || memcmp(tag, &expected[31], ESTC_CRYPT_TAG_LEN))
+    {
+        printf("FAIL CCM encryption of RFC 3610 packet vector #1\n");
+        return 1;
+    }
+
+    if (!estc_crypt_ccm_decrypt(&ctx, nonce, packet, 8, &expected[8], 23, out, &expected[31]) ||
+        memcmp(out, &packet[8], 23))
+    {
+        printf("FAIL CCM decryption of RFC 3610 packet vector #1\n");
+        return 1;
+    }
+
+    expected[20] ^= 0x01;
+    if (estc_crypt_ccm_decrypt(&ctx, nonce, packet, 8, &expected[8], 23, out, &expected[31]))
+    {
+        printf("FAIL CCM accepted a modified ciphertext\n");
+        return 1;
+    }
+    return 0;
+}
+
+/**@brief Records of every length, sealed with the pool full, partly filled and empty, against the plain functions. */
+static int record_check(estc_crypt_mode_t mode)
+{
+    static const uint8_t key[ESTC_CRYPT_KEY_LEN] = "record check key";
+    static const uint8_t head[ESTC_CRYPT_NONCE_HEAD_LEN] = { 0xE5, 0x7C, 0x00, 0x01, 0x02 };
+    static estc_crypt_t crypt;
+    uint8_t data[RECORD_LEN_MAX];
+    uint8_t rec[RECORD_LEN_MAX + ESTC_CRYPT_RECORD_HDR_LEN + ESTC_CRYPT_TAG_LEN];
+    uint8_t out[RECORD_LEN_MAX];
+
+    estc_crypt_init(&crypt, mode, key, head, 0x5EED1234);
+
+    for (uint16_t len = 0; len <= RECORD_LEN_MAX; len++)
+    {
+        uint16_t out_len = 0;
+
+        for (uint16_t i = 0; i < len; i++)
+        {
+            data[i] = rand_u8();
+        }
+        for (unsigned refills = rand_u8() % 32; refills > 0; refills--)
+        {
+            estc_crypt_refill(&crypt);
+        }
+
+        uint16_t rec_len = estc_crypt_seal(&crypt, data, len, rec, sizeof(rec));
+        if (rec_len != estc_crypt_record_len(mode, len))
+        {
+            printf("FAIL record of %u bytes sealed into %u\n", len, rec_len);
+            return 1;
+        }
+
+        // The pool has to produce what CCM computed from scratch does
+        if (mode == ESTC_CRYPT_MODE_CCM)
+        {
+            uint8_t nonce[ESTC_CRYPT_NONCE_LEN];
+            uint8_t tag[ESTC_CRYPT_TAG_LEN];
+
+            memcpy(nonce, head, ESTC_CRYPT_NONCE_HEAD_LEN);
+            memcpy(&nonce[ESTC_CRYPT_NONCE_HEAD_LEN], rec, ESTC_CRYPT_RECORD_HDR_LEN);
+            estc_crypt_ccm_encrypt(&crypt.key, nonce, NULL, 0, data, len, out, tag);
+            if (memcmp(out, &rec[ESTC_CRYPT_RECORD_HDR_LEN], len) ||
+                memcmp(tag, &rec[ESTC_CRYPT_RECORD_HDR_LEN + len], ESTC_CRYPT_TAG_LEN))
+            {
+                printf("FAIL CCM record of %u bytes differs from estc_crypt_ccm_encrypt()\n", len);
+                return 1;
+            }
+        }
+
+        if (!estc_crypt_open(&crypt.key, mode, head, rec, rec_len, out, &out_len) || (out_len != len) ||
+            memcmp(out, data, len))
+        {
+            printf("FAIL record of %u bytes does not open\n", len);
+            return 1;
+        }
+
+        if (mode == ESTC_CRYPT_MODE_CCM)
+        {
+            rec[rand_u8() % rec_len] ^= (uint8_t)(1 << (rand_u8() % 8));
+            if (estc_crypt_open(&crypt.key, mode, head, rec, rec_len, out, &out_len))
+            {
+                printf("FAIL modified record of %u bytes opened\n", len);
+                return 1;
+            }
+        }
+    }
+
+    printf("%s records: %u sealed, %u with the keystream all computed ahead, %u blocks refilled\n",
+           (mode == ESTC_CRYPT_MODE_CCM) ? "CCM" : "CTR", (unsigned)crypt.stats.sealed,
+           (unsigned)crypt.stats.precomputed, (unsigned)crypt.stats.refill_blocks);
+    return 0;
+}
+
+static double per_byte(uint64_t cycles, uint32_t len)
+{
+    return (double)cycles / ((double)len * BENCH_ROUNDS);
+}
+
+static void bench(void)
+{
+    static const uint8_t key[ESTC_CRYPT_KEY_LEN] = "bench key 012345";
+    static const uint8_t head[ESTC_CRYPT_NONCE_HEAD_LEN] = { 0 };
+    static estc_crypt_t crypt;
+    static volatile uint8_t sink;
+    uint8_t data[ESTC_CRYPT_PRECOMPUTE_LEN];
+    uint8_t rec[ESTC_CRYPT_PRECOMPUTE_LEN + ESTC_CRYPT_RECORD_HDR_LEN + ESTC_CRYPT_TAG_LEN];
+    uint64_t start;
+    uint64_t refill = 0;
+    uint64_t seal[2] = { 0 };
+    uint64_t cold[2] = { 0 };
+
+    memset(data, 0x5A, sizeof(data));
+    estc_crypt_key_init(&crypt.key, key);
+
+    start = CYCLES();
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        estc_crypt_ecb_soft(&crypt.key, data, data, sizeof(data) / ESTC_CRYPT_BLOCK_LEN);
+    }
+    uint64_t soft = CYCLES() - start;
+
+    for (int mode = ESTC_CRYPT_MODE_CTR; mode <= ESTC_CRYPT_MODE_CCM; mode++)
+    {
+        estc_crypt_init(&crypt, (estc_crypt_mode_t)mode, key, head, 1);
+        for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+        {
+            // Idle time, then the hot path
+            start = CYCLES();
+            while (estc_crypt_refill(&crypt))
+            {
+            }
+            refill += CYCLES() - start;
+
+            start = CYCLES();
+            estc_crypt_seal(&crypt, data, sizeof(data), rec, sizeof(rec));
+            seal[mode] += CYCLES() - start;
+            sink ^= rec[ESTC_CRYPT_RECORD_HDR_LEN];
+        }
+
+        // Nothing computed ahead, every record after the pool ran dry
+        estc_crypt_init(&crypt, (estc_crypt_mode_t)mode, key, head, 1);
+        for (uint32_t i = 0; i < ESTC_CRYPT_POOL_RECORDS; i++)
+        {
+            estc_crypt_seal(&crypt, data, sizeof(data), rec, sizeof(rec));
+        }
+        start = CYCLES();
+        for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+        {
+            estc_crypt_seal(&crypt, data, sizeof(data), rec, sizeof(rec));
+        }
+        cold[mode] = CYCLES() - start;
+    }
+
+    printf("%s per byte of a %u byte record, software AES:\n", CYCLES_UNIT, (unsigned)sizeof(data));
+    printf("  %-34s %6.1f\n", "ECB", per_byte(soft, sizeof(data)));
+    printf("  %-34s %6.1f\n", "keystream refill, idle time", per_byte(refill / 2, sizeof(data)));
+    printf("  %-34s %6.1f\n", "CTR seal from the pool", per_byte(seal[ESTC_CRYPT_MODE_CTR], sizeof(data)));
+    printf("  %-34s %6.1f\n", "CTR seal, nothing computed ahead", per_byte(cold[ESTC_CRYPT_MODE_CTR], sizeof(data)));
+    printf("  %-34s %6.1f\n", "CCM seal from the pool", per_byte(seal[ESTC_CRYPT_MODE_CCM], sizeof(data)));
+    printf("  %-34s %6.1f\n", "CCM seal, nothing computed ahead", per_byte(cold[ESTC_CRYPT_MODE_CCM], sizeof(data)));
+}
+
+int main(void)
+{
+    int failed = aes_check() | ccm_check() | record_check(ESTC_CRYPT_MODE_CTR) | record_check(ESTC_CRYPT_MODE_CCM);
+
+    if (!failed)
+    {
+        bench();
+    }
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,244 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host benchmark for estc_delta: applies a patch made by delta_patch.py to the old image the way estc_dfu does, in
+// BLE sized pieces into flash block sized buffers, fails if the result differs from the new image and prints the
+// patch ratio and the apply speed. Built and run by `make delta_bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "estc_crc.h"
+#include "estc_delta.h"
+
+#define BENCH_CHUNK     244         /**< Patch bytes per write, a 247 byte ATT MTU. */
+#define BENCH_BLOCK     2048        /**< ESTC_DFU_BUF_SIZE. */
+#define BENCH_ROUNDS    50
+
+static uint8_t m_block[BENCH_BLOCK];
+
+static uint8_t * file_read(char const * p_path, uint32_t * p_len)
+{
+    FILE * p_file = fopen(p_path, "rb");
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(EXIT_FAILURE);
+    }
+
+    fseek(p_file, 0, SEEK_END);
+    long len = ftell(p_file);
+    fseek(p_file, 0, SEEK_SET);
+
+    uint8_t * p_data = malloc(len > 0 ? (size_t)len : 1);
+    if ((p_data == NULL) || (fread(p_data, 1, (size_t)len, p_file) != (size_t)len))
+    {
+        perror(p_path);
+        exit(EXIT_FAILURE);
+    }
+    fclose(p_file);
+
+    *p_len = (uint32_t)len;
+    return p_data;
+}
+
+/**@brief Apply the patch into @p p_new, @p chunk patch bytes at a time.
+ *
+ * @return The last status, ESTC_DELTA_STATUS_DONE on success.
+ */
+static estc_delta_status_t patch_apply(uint8_t const * p_old, uint32_t old_len,
+                                       uint8_t const * p_patch, uint32_t patch_len, uint32_t chunk,
+                                       uint8_t * p_new, uint32_t new_cap, uint32_t * p_new_len)
+{
+    estc_delta_t        delta;
+    estc_delta_status_t status   = ESTC_DELTA_STATUS_NEED_INPUT;
+    uint32_t            consumed = 0;
+    uint32_t            fill     = 0;
+
+    estc_delta_init(&delta, p_old, old_len);
+    *p_new_len = 0;
+
+    while (consumed < patch_len || status == ESTC_DELTA_STATUS_OUTPUT_FULL || status == ESTC_DELTA_STATUS_HEADER)
+    {
+        uint32_t in_len  = (patch_len - consumed < chunk) ? patch_len - consumed : chunk;
+        uint32_t out_len = BENCH_BLOCK - fill;
+
+        status    = estc_delta_apply(&delta, &p_patch[consumed], &in_len, &m_block[fill], &out_len);
+        consumed += in_len;
+        fill     += out_len;
+
+        if (status == ESTC_DELTA_STATUS_HEADER && delta.header.new_size > new_cap)
+        {
+            return ESTC_DELTA_STATUS_ERR_BOUNDS;
+        }
+
+        // Like a flash block write, also done when the last block is partial
+        if ((fill == BENCH_BLOCK) || (status == ESTC_DELTA_STATUS_DONE))
+        {
+            memcpy(&p_new[*p_new_len], m_block, fill);
+            *p_new_len += fill;
+            fill        = 0;
+        }
+
+        if ((status == ESTC_DELTA_STATUS_DONE) || (status >= ESTC_DELTA_STATUS_ERR_FORMAT))
+        {
+            break;
+        }
+    }
+
+    if ((status == ESTC_DELTA_STATUS_DONE) && (consumed != patch_len))
+    {
+        // Trailing bytes, estc_dfu rejects those too
+        return ESTC_DELTA_STATUS_ERR_FORMAT;
+    }
+    return status;
+}
+
+/**@brief Broken patches have to be rejected or produce a wrong image, never read outside the old image. */
+static int corruption_check(uint8_t const * p_old, uint32_t old_len, uint8_t const * p_patch, uint32_t patch_len,
+                            uint8_t * p_new, uint32_t new_cap)
+{
+    uint8_t * p_broken = malloc(patch_len);
+    uint32_t  rand     = 1;
+    uint32_t  rejected = 0;
+    uint32_t  new_len;
+
+    for (int round = 0; round < 200; round++)
+    {
+        memcpy(p_broken, p_patch, patch_len);
+
+        // xorshift32, the same sequence on every host
+        rand ^= rand << 13;
+        rand ^= rand >> 17;
+        rand ^= rand << 5;
+        p_broken[ESTC_DELTA_HEADER_LEN + rand % (patch_len - ESTC_DELTA_HEADER_LEN)] ^= (uint8_t)(1 << (rand >> 29));
+
+        if (patch_apply(p_old, old_len, p_broken, patch_len, BENCH_CHUNK, p_new, new_cap, &new_len)
+            != ESTC_DELTA_STATUS_DONE)
+        {
+            rejected++;
+        }
+    }
+
+    // Truncated patches must not complete
+    for (uint32_t cut = 0; cut < patch_len; cut += 1 + patch_len / 64)
+    {
+        if (patch_apply(p_old, old_len, p_patch, cut, BENCH_CHUNK, p_new, new_cap, &new_len)
+            == ESTC_DELTA_STATUS_DONE)
+        {
+            printf("FAIL patch truncated to %u bytes completed\n", (unsigned)cut);
+            free(p_broken);
+            return 1;
+        }
+    }
+
+    printf("corrupted patches: %u of 200 rejected by the applier, the rest by the image CRC\n", (unsigned)rejected);
+    free(p_broken);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    static const uint32_t chunks[] = { 1, 20, BENCH_CHUNK, 4096 };
+
+    uint32_t old_len;
+    uint32_t new_len;
+    uint32_t patch_len;
+    uint32_t out_len;
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "usage: %s old.bin new.bin patch\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t * p_old   = file_read(argv[1], &old_len);
+    uint8_t * p_new   = file_read(argv[2], &new_len);
+    uint8_t * p_patch = file_read(argv[3], &patch_len);
+    uint8_t * p_out   = malloc(new_len + 1);
+
+    if (patch_len < ESTC_DELTA_HEADER_LEN)
+    {
+        printf("FAIL patch too short\n");
+        return EXIT_FAILURE;
+    }
+
+    // What estc_dfu checks before it starts, and after the image is rebuilt
+    estc_delta_t delta;
+    uint32_t     in_len  = ESTC_DELTA_HEADER_LEN;
+    uint32_t     hdr_out = 0;
+
+    estc_delta_init(&delta, p_old, old_len);
+    (void)estc_delta_apply(&delta, p_patch, &in_len, m_block, &hdr_out);
+    if ((delta.header.old_crc != estc_crc32(p_old, old_len)) ||
+        (delta.header.new_crc != estc_crc32(p_new, new_len)))
+    {
+        printf("FAIL header checksums do not match the images\n");
+        return EXIT_FAILURE;
+    }
+
+    // Any split of the patch has to give the same image
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+    {
+        estc_delta_status_t status = patch_apply(p_old, old_len, p_patch, patch_len, chunks[c], p_out, new_len,
+                                                 &out_len);
+
+        if ((status != ESTC_DELTA_STATUS_DONE) || (out_len != new_len) || (memcmp(p_out, p_new, new_len) != 0))
+        {
+            printf("FAIL %u byte writes: status %d, %u of %u bytes\n", (unsigned)chunks[c], status,
+                   (unsigned)out_len, (unsigned)new_len);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (corruption_check(p_old, old_len, p_patch, patch_len, p_out, new_len) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    clock_t start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        (void)patch_apply(p_old, old_len, p_patch, patch_len, BENCH_CHUNK, p_out, new_len, &out_len);
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("patch %u bytes for a %u byte image: %.1f%% of a full transfer\n", (unsigned)patch_len,
+           (unsigned)new_len, 100.0 * patch_len / new_len);
+    printf("apply %.1f MB/s of new image on this host\n", (double)new_len * BENCH_ROUNDS / seconds / 1e6);
+
+    free(p_old);
+    free(p_new);
+    free(p_patch);
+    free(p_out);
+    return EXIT_SUCCESS;
+}
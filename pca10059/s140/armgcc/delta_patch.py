@@ -0,0 +1,226 @@
+#!/usr/bin/env python3
+# Make a delta patch between two application images for estc_dfu.
+#
+# The patch format is described in estc_delta.h. Matching is greedy: exact matches are found through an index of the
+# old image, preferring the place the old image cursor already is at, then grown over bytes that differ as long as
+# most of them still match. Code that only moved keeps its layout, so growing the match turns its changed addresses
+# into a few non-zero ADD bytes instead of new literals. The patch is applied back before it is written, so a patch
+# that comes out of this tool rebuilds the new image.
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = 0x544C4445
+VERSION = 1
+
+OP_COPY = 0
+OP_ADD = 1
+OP_INSERT = 2
+OP_SEEK = 3
+
+BLOCK = 8               # Bytes hashed into the old image index, also the shortest match taken
+CANDIDATES = 16         # Old image positions kept per index entry
+GROW_SLACK = 16         # How far growing a match may fall behind its best score before it stops
+ZERO_RUN_MIN = 4        # Zero differences that become a COPY instead of staying in an ADD
+
+
+def build_index(old):
+    index = {}
+    for pos in range(len(old) - BLOCK + 1):
+        entry = index.setdefault(old[pos:pos + BLOCK], [])
+        if len(entry) < CANDIDATES:
+            entry.append(pos)
+    return index
+
+
+def match_len(old, old_pos, new, new_pos):
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    n = 0
+    step = 64
+    while n < limit:
+        size = min(step, limit - n)
+        if old[old_pos + n:old_pos + n + size] == new[new_pos + n:new_pos + n + size]:
+            n += size
+            step = min(step * 2, 4096)
+        elif size == 1:
+            break
+        else:
+            step = size // 2
+    return n
+
+
+def best_match(old, new, new_pos, cursor, index):
+    candidates = index.get(new[new_pos:new_pos + BLOCK], [])
+    best_pos, best_len = cursor, match_len(old, cursor, new, new_pos) if cursor < len(old) else 0
+    for pos in candidates:
+        n = match_len(old, pos, new, new_pos)
+        # Staying at the cursor saves a SEEK, so others have to be strictly longer
+        if n > best_len or (n == best_len and best_pos != cursor and abs(pos - cursor) < abs(best_pos - cursor)):
+            best_pos, best_len = pos, n
+    return best_pos, best_len
+
+
+def grow(old, old_pos, new, new_pos, n):
+    """Extend an exact match over differing bytes while at least half of them match, like bsdiff does."""
+    limit = min(len(old) - old_pos, len(new) - new_pos)
+    score = best = best_len = n
+    k = n
+    while k < limit and score > best - GROW_SLACK:
+        score += 1 if old[old_pos + k] == new[new_pos + k] else -1
+        k += 1
+        if score > best:
+            best, best_len = score, k
+    return best_len
+
+
+class Encoder:
+    def __init__(self):
+        self.out = bytearray()
+        self.counts = {OP_COPY: 0, OP_ADD: 0, OP_INSERT: 0, OP_SEEK: 0}
+        self.bytes = {OP_COPY: 0, OP_ADD: 0, OP_INSERT: 0, OP_SEEK: 0}
+
+    def command(self, op, arg, data=b''):
+        head = (op << 6) | (arg & 0x1F)
+        arg >>= 5
+        if arg:
+            self.out.append(head | 0x20)
+            while True:
+                byte = arg & 0x7F
+                arg >>= 7
+                self.out.append(byte | (0x80 if arg else 0))
+                if not arg:
+                    break
+        else:
+            self.out.append(head)
+        self.out += data
+        self.counts[op] += 1
+        self.bytes[op] += len(data) if op != OP_COPY else 0
+
+    def seek(self, offset):
+        self.command(OP_SEEK, (offset << 1) if offset >= 0 else ((-offset) << 1) - 1)
+
+    def matched(self, old, old_pos, new, new_pos, n):
+        """COPY the runs that did not change, ADD the differences around them."""
+        diff = bytes((new[new_pos + k] - old[old_pos + k]) & 0xFF for k in range(n))
+        start = 0
+        k = 0
+        while k < n:
+            if diff[k]:
+                k += 1
+                continue
+            end = k
+            while end < n and not diff[end]:
+                end += 1
+            if end - k >= ZERO_RUN_MIN or end == n:
+                if k > start:
+                    self.command(OP_ADD, k - start, diff[start:k])
+                self.command(OP_COPY, end - k)
+                start = end
+            k = end
+        if start < n:
+            self.command(OP_ADD, n - start, diff[start:n])
+
+
+def diff(old, new):
+    index = build_index(old)
+    enc = Encoder()
+    literal = bytearray()
+    cursor = 0
+    pos = 0
+
+    while pos < len(new):
+        old_pos, n = best_match(old, new, pos, cursor, index)
+        if n < BLOCK:
+            literal.append(new[pos])
+            pos += 1
+            continue
+
+        if literal:
+            enc.command(OP_INSERT, len(literal), bytes(literal))
+            literal = bytearray()
+
+        n = grow(old, old_pos, new, pos, n)
+        if old_pos != cursor:
+            enc.seek(old_pos - cursor)
+        enc.matched(old, old_pos, new, pos, n)
+        pos += n
+        cursor = old_pos + n
+
+    if literal:
+        enc.command(OP_INSERT, len(literal), bytes(literal))
+
+    header = struct.pack('<IB3xIIII', MAGIC, VERSION, len(old), zlib.crc32(old), len(new), zlib.crc32(new))
+    return header + bytes(enc.out), enc
+
+
+def apply(old, patch):
+    """Reference applier, mirrors estc_delta_apply()."""
+    magic, version, old_size, old_crc, new_size, new_crc = struct.unpack_from('<IB3xIIII', patch)
+    if magic != MAGIC or version != VERSION or old_size != len(old) or old_crc != zlib.crc32(old):
+        raise ValueError('patch does not apply to this image')
+
+    out = bytearray()
+    cursor = 0
+    pos = 24
+    while len(out) < new_size:
+        head = patch[pos]
+        pos += 1
+        op, arg, shift = head >> 6, head & 0x1F, 5
+        if head & 0x20:
+            while True:
+                byte = patch[pos]
+                pos += 1
+                arg |= (byte & 0x7F) << shift
+                shift += 7
+                if not byte & 0x80:
+                    break
+        if op == OP_COPY:
+            out += old[cursor:cursor + arg]
+            cursor += arg
+        elif op == OP_ADD:
+            out += bytes((old[cursor + k] + patch[pos + k]) & 0xFF for k in range(arg))
+            cursor += arg
+            pos += arg
+        elif op == OP_INSERT:
+            out += patch[pos:pos + arg]
+            pos += arg
+        else:
+            cursor += (arg >> 1) if not arg & 1 else -(arg >> 1) - 1
+    if pos != len(patch) or zlib.crc32(out) != new_crc:
+        raise ValueError('patch is inconsistent')
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Make a delta patch between two application images (.bin).')
+    parser.add_argument('old', help='image running on the nodes')
+    parser.add_argument('new', help='image to update them to')
+    parser.add_argument('-o', '--output', required=True, help='patch file to write')
+    args = parser.parse_args()
+
+    with open(args.old, 'rb') as f:
+        old = f.read()
+    with open(args.new, 'rb') as f:
+        new = f.read()
+
+    start = time.monotonic()
+    patch, enc = diff(old, new)
+    elapsed = time.monotonic() - start
+
+    if apply(old, patch) != new:
+        sys.exit('delta_patch: the patch does not rebuild the new image')
+
+    with open(args.output, 'wb') as f:
+        f.write(patch)
+
+    print('old %d bytes, new %d bytes, patch %d bytes (%.1f%% of the new image) in %.1f s' %
+          (len(old), len(new), len(patch), 100.0 * len(patch) / len(new), elapsed))
+    for op, name in ((OP_COPY, 'copy'), (OP_ADD, 'add'), (OP_INSERT, 'insert'), (OP_SEEK, 'seek')):
+        print('  %-6s %6d commands, %7d patch bytes of data' % (name, enc.counts[op], enc.bytes[op]))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,255 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host benchmark for estc_dsp: runs the scalar and SIMD variants of every kernel on the same input, fails on the
+// first output that differs and prints the time per sample of each. Built and run by `make dsp_bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "estc_dsp.h"
+
+#define BENCH_BLOCK     1024
+#define BENCH_ROUNDS    2000
+
+static int16_t m_in[BENCH_BLOCK];
+static int16_t m_out_scalar[BENCH_BLOCK];
+static int16_t m_out_simd[BENCH_BLOCK];
+
+static uint32_t m_rand = 1;
+
+static int16_t rand_q15(void)
+{
+    // xorshift32, the same sequence on every host
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return (int16_t)m_rand;
+}
+
+static void input_fill(int pattern)
+{
+    for (int i = 0; i < BENCH_BLOCK; i++)
+    {
+        switch (pattern)
+        {
+            case 0:  m_in[i] = rand_q15();                              break;
+            case 1:  m_in[i] = (i & 1) ? INT16_MAX : INT16_MIN;         break;  // full scale square, saturates
+            default: m_in[i] = (int16_t)((i * 64) & 0x7FFF);            break;  // ramp
+        }
+    }
+}
+
+static double ns_per_sample(clock_t start, clock_t end)
+{
+    return (double)(end - start) * 1e9 / CLOCKS_PER_SEC / ((double)BENCH_BLOCK * BENCH_ROUNDS);
+}
+
+static int biquad_check(estc_dsp_biquad_coefs_t const * p_coefs, char const * p_name)
+{
+    estc_dsp_biquad_t scalar;
+    estc_dsp_biquad_t simd;
+
+    estc_dsp_biquad_init(&scalar, p_coefs);
+    estc_dsp_biquad_init(&simd, p_coefs);
+
+    // Odd block sizes, so the state is carried across calls
+    for (int offset = 0; offset < BENCH_BLOCK; offset += 97)
+    {
+        int cnt = (offset + 97 > BENCH_BLOCK) ? BENCH_BLOCK - offset : 97;
+
+        estc_dsp_biquad_q15_scalar(&scalar, &m_in[offset], &m_out_scalar[offset], cnt);
+        estc_dsp_biquad_q15_simd(&simd, &m_in[offset], &m_out_simd[offset], cnt);
+    }
+
+    if (memcmp(m_out_scalar, m_out_simd, sizeof(m_out_scalar)) != 0)
+    {
+        printf("FAIL biquad %s\n", p_name);
+        return 1;
+    }
+    return 0;
+}
+
+static int stats_check(uint32_t cnt)
+{
+    estc_dsp_stats_t scalar;
+    estc_dsp_stats_t simd;
+
+    estc_dsp_stats_q15_scalar(m_in, cnt, &scalar);
+    estc_dsp_stats_q15_simd(m_in, cnt, &simd);
+
+    if (memcmp(&scalar, &simd, sizeof(scalar)) != 0)
+    {
+        printf("FAIL stats cnt %u\n", (unsigned)cnt);
+        return 1;
+    }
+    return 0;
+}
+
+static int offset_check(int16_t offset)
+{
+    estc_dsp_offset_q15_scalar(m_in, m_out_scalar, BENCH_BLOCK - 1, offset);
+    estc_dsp_offset_q15_simd(m_in, m_out_simd, BENCH_BLOCK - 1, offset);
+
+    if (memcmp(m_out_scalar, m_out_simd, (BENCH_BLOCK - 1) * sizeof(int16_t)) != 0)
+    {
+        printf("FAIL offset %d\n", offset);
+        return 1;
+    }
+    return 0;
+}
+
+static void biquad_time(estc_dsp_biquad_coefs_t const * p_coefs)
+{
+    estc_dsp_biquad_t biquad;
+    clock_t           start;
+    double            scalar_ns;
+
+    estc_dsp_biquad_init(&biquad, p_coefs);
+    start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        estc_dsp_biquad_q15_scalar(&biquad, m_in, m_out_scalar, BENCH_BLOCK);
+    }
+    scalar_ns = ns_per_sample(start, clock());
+
+    estc_dsp_biquad_init(&biquad, p_coefs);
+    start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        estc_dsp_biquad_q15_simd(&biquad, m_in, m_out_simd, BENCH_BLOCK);
+    }
+    printf("biquad  scalar %6.2f ns/sample  simd %6.2f ns/sample\n", scalar_ns, ns_per_sample(start, clock()));
+}
+
+static void stats_time(void)
+{
+    estc_dsp_stats_t stats;
+    clock_t          start;
+    double           scalar_ns;
+
+    start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        estc_dsp_stats_q15_scalar(m_in, BENCH_BLOCK, &stats);
+    }
+    scalar_ns = ns_per_sample(start, clock());
+
+    start = clock();
+    for (int r = 0; r < BENCH_ROUNDS; r++)
+    {
+        estc_dsp_stats_q15_simd(m_in, BENCH_BLOCK, &stats);
+    }
+    printf("stats   scalar %6.2f ns/sample  simd %6.2f ns/sample\n", scalar_ns, ns_per_sample(start, clock()));
+}
+
+static int lowpass_check(uint16_t cutoff)
+{
+    estc_dsp_biquad_coefs_t coefs;
+    bool                    in_range = (cutoff >= ESTC_DSP_BIQUAD_CUTOFF_MIN_PERMILLE) && (cutoff < 500);
+
+    if (estc_dsp_biquad_lowpass(&coefs, cutoff) != in_range)
+    {
+        printf("FAIL lowpass %u: range check\n", cutoff);
+        return 1;
+    }
+    if (!in_range)
+    {
+        return 0;
+    }
+
+    // The rounded coefficients still have unity gain at DC, within 1 %
+    int32_t num = coefs.b0 + coefs.b1 + coefs.b2;
+    int32_t den = (1 << ESTC_DSP_BIQUAD_COEF_SHIFT) - coefs.a1 - coefs.a2;
+    if ((den <= 0) || (labs(num - den) * 100 > den))
+    {
+        printf("FAIL lowpass %u: DC gain %d/%d\n", cutoff, num, den);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    static const uint16_t cutoffs[] = { ESTC_DSP_BIQUAD_CUTOFF_MIN_PERMILLE, 50, 125, 250, 450 };
+
+    estc_dsp_biquad_coefs_t coefs;
+    int                     failed = 0;
+
+    for (uint16_t cutoff = 0; cutoff <= 500; cutoff++)
+    {
+        failed |= lowpass_check(cutoff);
+    }
+
+    // Unity-ish gain on the worst case input, drives the accumulator and the output into saturation
+    estc_dsp_biquad_coefs_t const extreme = { INT16_MAX, INT16_MIN, INT16_MAX, INT16_MAX, INT16_MIN };
+
+    for (int pattern = 0; pattern < 3; pattern++)
+    {
+        input_fill(pattern);
+
+        for (size_t c = 0; c < sizeof(cutoffs) / sizeof(cutoffs[0]); c++)
+        {
+            char name[32];
+
+            estc_dsp_biquad_lowpass(&coefs, cutoffs[c]);
+            snprintf(name, sizeof(name), "lowpass %u", cutoffs[c]);
+            failed |= biquad_check(&coefs, name);
+        }
+        failed |= biquad_check(&extreme, "extreme");
+
+        for (uint32_t cnt = 0; cnt < 16; cnt++)
+        {
+            failed |= stats_check(cnt);
+        }
+        failed |= stats_check(BENCH_BLOCK);
+        failed |= stats_check(BENCH_BLOCK - 1);
+
+        failed |= offset_check(0);
+        failed |= offset_check(-500);
+        failed |= offset_check(INT16_MAX);
+        failed |= offset_check(INT16_MIN);
+    }
+
+    if (failed)
+    {
+        return EXIT_FAILURE;
+    }
+    printf("scalar and SIMD variants are bit-exact\n");
+
+    input_fill(0);
+    estc_dsp_biquad_lowpass(&coefs, 100);
+    biquad_time(&coefs);
+    stats_time();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,284 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host check of the metrics snapshot codec the gateway tools use. Snapshots round trip, truncated buffers and
+// unknown versions are refused, and the header counts keep the decoder compatible both ways: gauges and
+// characteristics appended by a newer encoder are skipped, the ones an older encoder did not have come out zeroed.
+// Random buffers close the run. Built and run by `make metrics_snapshot_bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "estc_metrics_snapshot.h"
+#include "estc_le.h"
+
+#define EXTRA_GAUGES        5           /**< Appended by the simulated newer encoder. */
+#define EXTRA_CHARS         2
+#define MISSING_GAUGES      3           /**< Not known yet to the simulated older encoder. */
+#define MISSING_CHARS       1
+#define FUZZ_ROUNDS         200000
+
+#define BUF_LEN             ESTC_METRICS_SNAPSHOT_LEN(ESTC_METRICS_GAUGE_COUNT + EXTRA_GAUGES, \
+                                                      ESTC_METRICS_CHAR_COUNT + EXTRA_CHARS)
+
+static uint32_t m_rand = 1;
+
+static uint32_t rand_u32(void)
+{
+    // xorshift32, the same sequence on every host
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand;
+}
+
+static void snapshot_make(estc_metrics_snapshot_t * p_snapshot)
+{
+    memset(p_snapshot, 0, sizeof(*p_snapshot));
+    p_snapshot->connections = rand_u32();
+
+    for (uint8_t i = 0; i < ESTC_METRICS_GAUGE_COUNT; i++)
+    {
+        p_snapshot->gauges[i] = (uint16_t)rand_u32();
+    }
+    for (uint8_t i = 0; i < ESTC_METRICS_CHAR_COUNT; i++)
+    {
+        p_snapshot->chars[i].hvx_attempts  = rand_u32();
+        p_snapshot->chars[i].hvx_success   = rand_u32();
+        p_snapshot->chars[i].hvx_resources = rand_u32();
+        p_snapshot->chars[i].tx_bytes      = rand_u32();
+        p_snapshot->chars[i].rx_bytes      = rand_u32();
+    }
+}
+
+/**@brief Encoder of another firmware version: @p gauge_cnt and @p char_cnt entries, the ones beyond the snapshot
+ *        filled with a marker the decoder must not let through.
+ */
+static uint16_t snapshot_encode_as(estc_metrics_snapshot_t const * p_snapshot, uint8_t gauge_cnt, uint8_t char_cnt,
+                                   uint8_t * p_buf)
+{
+    uint8_t * p = p_buf;
+
+    *p++ = ESTC_METRICS_SNAPSHOT_VERSION;
+    *p++ = gauge_cnt;
+    *p++ = char_cnt;
+    p    = estc_le_put_u32(p, p_snapshot->connections);
+
+    for (uint8_t i = 0; i < gauge_cnt; i++)
+    {
+        p = estc_le_put_u16(p, (i < ESTC_METRICS_GAUGE_COUNT) ? p_snapshot->gauges[i] : 0xDEAD);
+    }
+    for (uint8_t i = 0; i < char_cnt; i++)
+    {
+        estc_metrics_char_stats_t const * p_char = &p_snapshot->chars[i];
+
+        if (i >= ESTC_METRICS_CHAR_COUNT)
+        {
+            memset(p, 0xA5, ESTC_METRICS_SNAPSHOT_CHAR_LEN);
+            p += ESTC_METRICS_SNAPSHOT_CHAR_LEN;
+            continue;
+        }
+        p = estc_le_put_u32(p, p_char->hvx_attempts);
+        p = estc_le_put_u32(p, p_char->hvx_success);
+        p = estc_le_put_u32(p, p_char->hvx_resources);
+        p = estc_le_put_u32(p, p_char->tx_bytes);
+        p = estc_le_put_u32(p, p_char->rx_bytes);
+    }
+
+    return (uint16_t)(p - p_buf);
+}
+
+/**@brief Compare the first @p gauge_cnt gauges and @p char_cnt characteristics, the rest has to be zero. */
+static bool snapshot_equal(estc_metrics_snapshot_t const * p_got, estc_metrics_snapshot_t const * p_sent,
+                           uint8_t gauge_cnt, uint8_t char_cnt)
+{
+    static const estc_metrics_char_stats_t zero;
+
+    if (p_got->connections != p_sent->connections)
+    {
+        return false;
+    }
+    for (uint8_t i = 0; i < ESTC_METRICS_GAUGE_COUNT; i++)
+    {
+        if (p_got->gauges[i] != ((i < gauge_cnt) ? p_sent->gauges[i] : 0))
+        {
+            return false;
+        }
+    }
+    for (uint8_t i = 0; i < ESTC_METRICS_CHAR_COUNT; i++)
+    {
+        if (memcmp(&p_got->chars[i], (i < char_cnt) ? &p_sent->chars[i] : &zero, sizeof(zero)) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int round_trip_check(void)
+{
+    uint8_t                 buf[BUF_LEN];
+    estc_metrics_snapshot_t sent;
+    estc_metrics_snapshot_t got;
+    int                     failed = 0;
+
+    snapshot_make(&sent);
+
+    uint16_t len = estc_metrics_snapshot_encode(&sent, buf, sizeof(buf));
+    if (len != ESTC_METRICS_SNAPSHOT_LEN_MAX)
+    {
+        printf("FAIL snapshot encoded into %u bytes\n", len);
+        return 1;
+    }
+    if (estc_metrics_snapshot_encode(&sent, buf, (uint16_t)(len - 1)) != 0)
+    {
+        printf("FAIL snapshot encoded into a short buffer\n");
+        failed = 1;
+    }
+    if (!estc_metrics_snapshot_decode(buf, len, &got) ||
+        !snapshot_equal(&got, &sent, ESTC_METRICS_GAUGE_COUNT, ESTC_METRICS_CHAR_COUNT))
+    {
+        printf("FAIL snapshot does not round trip\n");
+        failed = 1;
+    }
+
+    for (uint16_t cut = 0; cut < len; cut++)
+    {
+        if (estc_metrics_snapshot_decode(buf, cut, &got))
+        {
+            printf("FAIL snapshot decoded from %u of %u bytes\n", cut, len);
+            failed = 1;
+        }
+    }
+
+    buf[0]++;
+    if (estc_metrics_snapshot_decode(buf, len, &got))
+    {
+        printf("FAIL snapshot decoded with version %u\n", buf[0]);
+        failed = 1;
+    }
+
+    printf("snapshot of %u gauges and %u characteristics: %u bytes\n",
+           (unsigned)ESTC_METRICS_GAUGE_COUNT, (unsigned)ESTC_METRICS_CHAR_COUNT, len);
+    return failed;
+}
+
+static int version_check(void)
+{
+    static const struct
+    {
+        char const * p_name;
+        uint8_t      gauge_cnt;
+        uint8_t      char_cnt;
+    } encoders[] =
+    {
+        { "newer", ESTC_METRICS_GAUGE_COUNT + EXTRA_GAUGES,   ESTC_METRICS_CHAR_COUNT + EXTRA_CHARS   },
+        { "older", ESTC_METRICS_GAUGE_COUNT - MISSING_GAUGES, ESTC_METRICS_CHAR_COUNT - MISSING_CHARS },
+        { "newer gauges, older characteristics",
+                   ESTC_METRICS_GAUGE_COUNT + EXTRA_GAUGES,   ESTC_METRICS_CHAR_COUNT - MISSING_CHARS },
+    };
+    uint8_t                 buf[BUF_LEN];
+    estc_metrics_snapshot_t sent;
+    estc_metrics_snapshot_t got;
+    int                     failed = 0;
+
+    for (uint8_t e = 0; e < sizeof(encoders) / sizeof(encoders[0]); e++)
+    {
+        uint8_t  gauge_cnt = encoders[e].gauge_cnt;
+        uint8_t  char_cnt  = encoders[e].char_cnt;
+
+        snapshot_make(&sent);
+        uint16_t len = snapshot_encode_as(&sent, gauge_cnt, char_cnt, buf);
+
+        // Stale content has to be overwritten, not merged
+        memset(&got, 0xFF, sizeof(got));
+        if (!estc_metrics_snapshot_decode(buf, len, &got) || !snapshot_equal(&got, &sent, gauge_cnt, char_cnt))
+        {
+            printf("FAIL snapshot of a %s encoder (%u gauges, %u characteristics) decoded wrong\n",
+                   encoders[e].p_name, gauge_cnt, char_cnt);
+            failed = 1;
+        }
+        if (estc_metrics_snapshot_decode(buf, (uint16_t)(len - 1), &got))
+        {
+            printf("FAIL truncated snapshot of a %s encoder decoded\n", encoders[e].p_name);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+static int fuzz_check(void)
+{
+    uint8_t                 buf[BUF_LEN];
+    estc_metrics_snapshot_t got;
+    uint32_t                accepted = 0;
+    int                     failed = 0;
+
+    // Whatever decodes has to have been long enough for the counts in its header
+    for (uint32_t round = 0; round < FUZZ_ROUNDS; round++)
+    {
+        uint16_t len = (uint16_t)(rand_u32() % sizeof(buf));
+
+        for (uint16_t i = 0; i < len; i++)
+        {
+            buf[i] = (uint8_t)rand_u32();
+        }
+        // A valid version and small counts, or almost nothing would get past the header
+        if (len >= ESTC_METRICS_SNAPSHOT_HDR_LEN)
+        {
+            buf[0] = ESTC_METRICS_SNAPSHOT_VERSION;
+            buf[1] %= ESTC_METRICS_GAUGE_COUNT + EXTRA_GAUGES + 1;
+            buf[2] %= ESTC_METRICS_CHAR_COUNT + EXTRA_CHARS + 1;
+        }
+        if (!estc_metrics_snapshot_decode(buf, len, &got))
+        {
+            continue;
+        }
+        accepted++;
+        if (len < ESTC_METRICS_SNAPSHOT_LEN(buf[1], buf[2]))
+        {
+            printf("FAIL %u byte buffer decoded with %u gauges and %u characteristics\n", len, buf[1], buf[2]);
+            failed = 1;
+        }
+    }
+
+    printf("%u random buffers, %u decoded\n", (unsigned)FUZZ_ROUNDS, (unsigned)accepted);
+    return failed;
+}
+
+int main(void)
+{
+    int failed = round_trip_check() | version_check() | fuzz_check();
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+# Report the RAM budget of a build profile.
+#
+# Resolves the configuration through the C preprocessor exactly like the firmware build does, so the
+# numbers follow app_config.h and estc_config_profile.h. With --elf the static RAM of a linked image
+# is taken into account as well.
+
+import argparse
+import re
+import subprocess
+import sys
+
+CONFIG_DIR = '../config'
+
+
+def resolve_macros(cc, profile):
+    out = subprocess.run([cc, '-E', '-dM', '-x', 'c', '-I' + CONFIG_DIR, '-DUSE_APP_CONFIG',
+                          '-DESTC_CONFIG_PROFILE=%d' % profile, CONFIG_DIR + '/sdk_config.h'],
+                         check=True, capture_output=True, text=True).stdout
+    macros = {}
+    for line in out.splitlines():
+        m = re.match(r'#define (\w+) (.*)$', line)
+        if m:
+            macros[m.group(1)] = m.group(2).strip()
+    return macros
+
+
+def value(macros, name, depth=0):
+    expr = macros[name]
+    # Expand nested macro references, then evaluate the remaining C integer expression
+    expr = re.sub(r'\b([A-Za-z_]\w*)\b',
+                  lambda m: str(value(macros, m.group(1), depth + 1)) if m.group(1) in macros else m.group(1),
+                  expr)
+    expr = re.sub(r'\b(0[xX][0-9a-fA-F]+|\d+)[uUlL]+\b', r'\1', expr)
+    return int(eval(expr.replace('/', '//'), {}, {}))
+
+
+def elf_ram(size_tool, elf):
+    out = subprocess.run([size_tool, '-A', elf], check=True, capture_output=True, text=True).stdout
+    sections = {}
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1].isdigit() and int(fields[2]) >= 0x20000000:
+            sections[fields[0]] = int(fields[1])
+    return sections
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--profile', type=int, required=True)
+    parser.add_argument('--cc', default='cc', help='compiler used to resolve the configuration')
+    parser.add_argument('--heap', type=int, default=8192)
+    parser.add_argument('--stack', type=int, default=8192)
+    parser.add_argument('--elf', help='linked image to take .data/.bss from')
+    parser.add_argument('--size', default='arm-none-eabi-size')
+    args = parser.parse_args()
+
+    macros = resolve_macros(args.cc, args.profile)
+    v = lambda name: value(macros, name)
+
+    ram_base  = v('ESTC_CONFIG_RAM_BASE')
+    ram_start = v('ESTC_CONFIG_APP_RAM_START')
+    ram_end   = v('ESTC_CONFIG_RAM_END')
+    app_total = ram_end - ram_start
+
+    print('Profile %s (%d)' % (macros['ESTC_CONFIG_PROFILE_NAME'].strip('"'), args.profile))
+    print('  links %d, MTU %d, data length %d, event length %.2f ms, connection interval %.2f-%.2f ms'
+          % (v('NRF_SDH_BLE_TOTAL_LINK_COUNT'), v('NRF_SDH_BLE_GATT_MAX_MTU_SIZE'),
+             v('NRF_SDH_BLE_GAP_DATA_LENGTH'), v('NRF_SDH_BLE_GAP_EVENT_LENGTH') * 1.25,
+             v('ESTC_CONFIG_MIN_CONN_INTERVAL') * 1.25, v('ESTC_CONFIG_MAX_CONN_INTERVAL') * 1.25))
+    print()
+    print('  %-28s 0x%08x-0x%08x %7d' % ('SoftDevice', ram_base, ram_start, ram_start - ram_base))
+    print('  %-28s 0x%08x-0x%08x %7d' % ('Application', ram_start, ram_end, app_total))
+
+    if args.elf:
+        rows = sorted(elf_ram(args.size, args.elf).items())
+        rows = [(name, size) for name, size in rows if size]
+    else:
+        bridge = (v('ESTC_USB_BRIDGE_TX_SLOTS') * (v('ESTC_USB_BRIDGE_TX_SLOT_SIZE') + 2)
+                  + v('ESTC_USB_BRIDGE_RX_SLOTS') * (v('ESTC_USB_BRIDGE_RX_SLOT_SIZE') + 2))
+        rows = [('NRF_LOG buffer', v('NRF_LOG_BUFSIZE')),
+                ('USB bridge rings', bridge),
+                ('transport ring', v('ESTC_TRANSPORT_BUF_SIZE')),
+                ('keystream pool', v('ESTC_CRYPT_POOL_RECORDS') * (v('ESTC_CRYPT_PRECOMPUTE_LEN') + 16)),
+                ('heap', args.heap),
+                ('stack', args.stack)]
+
+    used = 0
+    for name, size in rows:
+        print('    %-26s %29d' % (name, size))
+        used += size
+    print('    %-26s %29d' % ('free' if args.elf else 'left for other .data/.bss', app_total - used))
+
+    return 0 if used <= app_total else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
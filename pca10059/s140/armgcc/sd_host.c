@@ -0,0 +1,154 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#include "sd_host.h"
+
+#include <string.h>
+
+static bool     m_configured;
+static bool     m_running;
+static uint8_t  m_handle = BLE_GAP_ADV_SET_HANDLE_NOT_SET;
+static uint8_t  * m_p_data;     /**< Buffer of the application the set transmits from. */
+static uint16_t m_len;
+static uint8_t  m_snapshot[BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED];
+static uint32_t m_interval;
+static uint32_t m_torn;
+
+uint32_t sd_ble_gap_adv_set_configure(uint8_t                    * p_adv_handle,
+                                      ble_gap_adv_data_t const   * p_adv_data,
+                                      ble_gap_adv_params_t const * p_adv_params)
+{
+    if (p_adv_handle == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (*p_adv_handle == BLE_GAP_ADV_SET_HANDLE_NOT_SET)
+    {
+        if (m_configured || (p_adv_params == NULL))
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        *p_adv_handle = 0;
+    }
+    else if (*p_adv_handle != m_handle)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (m_running && (p_adv_params != NULL))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (p_adv_data != NULL)
+    {
+        if (p_adv_data->adv_data.len > BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED)
+        {
+            return NRF_ERROR_INVALID_LENGTH;
+        }
+        if (m_running && (p_adv_data->adv_data.p_data == m_p_data))
+        {
+            return NRF_ERROR_INVALID_STATE;
+        }
+        m_p_data = p_adv_data->adv_data.p_data;
+        m_len    = p_adv_data->adv_data.len;
+        memcpy(m_snapshot, m_p_data, m_len);
+    }
+
+    if (p_adv_params != NULL)
+    {
+        m_interval = p_adv_params->interval;
+    }
+
+    m_handle     = *p_adv_handle;
+    m_configured = true;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_start(uint8_t adv_handle, uint8_t conn_cfg_tag)
+{
+    (void)conn_cfg_tag;
+    if (!m_configured || (adv_handle != m_handle))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (m_running)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_running = true;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_stop(uint8_t adv_handle)
+{
+    if (!m_running || (adv_handle != m_handle))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_running = false;
+    return NRF_SUCCESS;
+}
+
+void sd_host_reset(void)
+{
+    m_configured = false;
+    m_running    = false;
+    m_handle     = BLE_GAP_ADV_SET_HANDLE_NOT_SET;
+    m_p_data     = NULL;
+    m_len        = 0;
+    m_interval   = 0;
+    m_torn       = 0;
+}
+
+uint16_t sd_host_adv_event(uint8_t * p_buf)
+{
+    if (!m_running)
+    {
+        return 0;
+    }
+    // The radio reads the application buffer while the event is on air
+    if (memcmp(m_p_data, m_snapshot, m_len) != 0)
+    {
+        m_torn++;
+    }
+    memcpy(p_buf, m_p_data, m_len);
+    return m_len;
+}
+
+uint32_t sd_host_adv_interval(void)
+{
+    return m_interval;
+}
+
+uint32_t sd_host_torn_events(void)
+{
+    return m_torn;
+}
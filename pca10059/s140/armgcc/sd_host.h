@@ -0,0 +1,94 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host stand-in for the part of the S140 advertising API the broadcast path uses. It follows the documented rules
+// of sd_ble_gap_adv_set_configure() for a running set: parameters cannot change, and new data has to come in a
+// buffer other than the one on air. The data of the running set is checked against what was configured on every
+// advertising event, so a write into the live buffer shows up as a failure instead of a torn payload.
+
+#ifndef SD_HOST_H__
+#define SD_HOST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NRF_SUCCESS                                     0
+#define NRF_ERROR_INVALID_STATE                         8
+#define NRF_ERROR_INVALID_LENGTH                        9
+#define NRF_ERROR_INVALID_PARAM                         7
+#define NRF_ERROR_BUSY                                  17
+
+#define BLE_GAP_ADV_SET_HANDLE_NOT_SET                  0xFF
+#define BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED 255
+
+typedef struct
+{
+    uint8_t  * p_data;
+    uint16_t   len;
+} ble_data_t;
+
+typedef struct
+{
+    ble_data_t adv_data;
+    ble_data_t scan_rsp_data;
+} ble_gap_adv_data_t;
+
+/**@brief Only the interval matters here, the stand-in has no PHYs or channels. */
+typedef struct
+{
+    uint32_t interval;
+} ble_gap_adv_params_t;
+
+uint32_t sd_ble_gap_adv_set_configure(uint8_t                    * p_adv_handle,
+                                      ble_gap_adv_data_t const   * p_adv_data,
+                                      ble_gap_adv_params_t const * p_adv_params);
+
+uint32_t sd_ble_gap_adv_start(uint8_t adv_handle, uint8_t conn_cfg_tag);
+
+uint32_t sd_ble_gap_adv_stop(uint8_t adv_handle);
+
+/**@brief Forget the set, as after a SoftDevice reset. */
+void sd_host_reset(void);
+
+/**@brief Run one advertising event of the running set.
+ *
+ * @param[out] p_buf  What a scanner receives, at least BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED bytes.
+ *
+ * @return Length of the payload, 0 if the set is not running.
+ */
+uint16_t sd_host_adv_event(uint8_t * p_buf);
+
+/**@brief Advertising interval of the running set in 0.625 ms units. */
+uint32_t sd_host_adv_interval(void);
+
+/**@brief Number of advertising events whose buffer did not hold the configured data. */
+uint32_t sd_host_torn_events(void);
+
+#endif /* SD_HOST_H__ */
@@ -0,0 +1,418 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host check of the telemetry broadcast: frames are published the way estc_adv does it, into the spare of two
+// buffers wrapped in a manufacturer specific AD structure, through a stand-in of the SoftDevice advertising API
+// (sd_host.c). A scanner that hears a random share of the advertising events parses the AD structures, decodes
+// the frames and drops repeats by sequence number. Every frame that was on air during a heard event has to come
+// out once and intact. The decoder is then fed truncated, padded and random buffers. Built and run by
+// `make telemetry_bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "estc_telemetry_frame.h"
+#include "sd_host.h"
+
+#define COMPANY_ID          0xFFFF
+#define MANUF_HDR_LEN       4
+#define AD_TYPE_MANUF       0xFF
+#define ADV_INTERVAL_MS     100
+#define FRAMES_PER_LAYOUT   2000
+#define SEQ_FIRST           65000       /**< Close to the wrap, the scanner has to cope with it. */
+#define HEARD_PER_MILLE     600         /**< Advertising events the scanner catches. */
+#define FUZZ_ROUNDS         200000
+#define BENCH_ROUNDS        200000
+
+static uint32_t m_rand = 1;
+static volatile uint32_t m_sink;    /**< Keeps the timed decodes. */
+
+// The broadcaster side, as in estc_adv.c
+static uint8_t            m_adv_handle = BLE_GAP_ADV_SET_HANDLE_NOT_SET;
+static uint8_t            m_adv_buf[2][BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED];
+static uint8_t            m_adv_buf_idx;
+static ble_gap_adv_data_t m_adv_data;
+
+// Frames by sequence number, and how often the scanner should and did get each
+static estc_telemetry_frame_t m_sent[65536];
+static uint8_t                m_on_air[65536];
+static uint8_t                m_got[65536];
+
+static uint32_t rand_u32(void)
+{
+    // xorshift32, the same sequence on every host
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand;
+}
+
+static void frame_make(estc_telemetry_frame_t * p_frame, uint8_t layout, uint16_t seq)
+{
+    memset(p_frame, 0, sizeof(*p_frame));
+    p_frame->layout     = layout;
+    p_frame->seq        = seq;
+    p_frame->sample_cnt = (uint8_t)(1 + rand_u32() % ESTC_TELEMETRY_FRAME_SAMPLES_MAX);
+
+    // Only the fields the layout carries survive the round trip
+    if (layout & ESTC_TELEMETRY_LAYOUT_SAMPLES)
+    {
+        for (uint8_t i = 0; i < p_frame->sample_cnt; i++)
+        {
+            p_frame->samples[i] = (int16_t)rand_u32();
+        }
+    }
+    if (layout & ESTC_TELEMETRY_LAYOUT_SUMMARY)
+    {
+        p_frame->min  = (int16_t)rand_u32();
+        p_frame->max  = (int16_t)rand_u32();
+        p_frame->mean = (int16_t)rand_u32();
+    }
+    if (layout & ESTC_TELEMETRY_LAYOUT_RMS)
+    {
+        p_frame->rms = (uint16_t)rand_u32();
+    }
+    if (layout & ESTC_TELEMETRY_LAYOUT_TIMESTAMP)
+    {
+        p_frame->timestamp_ms = rand_u32();
+    }
+}
+
+static uint32_t broadcast_set(uint8_t const * p_payload, uint16_t len, bool with_params)
+{
+    uint8_t              next_idx = m_adv_buf_idx ^ 1;
+    uint8_t            * p_buf    = m_adv_buf[next_idx];
+    ble_gap_adv_params_t params   = { .interval = ADV_INTERVAL_MS * 8 / 5 };
+    uint32_t             err_code;
+
+    p_buf[0] = (uint8_t)(len + MANUF_HDR_LEN - 1);
+    p_buf[1] = AD_TYPE_MANUF;
+    p_buf[2] = (uint8_t)(COMPANY_ID & 0xFF);
+    p_buf[3] = (uint8_t)(COMPANY_ID >> 8);
+    memcpy(&p_buf[MANUF_HDR_LEN], p_payload, len);
+
+    m_adv_data.adv_data.p_data = p_buf;
+    m_adv_data.adv_data.len    = (uint16_t)(len + MANUF_HDR_LEN);
+
+    err_code = sd_ble_gap_adv_set_configure(&m_adv_handle, &m_adv_data, with_params ? &params : NULL);
+    if (err_code == NRF_SUCCESS)
+    {
+        m_adv_buf_idx = next_idx;
+    }
+    return err_code;
+}
+
+/**@brief Scanner side: find our manufacturer data among the AD structures and decode the frame in it. */
+static bool scan_decode(uint8_t const * p_adv, uint16_t len, estc_telemetry_frame_t * p_frame)
+{
+    uint16_t pos = 0;
+
+    while (pos < len)
+    {
+        uint8_t ad_len = p_adv[pos];
+
+        if ((ad_len == 0) || (pos + 1 + ad_len > len))
+        {
+            return false;
+        }
+        if ((ad_len >= MANUF_HDR_LEN - 1) && (p_adv[pos + 1] == AD_TYPE_MANUF) &&
+            ((p_adv[pos + 2] | (p_adv[pos + 3] << 8)) == COMPANY_ID))
+        {
+            return estc_telemetry_frame_decode(&p_adv[pos + MANUF_HDR_LEN], (uint16_t)(ad_len + 1 - MANUF_HDR_LEN),
+                                               p_frame);
+        }
+        pos += 1 + ad_len;
+    }
+    return false;
+}
+
+static bool frame_equal(estc_telemetry_frame_t const * p_a, estc_telemetry_frame_t const * p_b)
+{
+    if ((p_a->layout != p_b->layout) || (p_a->seq != p_b->seq) || (p_a->sample_cnt != p_b->sample_cnt))
+    {
+        return false;
+    }
+    if ((p_a->layout & ESTC_TELEMETRY_LAYOUT_SAMPLES) &&
+        (memcmp(p_a->samples, p_b->samples, p_a->sample_cnt * sizeof(int16_t)) != 0))
+    {
+        return false;
+    }
+    if ((p_a->layout & ESTC_TELEMETRY_LAYOUT_SUMMARY) &&
+        ((p_a->min != p_b->min) || (p_a->max != p_b->max) || (p_a->mean != p_b->mean)))
+    {
+        return false;
+    }
+    if ((p_a->layout & ESTC_TELEMETRY_LAYOUT_RMS) && (p_a->rms != p_b->rms))
+    {
+        return false;
+    }
+    if ((p_a->layout & ESTC_TELEMETRY_LAYOUT_TIMESTAMP) && (p_a->timestamp_ms != p_b->timestamp_ms))
+    {
+        return false;
+    }
+    return true;
+}
+
+static int broadcast_check(void)
+{
+    uint8_t                payload[ESTC_TELEMETRY_FRAME_LEN_MAX];
+    uint8_t                air[BLE_GAP_ADV_SET_DATA_SIZE_EXTENDED_MAX_SUPPORTED];
+    estc_telemetry_frame_t frame;
+    uint16_t               seq = SEQ_FIRST;
+    uint32_t               events = 0;
+    uint32_t               heard = 0;
+    uint32_t               repeats = 0;
+    uint32_t               decoded = 0;
+    bool                   have_last = false;
+    uint16_t               last_seq = 0;
+    int                    failed = 0;
+
+    sd_host_reset();
+    memset(m_on_air, 0, sizeof(m_on_air));
+    memset(m_got, 0, sizeof(m_got));
+
+    // An empty set first, the application starts advertising before the first frame is ready
+    if ((broadcast_set(payload, 0, true) != NRF_SUCCESS) || (sd_ble_gap_adv_start(m_adv_handle, 0) != NRF_SUCCESS))
+    {
+        printf("FAIL broadcast set did not start\n");
+        return 1;
+    }
+
+    for (uint8_t layout = 1; layout < 16; layout++)
+    {
+        for (uint32_t n = 0; n < FRAMES_PER_LAYOUT; n++, seq++)
+        {
+            frame_make(&m_sent[seq], layout, seq);
+
+            uint16_t len = estc_telemetry_frame_encode(&m_sent[seq], payload, sizeof(payload));
+            if ((len == 0) || (broadcast_set(payload, len, false) != NRF_SUCCESS))
+            {
+                printf("FAIL frame %u of layout 0x%x not published\n", seq, layout);
+                return 1;
+            }
+
+            // A few advertising events per frame, a frame can also be replaced before it is heard at all
+            uint32_t frame_events = rand_u32() % 8;
+            for (uint32_t e = 0; e < frame_events; e++)
+            {
+                uint16_t air_len = sd_host_adv_event(air);
+
+                events++;
+                if ((rand_u32() % 1000) >= HEARD_PER_MILLE)
+                {
+                    continue;
+                }
+                heard++;
+                m_on_air[seq] = 1;
+
+                if (!scan_decode(air, air_len, &frame))
+                {
+                    printf("FAIL frame %u of layout 0x%x does not decode\n", seq, layout);
+                    return 1;
+                }
+                if (have_last && (frame.seq == last_seq))
+                {
+                    repeats++;
+                    continue;
+                }
+                have_last = true;
+                last_seq  = frame.seq;
+                decoded++;
+
+                if (!frame_equal(&frame, &m_sent[frame.seq]))
+                {
+                    printf("FAIL frame %u of layout 0x%x decoded with other content\n", frame.seq, layout);
+                    failed = 1;
+                }
+                if (m_got[frame.seq]++ != 0)
+                {
+                    printf("FAIL frame %u delivered twice\n", frame.seq);
+                    failed = 1;
+                }
+            }
+        }
+    }
+
+    for (uint32_t s = 0; s < 65536; s++)
+    {
+        if (m_on_air[s] != (m_got[s] != 0))
+        {
+            printf("FAIL frame %u heard %u times, delivered %u times\n", (unsigned)s, m_on_air[s], m_got[s]);
+            failed = 1;
+        }
+    }
+
+    // The SoftDevice transmits from the application buffer, reusing it while on air has to be refused
+    m_adv_buf_idx ^= 1;
+    if (broadcast_set(payload, 8, false) != NRF_ERROR_INVALID_STATE)
+    {
+        printf("FAIL stand-in accepted the buffer on air\n");
+        failed = 1;
+    }
+    if (sd_host_torn_events() != 0)
+    {
+        printf("FAIL %u advertising events sent a buffer that was being rewritten\n",
+               (unsigned)sd_host_torn_events());
+        failed = 1;
+    }
+
+    printf("%u frames, %u advertising events, %u heard: %u frames decoded, %u repeats dropped\n",
+           (unsigned)(15 * FRAMES_PER_LAYOUT), (unsigned)events, (unsigned)heard, (unsigned)decoded,
+           (unsigned)repeats);
+    return failed;
+}
+
+static int decode_check(void)
+{
+    uint8_t                buf[ESTC_TELEMETRY_FRAME_LEN_MAX + 1];
+    estc_telemetry_frame_t sent;
+    estc_telemetry_frame_t frame;
+    uint32_t               accepted = 0;
+    int                    failed = 0;
+
+    for (uint8_t layout = 0; layout < 16; layout++)
+    {
+        frame_make(&sent, layout, (uint16_t)rand_u32());
+
+        uint16_t len = estc_telemetry_frame_encode(&sent, buf, sizeof(buf));
+        if (len != ESTC_TELEMETRY_FRAME_LEN(layout, sent.sample_cnt))
+        {
+            printf("FAIL layout 0x%x encoded into %u bytes\n", layout, len);
+            failed = 1;
+            continue;
+        }
+        if (estc_telemetry_frame_encode(&sent, buf, (uint16_t)(len - 1)) != 0)
+        {
+            printf("FAIL layout 0x%x encoded into a short buffer\n", layout);
+            failed = 1;
+        }
+        for (uint16_t cut = 0; cut < len; cut++)
+        {
+            if (estc_telemetry_frame_decode(buf, cut, &frame))
+            {
+                printf("FAIL layout 0x%x decoded from %u of %u bytes\n", layout, cut, len);
+                failed = 1;
+            }
+        }
+        buf[len] = 0;
+        if (estc_telemetry_frame_decode(buf, (uint16_t)(len + 1), &frame))
+        {
+            printf("FAIL layout 0x%x decoded with a trailing byte\n", layout);
+            failed = 1;
+        }
+
+        buf[0]++;
+        if (estc_telemetry_frame_decode(buf, len, &frame))
+        {
+            printf("FAIL layout 0x%x decoded with version %u\n", layout, buf[0]);
+            failed = 1;
+        }
+        buf[0]--;
+
+        if (!estc_telemetry_frame_decode(buf, len, &frame) || !frame_equal(&frame, &sent))
+        {
+            printf("FAIL layout 0x%x does not round trip\n", layout);
+            failed = 1;
+        }
+    }
+
+    sent.sample_cnt = ESTC_TELEMETRY_FRAME_SAMPLES_MAX + 1;
+    if (estc_telemetry_frame_encode(&sent, buf, sizeof(buf)) != 0)
+    {
+        printf("FAIL frame of %u samples encoded\n", sent.sample_cnt);
+        failed = 1;
+    }
+
+    // Whatever decodes has to be the one encoding of what came out
+    for (uint32_t round = 0; round < FUZZ_ROUNDS; round++)
+    {
+        uint8_t  copy[sizeof(buf)];
+        uint16_t len = (uint16_t)(rand_u32() % sizeof(buf));
+
+        for (uint16_t i = 0; i < len; i++)
+        {
+            buf[i] = (uint8_t)rand_u32();
+        }
+        // Mostly well-formed headers, or almost nothing would get past the version
+        if ((len > 0) && (round & 1))
+        {
+            buf[0] = ESTC_TELEMETRY_FRAME_VERSION;
+        }
+        if (!estc_telemetry_frame_decode(buf, len, &frame))
+        {
+            continue;
+        }
+        accepted++;
+        if ((estc_telemetry_frame_encode(&frame, copy, sizeof(copy)) != len) || (memcmp(copy, buf, len) != 0))
+        {
+            printf("FAIL random buffer of %u bytes decoded into another frame\n", len);
+            failed = 1;
+        }
+    }
+
+    printf("%u random buffers, %u decoded\n", (unsigned)FUZZ_ROUNDS, (unsigned)accepted);
+    return failed;
+}
+
+static void bench(void)
+{
+    uint8_t                buf[ESTC_TELEMETRY_FRAME_LEN_MAX];
+    estc_telemetry_frame_t frame;
+    frame_make(&frame, 0x0F, 0);
+    frame.sample_cnt = ESTC_TELEMETRY_FRAME_SAMPLES_MAX;
+
+    uint16_t len   = estc_telemetry_frame_encode(&frame, buf, sizeof(buf));
+    clock_t  start = clock();
+
+    for (uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        buf[2] = (uint8_t)i;
+        estc_telemetry_frame_decode(buf, len, &frame);
+        m_sink += frame.seq;
+    }
+
+    double ns = (double)(clock() - start) * 1e9 / CLOCKS_PER_SEC / BENCH_ROUNDS;
+    printf("decode of a %u byte frame: %.1f ns\n", len, ns);
+}
+
+int main(void)
+{
+    int failed = broadcast_check() | decode_check();
+
+    if (!failed)
+    {
+        bench();
+    }
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
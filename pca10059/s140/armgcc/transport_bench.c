@@ -0,0 +1,394 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host simulation of estc_transport: the sender against the reference receiver over a link that queues a few
+// notifications like the SoftDevice does, drops segments on the receiver side, disconnects with segments and
+// acknowledgements in flight and comes back with another MTU, to a gateway that may have restarted or to another one.
+// Every message has to arrive in order and intact, a gateway that keeps its state gets each one once. The gateway keeps
+// the segments behind a drop, and none it acknowledged selectively may be sent again. Prints what the framing and the
+// retransmissions cost. Built and run by `make transport_bench`.
+
+#include <stdbool.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "estc_transport.h"
+
+#define RING_SIZE       8192
+#define MSG_LEN_MAX     4000
+#define LINK_QUEUE      8           /**< Notifications the SoftDevice buffers. */
+#define LINK_PER_TICK   4           /**< Delivered per connection event. */
+#define ACK_EVERY       8           /**< Segments the receiver takes before it acknowledges. */
+#define NACK_TIMEOUT    16          /**< Ticks without progress before the receiver asks again. */
+#define GATEWAYS_MAX    2
+
+typedef struct
+{
+    char const * p_name;
+    uint32_t     messages;
+    unsigned     drop_per_mille;    /**< Segments the receiver loses. */
+    unsigned     disconnect_per_mille;  /**< Chance of a disconnection per tick. */
+    uint16_t     mtu_first;         /**< MTU of the first connection, 0 for a random one each time. */
+    unsigned     restart_per_mille; /**< Chance that the gateway lost its state before a reconnection. */
+    unsigned     gateways;          /**< Each reconnection goes to one of them at random. */
+} scenario_t;
+
+typedef struct
+{
+    estc_transport_rx_t     rx;
+    uint8_t                 buf[MSG_LEN_MAX + ESTC_TRANSPORT_MSG_CRC_LEN];
+    estc_transport_rx_seg_t held[ESTC_TRANSPORT_WINDOW];
+    uint16_t            session;
+    bool                has_state;
+    uint32_t            next_msg;   /**< Index of the next message it completes. */
+} gateway_t;
+
+static const scenario_t m_scenarios[] =
+{
+    { "clean, MTU 247",              2000,  0, 0, 247,   0, 1 },
+    { "clean, MTU 23",                300,  0, 0, 23,    0, 1 },
+    { "2% drops",                    2000, 20, 0, 247,   0, 1 },
+    { "disconnects, random MTU",     2000,  0, 5, 0,     0, 1 },
+    { "drops and disconnects",       2000, 20, 5, 0,     0, 1 },
+    { "gateway restarts",            2000, 20, 5, 0,   300, 1 },
+    { "two gateways",                2000, 20, 5, 0,     0, 2 },
+};
+
+static const uint16_t m_mtus[] = { 23, 65, 158, 185, 247 };
+
+typedef struct
+{
+    uint8_t  data[ESTC_TRANSPORT_SEG_HDR_LEN + ESTC_TRANSPORT_SEG_PAYLOAD_MAX];
+    uint16_t len;
+} packet_t;
+
+static packet_t  m_link[LINK_QUEUE];
+static unsigned  m_link_head;
+static unsigned  m_link_len;
+static bool      m_connected;
+static uint16_t  m_mtu;
+static uint32_t  m_air_bytes;
+static uint32_t  m_rand = 1;
+
+static estc_transport_t    m_transport;
+static gateway_t           m_gateways[GATEWAYS_MAX];
+static gateway_t         * m_gw;
+static uint32_t            m_confirmed;     /**< Messages the sender has seen acknowledged completely. */
+static uint16_t            m_sack_next;     /**< Last acknowledgement of this connection, what it says the gateway has. */
+static uint32_t            m_sack;
+static uint8_t             m_ring[RING_SIZE];
+static uint8_t             m_msg[MSG_LEN_MAX];
+
+static uint32_t rand_u32(void)
+{
+    // xorshift32, the same sequence on every host
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand;
+}
+
+static bool chance(unsigned per_mille)
+{
+    return (rand_u32() % 1000) < per_mille;
+}
+
+// Message n is rebuilt from n alone, so the receiver side can check it without keeping a copy
+static uint16_t msg_make(uint32_t n, uint8_t * p_buf)
+{
+    uint32_t state = n * 2654435761u + 1;
+    uint16_t len = (uint16_t)(state % (MSG_LEN_MAX + 1));
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        p_buf[i] = (uint8_t)state;
+    }
+    return len;
+}
+
+static bool link_send(void * p_ctx, uint8_t const * p_seg, uint16_t len)
+{
+    (void)p_ctx;
+    if (!m_connected || m_link_len == LINK_QUEUE)
+    {
+        return false;
+    }
+    if (len > m_mtu - 3)
+    {
+        printf("FAIL segment of %u bytes over MTU %u\n", len, m_mtu);
+        exit(1);
+    }
+
+    uint16_t after = (uint16_t)((p_seg[0] | (p_seg[1] << 8)) - m_sack_next - 1);
+    if ((after < 32) && (m_sack & (1UL << after)))
+    {
+        printf("FAIL segment %u sent again after it was acknowledged selectively\n", p_seg[0] | (p_seg[1] << 8));
+        exit(1);
+    }
+
+    packet_t * p_packet = &m_link[(m_link_head + m_link_len++) % LINK_QUEUE];
+    memcpy(p_packet->data, p_seg, len);
+    p_packet->len = len;
+    m_air_bytes += len;
+    return true;
+}
+
+static void ack_write(uint8_t op)
+{
+    uint8_t ack[ESTC_TRANSPORT_ACK_LEN];
+    uint16_t len = estc_transport_rx_ack_encode(&m_gw->rx, op, ack);
+
+    // The sender may send again right away, what it is told holds from now on
+    m_sack_next = m_gw->rx.expected;
+    m_sack      = ack[3] | (ack[4] << 8) | (ack[5] << 16) | ((uint32_t)ack[6] << 24);
+
+    if (!estc_transport_on_ack(&m_transport, ack, len))
+    {
+        printf("FAIL acknowledgement of %u refused\n", m_gw->rx.expected);
+        exit(1);
+    }
+    // Every message it completed lies before its expected seq
+    m_confirmed = m_gw->next_msg;
+}
+
+static void gateway_connect(gateway_t * p_gw, bool restarted)
+{
+    m_gw = p_gw;
+    if (restarted)
+    {
+        p_gw->has_state = false;
+    }
+
+    // Reads the session before it subscribes
+    if (!p_gw->has_state || (p_gw->session != estc_transport_session(&m_transport)))
+    {
+        estc_transport_rx_reset(&p_gw->rx);
+        p_gw->next_msg = m_confirmed;
+        ack_write(ESTC_TRANSPORT_OP_START);
+        p_gw->session   = estc_transport_session(&m_transport);
+        p_gw->has_state = true;
+    }
+    else
+    {
+        ack_write(ESTC_TRANSPORT_OP_ACK);
+    }
+}
+
+static int scenario_run(scenario_t const * p_scenario)
+{
+    uint32_t queued = 0;
+    uint32_t received = 0;
+    uint32_t again = 0;
+    uint32_t payload = 0;
+    uint32_t ticks = 0;
+    uint32_t disconnects = 0;
+    uint32_t nacks = 0;
+    uint32_t idle = 0;
+    unsigned unacked = 0;
+    bool     nacked = false;
+
+    memset(m_ring, 0, sizeof(m_ring));
+    m_link_head = 0;
+    m_link_len = 0;
+    m_air_bytes = 0;
+    m_connected = true;
+    m_mtu = p_scenario->mtu_first ? p_scenario->mtu_first : m_mtus[rand_u32() % 5];
+
+    m_confirmed = 0;
+
+    estc_transport_init(&m_transport, link_send, NULL, m_ring, sizeof(m_ring), (uint16_t)rand_u32());
+    for (unsigned i = 0; i < GATEWAYS_MAX; i++)
+    {
+        estc_transport_rx_init(&m_gateways[i].rx, m_gateways[i].buf, sizeof(m_gateways[i].buf), m_gateways[i].held);
+        m_gateways[i].has_state = false;
+    }
+    estc_transport_mtu_set(&m_transport, m_mtu);
+    gateway_connect(&m_gateways[0], false);
+
+    while (received < p_scenario->messages)
+    {
+        if (++ticks > 10000000)
+        {
+            printf("FAIL %s: stalled at message %u\n", p_scenario->p_name, (unsigned)received);
+            return 1;
+        }
+
+        // The application queues what the ring takes
+        while (queued < p_scenario->messages)
+        {
+            uint16_t len = msg_make(queued, m_msg);
+            if (!estc_transport_send(&m_transport, m_msg, len))
+            {
+                break;
+            }
+            queued++;
+        }
+
+        if (!m_connected)
+        {
+            if (chance(100))
+            {
+                m_connected = true;
+                m_mtu = m_mtus[rand_u32() % 5];
+                estc_transport_mtu_set(&m_transport, m_mtu);
+                unacked = 0;
+                nacked = false;
+                gateway_connect(&m_gateways[rand_u32() % p_scenario->gateways], chance(p_scenario->restart_per_mille));
+            }
+            continue;
+        }
+
+        if (chance(p_scenario->disconnect_per_mille))
+        {
+            // Whatever the SoftDevice still held is lost, and so is the acknowledgement that was due
+            m_connected = false;
+            m_link_len = 0;
+            disconnects++;
+            estc_transport_on_disconnect(&m_transport);
+            estc_transport_rx_on_disconnect(&m_gw->rx);
+            continue;
+        }
+
+        bool progress = false;
+        for (unsigned n = 0; n < LINK_PER_TICK && m_link_len > 0; n++)
+        {
+            packet_t * p_packet = &m_link[m_link_head];
+            m_link_head = (m_link_head + 1) % LINK_QUEUE;
+            m_link_len--;
+
+            if (chance(p_scenario->drop_per_mille))
+            {
+                continue;
+            }
+
+            uint8_t const * p_msg;
+            uint16_t msg_len;
+            estc_transport_rx_status_t status = estc_transport_rx_segment(&m_gw->rx, p_packet->data, p_packet->len,
+                                                                          &p_msg, &msg_len);
+
+            // A segment that fills the gap brings the ones kept behind it along
+            for (; status != ESTC_TRANSPORT_RX_NONE; status = estc_transport_rx_next(&m_gw->rx, &p_msg, &msg_len))
+            {
+                switch (status)
+                {
+                    case ESTC_TRANSPORT_RX_MESSAGE:
+                        if ((msg_make(m_gw->next_msg, m_msg) != msg_len) || memcmp(m_msg, p_msg, msg_len))
+                        {
+                            printf("FAIL %s: message %u corrupted\n", p_scenario->p_name, (unsigned)m_gw->next_msg);
+                            return 1;
+                        }
+                        // Received before by a gateway that started over or by the other one, not acknowledged then
+                        if (++m_gw->next_msg <= received)
+                        {
+                            again++;
+                        }
+                        else
+                        {
+                            received = m_gw->next_msg;
+                            payload += msg_len;
+                        }
+                        /* fall through */
+                    case ESTC_TRANSPORT_RX_ACCEPTED:
+                        progress = true;
+                        nacked = false;
+                        unacked++;
+                        break;
+
+                    case ESTC_TRANSPORT_RX_GAP:
+                        if (!nacked)
+                        {
+                            ack_write(ESTC_TRANSPORT_OP_NACK);
+                            nacked = true;
+                            nacks++;
+                            unacked = 0;
+                        }
+                        break;
+
+                    case ESTC_TRANSPORT_RX_DUPLICATE:
+                        break;
+
+                    default:
+                        printf("FAIL %s: segment %u refused\n", p_scenario->p_name, m_gw->rx.expected - 1);
+                        return 1;
+                }
+            }
+        }
+
+        if (unacked >= ACK_EVERY)
+        {
+            ack_write(ESTC_TRANSPORT_OP_ACK);
+            unacked = 0;
+        }
+
+        // Lost the last segment sent, nothing behind it shows the gap
+        idle = progress ? 0 : idle + 1;
+        if (idle >= NACK_TIMEOUT)
+        {
+            ack_write(ESTC_TRANSPORT_OP_NACK);
+            nacks++;
+            idle = 0;
+        }
+
+        // BLE_GATTS_EVT_HVN_TX_COMPLETE
+        estc_transport_pump(&m_transport);
+    }
+
+    printf("%-26s %5u msgs %8u bytes %7u segments %6u resent %6u skipped %5u nacks %4u disconnects %4u again  "
+           "%5.1f%% efficient\n",
+           p_scenario->p_name, (unsigned)received, (unsigned)payload, (unsigned)m_transport.stats.segments,
+           (unsigned)m_transport.stats.resent, (unsigned)m_transport.stats.skipped, (unsigned)nacks,
+           (unsigned)disconnects, (unsigned)again, 100.0 * payload / m_air_bytes);
+
+    // Drops leave segments behind the gap, the gateway has to keep some that are not sent again
+    if ((p_scenario->drop_per_mille > 0) && (m_transport.stats.skipped == 0))
+    {
+        printf("FAIL %s: no segment acknowledged selectively\n", p_scenario->p_name);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(m_scenarios) / sizeof(m_scenarios[0]); i++)
+    {
+        failed |= scenario_run(&m_scenarios[i]);
+    }
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
@@ -0,0 +1,470 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+// Host simulation of estc_usb_bridge against a fake USBD port. Producers run like the SoftDevice and app_timer
+// handlers: between main loop steps and in the middle of them, from inside the port calls. The host side takes
+// IN transfers at its own pace, closes and reopens the port, and writes a stream of 16-bit values cut into
+// transfers of any size. Every record has to arrive intact and in order or be counted as dropped, the endpoint
+// buffer must not change while a transfer is in flight, and the device has to see whole values only.
+// Built and run by `make usb_bridge_bench`.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "estc_usb_bridge.h"
+
+#define TICKS               200000
+#define EP_SIZE             64          /**< Full speed bulk endpoint. */
+#define RECORD_LEN          sizeof(uint16_t)
+#define NRF_ERROR_INTERNAL  3
+
+typedef struct
+{
+    char const * p_name;
+    unsigned     tx_done_per_mille;     /**< Chance per tick that the host completes the IN transfer. */
+    unsigned     close_per_mille;       /**< Chance per tick that the host closes the port. */
+    unsigned     refuse_per_mille;      /**< IN transfers the class driver refuses. */
+} scenario_t;
+
+static const scenario_t m_scenarios[] =
+{
+    { "host keeps up",        900, 0,  0  },
+    { "host slow",            150, 0,  0  },
+    { "port closes",          500, 2,  0  },
+    { "transfers refused",    500, 0,  20 },
+    { "all of it",            300, 2,  20 },
+};
+
+static scenario_t const * mp_scenario;
+static uint32_t m_rand = 1;
+
+// IN endpoint
+static uint8_t const * mp_in_flight;
+static uint16_t        m_in_len;
+static uint8_t         m_in_copy[ESTC_USB_BRIDGE_TX_SLOT_SIZE];
+static bool            m_open;
+
+// OUT endpoint, and the stream the host writes
+static uint8_t       * mp_out_buf;
+static uint16_t        m_out_size;
+static uint8_t         m_out_stream[EP_SIZE * 4];
+static uint16_t        m_out_pos;
+static uint16_t        m_out_len;
+static uint16_t        m_host_value;    /**< Next value the host writes. */
+static uint16_t        m_dev_value;     /**< Next value the device expects. */
+static bool            m_dev_synced;
+static uint32_t        m_values;
+
+// Producer and host side of the records
+static uint32_t        m_attempts;
+static uint32_t        m_committed;     /**< Sequence number of the next committed record. */
+static uint32_t        m_delivered;
+static uint32_t        m_next_expected;
+static int             m_failed;
+
+static uint32_t rand_u32(void)
+{
+    // xorshift32, the same sequence on every host
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand;
+}
+
+static bool chance(unsigned per_mille)
+{
+    return (rand_u32() % 1000) < per_mille;
+}
+
+// Record n is rebuilt from n alone
+static uint16_t record_make(uint32_t n, uint8_t * p_buf)
+{
+    uint32_t state = n * 2654435761u + 1;
+    uint16_t len = (uint16_t)(1 + state % ESTC_USB_BRIDGE_PAYLOAD_MAX);
+
+    for (uint16_t i = 0; i < len; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        p_buf[i] = (uint8_t)state;
+    }
+    if (len >= sizeof(uint32_t))
+    {
+        memcpy(p_buf, &n, sizeof(n));
+    }
+    return len;
+}
+
+/**@brief A producer interrupt: mostly nothing to send, sometimes a burst written in place. */
+static void producer_irq(void)
+{
+    unsigned count = chance(100) ? 1 + rand_u32() % 4 : 0;
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        m_attempts++;
+
+        uint8_t * p_payload = estc_usb_bridge_tx_alloc(ESTC_USB_BRIDGE_CH_TELEMETRY);
+        if (p_payload == NULL)
+        {
+            continue;
+        }
+        if (estc_usb_bridge_tx_commit(record_make(m_committed, p_payload)) == NRF_SUCCESS)
+        {
+            m_committed++;
+        }
+    }
+}
+
+static ret_code_t port_write(uint8_t const * p_data, uint16_t len)
+{
+    if (!m_open || (mp_in_flight != NULL))
+    {
+        printf("FAIL %s: IN transfer started on a %s endpoint\n", mp_scenario->p_name, m_open ? "busy" : "closed");
+        exit(1);
+    }
+
+    // The interrupt can come in before the bridge has marked the endpoint busy
+    producer_irq();
+    if (chance(mp_scenario->refuse_per_mille))
+    {
+        return NRF_ERROR_INTERNAL;
+    }
+
+    mp_in_flight = p_data;
+    m_in_len     = len;
+    memcpy(m_in_copy, p_data, len);
+    return NRF_SUCCESS;
+}
+
+static ret_code_t port_read(uint8_t * p_buf, uint16_t len, uint16_t * p_rx_len)
+{
+    producer_irq();
+
+    // The class driver may already hold a transfer, then there is no completion event
+    if ((m_out_pos < m_out_len) && chance(300))
+    {
+        uint16_t n = (uint16_t)(1 + rand_u32() % EP_SIZE);
+
+        n = (n > m_out_len - m_out_pos) ? (uint16_t)(m_out_len - m_out_pos) : n;
+        n = (n > len) ? len : n;
+        memcpy(p_buf, &m_out_stream[m_out_pos], n);
+        m_out_pos += n;
+        *p_rx_len  = n;
+        return NRF_SUCCESS;
+    }
+
+    mp_out_buf = p_buf;
+    m_out_size = len;
+    return NRF_ERROR_IO_PENDING;
+}
+
+static const estc_usb_bridge_port_t m_port =
+{
+    .write = port_write,
+    .read  = port_read,
+};
+
+static void rx_handler(uint8_t const * p_data, uint16_t len)
+{
+    uint16_t value;
+
+    if (len != RECORD_LEN)
+    {
+        printf("FAIL %s: host record of %u bytes\n", mp_scenario->p_name, len);
+        m_failed = 1;
+        return;
+    }
+
+    // Values the host wrote before a close may be lost, never cut apart
+    memcpy(&value, p_data, sizeof(value));
+    if (m_dev_synced && (value != m_dev_value) && (mp_scenario->close_per_mille == 0))
+    {
+        printf("FAIL %s: host value %u, expected %u\n", mp_scenario->p_name, value, m_dev_value);
+        m_failed = 1;
+    }
+    if ((value & 1) != 0)
+    {
+        printf("FAIL %s: host value %u is out of alignment\n", mp_scenario->p_name, value);
+        m_failed = 1;
+    }
+    m_dev_value  = (uint16_t)(value + 2);
+    m_dev_synced = true;
+    m_values++;
+
+    if (chance(10))
+    {
+        producer_irq();
+    }
+}
+
+static void host_in_done(void)
+{
+    uint16_t len = (uint16_t)(mp_in_flight[1] | (mp_in_flight[2] << 8));
+    uint8_t  expect[ESTC_USB_BRIDGE_PAYLOAD_MAX];
+    uint32_t n;
+
+    if (memcmp(mp_in_flight, m_in_copy, m_in_len) != 0)
+    {
+        printf("FAIL %s: record changed while the IN transfer was in flight\n", mp_scenario->p_name);
+        m_failed = 1;
+    }
+    if ((len + ESTC_USB_BRIDGE_REC_HDR_LEN != m_in_len) || (mp_in_flight[0] != ESTC_USB_BRIDGE_CH_TELEMETRY))
+    {
+        printf("FAIL %s: record header %02x %u in a transfer of %u\n", mp_scenario->p_name, mp_in_flight[0], len,
+               m_in_len);
+        exit(1);
+    }
+
+    // Records are dropped whole, so the host finds the one that came
+    for (n = m_next_expected; n < m_committed; n++)
+    {
+        if ((record_make(n, expect) == len) &&
+            (memcmp(expect, &mp_in_flight[ESTC_USB_BRIDGE_REC_HDR_LEN], len) == 0))
+        {
+            break;
+        }
+    }
+    if (n == m_committed)
+    {
+        printf("FAIL %s: record after %u corrupted or out of order\n", mp_scenario->p_name, m_next_expected);
+        m_failed = 1;
+    }
+    else if ((n != m_next_expected) && (mp_scenario->close_per_mille == 0) && (mp_scenario->refuse_per_mille == 0))
+    {
+        printf("FAIL %s: records %u to %u lost\n", mp_scenario->p_name, m_next_expected, n - 1);
+        m_failed = 1;
+    }
+    m_next_expected = n + 1;
+    m_delivered++;
+
+    mp_in_flight = NULL;
+    estc_usb_bridge_on_tx_done();
+}
+
+static void host_out(void)
+{
+    // Refill the stream with whole values, USB cuts it up however it likes
+    if (m_out_pos == m_out_len)
+    {
+        m_out_pos = 0;
+        m_out_len = 0;
+        while (m_out_len + RECORD_LEN <= sizeof(m_out_stream))
+        {
+            memcpy(&m_out_stream[m_out_len], &m_host_value, RECORD_LEN);
+            m_host_value = (uint16_t)(m_host_value + 2);
+            m_out_len   += RECORD_LEN;
+        }
+    }
+
+    if (mp_out_buf != NULL)
+    {
+        uint16_t n = (uint16_t)(1 + rand_u32() % EP_SIZE);
+
+        n = (n > m_out_len - m_out_pos) ? (uint16_t)(m_out_len - m_out_pos) : n;
+        n = (n > m_out_size) ? m_out_size : n;
+        memcpy(mp_out_buf, &m_out_stream[m_out_pos], n);
+        m_out_pos += n;
+        mp_out_buf = NULL;
+        estc_usb_bridge_on_rx_done(n);
+    }
+}
+
+static void host_close(void)
+{
+    bool late_in  = (mp_in_flight != NULL) && chance(500);
+    bool late_out = (mp_out_buf != NULL) && chance(500);
+
+    if (late_out)
+    {
+        // Half a value, it must not reach the device
+        mp_out_buf[0] = 0x55;
+    }
+
+    m_open       = false;
+    mp_in_flight = NULL;
+    mp_out_buf   = NULL;
+
+    // The host starts over on a value boundary after it reopens
+    m_out_len = m_out_pos = 0;
+    estc_usb_bridge_on_port_close();
+
+    // Completions still in the event queue are processed after the close
+    if (late_in)
+    {
+        estc_usb_bridge_on_tx_done();
+    }
+    if (late_out)
+    {
+        estc_usb_bridge_on_rx_done(1);
+    }
+}
+
+static int ownership_check(void)
+{
+    estc_usb_bridge_init_t init = { .p_port = &m_port, .rx_handler = rx_handler, .rx_record_len = RECORD_LEN };
+    int                    failed = 0;
+
+    estc_usb_bridge_init(&init);
+    m_open = true;
+    estc_usb_bridge_on_port_open();
+
+    if (estc_usb_bridge_tx_commit(4) != NRF_ERROR_INVALID_STATE)
+    {
+        printf("FAIL commit without a slot accepted\n");
+        failed = 1;
+    }
+    if ((estc_usb_bridge_tx_alloc(ESTC_USB_BRIDGE_CH_WRITE) == NULL) ||
+        (estc_usb_bridge_tx_alloc(ESTC_USB_BRIDGE_CH_WRITE) != NULL))
+    {
+        printf("FAIL second slot reserved before the first was committed\n");
+        failed = 1;
+    }
+    if ((estc_usb_bridge_tx_commit(0) != NRF_SUCCESS) || (estc_usb_bridge_tx_depth() != 0))
+    {
+        printf("FAIL slot committed empty was queued\n");
+        failed = 1;
+    }
+    if ((estc_usb_bridge_tx_alloc(ESTC_USB_BRIDGE_CH_WRITE) == NULL) ||
+        (estc_usb_bridge_tx_commit(ESTC_USB_BRIDGE_PAYLOAD_MAX + 1) != NRF_ERROR_INVALID_LENGTH) ||
+        (estc_usb_bridge_tx_alloc(ESTC_USB_BRIDGE_CH_WRITE) == NULL))
+    {
+        printf("FAIL oversized commit kept the slot reserved\n");
+        failed = 1;
+    }
+    host_close();
+    if (estc_usb_bridge_tx_commit(4) != NRF_ERROR_INVALID_STATE)
+    {
+        printf("FAIL slot committed to a closed port\n");
+        failed = 1;
+    }
+
+    return failed;
+}
+
+static int scenario_run(scenario_t const * p_scenario)
+{
+    estc_usb_bridge_init_t  init = { .p_port = &m_port, .rx_handler = rx_handler, .rx_record_len = RECORD_LEN };
+    estc_usb_bridge_stats_t stats;
+    uint32_t                closes = 0;
+
+    mp_scenario     = p_scenario;
+    mp_in_flight    = NULL;
+    mp_out_buf      = NULL;
+    m_out_pos       = m_out_len = 0;
+    m_host_value    = 0;
+    m_dev_synced    = false;
+    m_values        = 0;
+    m_attempts      = 0;
+    m_committed     = 0;
+    m_delivered     = 0;
+    m_next_expected = 0;
+    m_failed        = 0;
+
+    estc_usb_bridge_init(&init);
+    m_open = true;
+    estc_usb_bridge_on_port_open();
+
+    for (uint32_t tick = 0; tick < TICKS + 1000; tick++)
+    {
+        bool draining = (tick >= TICKS);
+
+        if (!draining)
+        {
+            producer_irq();
+        }
+
+        // app_usbd events, processed in the main loop
+        if (!m_open)
+        {
+            if (chance(50))
+            {
+                m_open = true;
+                estc_usb_bridge_on_port_open();
+            }
+        }
+        else if (!draining && chance(p_scenario->close_per_mille))
+        {
+            host_close();
+            closes++;
+        }
+        else
+        {
+            if ((mp_in_flight != NULL) && (draining || chance(p_scenario->tx_done_per_mille)))
+            {
+                host_in_done();
+            }
+            if (!draining && chance(100))
+            {
+                host_out();
+            }
+        }
+
+        // The main loop has other work too, events pile up in between
+        if (draining || chance(500))
+        {
+            estc_usb_bridge_process();
+        }
+    }
+
+    estc_usb_bridge_stats_get(&stats);
+    if (m_attempts != m_delivered + stats.tx_dropped + estc_usb_bridge_tx_depth())
+    {
+        printf("FAIL %s: %u records produced, %u delivered, %u dropped, %u queued\n", p_scenario->p_name,
+               (unsigned)m_attempts, (unsigned)m_delivered, (unsigned)stats.tx_dropped,
+               (unsigned)estc_usb_bridge_tx_depth());
+        m_failed = 1;
+    }
+    if (m_values == 0)
+    {
+        printf("FAIL %s: no host data arrived\n", p_scenario->p_name);
+        m_failed = 1;
+    }
+
+    printf("%-20s %7u records %7u delivered %7u dropped %4u closes %7u host values\n", p_scenario->p_name,
+           (unsigned)m_attempts, (unsigned)m_delivered, (unsigned)stats.tx_dropped, (unsigned)closes,
+           (unsigned)m_values);
+    return m_failed;
+}
+
+int main(void)
+{
+    int failed = ownership_check();
+
+    for (size_t i = 0; i < sizeof(m_scenarios) / sizeof(m_scenarios[0]); i++)
+    {
+        failed |= scenario_run(&m_scenarios[i]);
+    }
+
+    printf(failed ? "FAILED\n" : "OK\n");
+    return failed;
+}
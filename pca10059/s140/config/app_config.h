@@ -75,6 +75,21 @@
 // </e>
 
 
+// <q> NRF_LOG_FILTERS_ENABLED  - Runtime log level, set over the ESTC control point
+#ifndef NRF_LOG_FILTERS_ENABLED
+#define NRF_LOG_FILTERS_ENABLED 1
+#endif
+
+// <q> CRC32_ENABLED  - crc32 - Needed by the bootloader settings library of estc_dfu
+#ifndef CRC32_ENABLED
+#define CRC32_ENABLED 1
+#endif
+
+// <q> NRF_LOG_USES_TIMESTAMP  - Log timestamps from estc_time
+#ifndef NRF_LOG_USES_TIMESTAMP
+#define NRF_LOG_USES_TIMESTAMP 1
+#endif
+
 // <e> LOG_BACKEND_USB_ENABLED - log_backend_usb - Log USB backend
 //==========================================================
 #ifndef LOG_BACKEND_USB_ENABLED
@@ -127,4 +142,379 @@
 
 // </e>
 
+// <h> ESTC application configuration
+//==========================================================
+// <o> ESTC_CONFIG_PROFILE  - Link count, MTU and buffer sizing profile
+// <i> Normally selected with PROFILE= on the make command line.
+ 
+// <0=> Low power 
+// <1=> Balanced 
+// <2=> Max throughput 
+
+#ifndef ESTC_CONFIG_PROFILE
+#define ESTC_CONFIG_PROFILE 1
+#endif
+
+// <o> ESTC_ADV_DEFAULT_PROFILE  - Advertising profile selected at startup
+ 
+// <0=> Legacy 
+// <1=> Long range (Coded PHY, connectable) 
+// <2=> Broadcast, high rate (1M/2M) 
+// <3=> Broadcast, long range (Coded PHY) 
+
+#ifndef ESTC_ADV_DEFAULT_PROFILE
+#define ESTC_ADV_DEFAULT_PROFILE 0
+#endif
+
+// <o> ESTC_ADV_COMPANY_ID - Company identifier of the broadcast manufacturer data
+// <i> 0xFFFF is reserved by the Bluetooth SIG for testing.
+#ifndef ESTC_ADV_COMPANY_ID
+#define ESTC_ADV_COMPANY_ID 0xFFFF
+#endif
+
+// <o> ESTC_ADV_BROADCAST_INTERVAL_MS - Advertising interval of the high rate broadcast profile 
+#ifndef ESTC_ADV_BROADCAST_INTERVAL_MS
+#define ESTC_ADV_BROADCAST_INTERVAL_MS 100
+#endif
+
+// <o> ESTC_ADV_BLE_OBSERVER_PRIO - Priority of the advertising profile BLE observer
+#ifndef ESTC_ADV_BLE_OBSERVER_PRIO
+#define ESTC_ADV_BLE_OBSERVER_PRIO 2
+#endif
+
+// <o> ESTC_TELEMETRY_SAMPLE_PERIOD_MS - Period of the telemetry producer 
+#ifndef ESTC_TELEMETRY_SAMPLE_PERIOD_MS
+#define ESTC_TELEMETRY_SAMPLE_PERIOD_MS 1000
+#endif
+
+// <o> ESTC_TELEMETRY_SAMPLES_PER_FRAME - Samples batched into one telemetry frame  <1-64> 
+#ifndef ESTC_TELEMETRY_SAMPLES_PER_FRAME
+#define ESTC_TELEMETRY_SAMPLES_PER_FRAME 6
+#endif
+
+// <o> ESTC_TELEMETRY_LAYOUT  - Telemetry frame payload layout
+ 
+// <1=> Samples 
+// <2=> Summary (min, max, mean) 
+// <3=> Samples and summary 
+// <4=> RMS 
+// <5=> Samples and RMS 
+// <6=> Summary and RMS 
+// <7=> Samples, summary and RMS 
+
+#ifndef ESTC_TELEMETRY_LAYOUT
+#define ESTC_TELEMETRY_LAYOUT 1
+#endif
+
+// <q> ESTC_TELEMETRY_TIMESTAMP  - Add the uptime of the first sample to each frame
+// <i> Four more bytes per frame, the default batch then no longer fits a 23-byte ATT MTU.
+#ifndef ESTC_TELEMETRY_TIMESTAMP
+#define ESTC_TELEMETRY_TIMESTAMP 0
+#endif
+
+// <o> ESTC_TELEMETRY_SENSOR_MIN - Lower bound of the simulated sensor 
+#ifndef ESTC_TELEMETRY_SENSOR_MIN
+#define ESTC_TELEMETRY_SENSOR_MIN 0
+#endif
+
+// <o> ESTC_TELEMETRY_SENSOR_MAX - Upper bound of the simulated sensor 
+#ifndef ESTC_TELEMETRY_SENSOR_MAX
+#define ESTC_TELEMETRY_SENSOR_MAX 1000
+#endif
+
+// <o> ESTC_TELEMETRY_SENSOR_INCR - Step of the simulated sensor 
+#ifndef ESTC_TELEMETRY_SENSOR_INCR
+#define ESTC_TELEMETRY_SENSOR_INCR 25
+#endif
+
+// <o> ESTC_TELEMETRY_SENSOR_OFFSET - Added to every raw sample before filtering 
+#ifndef ESTC_TELEMETRY_SENSOR_OFFSET
+#define ESTC_TELEMETRY_SENSOR_OFFSET 0
+#endif
+
+// <o> ESTC_TELEMETRY_FILTER  - Filter applied to the raw samples
+ 
+// <0=> None 
+// <1=> Low-pass biquad 
+// <2=> Moving average 
+
+#ifndef ESTC_TELEMETRY_FILTER
+#define ESTC_TELEMETRY_FILTER 1
+#endif
+
+// <o> ESTC_TELEMETRY_FILTER_CUTOFF_PERMILLE - Low-pass cutoff in permille of the sample rate  <20-499> 
+#ifndef ESTC_TELEMETRY_FILTER_CUTOFF_PERMILLE
+#define ESTC_TELEMETRY_FILTER_CUTOFF_PERMILLE 100
+#endif
+
+// <o> ESTC_TELEMETRY_FILTER_MA_LOG2_WINDOW - Moving average over 2^n samples  <0-5> 
+#ifndef ESTC_TELEMETRY_FILTER_MA_LOG2_WINDOW
+#define ESTC_TELEMETRY_FILTER_MA_LOG2_WINDOW 2
+#endif
+
+// <o> ESTC_TELEMETRY_DECIMATION - Filtered samples per sample sent  <1-16> 
+// <i> Samples per frame times decimation must not exceed 256
+#ifndef ESTC_TELEMETRY_DECIMATION
+#define ESTC_TELEMETRY_DECIMATION 1
+#endif
+
+// <q> ESTC_RADIO_SYNC_ALIGN  - Take telemetry samples right before connection events
+#ifndef ESTC_RADIO_SYNC_ALIGN
+#define ESTC_RADIO_SYNC_ALIGN 1
+#endif
+
+// <o> ESTC_RADIO_SYNC_DISTANCE  - Radio notification distance before the event
+// <1=> 800 us
+// <2=> 1740 us
+// <3=> 2680 us
+// <4=> 3620 us
+// <5=> 4560 us
+// <6=> 5500 us
+#ifndef ESTC_RADIO_SYNC_DISTANCE
+#define ESTC_RADIO_SYNC_DISTANCE 1
+#endif
+
+// <o> ESTC_RADIO_SYNC_BLE_OBSERVER_PRIO - Priority of the radio sync BLE observer
+#ifndef ESTC_RADIO_SYNC_BLE_OBSERVER_PRIO
+#define ESTC_RADIO_SYNC_BLE_OBSERVER_PRIO 2
+#endif
+
+// <o> ESTC_USB_BRIDGE_COMM_INTERFACE - Bridge CDC ACM COMM Interface number
+#ifndef ESTC_USB_BRIDGE_COMM_INTERFACE
+#define ESTC_USB_BRIDGE_COMM_INTERFACE 2
+#endif
+
+// <o> ESTC_USB_BRIDGE_DATA_INTERFACE - Bridge CDC ACM Data Interface number
+#ifndef ESTC_USB_BRIDGE_DATA_INTERFACE
+#define ESTC_USB_BRIDGE_DATA_INTERFACE 3
+#endif
+
+// <o> ESTC_USB_BRIDGE_COMM_EPIN - Bridge CDC ACM COMM IN endpoint number
+#ifndef ESTC_USB_BRIDGE_COMM_EPIN
+#define ESTC_USB_BRIDGE_COMM_EPIN 3
+#endif
+
+// <o> ESTC_USB_BRIDGE_DATA_EPIN - Bridge CDC ACM DATA IN endpoint number
+#ifndef ESTC_USB_BRIDGE_DATA_EPIN
+#define ESTC_USB_BRIDGE_DATA_EPIN 4
+#endif
+
+// <o> ESTC_USB_BRIDGE_DATA_EPOUT - Bridge CDC ACM DATA OUT endpoint number
+#ifndef ESTC_USB_BRIDGE_DATA_EPOUT
+#define ESTC_USB_BRIDGE_DATA_EPOUT 2
+#endif
+
+// <o> ESTC_USB_BRIDGE_TX_SLOTS - Records queued towards the host  <2=> 2 <4=> 4 <8=> 8 <16=> 16 
+#ifndef ESTC_USB_BRIDGE_TX_SLOTS
+#define ESTC_USB_BRIDGE_TX_SLOTS 8
+#endif
+
+// <o> ESTC_USB_BRIDGE_TX_SLOT_SIZE - Size of one record towards the host, header included 
+#ifndef ESTC_USB_BRIDGE_TX_SLOT_SIZE
+#define ESTC_USB_BRIDGE_TX_SLOT_SIZE 160
+#endif
+
+// <o> ESTC_USB_BRIDGE_RX_SLOTS - OUT transfers buffered from the host  <2=> 2 <4=> 4 <8=> 8 
+#ifndef ESTC_USB_BRIDGE_RX_SLOTS
+#define ESTC_USB_BRIDGE_RX_SLOTS 4
+#endif
+
+// <o> ESTC_USB_BRIDGE_RX_SLOT_SIZE - Size of one OUT transfer buffer, at least the endpoint size 
+#ifndef ESTC_USB_BRIDGE_RX_SLOT_SIZE
+#define ESTC_USB_BRIDGE_RX_SLOT_SIZE 64
+#endif
+
+// <o> ESTC_METRICS_BLE_OBSERVER_PRIO - Priority of the metrics BLE observer
+#ifndef ESTC_METRICS_BLE_OBSERVER_PRIO
+#define ESTC_METRICS_BLE_OBSERVER_PRIO 2
+#endif
+
+// <o> ESTC_SERVICE_BLE_OBSERVER_PRIO - Priority of the ESTC service BLE observer
+#ifndef ESTC_SERVICE_BLE_OBSERVER_PRIO
+#define ESTC_SERVICE_BLE_OBSERVER_PRIO 2
+#endif
+
+// <o> ESTC_SERVICE_READ_CACHE_MS - How long a value computed for a read is served to later reads 
+#ifndef ESTC_SERVICE_READ_CACHE_MS
+#define ESTC_SERVICE_READ_CACHE_MS 1000
+#endif
+
+// <o> ESTC_TRANSPORT_BUF_SIZE - Message ring of the reliable transport, see estc_transport.h
+// <i> Messages stay in it until the peer acknowledges them, across reconnections.
+// <2048=> 2048 
+// <4096=> 4096 
+// <8192=> 8192 
+// <16384=> 16384 
+#ifndef ESTC_TRANSPORT_BUF_SIZE
+#define ESTC_TRANSPORT_BUF_SIZE 8192
+#endif
+
+// <o> ESTC_TRANSPORT_MSG_LEN_MAX - Longest message the transport takes <1-65535>
+#ifndef ESTC_TRANSPORT_MSG_LEN_MAX
+#define ESTC_TRANSPORT_MSG_LEN_MAX 4096
+#endif
+
+// <e> ESTC_CRYPT_ENABLED - Seal telemetry records for the backend and queue them on the reliable transport
+// <i> The AES-128 key is provisioned into UICR CUSTOMER[0..3], see estc_crypt.h. Without one nothing is sealed.
+//==========================================================
+#ifndef ESTC_CRYPT_ENABLED
+#define ESTC_CRYPT_ENABLED 1
+#endif
+// <o> ESTC_CRYPT_MODE - Record encryption
+// <0=> CTR, confidentiality only 
+// <1=> CCM, authenticated 
+#ifndef ESTC_CRYPT_MODE
+#define ESTC_CRYPT_MODE 1
+#endif
+
+// <o> ESTC_CRYPT_POOL_RECORDS - Records whose keystream is computed ahead in idle time <1-16>
+#ifndef ESTC_CRYPT_POOL_RECORDS
+#define ESTC_CRYPT_POOL_RECORDS 4
+#endif
+
+// <o> ESTC_CRYPT_PRECOMPUTE_LEN - Bytes of each record covered by the keystream computed ahead <16-1024:16>
+// <i> The largest telemetry frame is 145 bytes.
+#ifndef ESTC_CRYPT_PRECOMPUTE_LEN
+#define ESTC_CRYPT_PRECOMPUTE_LEN 160
+#endif
+
+// <o> ESTC_CRYPT_BATCH_BLOCKS - AES blocks per sd_ecb_blocks_encrypt() call <1-16>
+#ifndef ESTC_CRYPT_BATCH_BLOCKS
+#define ESTC_CRYPT_BATCH_BLOCKS 8
+#endif
+
+// </e>
+
+// <e> ESTC_CHANGE_ENABLED - Notify ESTC characteristics on change instead of on every update
+// <i> Runtime tuning through the change detection configuration characteristic, see estc_change.h
+//==========================================================
+#ifndef ESTC_CHANGE_ENABLED
+#define ESTC_CHANGE_ENABLED 1
+#endif
+// <o> ESTC_CHANGE_HELLO_HEARTBEAT_S - Hello notification period in seconds 
+#ifndef ESTC_CHANGE_HELLO_HEARTBEAT_S
+#define ESTC_CHANGE_HELLO_HEARTBEAT_S 60
+#endif
+
+// <o> ESTC_CHANGE_TELEMETRY_DEADBAND - Change of the frame mean that is notified 
+#ifndef ESTC_CHANGE_TELEMETRY_DEADBAND
+#define ESTC_CHANGE_TELEMETRY_DEADBAND 50
+#endif
+
+// <o> ESTC_CHANGE_TELEMETRY_HEARTBEAT_S - Longest silence of the telemetry characteristic in seconds 
+#ifndef ESTC_CHANGE_TELEMETRY_HEARTBEAT_S
+#define ESTC_CHANGE_TELEMETRY_HEARTBEAT_S 30
+#endif
+
+// <o> ESTC_CHANGE_METRICS_DEADBAND - Change of the CPU load in permille that is notified 
+#ifndef ESTC_CHANGE_METRICS_DEADBAND
+#define ESTC_CHANGE_METRICS_DEADBAND 20
+#endif
+
+// <o> ESTC_CHANGE_METRICS_HEARTBEAT_S - Longest silence of the metrics characteristic in seconds 
+#ifndef ESTC_CHANGE_METRICS_HEARTBEAT_S
+#define ESTC_CHANGE_METRICS_HEARTBEAT_S 60
+#endif
+
+// </e>
+
+// <o> ESTC_CRC_SLICES - Bytes estc_crc folds in per step, trading flash for speed
+// <i> Each 32-bit CRC in use takes 1 KB of tables per slice, CRC-16 512 bytes.
+// <1=> 1 
+// <4=> 4 
+// <8=> 8 
+#ifndef ESTC_CRC_SLICES
+#define ESTC_CRC_SLICES 4
+#endif
+
+// <e> ESTC_DFU_ENABLED - Over-the-air update staged by the application, see estc_dfu.h
+// <i> The bootloader has to be built with NRF_BL_DFU_ALLOW_UPDATE_FROM_APP.
+//==========================================================
+#ifndef ESTC_DFU_ENABLED
+#define ESTC_DFU_ENABLED 1
+#endif
+// <o> ESTC_DFU_BANK_START - Start of the bank the image is staged in, page aligned <0x27000-0xFF000:0x1000>
+// <i> Also the end of the application region in the linker script. The bank has to be at least as large as that region.
+#ifndef ESTC_DFU_BANK_START
+#define ESTC_DFU_BANK_START 0x82000
+#endif
+
+// <o> ESTC_DFU_BANK_END - End of the bank, below the FDS pages <0x27000-0xFF000:0x1000>
+#ifndef ESTC_DFU_BANK_END
+#define ESTC_DFU_BANK_END 0xDD000
+#endif
+
+// <o> ESTC_DFU_BUF_SIZE - Size of each of the two flash write buffers 
+// <1024=> 1024 
+// <2048=> 2048 
+// <4096=> 4096 
+#ifndef ESTC_DFU_BUF_SIZE
+#define ESTC_DFU_BUF_SIZE 2048
+#endif
+
+// <o> ESTC_DFU_DELTA_WINDOW - Patch bytes a client may have in flight during a delta update
+// <i> Buffered until the patch applier gets to them.
+#ifndef ESTC_DFU_DELTA_WINDOW
+#define ESTC_DFU_DELTA_WINDOW 1024
+#endif
+
+// <o> ESTC_DFU_BLE_OBSERVER_PRIO - Priority of the DFU service BLE observer
+#ifndef ESTC_DFU_BLE_OBSERVER_PRIO
+#define ESTC_DFU_BLE_OBSERVER_PRIO 2
+#endif
+
+// <q> NRF_DFU_IN_APP  - The bootloader settings library runs in the application
+#ifndef NRF_DFU_IN_APP
+#define NRF_DFU_IN_APP 1
+#endif
+
+// </e>
+
+// <q> ESTC_PERF_ENABLED  - Count cycles of the hot path probes with the DWT
+#ifndef ESTC_PERF_ENABLED
+#define ESTC_PERF_ENABLED 1
+#endif
+
+// <q> ESTC_RAMFUNC_ENABLED  - Run the ESTC_RAMFUNC functions from RAM instead of flash
+#ifndef ESTC_RAMFUNC_ENABLED
+#define ESTC_RAMFUNC_ENABLED 1
+#endif
+
+// <o> ESTC_TIMER_WHEEL_TICK_RTC - Timer wheel tick in app_timer ticks 
+// <i> 128 is 7.8125 ms with APP_TIMER_CONFIG_RTC_FREQUENCY 1, so periods in whole seconds are exact.
+#ifndef ESTC_TIMER_WHEEL_TICK_RTC
+#define ESTC_TIMER_WHEEL_TICK_RTC 128
+#endif
+
+// <o> ESTC_TIMER_WHEEL_JOBS_MAX - Jobs tracked for the timer wheel report 
+#ifndef ESTC_TIMER_WHEEL_JOBS_MAX
+#define ESTC_TIMER_WHEEL_JOBS_MAX 8
+#endif
+
+// <o> ESTC_LOG_PUMP_BUDGET_US - Log processing time per main loop pass 
+#ifndef ESTC_LOG_PUMP_BUDGET_US
+#define ESTC_LOG_PUMP_BUDGET_US 500
+#endif
+
+// <o> ESTC_LOG_PUMP_BUSY_BUDGET_US - Log processing time per pass while notifications or bridge records are queued 
+#ifndef ESTC_LOG_PUMP_BUSY_BUDGET_US
+#define ESTC_LOG_PUMP_BUSY_BUDGET_US 50
+#endif
+
+// <o> ESTC_LOAD_RUN_CURRENT_UA - CPU current while running from flash, used to project the average current 
+// <i> nRF52840 running from flash with the cache enabled on the LDO regulator, the dongle has DC/DC disabled.
+#ifndef ESTC_LOAD_RUN_CURRENT_UA
+#define ESTC_LOAD_RUN_CURRENT_UA 6300
+#endif
+
+// <o> ESTC_LOAD_SLEEP_CURRENT_UA - System ON sleep current with the RTC running and RAM retained 
+#ifndef ESTC_LOAD_SLEEP_CURRENT_UA
+#define ESTC_LOAD_SLEEP_CURRENT_UA 3
+#endif
+
+// </h>
+//==========================================================
+
+#include "estc_config_profile.h"
+
 #endif
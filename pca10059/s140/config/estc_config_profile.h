@@ -0,0 +1,104 @@
+/**
+ * Copyright 2022 Evgeniy Morozov
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software without
+ * specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY
+ * WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE
+*/
+
+#ifndef ESTC_CONFIG_PROFILE_H__
+#define ESTC_CONFIG_PROFILE_H__
+
+// Build profiles. Every knob that depends on the link count, MTU or event length is set here
+// together with the RAM the SoftDevice needs for it, so the profile is the only thing to change.
+// Only preprocessor definitions: the file is also run through cpp to produce the linker memory map.
+//
+// All profiles have one peripheral link. The application keeps a single connection (one connection handle, one
+// set of subscriptions, advertising stops once connected), so more links would only cost SoftDevice RAM.
+
+#define ESTC_CONFIG_PROFILE_LOW_POWER       0
+#define ESTC_CONFIG_PROFILE_BALANCED        1
+#define ESTC_CONFIG_PROFILE_MAX_THROUGHPUT  2
+
+// Application RAM starts where the SoftDevice RAM ends. The values carry a margin over what
+// nrf_sdh_ble_enable() reports as the minimum for the profile; it fails with NRF_ERROR_NO_MEM and
+// logs the required start address if the margin is ever exhausted.
+#define ESTC_CONFIG_RAM_BASE                0x20000000
+#define ESTC_CONFIG_RAM_END                 0x20040000
+
+#if ESTC_CONFIG_PROFILE == ESTC_CONFIG_PROFILE_LOW_POWER
+
+// Short radio events and a long, latency tolerant connection interval
+#define ESTC_CONFIG_PROFILE_NAME            "low-power"
+#define ESTC_CONFIG_APP_RAM_START           0x20002300
+#define ESTC_CONFIG_PERIPHERAL_LINK_COUNT   1
+#define ESTC_CONFIG_GATT_MAX_MTU_SIZE       23
+#define ESTC_CONFIG_GAP_EVENT_LENGTH        3
+#define ESTC_CONFIG_GAP_DATA_LENGTH         27
+#define ESTC_CONFIG_LOG_BUFSIZE             512
+#define ESTC_CONFIG_MIN_CONN_INTERVAL       160     /**< 200 ms in 1.25 ms units. */
+#define ESTC_CONFIG_MAX_CONN_INTERVAL       320     /**< 400 ms in 1.25 ms units. */
+#define ESTC_CONFIG_SLAVE_LATENCY           3
+
+#elif ESTC_CONFIG_PROFILE == ESTC_CONFIG_PROFILE_BALANCED
+
+#define ESTC_CONFIG_PROFILE_NAME            "balanced"
+#define ESTC_CONFIG_APP_RAM_START           0x20002300
+#define ESTC_CONFIG_PERIPHERAL_LINK_COUNT   1
+#define ESTC_CONFIG_GATT_MAX_MTU_SIZE       23
+#define ESTC_CONFIG_GAP_EVENT_LENGTH        6
+#define ESTC_CONFIG_GAP_DATA_LENGTH         27
+#define ESTC_CONFIG_LOG_BUFSIZE             1024
+#define ESTC_CONFIG_MIN_CONN_INTERVAL       80      /**< 100 ms in 1.25 ms units. */
+#define ESTC_CONFIG_MAX_CONN_INTERVAL       160     /**< 200 ms in 1.25 ms units. */
+#define ESTC_CONFIG_SLAVE_LATENCY           0
+
+#elif ESTC_CONFIG_PROFILE == ESTC_CONFIG_PROFILE_MAX_THROUGHPUT
+
+// Full size ATT and link layer packets, the radio event may take the whole connection interval
+#define ESTC_CONFIG_PROFILE_NAME            "max-throughput"
+#define ESTC_CONFIG_APP_RAM_START           0x20002C00
+#define ESTC_CONFIG_PERIPHERAL_LINK_COUNT   1
+#define ESTC_CONFIG_GATT_MAX_MTU_SIZE       247
+#define ESTC_CONFIG_GAP_EVENT_LENGTH        400
+#define ESTC_CONFIG_GAP_DATA_LENGTH         251
+#define ESTC_CONFIG_LOG_BUFSIZE             1024
+#define ESTC_CONFIG_MIN_CONN_INTERVAL       6       /**< 7.5 ms in 1.25 ms units. */
+#define ESTC_CONFIG_MAX_CONN_INTERVAL       12      /**< 15 ms in 1.25 ms units. */
+#define ESTC_CONFIG_SLAVE_LATENCY           0
+
+#else
+#error "Unknown ESTC_CONFIG_PROFILE"
+#endif
+
+#define NRF_SDH_BLE_PERIPHERAL_LINK_COUNT   ESTC_CONFIG_PERIPHERAL_LINK_COUNT
+#define NRF_SDH_BLE_CENTRAL_LINK_COUNT      0
+#define NRF_SDH_BLE_TOTAL_LINK_COUNT        (NRF_SDH_BLE_PERIPHERAL_LINK_COUNT + NRF_SDH_BLE_CENTRAL_LINK_COUNT)
+#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE       ESTC_CONFIG_GATT_MAX_MTU_SIZE
+#define NRF_SDH_BLE_GAP_EVENT_LENGTH        ESTC_CONFIG_GAP_EVENT_LENGTH
+#define NRF_SDH_BLE_GAP_DATA_LENGTH         ESTC_CONFIG_GAP_DATA_LENGTH
+#define NRF_LOG_BUFSIZE                     ESTC_CONFIG_LOG_BUFSIZE
+
+#endif /* ESTC_CONFIG_PROFILE_H__ */